@@ -0,0 +1,89 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares a recorder of hall sensor and servo input events on the
+ *       target, which prints them in the capture format of host/capture.h so
+ *       that field runs can be replayed with corn_replay.
+ *
+ * @note Events are recorded from the input capture interrupts into a fixed
+ *       buffer, from the start of the recording until it is full, so that a
+ *       capture always replays from a known start. Event times are in system
+ *       ticks converted to microseconds, which only order the events.
+ */
+
+#ifndef BASE_CAPTURE_RECORD_H_
+#define BASE_CAPTURE_RECORD_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Output function for one line of the capture, without a terminator. */
+typedef void (*CaptureRecordPrint)(const char *format, ...);
+
+/**
+ * @brief Clears the buffer and starts a new recording.
+ *
+ * @note Must be called before the input capture interrupts are enabled.
+ */
+void CaptureRecordInit(void);
+
+/**
+ * @brief Records one event, unless the buffer is full.
+ *
+ * @note Can only be called from an interrupt handler, not holding a lock.
+ *
+ * @param type Event type character, as in host/capture.h.
+ * @param hall_state Hall GPIO state after a hall edge, or 0.
+ * @param count Hall edge count or servo pulse width, or 0.
+ * @param period Servo pulse period, or 0.
+ */
+void CaptureRecordEventFromIsr(char type,
+                               unsigned hall_state,
+                               uint32_t count,
+                               uint32_t period);
+
+/**
+ * @brief Clears the buffer and starts a new recording.
+ */
+void CaptureRecordReset(void);
+
+/**
+ * @brief Prints the events recorded so far as a capture file, one line per
+ *        event, after a header line starting with '#'.
+ *
+ * @param print Function to write capture lines with.
+ */
+void CaptureRecordPrintAll(CaptureRecordPrint print);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* BASE_CAPTURE_RECORD_H_ */
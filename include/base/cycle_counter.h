@@ -0,0 +1,85 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares a free-running counter for timing short sections of code.
+ *
+ * @note On the target, this is the Cortex-M4 data watchpoint and trace (DWT)
+ *       cycle counter, which counts core clock cycles. On the build host and in
+ *       the simulator, it counts nanoseconds of monotonic wall clock time.
+ *       Either way it is 32 bits wide and wraps around, so intervals must be
+ *       computed with unsigned subtraction and be shorter than one wrap
+ *       (about 60 s at 72 MHz, or 4.3 s in nanoseconds).
+ */
+
+#ifndef BASE_CYCLE_COUNTER_H_
+#define BASE_CYCLE_COUNTER_H_
+
+#include <stdint.h>
+
+#if defined(CORN_HOST) || defined(CORN_SIM)
+#include <time.h>
+
+/* Unit of counter values, for reporting, and counts per second. */
+#define CYCLE_COUNTER_UNIT "ns"
+#define CYCLE_COUNTER_FREQ 1000000000U
+
+static inline void CycleCounterEnable(void) {
+}
+
+static inline uint32_t CycleCounterRead(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)now.tv_sec * 1000000000U + (uint32_t)now.tv_nsec;
+}
+#else
+#include "hal.h"
+
+/* Unit of counter values, for reporting, and counts per second. */
+#define CYCLE_COUNTER_UNIT "cycles"
+#define CYCLE_COUNTER_FREQ STM32_SYSCLK
+
+/**
+ * @brief Turns on the DWT unit and starts its cycle counter from zero.
+ *
+ * @note The counter keeps running until reset, and is unaffected by a debugger
+ *       attaching, so this only needs to be called once.
+ */
+static inline void CycleCounterEnable(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+ * @brief Reads the core clock cycle count. Takes a single bus access.
+ */
+static inline uint32_t CycleCounterRead(void) {
+  return DWT->CYCCNT;
+}
+#endif  /* #if defined(CORN_HOST) || defined(CORN_SIM) */
+
+#endif  /* BASE_CYCLE_COUNTER_H_ */
@@ -0,0 +1,121 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares a fixed-size histogram of 32-bit values with logarithmically
+ *       spaced bins, cheap enough to add to from within interrupt handlers.
+ */
+
+#ifndef BASE_HISTOGRAM_H_
+#define BASE_HISTOGRAM_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Histogram bins are spaced logarithmically, with four bins per power of two
+ * (so each bin is at most 25% wide) above eight, and one bin per value below.
+ * Values past the last bin (65536 and up) are also counted in the last bin,
+ * which has no upper bound.
+ */
+#define HISTOGRAM_NUM_BINS 60
+
+/* Number of values written by HistogramSummarize. */
+#define HISTOGRAM_NUM_SUMMARY_VALUES 6
+
+/**
+ * @brief Distribution of one measurement.
+ */
+typedef struct Histogram {
+  uint32_t count;  /* Number of values recorded. */
+  uint32_t min;    /* Smallest value recorded. */
+  uint32_t max;    /* Largest value recorded. */
+  uint32_t bins[HISTOGRAM_NUM_BINS];  /* Number of values in each bin. */
+} Histogram;
+
+/**
+ * @brief Finds the bin that a value is counted in.
+ */
+static inline unsigned HistogramBin(uint32_t value) {
+  if (value < 8) {
+    return value;
+  }
+  /* Position of the most significant set bit, at least 3. */
+  const unsigned exponent = 31 - __builtin_clz(value);
+  /* The two bits after the most significant bit select one of four bins. */
+  const unsigned bin = 8 + (exponent - 3) * 4 + ((value >> (exponent - 2)) & 3);
+  return bin < HISTOGRAM_NUM_BINS ? bin : HISTOGRAM_NUM_BINS - 1;
+}
+
+/**
+ * @brief Records one value.
+ *
+ * @note Not atomic; must be called with the histogram's writer locked out.
+ */
+static inline void HistogramAdd(Histogram *histogram, uint32_t value) {
+  if (histogram->count == 0 || value < histogram->min) {
+    histogram->min = value;
+  }
+  if (value > histogram->max) {
+    histogram->max = value;
+  }
+  histogram->count++;
+  histogram->bins[HistogramBin(value)]++;
+}
+
+/**
+ * @brief Removes all recorded values.
+ */
+void HistogramClear(Histogram *histogram);
+
+/**
+ * @brief Finds the value below which a fraction of recorded values fall.
+ *
+ * @note The result is the upper bound of the bin that the percentile falls in,
+ *       so is pessimistic by up to 25%, but never exceeds the maximum. The
+ *       last bin has no upper bound, so a percentile in it is the maximum.
+ *
+ * @param per_mille Fraction in thousandths.
+ */
+uint32_t HistogramPercentile(const Histogram *histogram, uint32_t per_mille);
+
+/**
+ * @brief Computes min, p50, p90, p99, p99.9, and max of the recorded values,
+ *        scaled by a ratio, or all zeros if none were recorded.
+ */
+void HistogramSummarize(const Histogram *histogram,
+                        uint32_t scale_numerator,
+                        uint32_t scale_denominator,
+                        uint32_t summary[HISTOGRAM_NUM_SUMMARY_VALUES]);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* BASE_HISTOGRAM_H_ */
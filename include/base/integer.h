@@ -115,4 +115,27 @@ static inline T SignOf(T i) {
   return (i > 0) - (i < 0);
 }
 
+/**
+ * @brief Computes the integer square root of a value bit by bit.
+ *
+ * @param n Value.
+ * @return Largest integer whose square is less than or equal to @p n.
+ */
+template<typename T>
+static inline T IntegerSqrt(T n) {
+  static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value,
+                "IntegerSqrt is valid only for unsigned integers.");
+  constexpr int num_bits = sizeof(T) * 8;
+  T root = 0;
+  for (T bit = static_cast<T>(1) << (num_bits - 2); bit != 0; bit >>= 2) {
+    if (n >= root + bit) {
+      n -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+  }
+  return root;
+}
+
 #endif  /* BASE_INTEGER_H_ */
@@ -0,0 +1,134 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares per-interrupt histograms of entry latency and execution time,
+ *       recorded with the cycle counter from within interrupt handlers.
+ */
+
+#ifndef BASE_ISR_PROFILE_H_
+#define BASE_ISR_PROFILE_H_
+
+#include <stdint.h>
+
+#include "base/cycle_counter.h"
+#include "base/histogram.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Interrupts that are profiled. */
+typedef enum IsrProfileId {
+  ISR_PROFILE_TIM1_UP,  /* Inverter PWM update. */
+  ISR_PROFILE_TIM1_CC,  /* Inverter PWM compare. */
+  ISR_PROFILE_TIM2,     /* Hall sensor input capture. */
+  ISR_PROFILE_TIM4,     /* Servo pulse input capture. */
+  ISR_PROFILE_NUM_IDS
+} IsrProfileId;
+
+/**
+ * @brief Measurements of one interrupt handler.
+ */
+typedef struct IsrProfile {
+  /* Time from the hardware event to the start of the handler, in ticks of the
+   * timer that generated the event. */
+  Histogram latency;
+  /* Time to run the handler body, in cycle counter units. */
+  Histogram duration;
+  /* Frequency of the event timer's counter, to convert latency ticks. */
+  uint32_t latency_tick_frequency;
+} IsrProfile;
+
+/* Output function for one line of profile results, without a terminator. */
+typedef void (*IsrProfilePrint)(const char *format, ...);
+
+/**
+ * @brief Starts the cycle counter and clears all profiles.
+ *
+ * @note Must be called before the profiled interrupts are enabled.
+ */
+void IsrProfileInit(void);
+
+/**
+ * @brief Sets the rate at which latency ticks for an interrupt are counted,
+ *        i.e. the counter frequency of the timer whose events trigger it.
+ *
+ * @note Called by the timer drivers when they are started.
+ */
+void IsrProfileSetTickFrequency(IsrProfileId id, uint32_t frequency);
+
+/**
+ * @brief Marks the start of an interrupt handler body.
+ *
+ * @return Time stamp to pass to @c IsrProfileRecordI at the end of the body.
+ */
+static inline uint32_t IsrProfileEnter(void) {
+  return CycleCounterRead();
+}
+
+/**
+ * @brief Records one run of an interrupt handler.
+ *
+ * @note Can only be called from the profiled interrupt handler, after all the
+ *       work to be measured is done.
+ *
+ * @param id Interrupt that is ending.
+ * @param latency_ticks Event timer ticks between the event and the start of the
+ *                      handler.
+ * @param entry_time Time stamp returned by @c IsrProfileEnter.
+ */
+void IsrProfileRecordI(IsrProfileId id,
+                       uint32_t latency_ticks,
+                       uint32_t entry_time);
+
+/**
+ * @brief Clears all recorded measurements.
+ */
+void IsrProfileReset(void);
+
+/**
+ * @brief Prints a summary of each interrupt's histograms.
+ *
+ * @note Writes one header line starting with '#', then two lines per
+ *       interrupt of whitespace-separated fields:
+ *
+ *         name measure unit count min p50 p90 p99 p999 max
+ *
+ *       where measure is "latency" or "duration", and unit is that of the
+ *       cycle counter. Percentiles are the upper bound of the histogram bin
+ *       they fall in, so are pessimistic by up to 25%. Latency resolution is
+ *       one tick of the event timer.
+ *
+ * @param print Function to write result lines with.
+ */
+void IsrProfilePrintAll(IsrProfilePrint print);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* BASE_ISR_PROFILE_H_ */
@@ -0,0 +1,125 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares a trace of the hall-edge-to-commutation path, which stamps
+ *       each stage that a hall edge passes through on its way to the inverter
+ *       and keeps histograms of the delays between them.
+ *
+ * @note A trace is started by the hall capture interrupt and ended by the
+ *       commutation that follows. Stages are stamped in order; a stamp is
+ *       ignored unless the stage before it was stamped for the same edge, so
+ *       that commutations woken by something other than a hall edge (e.g. a
+ *       servo command) are not counted. If another edge arrives before the
+ *       previous one was commutated, the trace restarts and an overrun is
+ *       counted.
+ */
+
+#ifndef BASE_LATENCY_TRACE_H_
+#define BASE_LATENCY_TRACE_H_
+
+#include <stdint.h>
+
+#include "base/cycle_counter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Stages of the hall-edge-to-commutation path, in order. */
+typedef enum LatencyStage {
+  LATENCY_STAGE_CAPTURE,    /* Hall edge captured by the ICU timer. */
+  LATENCY_STAGE_ISR_ENTRY,  /* Capture interrupt handler started. */
+  LATENCY_STAGE_SIGNAL,     /* Commutator signaled by RotorHall::HandleEdge. */
+  LATENCY_STAGE_RESUME,     /* Commutation thread woken by the signal. */
+  LATENCY_STAGE_SYNC,       /* New inverter modes synchronized by COM event. */
+  LATENCY_NUM_STAGES
+} LatencyStage;
+
+/* Output function for one line of trace results, without a terminator. */
+typedef void (*LatencyTracePrint)(const char *format, ...);
+
+/**
+ * @brief Starts the cycle counter and clears all recorded traces.
+ *
+ * @note Must be called before the hall capture interrupt is enabled.
+ */
+void LatencyTraceInit(void);
+
+/**
+ * @brief Starts a trace for a hall edge, stamping the capture and interrupt
+ *        entry stages.
+ *
+ * @note Can only be called from the hall capture interrupt handler, before the
+ *       edge is handled.
+ *
+ * @param entry_time Cycle counter value at the start of the handler.
+ * @param capture_age Cycle counter units between the edge and @p entry_time.
+ */
+void LatencyTraceStartI(uint32_t entry_time, uint32_t capture_age);
+
+/**
+ * @brief Stamps a stage of the current trace with the current time.
+ *
+ * @note Must be called under a ChibiOS lock.
+ *
+ * @note Stamping @c LATENCY_STAGE_SYNC ends the trace and records it.
+ */
+void LatencyTraceStampI(LatencyStage stage);
+
+/**
+ * @brief Stamps a stage of the current trace with the current time.
+ *
+ * @note Must be called from a thread that is not holding a ChibiOS lock.
+ */
+void LatencyTraceStamp(LatencyStage stage);
+
+/**
+ * @brief Clears all recorded traces.
+ */
+void LatencyTraceReset(void);
+
+/**
+ * @brief Prints a summary of the delays between successive stages and of the
+ *        total delay from capture to synchronization.
+ *
+ * @note Writes one header line starting with '#', then one line per interval
+ *       of whitespace-separated fields:
+ *
+ *         interval unit count min p50 p90 p99 p999 max
+ *
+ *       as for @c IsrProfilePrintAll, followed by a "# overruns" line with the
+ *       number of edges that were not commutated before the next one arrived.
+ *
+ * @param print Function to write result lines with.
+ */
+void LatencyTracePrintAll(LatencyTracePrint print);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* BASE_LATENCY_TRACE_H_ */
@@ -0,0 +1,79 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares micro-benchmarks of the hall-edge-to-PWM commutation path,
+ *       which run identically on the build host and on the target.
+ */
+
+#ifndef BENCH_BENCHMARK_H_
+#define BENCH_BENCHMARK_H_
+
+#include <cstdint>
+
+#include "base/utility.h"
+
+/**
+ * @brief Output function for benchmark results, with printf-style formatting.
+ *        Called once per line, without a line terminator.
+ */
+typedef void (*BenchmarkPrint)(const char *format, ...);
+
+/**
+ * @brief Runs each benchmark kernel and prints its timing statistics.
+ *
+ * @note Each kernel is timed over @p num_samples batches of @p iterations
+ *       calls, with @c CycleCounterRead. The first batch of each kernel is run
+ *       untimed to warm up caches and branch predictors. Batches are run with
+ *       the system locked, so on the target they are free of interrupts and
+ *       preemption.
+ *
+ * @note Results are written as one header line starting with '#', then one
+ *       line per kernel of whitespace-separated fields:
+ *
+ *         name unit iterations samples min median mean stddev
+ *
+ *       where the last four are the per-call cost in @p unit (cycles on the
+ *       target, ns on the host) to two decimal places. The "loop" kernel
+ *       measures the benchmark loop itself and is included in the others.
+ *
+ * @note The kernels drive the PWM and ICU timers' registers without starting
+ *       the drivers, so on the target they must be run before the motor
+ *       drivers are started.
+ *
+ * @param print Function to write result lines with.
+ * @param iterations Calls to each kernel per timed batch. Must be at least 1.
+ * @param num_samples Timed batches per kernel, from 1 to
+ *                    @c kBenchmarkMaxSamples.
+ */
+void RunBenchmarks(BenchmarkPrint print,
+                   uint32_t iterations,
+                   uint32_t num_samples);
+
+/// Upper limit on batches per kernel, which sets the size of sample storage.
+constexpr uint32_t kBenchmarkMaxSamples = 63;
+
+#endif  /* BENCH_BENCHMARK_H_ */
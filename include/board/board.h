@@ -57,8 +57,8 @@
 #define GPIOA_HALL_A                0
 #define GPIOA_HALL_B                1
 #define GPIOA_HALL_C                2
-#define GPIOA_PIN3                  3
-#define GPIOA_PIN4                  4
+#define GPIOA_AN_1                  3
+#define GPIOA_AN_2                  4
 #define GPIOA_PIN5                  5
 #define GPIOA_PIN6                  6
 #define GPIOA_PIN7                  7
@@ -183,8 +183,8 @@
  * PA0  - HALL_A                    (alternate 1 pullup).
  * PA1  - HALL_B                    (alternate 1 pullup).
  * PA2  - HALL_C                    (alternate 1 pullup).
- * PA3  - PIN3                      (input pullup).
- * PA4  - PIN4                      (input pullup).
+ * PA3  - AN_1                      (analog, phase C current).
+ * PA4  - AN_2                      (analog, phase B current).
  * PA5  - PIN5                      (input pullup).
  * PA6  - PIN6                      (input pullup).
  * PA7  - PIN7                      (input pullup).
@@ -200,8 +200,8 @@
 #define VAL_GPIOA_MODER             (PIN_MODE_ALTERNATE(GPIOA_HALL_A) |     \
                                      PIN_MODE_ALTERNATE(GPIOA_HALL_B) |     \
                                      PIN_MODE_ALTERNATE(GPIOA_HALL_C) |     \
-                                     PIN_MODE_INPUT(GPIOA_PIN3) |           \
-                                     PIN_MODE_INPUT(GPIOA_PIN4) |           \
+                                     PIN_MODE_ANALOG(GPIOA_AN_1) |          \
+                                     PIN_MODE_ANALOG(GPIOA_AN_2) |          \
                                      PIN_MODE_INPUT(GPIOA_PIN5) |           \
                                      PIN_MODE_INPUT(GPIOA_PIN6) |           \
                                      PIN_MODE_INPUT(GPIOA_PIN7) |           \
@@ -216,8 +216,8 @@
 #define VAL_GPIOA_OTYPER            (PIN_OTYPE_PUSHPULL(GPIOA_HALL_A) |     \
                                      PIN_OTYPE_PUSHPULL(GPIOA_HALL_A) |     \
                                      PIN_OTYPE_PUSHPULL(GPIOA_HALL_C) |     \
-                                     PIN_OTYPE_PUSHPULL(GPIOA_PIN3) |       \
-                                     PIN_OTYPE_PUSHPULL(GPIOA_PIN4) |       \
+                                     PIN_OTYPE_PUSHPULL(GPIOA_AN_1) |       \
+                                     PIN_OTYPE_PUSHPULL(GPIOA_AN_2) |       \
                                      PIN_OTYPE_PUSHPULL(GPIOA_PIN5) |       \
                                      PIN_OTYPE_PUSHPULL(GPIOA_PIN6) |       \
                                      PIN_OTYPE_PUSHPULL(GPIOA_PIN7) |       \
@@ -232,8 +232,8 @@
 #define VAL_GPIOA_OSPEEDR           (PIN_OSPEED_50M(GPIOA_HALL_A) |         \
                                      PIN_OSPEED_50M(GPIOA_HALL_B) |         \
                                      PIN_OSPEED_50M(GPIOA_HALL_C) |         \
-                                     PIN_OSPEED_2M(GPIOA_PIN3) |            \
-                                     PIN_OSPEED_2M(GPIOA_PIN4) |            \
+                                     PIN_OSPEED_2M(GPIOA_AN_1) |            \
+                                     PIN_OSPEED_2M(GPIOA_AN_2) |            \
                                      PIN_OSPEED_2M(GPIOA_PIN5) |            \
                                      PIN_OSPEED_2M(GPIOA_PIN6) |            \
                                      PIN_OSPEED_2M(GPIOA_PIN7) |            \
@@ -248,8 +248,8 @@
 #define VAL_GPIOA_PUPDR             (PIN_PUPDR_PULLUP(GPIOA_HALL_A) |       \
                                      PIN_PUPDR_PULLUP(GPIOA_HALL_B) |       \
                                      PIN_PUPDR_PULLUP(GPIOA_HALL_C) |       \
-                                     PIN_PUPDR_PULLUP(GPIOA_PIN3) |         \
-                                     PIN_PUPDR_PULLUP(GPIOA_PIN4) |         \
+                                     PIN_PUPDR_FLOATING(GPIOA_AN_1) |       \
+                                     PIN_PUPDR_FLOATING(GPIOA_AN_2) |       \
                                      PIN_PUPDR_PULLUP(GPIOA_PIN5) |         \
                                      PIN_PUPDR_PULLUP(GPIOA_PIN6) |         \
                                      PIN_PUPDR_PULLUP(GPIOA_PIN7) |         \
@@ -264,8 +264,8 @@
 #define VAL_GPIOA_ODR               (PIN_ODR_HIGH(GPIOA_HALL_A) |           \
                                      PIN_ODR_HIGH(GPIOA_HALL_B) |           \
                                      PIN_ODR_HIGH(GPIOA_HALL_C) |           \
-                                     PIN_ODR_HIGH(GPIOA_PIN3) |             \
-                                     PIN_ODR_HIGH(GPIOA_PIN4) |             \
+                                     PIN_ODR_LOW(GPIOA_AN_1) |              \
+                                     PIN_ODR_LOW(GPIOA_AN_2) |              \
                                      PIN_ODR_HIGH(GPIOA_PIN5) |             \
                                      PIN_ODR_HIGH(GPIOA_PIN6) |             \
                                      PIN_ODR_HIGH(GPIOA_PIN7) |             \
@@ -280,11 +280,11 @@
 #define VAL_GPIOA_AFRL              (PIN_AFIO_AF(GPIOA_HALL_A, 1) |         \
                                      PIN_AFIO_AF(GPIOA_HALL_B, 1) |         \
                                      PIN_AFIO_AF(GPIOA_HALL_C, 1) |         \
-                                     PIN_AFIO_AF(GPIOA_PIN3, 0) |           \
-                                     PIN_AFIO_AF(GPIOA_PIN4, 0) |           \
-                                     PIN_AFIO_AF(GPIOA_PIN4, 0) |           \
-                                     PIN_AFIO_AF(GPIOA_PIN4, 0) |           \
-                                     PIN_AFIO_AF(GPIOA_PIN4, 0))
+                                     PIN_AFIO_AF(GPIOA_AN_1, 0) |           \
+                                     PIN_AFIO_AF(GPIOA_AN_2, 0) |           \
+                                     PIN_AFIO_AF(GPIOA_PIN5, 0) |           \
+                                     PIN_AFIO_AF(GPIOA_PIN6, 0) |           \
+                                     PIN_AFIO_AF(GPIOA_PIN7, 0))
 #define VAL_GPIOA_AFRH              (PIN_AFIO_AF(GPIOA_PWM_C, 6) |          \
                                      PIN_AFIO_AF(GPIOA_PWM_B, 6) |          \
                                      PIN_AFIO_AF(GPIOA_PWM_A, 6) |          \
@@ -57,7 +57,6 @@
                         GPIOA_HALL_A
 
 /* Options for LED functionality. */
-#define GPIO_LED_ISR        GPIO_LEDX  /* Turned on while in important ISR.   */
 #define GPIO_LED_ERROR      GPIO_LEDX  /* Latched on when error encountered.  */
 #define GPIO_LED_HEARTBEAT  GPIO_LEDY  /* Blinks at 1 Hz for system healthy.  */
 #define GPIO_LED_INIT       GPIO_LEDZ  /* Cleared upon system initialization. */
@@ -72,13 +71,180 @@
 #define HALL_ICU_FREQ         (720000)
 #define HALL_THREAD_PRIORITY  NORMALPRIO
 
+/* Rotor angle observer options. The phase-locked loop tracks the hall edges
+ * with a critically damped loop of the given natural frequency, and feeds the
+ * commutator a smooth angle and speed in place of the hall sensor driver. */
+#define ROTOR_PLL_ENABLE     FALSE
+#define ROTOR_PLL_BANDWIDTH  (50)  /* Unit: Hz. */
+
+/* Sensorless back EMF options. Zero crossings of the floating phase are timed
+ * in counts of the commutation timer, which then delays each commutation until
+ * 30 degrees after the crossing. Samples are ignored for the blanking angle
+ * after a commutation, while the floating phase current decays, and a crossing
+ * is only armed once the back EMF exceeds the threshold. */
+#define BEMF_GPT              (GPTD6)
+#define BEMF_GPT_FREQ         (720000)
+#define BEMF_BLANKING_ANGLE   (15)  /* Unit: degrees. */
+#define BEMF_ZC_THRESHOLD     (26)  /* Unit: 1/256 V. */
+
+/* Motor parameters, for the estimators that model the motor. Resistance and
+ * inductance are per phase (line to neutral), and the flux linkage is the peak
+ * phase back EMF per electrical radian per second. The bus voltage is nominal,
+ * as it is not measured. */
+#define MOTOR_RESISTANCE    (100)     /* Unit: milliohm. */
+#define MOTOR_INDUCTANCE    (20000)   /* Unit: nH. */
+#define MOTOR_FLUX_LINKAGE  (714286)  /* Unit: nWb. */
+#define MOTOR_BUS_VOLTAGE   (12000)   /* Unit: mV. */
+
+/* Sensorless flux observer options. The flux estimate converges to the flux
+ * linkage at the gain rate, and a critically damped phase-locked loop of the
+ * given natural frequency tracks its angle for the speed. Below the minimum
+ * speed the angle is not trusted. */
+#define ROTOR_FLUX_GAIN           (2000)  /* Unit: 1/s. */
+#define ROTOR_FLUX_PLL_BANDWIDTH  (200)   /* Unit: Hz. */
+#define ROTOR_FLUX_MIN_SPEED      (6000)  /* Unit: electrical RPM. */
+
+/* Open-loop startup options. With STARTUP_ENABLE set, a rotor without a valid
+ * angle is aligned to a fixed field for the align time, then turned by a field
+ * that accelerates up to the maximum speed, driven for the startup current.
+ * Above the handover speed, the rotor estimate takes over once it has agreed
+ * with the open-loop speed for the handover time; if it hasn't by the hold
+ * time after the maximum speed is reached, the sequence starts over. */
+#define STARTUP_ENABLE          FALSE
+#define STARTUP_ALIGN_TIME      (100)    /* Unit: ms. */
+#define STARTUP_CURRENT         (4000)   /* Unit: mA. */
+#define STARTUP_ACCELERATION    (50000)  /* Unit: electrical RPM per second. */
+#define STARTUP_MAX_SPEED       (12000)  /* Unit: electrical RPM. */
+#define STARTUP_HANDOVER_SPEED  (6000)   /* Unit: electrical RPM. */
+#define STARTUP_HANDOVER_TIME   (10)     /* Unit: ms. */
+#define STARTUP_HOLD_TIME       (200)    /* Unit: ms. */
+
+/* Speed governor options. With SPEED_GOVERNOR_ENABLE set, the servo command
+ * sets a rotor speed, where full command is the maximum speed, and a PI loop on
+ * the rotor velocity sets the amplitude. The loop runs at the given frequency,
+ * paced by the timer. Gains are Q16 amplitude counts per electrical RPM, and
+ * per update for the integral gain. */
+#define SPEED_GOVERNOR_ENABLE     FALSE
+#define SPEED_GOVERNOR_GPT        (GPTD3)
+#define SPEED_GOVERNOR_GPT_FREQ   (1000000)
+#define SPEED_GOVERNOR_FREQ       (1000)   /* Unit: Hz. */
+#define SPEED_GOVERNOR_MAX_SPEED  (90000)  /* Unit: electrical RPM. */
+#define SPEED_GOVERNOR_KP         (2360)
+#define SPEED_GOVERNOR_KI         (158)
+
 /* DRV8303 driver options. See class definition for additional configuration. */
 #define DRV_SPI  (SPID1)
 
-/* Inverter options. See class definition for dead time setting. */
-#define INVERTER_PWM           (PWMD1)
-#define INVERTER_COUNTER_FREQ  (144000000)
-#define INVERTER_PWM_PERIOD    (7200)
+/* Inverter options. See class definition for dead time setting. Switching
+ * channels are lengthened or shortened by the deadtime compensation according
+ * to their phase current direction; with current sensing, the compensation
+ * ramps in up to the given current. The compensation defaults to the timer's
+ * inserted deadtime, and should be raised to include the gate driver's own
+ * deadtime and the switching delays; zero disables it. The PWM is center-
+ * aligned, so each PWM period is two counter periods. */
+#define INVERTER_PWM                    (PWMD1)
+#define INVERTER_COUNTER_FREQ           (144000000)
+#define INVERTER_PWM_PERIOD             (7200)
+#define INVERTER_PWM_FREQ \
+    (INVERTER_COUNTER_FREQ / INVERTER_PWM_PERIOD / 2)  /* Unit: Hz. */
+#define INVERTER_DEADTIME_COMPENSATION  (4)    /* Unit: timer counts. */
+#define INVERTER_DEADTIME_CURRENT       (500)  /* Unit: mA. */
+
+/* Current sense options. With CURRENT_SENSE_ENABLE set, the phase B and C
+ * low-side shunt amplifiers are sampled together once per PWM period by ADC1
+ * and ADC2, triggered by the inverter timer at the top of its count, and FOC
+ * regulates current. A sample is discarded unless both phases' low sides were
+ * on for the settle time before it. The amplifier gain must match the DRV8303
+ * GAIN setting (10 V/V after reset). The amplifier offsets are calibrated at
+ * startup, and again every calibration interval while the inverter is floating,
+ * by averaging the outputs over the calibration samples with the DRV8303 inputs
+ * shorted (DC_CAL). */
+#define CURRENT_SENSE_ENABLE                FALSE
+#define CURRENT_SENSE_ADC                   (ADCD1)
+#define CURRENT_SENSE_SHUNT                 (5000)  /* Unit: micro-ohm. */
+#define CURRENT_SENSE_GAIN                  (10)    /* Unit: V/V. */
+#define CURRENT_SENSE_VREF                  (3300)  /* Unit: mV, full scale. */
+#define CURRENT_SENSE_SETTLE                (1000)  /* Unit: ns. */
+#define CURRENT_SENSE_CALIBRATION_SAMPLES   (1024)
+#define CURRENT_SENSE_CALIBRATION_INTERVAL  (1000)  /* Unit: ms. */
+
+/* Bus voltage compensation options. With BUS_VOLTAGE_ENABLE set, amplitude
+ * commands are taken as a fraction of the nominal bus voltage, and scaled by
+ * the nominal over the measured bus voltage, so that a command puts out the
+ * same voltage as the battery discharges. The bus is measured every interval
+ * through a PVDD divider on PB0 (ADC3_IN12), which Corn3 doesn't have; the full
+ * scale is the bus voltage that reads as 3.3 V at the pin. A bus below the
+ * minimum is taken to be at the minimum, which bounds the scaling. */
+#define BUS_VOLTAGE_ENABLE      FALSE
+#define BUS_VOLTAGE_ADC         (ADCD3)
+#define BUS_VOLTAGE_FULL_SCALE  (36300)  /* Unit: mV. */
+#define BUS_VOLTAGE_NOMINAL     (11100)  /* Unit: mV. */
+#define BUS_VOLTAGE_MIN         (6000)   /* Unit: mV. */
+#define BUS_VOLTAGE_INTERVAL    (10)     /* Unit: ms. */
+
+/* Commutation options. Field-oriented control (FOC) runs once per PWM period
+ * and needs a rotor angle that is interpolated between hall edges; otherwise
+ * six-step commutation is used. */
+#define MOTOR_COMMUTATOR_FOC  FALSE
+
+/* Six-step timing advance options. The commutation points are moved ahead of
+ * the rotor angle by the advance in the table, in degrees, at speeds spaced the
+ * speed step apart starting from zero; it is interpolated linearly, and held
+ * past the end. Advanced commutations are scheduled on the timer, which counts
+ * at the given frequency. */
+#define SIX_STEP_GPT                 (GPTD7)
+#define SIX_STEP_GPT_FREQ            (720000)
+#define SIX_STEP_ADVANCE_SPEED_STEP  (10000)  /* Unit: electrical RPM. */
+#define SIX_STEP_ADVANCE_TABLE       { 0, 2, 4, 5, 6, 7, 7, 8, 9, 11, 12 }
+
+/* Six-step modulation options. Bipolar modulation switches both driven phases
+ * around half of the PWM period; unipolar modulation chops only the high side
+ * of one phase, holding the other low, and synchronous modulation also drives
+ * the chopped phase's low side in the off time. */
+#define SIX_STEP_MODULATION_BIPOLAR      (0)
+#define SIX_STEP_MODULATION_UNIPOLAR     (1)
+#define SIX_STEP_MODULATION_SYNCHRONOUS  (2)
+#define SIX_STEP_MODULATION              SIX_STEP_MODULATION_BIPOLAR
+
+/* Six-step braking options, for a zero amplitude. The phases either coast
+ * (float), are shorted by the low sides for the strength as a percentage of the
+ * PWM period (dynamic), or are driven below their back EMF for the strength as
+ * a percentage of the braking current, which flows back into the bus
+ * (regenerative). Regenerative braking needs the bus voltage measurement, and
+ * falls back to dynamic braking without it, at low speed, or with the bus at
+ * or above the maximum voltage. */
+#define SIX_STEP_BRAKE_COAST         (0)
+#define SIX_STEP_BRAKE_DYNAMIC       (1)
+#define SIX_STEP_BRAKE_REGENERATIVE  (2)
+#define SIX_STEP_BRAKE_MODE          SIX_STEP_BRAKE_DYNAMIC
+#define SIX_STEP_BRAKE_STRENGTH      (100)    /* Unit: percent. */
+#define SIX_STEP_BRAKE_CURRENT       (10000)  /* Unit: mA. */
+#define SIX_STEP_BRAKE_MAX_VOLTAGE   (14000)  /* Unit: mV. */
+
+/* FOC current loop options. Gains are Q16 PWM counts per mA, and per PWM
+ * period for the integral gain. For a current loop bandwidth of w rad/s, set
+ * KP = L * w and KI = R * w * T, scaled by the PWM period over the bus voltage
+ * (defaults: 20 uH, 0.1 ohm, 1 kHz, 12 V). */
+#define FOC_MAX_CURRENT  (20000)  /* Unit: mA, at full amplitude. */
+#define FOC_CURRENT_KP   (4940)
+#define FOC_CURRENT_KI   (2470)
+
+/* Motor identification options. With MOTOR_IDENTIFY_ENABLE set, the motor is
+ * identified at startup: the resistance from two DC currents into phase A, up
+ * to the identification current, the inductance from the decay of the current
+ * stepped between them, and the flux linkage from six-step drive at the spin
+ * amplitude, as a percentage of full, for the spin time. The results and the
+ * FOC current loop gains for the bandwidth are stored in the flash page at the
+ * storage address, and are logged at each startup; the motor is only
+ * identified while none are stored. The link fails if the firmware image
+ * reaches the storage address (see src/flash_reserve.ld). Needs current
+ * sensing. */
+#define MOTOR_IDENTIFY_ENABLE          FALSE
+#define MOTOR_IDENTIFY_CURRENT         (4000)        /* Unit: mA. */
+#define MOTOR_IDENTIFY_SPIN_AMPLITUDE  (20)          /* Unit: percent. */
+#define MOTOR_IDENTIFY_SPIN_TIME       (1000)        /* Unit: ms. */
+#define MOTOR_IDENTIFY_BANDWIDTH       (1000)        /* Unit: Hz. */
+#define MOTOR_IDENTIFY_STORAGE         (0x0803F800)  /* Last 2 KiB page. */
 
 /* Servo PWM input options. See servo_input.h for descriptions. */
 #define SERVO_INPUT_ICU          (ICUD4)
@@ -90,6 +256,28 @@
 #define SERVO_INPUT_SLEW_LIMIT   (34)  /* Unit: motor amplitude / ms. */
                                        /* Must be <= 32767. */
 
+/* Interrupt profiling options. Send 'i' on the debug serial port to print
+ * latency and duration histograms of the timer interrupts, or 'I' to clear
+ * them. */
+#define ISR_PROFILE_ENABLE  TRUE
+
+/* Hall edge to commutation latency tracing options. Send 'l' on the debug
+ * serial port to print the delays between each stage of the path, or 'L' to
+ * clear them. */
+#define LATENCY_TRACE_ENABLE  TRUE
+
+/* Input capture recording options. Send 'c' on the debug serial port to print
+ * the hall and servo input events recorded since startup as a capture for
+ * corn_replay (see include/host/capture.h), or 'C' to start a new recording.
+ * Recording stops once the buffer of events is full. */
+#define CAPTURE_RECORD_ENABLE  FALSE
+#define CAPTURE_RECORD_EVENTS  (512)  /* 16 bytes each. */
+
+/* Benchmark options. Results are printed to the debug serial port. */
+#define BENCHMARK_AT_STARTUP  FALSE  /* Run before starting motor drivers. */
+#define BENCHMARK_ITERATIONS  (100)  /* Calls per timed batch. */
+#define BENCHMARK_SAMPLES     (31)   /* Timed batches per kernel. */
+
 /* USB device options. */
 #define USB_DRIVER  (USBD1)
 
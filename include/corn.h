@@ -31,12 +31,30 @@
 
 #include "hal.h"
 
+#include "config.h"
 #include "base/utility.h"
 #include "driver/DRV8303.h"
+#if MOTOR_IDENTIFY_ENABLE
+#include "driver/flash_storage.h"
+#endif
 #include "driver/servo_input.h"
+#include "motor/commutator_foc.h"
 #include "motor/commutator_six_step.h"
+#if BUS_VOLTAGE_ENABLE
+#include "motor/bus_voltage_adc.h"
+#endif
+#if CURRENT_SENSE_ENABLE
+#include "motor/current_sensor_adc.h"
+#endif
 #include "motor/inverter_pwm.h"
+#if MOTOR_IDENTIFY_ENABLE
+#include "motor/motor_identifier.h"
+#endif
 #include "motor/rotor_hall.h"
+#include "motor/rotor_pll.h"
+#include "motor/speed_governor.h"
+#include "motor/startup_sequencer.h"
+#include "motor/voltage_compensator.h"
 
 /**
  * @brief Entry point, initialization, and main loop for all functionality.
@@ -62,11 +80,19 @@ class Corn {
   NORETURN void MainLoop();
 
  protected:
+#if MOTOR_COMMUTATOR_FOC
+  typedef CommutatorFoc Commutator;
+#else
+  typedef CommutatorSixStep Commutator;
+#endif
+
   static const SerialConfig kDebugSerialConfig;  ///< Serial port configuration.
   static void (* const system_reset_function)(void);  ///< NVIC_SystemReset.
 
   /**
-   * @brief Resets the system upon command through the debug serial channel.
+   * @brief Resets the system upon command through the debug serial channel,
+   *        and prints or clears interrupt profiles, latency traces, and input
+   *        capture recordings on request.
    */
   NORETURN static msg_t ThreadReset(void *arg);
 
@@ -83,15 +109,152 @@ class Corn {
    */
   NORETURN static msg_t ThreadError(void *drv8303_pointer);
 
+#if CURRENT_SENSE_ENABLE
+  /**
+   * @brief Recalibrates the current sense amplifier offsets periodically, if
+   *        the inverter is floating.
+   *
+   * @param corn Pointer to the Corn whose current sensing to calibrate.
+   */
+  NORETURN static msg_t ThreadCalibrate(void *corn);
+
+  /**
+   * @brief Measures the current sense amplifier offsets with their inputs
+   *        shorted.
+   *
+   * @note Takes about a tenth of a second, during which the currents are
+   *       reported invalid. Stops early if the inverter is driven, so that the
+   *       current loop gets its feedback back.
+   *
+   * @return True if new offsets were taken.
+   */
+  bool CalibrateCurrentSense();
+#endif
+
+  /**
+   * @brief Sets the inverter's update callback to run the motor control.
+   */
+  void SetUpdateCallback();
+
+#if MOTOR_IDENTIFY_ENABLE
+  /**
+   * @brief Logs the stored motor parameters, identifying and storing them
+   *        first if there are none.
+   *
+   * @note Takes a few seconds and spins the motor when identifying, so must be
+   *       called with the rotor angle and current sense running, before any
+   *       commands are taken.
+   */
+  void IdentifyMotor();
+#endif
+
+#if STARTUP_ENABLE && MOTOR_COMMUTATOR_FOC
+  /**
+   * @brief Counts a PWM period for the startup sequencer, and starts the FOC
+   *        update, from the inverter's update interrupt.
+   *
+   * @param corn Pointer to the Corn whose inverter updated.
+   */
+  static void SignalPeriod(void *corn);
+#endif
+
+  /**
+   * @brief Selects the closed-loop rotor angle source.
+   */
+  RotorInterface *rotor() {
+#if ROTOR_PLL_ENABLE
+    return &rotor_pll_;
+#else
+    return &rotor_hall_;
+#endif
+  }
+
+  /**
+   * @brief Selects the rotor angle source for the commutator, which starts the
+   *        motor when enabled.
+   */
+  RotorInterface *commutator_rotor() {
+#if STARTUP_ENABLE
+    return &startup_sequencer_;
+#else
+    return rotor();
+#endif
+  }
+
+  /**
+   * @brief Selects the commutator that amplitudes and rotor changes are sent
+   *        to.
+   */
+  CommutatorInterface *commutator_input() {
+#if STARTUP_ENABLE
+    return &startup_sequencer_;
+#else
+    return &commutator_;
+#endif
+  }
+
+  /**
+   * @brief Selects the commutator that amplitudes are written to, which takes
+   *        them as voltages when bus voltage compensation is enabled.
+   */
+  CommutatorInterface *voltage_input() {
+#if BUS_VOLTAGE_ENABLE
+    return &voltage_compensator_;
+#else
+    return commutator_input();
+#endif
+  }
+
+  /**
+   * @brief Selects the commutator that commands are sent to, which takes them
+   *        as speeds when the governor is enabled.
+   */
+  CommutatorInterface *command_input() {
+#if SPEED_GOVERNOR_ENABLE
+    return &speed_governor_;
+#else
+    return voltage_input();
+#endif
+  }
+
   static WORKING_AREA(wa_reset_, 128);      ///< Reset thread working area.
   static WORKING_AREA(wa_heartbeat_, 128);  ///< Heartbeat thread working area.
   static WORKING_AREA(wa_hall_, 1024);      ///< Hall thread working area.
   static WORKING_AREA(wa_error_, 512);      ///< Polling thread working area.
+#if SPEED_GOVERNOR_ENABLE
+  static WORKING_AREA(wa_governor_, 512);   ///< Speed loop working area.
+#endif
+#if BUS_VOLTAGE_ENABLE
+  static WORKING_AREA(wa_compensator_, 256);  ///< Bus voltage working area.
+#endif
+#if CURRENT_SENSE_ENABLE
+  static WORKING_AREA(wa_calibrate_, 512);  ///< Calibration working area.
+#endif
 
   RotorHall rotor_hall_;  ///< Hall sensor signal handling driver.
+#if ROTOR_PLL_ENABLE
+  RotorPll rotor_pll_;  ///< Angle and speed observer on hall transitions.
+#endif
+#if STARTUP_ENABLE
+  StartupSequencer startup_sequencer_;  ///< Open-loop starting.
+#endif
+#if SPEED_GOVERNOR_ENABLE
+  SpeedGovernor speed_governor_;  ///< Closed-loop speed control.
+#endif
+#if BUS_VOLTAGE_ENABLE
+  BusVoltageAdc bus_voltage_adc_;  ///< Supply voltage measurement.
+  VoltageCompensator voltage_compensator_;  ///< Bus voltage compensation.
+#endif
   InverterPWM inverter_pwm_;  ///< 3-phase inverter driver.
   DRV8303 drv8303_;  ///< Gate driver and current sense amplifier driver.
-  CommutatorSixStep commutator_six_step_;  ///< Motor output sequencer.
+#if CURRENT_SENSE_ENABLE
+  CurrentSensorAdc current_sensor_adc_;  ///< Phase current sampling.
+#endif
+#if MOTOR_IDENTIFY_ENABLE
+  MotorIdentifier motor_identifier_;  ///< Motor parameter identification.
+  FlashStorage motor_storage_;  ///< Identified motor parameters.
+#endif
+  Commutator commutator_;  ///< Motor output sequencer.
   ServoInput servo_input_;  ///< Servo pulse input from R/C receiver.
 };
 
@@ -76,6 +76,19 @@ class DRV8303 {
    */
   void Deactivate();
 
+  /**
+   * @brief Shorts or reconnects the inputs of both current sense amplifiers,
+   *        so that their outputs can be measured at zero current.
+   *
+   * @note The amplifier outputs need some time to settle after each change.
+   *       Other Control register 2 settings are left as they are.
+   *
+   * @param enable True to short the inputs (DC_CAL mode), false to sense the
+   *               shunts.
+   * @return True if the setting was written.
+   */
+  bool SetDcCalibration(bool enable);
+
  protected:
   /**
    * @brief Set of addressable registers in the gate driver IC.
@@ -0,0 +1,116 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#ifndef DRIVER_FLASH_STORAGE_H_
+#define DRIVER_FLASH_STORAGE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Driver for keeping a small record in a page of the internal flash,
+ *        so that it persists across resets and power cycles.
+ *
+ * @note The record is stored with a header holding its size and a checksum, so
+ *       an erased or partially written page reads as empty.
+ *
+ * @note Erasing and programming stall the CPU fetching from flash for tens of
+ *       milliseconds, interrupts included, so only write with the motor
+ *       stopped and the inverter floating.
+ */
+class FlashStorage {
+ public:
+  /**
+   * @brief Creates a driver structure for a flash page.
+   *
+   * @param address Start of the page, which must not hold any of the
+   *                firmware image.
+   */
+  explicit FlashStorage(uint32_t address);
+
+  /**
+   * @brief Reads the stored record.
+   *
+   * @param data Output for the record (if stored).
+   * @param size Size of the record, in bytes.
+   * @return True if a record of this size was stored and is intact.
+   */
+  bool Read(void *data, size_t size) const;
+
+  /**
+   * @brief Erases the page and stores a record in it.
+   *
+   * @param data Record to store.
+   * @param size Size of the record, in bytes; at most a page less the header.
+   * @return True if the record was written and reads back.
+   */
+  bool Write(const void *data, size_t size);
+
+ protected:
+  /// Size of an erasable page of the STM32F303xC flash.
+  static constexpr size_t kPageSize = 2048;
+  /// Marks a page that holds a record.
+  static constexpr uint32_t kMagic = 0x436f726e;
+
+  /**
+   * @brief Record header, at the start of the page.
+   */
+  struct Header {
+    uint32_t magic;     ///< @c kMagic.
+    uint16_t size;      ///< Size of the record following, in bytes.
+    uint16_t checksum;  ///< Fletcher-16 checksum of the record.
+  };
+
+  /**
+   * @brief Computes the checksum of a record.
+   *
+   * @param data Record to sum.
+   * @param size Size of the record, in bytes.
+   * @return Fletcher-16 checksum.
+   */
+  static uint16_t ComputeChecksum(const uint8_t *data, size_t size);
+
+  /**
+   * @brief Programs half-words into erased flash, which must be unlocked.
+   *
+   * @param address Destination, aligned to a half-word.
+   * @param data Source.
+   * @param size Size to program, in bytes, rounded up to a half-word.
+   * @return True if no programming error was flagged.
+   */
+  static bool Program(uint32_t address, const uint8_t *data, size_t size);
+
+  /**
+   * @brief Waits for the flash to finish an operation, and clears its flags.
+   *
+   * @return True if the operation had no programming or protection errors.
+   */
+  static bool WaitReady();
+
+  const uint32_t address_;  ///< Start of the flash page.
+};
+
+#endif  /* DRIVER_FLASH_STORAGE_H_ */
@@ -31,7 +31,7 @@
 
 #include "config.h"
 
-class CommutatorSixStep;
+class CommutatorInterface;
 
 /**
  * @brief Driver for reading and processing servo PWM signals into throttle
@@ -55,10 +55,10 @@ class ServoInput {
   /**
    * @brief Connects a commutator as an output for the servo signals being read.
    *
-   * @param commutator_six_step Motor driving sequencer.
+   * @param commutator Motor driving sequencer.
    */
-  void SetCommutatorSixStep(CommutatorSixStep *commutator_six_step) {
-    commutator_six_step_ = commutator_six_step;
+  void SetCommutator(CommutatorInterface *commutator) {
+    commutator_ = commutator;
   }
 
  protected:
@@ -133,7 +133,7 @@ class ServoInput {
                           int32_t out_low, int32_t out_high, int32_t deadband);
 
   ICUDriver * const icu_driver_;  ///< Timer input capture driver.
-  CommutatorSixStep *commutator_six_step_;  ///< Servo commands signal sink.
+  CommutatorInterface *commutator_;  ///< Servo commands signal sink.
   int num_overflows_;  ///< Times the timer overflowed since last edge.
   int last_amplitude_;  ///< Previous command sent to motor.
 };
@@ -59,7 +59,7 @@
  * @brief   Enables the ADC subsystem.
  */
 #if !defined(HAL_USE_ADC) || defined(__DOXYGEN__)
-#define HAL_USE_ADC                 FALSE
+#define HAL_USE_ADC                 TRUE
 #endif
 
 /**
@@ -80,7 +80,7 @@
  * @brief   Enables the GPT subsystem.
  */
 #if !defined(HAL_USE_GPT) || defined(__DOXYGEN__)
-#define HAL_USE_GPT                 FALSE
+#define HAL_USE_GPT                 TRUE
 #endif
 
 /**
@@ -187,6 +187,15 @@
 #define ADC_USE_MUTUAL_EXCLUSION    TRUE
 #endif
 
+/**
+ * @brief   ADC driver structure extension.
+ * @details User fields added to the @p ADCDriver structure.
+ */
+#if !defined(ADC_DRIVER_EXT_FIELDS) || defined(__DOXYGEN__)
+#define ADC_DRIVER_EXT_FIELDS                                               \
+  void *self;  /**<  Pointer to a user-defined class instance.               */
+#endif
+
 /*===========================================================================*/
 /* CAN driver related settings.                                              */
 /*===========================================================================*/
@@ -318,6 +327,19 @@
 #define SPI_USE_MUTUAL_EXCLUSION    TRUE
 #endif
 
+/*===========================================================================*/
+/* GPT driver related settings.                                              */
+/*===========================================================================*/
+
+/**
+ * @brief   GPT driver structure extension.
+ * @details User fields added to the @p GPTDriver structure.
+ */
+#if !defined(GPT_DRIVER_EXT_FIELDS) || defined(__DOXYGEN__)
+#define GPT_DRIVER_EXT_FIELDS                                               \
+  void *self;  /**<  Pointer to a user-defined class instance.               */
+#endif
+
 /*===========================================================================*/
 /* ICU driver related settings.                                              */
 /*===========================================================================*/
@@ -331,6 +353,19 @@
   void *self;  /**<  Pointer to a user-defined class instance.               */
 #endif
 
+/*===========================================================================*/
+/* PWM driver related settings.                                              */
+/*===========================================================================*/
+
+/**
+ * @brief   PWM driver structure extension.
+ * @details User fields added to the @p PWMDriver structure.
+ */
+#if !defined(PWM_DRIVER_EXT_FIELDS) || defined(__DOXYGEN__)
+#define PWM_DRIVER_EXT_FIELDS                                               \
+  void *self;  /**<  Pointer to a user-defined class instance.               */
+#endif
+
 #endif /* _HALCONF_H_ */
 
 /** @} */
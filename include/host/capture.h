@@ -0,0 +1,104 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares the capture format for recorded hall sensor and servo input
+ *       events, used to replay field data through the motor control code on
+ *       the build host.
+ *
+ * @note A capture is a text file with one event per line, in the order the
+ *       events occurred. Blank lines and lines starting with '#' are ignored.
+ *       Each line is a type character followed by whitespace-separated
+ *       decimal fields:
+ *
+ *         H <time_us> <hall_state> <count>  Hall edge. @p hall_state is the
+ *                                           3-bit hall GPIO reading after the
+ *                                           edge, and @p count is the ICU
+ *                                           capture, i.e. the value passed to
+ *                                           RotorHall::HandleEdge.
+ *         O <time_us>                       Hall ICU timer overflow.
+ *         S <time_us> <width> <period>      Servo pulse, as ICU counts passed
+ *                                           to ServoInput::HandlePulse.
+ *         V <time_us>                       Servo ICU timer overflow.
+ *
+ *       @p time_us is the time of the event in microseconds from the start of
+ *       the capture. It sets the simulated system time during replay, but
+ *       does not otherwise affect the result.
+ *
+ * @note Captures are recorded on the target by base/capture_record.h.
+ */
+
+#ifndef HOST_CAPTURE_H_
+#define HOST_CAPTURE_H_
+
+#include <cstdint>
+#include <cstdio>
+
+/**
+ * @brief One recorded input event.
+ */
+struct CaptureEvent {
+  enum Type {
+    kHallEdge = 'H',
+    kHallOverflow = 'O',
+    kServoPulse = 'S',
+    kServoOverflow = 'V',
+  };
+
+  Type type;
+  uint32_t time_us;     ///< Time since start of capture.
+  unsigned hall_state;  ///< Hall GPIO state after the edge (kHallEdge).
+  uint32_t count;       ///< Hall edge count or servo pulse width.
+  uint32_t period;      ///< Servo pulse period (kServoPulse).
+};
+
+/**
+ * @brief Result of reading a capture line.
+ */
+enum CaptureReadResult {
+  kCaptureReadOk,
+  kCaptureReadEnd,    ///< No more events in the file.
+  kCaptureReadError,  ///< Malformed line; the line number is reported.
+};
+
+/**
+ * @brief Reads the next event from a capture file, skipping comments.
+ *
+ * @param file File to read from.
+ * @param event Output; the event read.
+ * @param line_number In/out; incremented for each line consumed.
+ * @return Whether an event was read.
+ */
+CaptureReadResult ReadCaptureEvent(std::FILE *file,
+                                   CaptureEvent *event,
+                                   unsigned *line_number);
+
+/**
+ * @brief Writes an event as one line of a capture file.
+ */
+void WriteCaptureEvent(std::FILE *file, const CaptureEvent &event);
+
+#endif  /* HOST_CAPTURE_H_ */
@@ -0,0 +1,185 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares a minimal stand-in for the ChibiOS/RT kernel API, used to
+ *       compile the portable motor control code natively on the build host.
+ *
+ * @note Nothing here schedules. Threads are recorded but never run, locks are
+ *       no-ops, and semaphores only count, so the code under test must be
+ *       driven by calling its update functions directly from a single thread.
+ */
+
+#ifndef HOST_CH_H_
+#define HOST_CH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int32_t msg_t;      /**< Inter-thread message. */
+typedef int32_t cnt_t;      /**< Resource counter. */
+typedef uint32_t systime_t; /**< System time in ticks. */
+typedef uint8_t tprio_t;    /**< Thread priority. */
+typedef uint64_t stkalign_t; /**< Stack alignment type. */
+typedef msg_t (*tfunc_t)(void *);
+
+#define FALSE 0
+#define TRUE  1
+
+#define RDY_OK        0
+#define RDY_TIMEOUT   -1
+#define RDY_RESET     -2
+
+#define IDLEPRIO      1
+#define LOWPRIO       2
+#define NORMALPRIO    64
+#define HIGHPRIO      127
+
+#define TIME_IMMEDIATE  ((systime_t)0)
+#define TIME_INFINITE   ((systime_t)-1)
+
+/* Same system tick frequency as the target (see chconf.h). */
+#define CH_FREQUENCY  1000
+
+#define S2ST(sec)   ((systime_t)((sec) * CH_FREQUENCY))
+#define MS2ST(msec) ((systime_t)(((((uint32_t)(msec)) * \
+                                   ((uint32_t)CH_FREQUENCY) - 1UL) / 1000UL) + 1UL))
+#define US2ST(usec) ((systime_t)(((((uint32_t)(usec)) * \
+                                   ((uint32_t)CH_FREQUENCY) - 1UL) / 1000000UL) + 1UL))
+
+/**
+ * @brief Record of a created thread. The thread function is never invoked.
+ */
+typedef struct Thread {
+  tfunc_t p_func;      /**< Thread function. */
+  void *p_arg;         /**< Argument passed to @p p_func. */
+  tprio_t p_prio;      /**< Requested priority. */
+} Thread;
+
+/**
+ * @brief Declares a thread working area large enough for both the requested
+ *        stack and the thread record.
+ */
+#define WORKING_AREA(s, n) \
+    stkalign_t s[(sizeof(Thread) + (n) + sizeof(stkalign_t) - 1) / \
+                 sizeof(stkalign_t)]
+
+/**
+ * @brief Counting semaphore. Waiting on a semaphore never blocks.
+ */
+typedef struct Semaphore {
+  cnt_t s_cnt;  /**< Pending signal count. */
+} Semaphore;
+
+#define _SEMAPHORE_DATA(name, n) { n }
+#define SEMAPHORE_DECL(name, n) Semaphore name = _SEMAPHORE_DATA(name, n)
+
+static inline void chSysLock(void) {}
+static inline void chSysUnlock(void) {}
+static inline void chSysLockFromIsr(void) {}
+static inline void chSysUnlockFromIsr(void) {}
+
+static inline void chSemInit(Semaphore *sp, cnt_t n) {
+  sp->s_cnt = n;
+}
+
+static inline void chSemReset(Semaphore *sp, cnt_t n) {
+  sp->s_cnt = n;
+}
+
+static inline void chSemSignalI(Semaphore *sp) {
+  sp->s_cnt++;
+}
+
+static inline void chSemSignal(Semaphore *sp) {
+  sp->s_cnt++;
+}
+
+/**
+ * @brief Consumes one signal if any are pending.
+ *
+ * @return @c RDY_OK if a signal was consumed, otherwise @c RDY_TIMEOUT, as
+ *         there is nobody else to signal the semaphore.
+ */
+static inline msg_t chSemWaitS(Semaphore *sp) {
+  if (sp->s_cnt <= 0) {
+    return RDY_TIMEOUT;
+  }
+  sp->s_cnt--;
+  return RDY_OK;
+}
+
+static inline msg_t chSemWait(Semaphore *sp) {
+  return chSemWaitS(sp);
+}
+
+static inline cnt_t chSemGetCounterI(Semaphore *sp) {
+  return sp->s_cnt;
+}
+
+/**
+ * @brief Records a thread in its working area without running it.
+ */
+Thread *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf,
+                          void *arg);
+
+/**
+ * @brief Terminates the host process, as host threads never run.
+ */
+#ifdef __cplusplus
+[[noreturn]]
+#else
+__attribute__((noreturn))
+#endif
+void chThdExit(msg_t msg);
+
+/**
+ * @brief Gets the current simulated system time.
+ */
+systime_t chTimeNow(void);
+
+/**
+ * @brief Advances simulated system time by a number of ticks.
+ */
+void chThdSleep(systime_t time);
+
+static inline void chThdYield(void) {}
+
+#define chThdSleepSeconds(sec)        chThdSleep(S2ST(sec))
+#define chThdSleepMilliseconds(msec)  chThdSleep(MS2ST(msec))
+#define chThdSleepMicroseconds(usec)  chThdSleep(US2ST(usec))
+
+#define chRegSetThreadName(p) ((void)(p))
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* HOST_CH_H_ */
@@ -0,0 +1,419 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares a minimal stand-in for the ChibiOS HAL, used to compile the
+ *       portable motor control code natively on the build host.
+ *
+ * @note Peripherals are plain structures in memory. GPIO inputs and timer
+ *       registers are written by the host program to simulate the hardware,
+ *       and outputs can be inspected after the code under test runs. ICU
+ *       callbacks are invoked by the host program through
+ *       @c icuHostInvokeWidth, @c icuHostInvokePeriod, and
+ *       @c icuHostInvokeOverflow, GPT expiry through
+ *       @c gptHostInvokeCallback, and ADC conversions through
+ *       @c adcHostInvokeConversion.
+ */
+
+#ifndef HOST_HAL_H_
+#define HOST_HAL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ch.h"
+#include "board.h"
+#include "host/stm32_tim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*===========================================================================*/
+/* PAL.                                                                      */
+/*===========================================================================*/
+
+typedef uint32_t ioportmask_t;
+
+/**
+ * @brief GPIO port. @p IDR holds the simulated pin levels and @p ODR holds the
+ *        output latch.
+ */
+typedef struct {
+  volatile uint32_t IDR;
+  volatile uint32_t ODR;
+} GPIO_TypeDef;
+
+typedef GPIO_TypeDef *ioportid_t;
+
+extern GPIO_TypeDef host_gpioa;
+extern GPIO_TypeDef host_gpiob;
+
+#define GPIOA (&host_gpioa)
+#define GPIOB (&host_gpiob)
+
+#define PAL_PORT_BIT(n) ((ioportmask_t)(1U << (n)))
+#define PAL_GROUP_MASK(width) ((ioportmask_t)(1U << (width)) - 1U)
+
+#define palReadPort(port) ((port)->IDR)
+#define palReadGroup(port, mask, offset) \
+    ((palReadPort(port) >> (offset)) & (mask))
+#define palReadPad(port, pad) ((palReadPort(port) >> (pad)) & 1U)
+#define palSetPad(port, pad) ((port)->ODR |= PAL_PORT_BIT(pad))
+#define palClearPad(port, pad) ((port)->ODR &= ~PAL_PORT_BIT(pad))
+#define palTogglePad(port, pad) ((port)->ODR ^= PAL_PORT_BIT(pad))
+
+/* Pin modes are not simulated. */
+#define PAL_MODE_INPUT_ANALOG 3
+#define palSetPadMode(port, pad, mode) ((void)(port), (void)(pad), (void)(mode))
+
+/*===========================================================================*/
+/* ADC. Fields and macros match the STM32F30x driver, in dual mode.          */
+/*===========================================================================*/
+
+typedef enum {
+  ADC_UNINIT = 0,
+  ADC_STOP = 1,
+  ADC_READY = 2,
+  ADC_ACTIVE = 3,
+  ADC_COMPLETE = 4,
+  ADC_ERROR = 5,
+} adcstate_t;
+
+typedef enum {
+  ADC_ERR_DMAFAILURE = 0,
+  ADC_ERR_OVERFLOW = 1,
+} adcerror_t;
+
+typedef uint16_t adcsample_t;
+typedef uint16_t adc_channels_num_t;
+
+typedef struct ADCDriver ADCDriver;
+typedef void (*adccallback_t)(ADCDriver *adcp, adcsample_t *buffer, size_t n);
+typedef void (*adcerrorcallback_t)(ADCDriver *adcp, adcerror_t err);
+
+typedef struct {
+  bool circular;
+  adc_channels_num_t num_channels;
+  adccallback_t end_cb;
+  adcerrorcallback_t error_cb;
+  uint32_t cfgr;
+  uint32_t tr1;
+  uint32_t ccr;
+  uint32_t smpr[2];
+  uint32_t sqr[4];
+  uint32_t ssmpr[2];
+  uint32_t ssqr[4];
+} ADCConversionGroup;
+
+typedef struct {
+  uint32_t difsel;
+} ADCConfig;
+
+struct ADCDriver {
+  adcstate_t state;
+  const ADCConfig *config;
+  adcsample_t *samples;
+  size_t depth;
+  const ADCConversionGroup *grpp;
+  void *self;
+  size_t next_half;  ///< Host only: half of the buffer filled next.
+};
+
+extern ADCDriver ADCD1;
+extern ADCDriver ADCD3;
+
+#define ADC_CFGR_EXTSEL_SRC(n)    ((n) << 6)
+#define ADC_CFGR_EXTEN_FALLING    (2U << 10)
+#define ADC_TR(low, high)         (((uint32_t)(high) << 16) | (uint32_t)(low))
+#define ADC_CCR_DUAL(n)           ((n) << 0)
+#define ADC_CCR_VREFEN            (1U << 22)
+#define ADC_SMPR_SMP_7P5          1
+#define ADC_SMPR_SMP_181P5        6
+#define ADC_SMPR1_SMP_AN1(n)      ((n) << 3)
+#define ADC_SMPR1_SMP_AN4(n)      ((n) << 12)
+#define ADC_SMPR2_SMP_AN12(n)     ((n) << 6)
+#define ADC_SMPR2_SMP_AN18(n)     ((n) << 24)
+#define ADC_SQR1_SQ1_N(n)         ((n) << 6)
+#define ADC_CHANNEL_IN1           1
+#define ADC_CHANNEL_IN4           4
+#define ADC_CHANNEL_IN12          12
+#define ADC_CHANNEL_IN18          18
+
+void adcStart(ADCDriver *adcp, const ADCConfig *config);
+void adcStop(ADCDriver *adcp);
+void adcStartConversion(ADCDriver *adcp,
+                        const ADCConversionGroup *grpp,
+                        adcsample_t *samples,
+                        size_t depth);
+void adcStopConversion(ADCDriver *adcp);
+
+/**
+ * @brief Host only: there is nothing to convert, so this always fails.
+ *
+ * @return @c RDY_RESET.
+ */
+msg_t adcConvert(ADCDriver *adcp,
+                 const ADCConversionGroup *grpp,
+                 adcsample_t *samples,
+                 size_t depth);
+
+/**
+ * @brief Simulates a triggered conversion of every channel in the group:
+ *        stores the samples in the next half of the circular buffer, and
+ *        invokes the end callback as the DMA ISR would once that half is full.
+ *        Does nothing if no conversion is running.
+ */
+void adcHostInvokeConversion(ADCDriver *adcp, const adcsample_t *samples);
+
+/*===========================================================================*/
+/* GPT.                                                                      */
+/*===========================================================================*/
+
+typedef enum {
+  GPT_UNINIT = 0,
+  GPT_STOP = 1,
+  GPT_READY = 2,
+  GPT_CONTINUOUS = 3,
+  GPT_ONESHOT = 4,
+} gptstate_t;
+
+typedef uint32_t gptfreq_t;
+typedef uint16_t gptcnt_t;
+
+typedef struct GPTDriver GPTDriver;
+typedef void (*gptcallback_t)(GPTDriver *gptp);
+
+typedef struct {
+  gptfreq_t frequency;
+  gptcallback_t callback;
+  uint32_t dier;
+} GPTConfig;
+
+/**
+ * @brief General purpose timer. A started timer's interval is in @p tim->ARR
+ *        (as interval - 1), for the host program to time its expiry.
+ */
+struct GPTDriver {
+  gptstate_t state;
+  const GPTConfig *config;
+  void *self;
+  uint32_t clock;
+  stm32_tim_t *tim;
+};
+
+extern GPTDriver GPTD3;
+extern GPTDriver GPTD6;
+extern GPTDriver GPTD7;
+
+void gptStart(GPTDriver *gptp, const GPTConfig *config);
+void gptStop(GPTDriver *gptp);
+void gptStartOneShotI(GPTDriver *gptp, gptcnt_t interval);
+void gptStartContinuous(GPTDriver *gptp, gptcnt_t interval);
+void gptStopTimerI(GPTDriver *gptp);
+
+/**
+ * @brief Simulates the expiry of a started timer and invokes its callback as
+ *        the ISR would. Does nothing if the timer is not running.
+ */
+void gptHostInvokeCallback(GPTDriver *gptp);
+
+/*===========================================================================*/
+/* ICU. Fields and constants match the Corn3 modified driver in /include/lld. */
+/*===========================================================================*/
+
+typedef enum {
+  ICU_UNINIT = 0,
+  ICU_STOP = 1,
+  ICU_READY = 2,
+  ICU_WAITING = 3,
+  ICU_ACTIVE = 4,
+  ICU_IDLE = 5,
+} icustate_t;
+
+typedef enum {
+  ICU_INPUT_ACTIVE_HIGH = 0,
+  ICU_INPUT_ACTIVE_LOW = 1,
+} icumode_t;
+
+typedef enum {
+  ICU_CHANNEL_1 = 0,
+  ICU_CHANNEL_2 = 1,
+  ICU_CHANNEL_3 = 2,
+  ICU_CHANNEL_4 = 3,
+} icuchannel_t;
+
+typedef enum {
+  ICU_RESET_NEVER = 0,
+  ICU_RESET_ON_ACTIVE = 1,
+  ICU_RESET_ON_CH1_EDGE = 2,
+} icuresetmode_t;
+
+typedef enum {
+  ICU_CHANNEL_1_INPUT_1 = 0,
+  ICU_CHANNEL_1_XOR_123 = 1,
+} icuxormode_t;
+
+typedef enum {
+  ICU_FILTER_F_1_N_1 = 0,
+  ICU_FILTER_F_1_N_2 = 1,
+  ICU_FILTER_F_1_N_4 = 2,
+  ICU_FILTER_F_1_N_8 = 3,
+  ICU_FILTER_F_2_N_6 = 4,
+  ICU_FILTER_F_2_N_8 = 5,
+  ICU_FILTER_F_4_N_6 = 6,
+  ICU_FILTER_F_4_N_8 = 7,
+  ICU_FILTER_F_8_N_6 = 8,
+  ICU_FILTER_F_8_N_8 = 9,
+  ICU_FILTER_F_16_N_5 = 10,
+  ICU_FILTER_F_16_N_6 = 11,
+  ICU_FILTER_F_16_N_8 = 12,
+  ICU_FILTER_F_32_N_5 = 13,
+  ICU_FILTER_F_32_N_6 = 14,
+  ICU_FILTER_F_32_N_8 = 15,
+} icufilter_t;
+
+typedef uint32_t icufreq_t;
+typedef uint32_t icucnt_t;
+
+typedef struct ICUDriver ICUDriver;
+typedef void (*icucallback_t)(ICUDriver *icup);
+
+typedef struct {
+  icumode_t mode;
+  icufreq_t frequency;
+  icucallback_t width_cb;
+  icucallback_t period_cb;
+  icucallback_t overflow_cb;
+  icuchannel_t channel;
+  uint32_t dier;
+  icuresetmode_t resetmode;
+  icuxormode_t xormode;
+  icufilter_t filter;
+} ICUConfig;
+
+struct ICUDriver {
+  icustate_t state;
+  const ICUConfig *config;
+  void *self;
+  uint32_t clock;
+  stm32_tim_t *tim;
+  volatile uint32_t *wccrp;
+  volatile uint32_t *pccrp;
+};
+
+extern ICUDriver ICUD2;
+extern ICUDriver ICUD4;
+
+#define icuGetWidth(icup) (*((icup)->wccrp) + 1)
+#define icuGetPeriod(icup) (*((icup)->pccrp) + 1)
+
+void icuStart(ICUDriver *icup, const ICUConfig *config);
+void icuStop(ICUDriver *icup);
+void icuEnable(ICUDriver *icup);
+void icuDisable(ICUDriver *icup);
+
+/**
+ * @brief Simulates a capture of a pulse width, as measured in timer counts,
+ *        and invokes the width callback as the ISR would.
+ */
+void icuHostInvokeWidth(ICUDriver *icup, icucnt_t width);
+
+/**
+ * @brief Simulates a capture of a cycle period, as measured in timer counts,
+ *        and invokes the period callback as the ISR would.
+ */
+void icuHostInvokePeriod(ICUDriver *icup, icucnt_t period);
+
+/**
+ * @brief Simulates a timer overflow and invokes the overflow callback.
+ */
+void icuHostInvokeOverflow(ICUDriver *icup);
+
+/*===========================================================================*/
+/* PWM. Fields and constants match the Corn3 modified driver in /include/lld. */
+/*===========================================================================*/
+
+#define PWM_CHANNELS 4
+
+#define PWM_OUTPUT_MASK                   0x0F
+#define PWM_OUTPUT_DISABLED               0x00
+#define PWM_OUTPUT_ACTIVE_HIGH            0x01
+#define PWM_OUTPUT_ACTIVE_LOW             0x02
+#define PWM_COMPLEMENTARY_OUTPUT_MASK     0xF0
+#define PWM_COMPLEMENTARY_OUTPUT_DISABLED 0x00
+#define PWM_COMPLEMENTARY_OUTPUT_ACTIVE_HIGH 0x10
+#define PWM_COMPLEMENTARY_OUTPUT_ACTIVE_LOW  0x20
+
+typedef enum {
+  PWM_UNINIT = 0,
+  PWM_STOP = 1,
+  PWM_READY = 2,
+} pwmstate_t;
+
+typedef uint32_t pwmmode_t;
+typedef uint8_t pwmchannel_t;
+typedef uint16_t pwmcnt_t;
+
+typedef struct PWMDriver PWMDriver;
+typedef void (*pwmcallback_t)(PWMDriver *pwmp);
+
+typedef struct {
+  pwmmode_t mode;
+  pwmcallback_t callback;
+} PWMChannelConfig;
+
+typedef struct {
+  uint32_t frequency;
+  pwmcnt_t period;
+  pwmcallback_t callback;
+  PWMChannelConfig channels[PWM_CHANNELS];
+  uint32_t cr1;
+  uint32_t cr2;
+  uint32_t bdtr;
+  uint32_t dier;
+} PWMConfig;
+
+struct PWMDriver {
+  pwmstate_t state;
+  const PWMConfig *config;
+  pwmcnt_t period;
+  void *self;
+  uint32_t clock;
+  stm32_tim_t *tim;
+};
+
+extern PWMDriver PWMD1;
+
+void pwmStart(PWMDriver *pwmp, const PWMConfig *config);
+void pwmStop(PWMDriver *pwmp);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* HOST_HAL_H_ */
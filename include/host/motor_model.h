@@ -0,0 +1,298 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares MotorModel, a numerical model of a brushless motor and three
+ *       phase inverter, for running the motor control code in closed loop on
+ *       the build host.
+ */
+
+#ifndef HOST_MOTOR_MODEL_H_
+#define HOST_MOTOR_MODEL_H_
+
+#include "motor/bus_voltage_sensor_interface.h"
+#include "motor/common.h"
+#include "motor/current_sensor_interface.h"
+#include "motor/inverter_interface.h"
+#include "motor/rotor_interface.h"
+#include "motor/voltage_sensor_interface.h"
+
+/**
+ * @brief Simulates a wye-connected brushless motor with sinusoidal back EMF,
+ *        fed by an ideal inverter, and turning a rotor with inertia, viscous
+ *        friction, and a constant load torque.
+ *
+ * @note The inverter is modeled by its average output over each PWM cycle.
+ *       A complementary channel puts out the bus voltage scaled by its duty
+ *       cycle (so zero width shorts the phase to ground, for braking). A
+ *       floating channel is high impedance, but any current still flowing in
+ *       its phase commutates through the body diodes, clamping the phase to
+ *       either bus rail until the current decays to zero. A low-side channel
+ *       is grounded outside of its width, and floating within it, and a
+ *       high-side channel is at the bus within its width, and floating
+ *       outside of it. Deadtime and current ripple within a PWM cycle are not
+ *       modeled.
+ *
+ * @note Channel modes written with @c WriteChannel take effect on
+ *       @c SyncModes, as with InverterPWM. Widths take effect immediately.
+ *
+ * @note The angle convention matches motor/common.h: the rotor is at 0 when
+ *       it is locked by current into phase A and out of phases B and C, and
+ *       positive rotation is counterclockwise.
+ */
+class MotorModel: public RotorInterface,
+                  public InverterInterface,
+                  public CurrentSensorInterface,
+                  public VoltageSensorInterface,
+                  public BusVoltageSensorInterface {
+ public:
+  /**
+   * @brief Physical parameters of the motor, inverter, and load, in SI units.
+   */
+  struct Parameters {
+    double resistance;          ///< Phase (line to neutral) resistance, ohm.
+    double inductance;          ///< Phase inductance, H.
+    double back_emf_constant;   ///< Phase peak back EMF per speed, V s / rad.
+    int pole_pairs;             ///< Electrical cycles per mechanical cycle.
+    double inertia;             ///< Rotor and load inertia, kg m^2.
+    double viscous_friction;    ///< Friction torque per speed, N m s / rad.
+    double load_torque;         ///< Constant torque opposing rotation, N m.
+    double bus_voltage;         ///< Inverter supply voltage, V.
+    Width16 pwm_period;         ///< Inverter PWM period, in counts.
+  };
+
+  /**
+   * @brief Quantities accumulated over each integration step since the last
+   *        call to @c ResetStatistics.
+   */
+  struct Statistics {
+    double duration;            ///< Simulated time, s.
+    double electrical_energy;   ///< Energy drawn from the bus, J.
+    double returned_energy;     ///< Energy returned to the bus, J.
+    double mechanical_energy;   ///< Energy delivered by the motor shaft, J.
+    double copper_loss;         ///< Energy dissipated in the windings, J.
+    double torque_sum;          ///< Sum of torque times step duration, N m s.
+    double torque_min;          ///< Lowest torque seen, N m.
+    double torque_max;          ///< Highest torque seen, N m.
+    double current_peak;        ///< Highest absolute phase current, A.
+    unsigned hall_transitions;  ///< Number of hall state changes.
+    double stop_time;           ///< Time until the rotor first stopped, s;
+                                ///< negative if it hasn't.
+  };
+
+  /**
+   * @brief Selects what @c ComputeAngle reports.
+   */
+  enum AngleMode {
+    kAngleHall,              ///< Center of the hall sensor sector.
+    kAngleHallInterpolated,  ///< Interpolated within the sector by the time
+                             ///< taken to cross the last, as from RotorHall.
+    kAngleExact,             ///< True electrical angle.
+  };
+
+  /**
+   * @brief Creates a motor at rest at electrical angle 0, with no current.
+   *
+   * @param parameters Physical parameters of the simulation.
+   */
+  MotorModel(const Parameters &parameters);
+
+  /**
+   * @brief Gets a set of parameters resembling a small hobby outrunner on a
+   *        3S battery, driven by the Corntroller inverter.
+   */
+  static Parameters DefaultParameters();
+
+  /**
+   * @brief Integrates the model over a time span.
+   *
+   * @param duration Time to advance the simulation by, in seconds.
+   * @param max_step Longest integration step, in seconds. Should be well under
+   *                 the electrical time constant (L / R).
+   * @return True if the hall state changed during the span. Integration stops
+   *         at the first step that changes the hall state, so @p duration may
+   *         not have fully elapsed.
+   */
+  bool Advance(double duration, double max_step = 1e-6);
+
+  /**
+   * @brief Computes the rotor angle as selected by @c SetAngleMode.
+   */
+  bool ComputeAngle(Angle16 *angle);
+
+  /**
+   * @brief Computes the electrical angular velocity, in fixed-point angle
+   *        units per second, as RotorHall does.
+   */
+  bool ComputeVelocity(Velocity32 *velocity);
+
+  /**
+   * @brief Computes the phase currents in milliamperes, saturating at the
+   *        limits of Current16, as an ideal current sensor.
+   */
+  bool ComputeCurrents(Current16 currents[kNumChannels]);
+
+  /**
+   * @brief Computes the phase terminal voltages in 1/256 V units, saturating
+   *        at the limits of Voltage16, as an ideal voltage sensor.
+   */
+  bool ComputeVoltages(Voltage16 voltages[kNumChannels]);
+
+  /**
+   * @brief Computes the bus voltage in 1/256 V units, saturating at the limit
+   *        of Voltage16, as an ideal voltage sensor.
+   */
+  bool ComputeBusVoltage(Voltage16 *voltage);
+
+  Width16 GetPeriod() {
+    return parameters_.pwm_period;
+  }
+
+  void WriteChannel(Channel channel,
+                    Width16 width,
+                    Mode mode = kModeComplementary);
+
+  void SyncModes();
+
+  /**
+   * @brief Gets the hall sensor state for the current rotor angle, encoded as
+   *        RotorHall::HallState.
+   */
+  unsigned GetHallState() const;
+
+  void SetAngleMode(AngleMode angle_mode) {
+    angle_mode_ = angle_mode;
+  }
+
+  void SetLoadTorque(double load_torque) {
+    parameters_.load_torque = load_torque;
+  }
+
+  void SetBusVoltage(double bus_voltage) {
+    parameters_.bus_voltage = bus_voltage;
+  }
+
+  /**
+   * @brief Sets the mechanical angular velocity in radians per second, e.g. to
+   *        start with the rotor already turning.
+   */
+  void SetMechanicalVelocity(double mechanical_velocity) {
+    mechanical_velocity_ = mechanical_velocity;
+  }
+
+  double GetTime() const {
+    return time_;
+  }
+
+  /**
+   * @brief Gets the electrical angle in radians, from 0 to 2 pi.
+   */
+  double GetElectricalAngle() const {
+    return electrical_angle_;
+  }
+
+  /**
+   * @brief Gets the mechanical angular velocity in radians per second.
+   */
+  double GetMechanicalVelocity() const {
+    return mechanical_velocity_;
+  }
+
+  double GetPhaseCurrent(Channel channel) const {
+    return current_[channel];
+  }
+
+  /**
+   * @brief Gets a phase terminal voltage with respect to the negative bus
+   *        rail, e.g. to observe back EMF on a floating phase.
+   */
+  double GetTerminalVoltage(Channel channel) const {
+    return terminal_voltage_[channel];
+  }
+
+  /**
+   * @brief Gets the electromagnetic torque from the last integration step.
+   */
+  double GetTorque() const {
+    return torque_;
+  }
+
+  /**
+   * @brief Gets the average current drawn from the bus in the last
+   *        integration step. Negative when regenerating.
+   */
+  double GetBusCurrent() const {
+    return bus_current_;
+  }
+
+  const Statistics &GetStatistics() const {
+    return statistics_;
+  }
+
+  void ResetStatistics();
+
+ protected:
+  /**
+   * @brief Integrates the model over one step with forward Euler.
+   */
+  void Step(double dt);
+
+  /**
+   * @brief Computes the torque (and back EMF) coefficient of a phase at an
+   *        electrical angle, such that phase torque is
+   *        back_emf_constant * coefficient * current.
+   */
+  static double TorqueCoefficient(Channel channel, double electrical_angle);
+
+  /**
+   * @brief Gets the index of the hall sector, counting counterclockwise from
+   *        the sector centered on 0.
+   */
+  int GetHallSector() const;
+
+  Parameters parameters_;
+  AngleMode angle_mode_;
+
+  Width16 width_[kNumChannels];  ///< Widths written by the commutator.
+  Mode mode_preload_[kNumChannels];  ///< Modes pending until SyncModes.
+  Mode mode_[kNumChannels];  ///< Modes in effect.
+
+  double time_;  ///< Simulated time, s.
+  double electrical_angle_;  ///< Rotor electrical angle, rad in [0, 2 pi).
+  double mechanical_velocity_;  ///< Rotor velocity, rad / s.
+  double current_[kNumChannels];  ///< Phase currents into the motor, A.
+  double terminal_voltage_[kNumChannels];  ///< Phase voltages, V.
+  double torque_;  ///< Electromagnetic torque, N m.
+  double bus_current_;  ///< Current drawn from the bus, A.
+
+  double hall_edge_time_;  ///< Time of the last hall transition, s.
+  double hall_sector_duration_;  ///< Time between the last two transitions.
+  int hall_direction_;  ///< Direction of the last transition, or 0 if none.
+
+  Statistics statistics_;
+};
+
+#endif  /* HOST_MOTOR_MODEL_H_ */
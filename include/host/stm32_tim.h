@@ -0,0 +1,159 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares a stand-in for the STM32 timer register block, so that code
+ *       which pokes timer registers directly can be compiled and run on the
+ *       build host.
+ *
+ * @note The layout and bit definitions follow the STM32F30x reference manual
+ *       (RM0316) and the ChibiOS stm32_tim.h header, but only the subset used
+ *       by Corn3 is defined.
+ */
+
+#ifndef HOST_STM32_TIM_H_
+#define HOST_STM32_TIM_H_
+
+#include <stdint.h>
+
+/* TIM_CR1 register. */
+#define STM32_TIM_CR1_CEN           (1U << 0)
+#define STM32_TIM_CR1_UDIS          (1U << 1)
+#define STM32_TIM_CR1_URS           (1U << 2)
+#define STM32_TIM_CR1_OPM           (1U << 3)
+#define STM32_TIM_CR1_DIR           (1U << 4)
+#define STM32_TIM_CR1_CMS(n)        ((n) << 5)
+#define STM32_TIM_CR1_ARPE          (1U << 7)
+
+/* TIM_CR2 register. */
+#define STM32_TIM_CR2_CCPC          (1U << 0)
+#define STM32_TIM_CR2_CCUS          (1U << 2)
+#define STM32_TIM_CR2_MMS(n)        ((n) << 4)
+#define STM32_TIM_CR2_TI1S          (1U << 7)
+#define STM32_TIM_CR2_MMS2(n)       ((n) << 20)
+
+/* TIM_DIER register. */
+#define STM32_TIM_DIER_UIE          (1U << 0)
+#define STM32_TIM_DIER_CC1IE        (1U << 1)
+#define STM32_TIM_DIER_CC2IE        (1U << 2)
+#define STM32_TIM_DIER_CC3IE        (1U << 3)
+#define STM32_TIM_DIER_CC4IE        (1U << 4)
+#define STM32_TIM_DIER_COMIE        (1U << 5)
+#define STM32_TIM_DIER_TIE          (1U << 6)
+#define STM32_TIM_DIER_BIE          (1U << 7)
+#define STM32_TIM_DIER_IRQ_MASK     (0xFFU)
+
+/* TIM_SR register. */
+#define STM32_TIM_SR_UIF            (1U << 0)
+#define STM32_TIM_SR_CC1IF          (1U << 1)
+#define STM32_TIM_SR_CC2IF          (1U << 2)
+#define STM32_TIM_SR_CC3IF          (1U << 3)
+#define STM32_TIM_SR_CC4IF          (1U << 4)
+#define STM32_TIM_SR_COMIF          (1U << 5)
+#define STM32_TIM_SR_TIF            (1U << 6)
+#define STM32_TIM_SR_BIF            (1U << 7)
+
+/* TIM_EGR register. */
+#define STM32_TIM_EGR_UG            (1U << 0)
+#define STM32_TIM_EGR_CC1G          (1U << 1)
+#define STM32_TIM_EGR_CC2G          (1U << 2)
+#define STM32_TIM_EGR_CC3G          (1U << 3)
+#define STM32_TIM_EGR_CC4G          (1U << 4)
+#define STM32_TIM_EGR_COMG          (1U << 5)
+#define STM32_TIM_EGR_TG            (1U << 6)
+#define STM32_TIM_EGR_BG            (1U << 7)
+
+/* TIM_CCMR1 register (output compare mode). */
+#define STM32_TIM_CCMR1_OC1PE       (1U << 3)
+#define STM32_TIM_CCMR1_OC1M(n)     ((n) << 4)
+#define STM32_TIM_CCMR1_OC1M_MASK   (7U << 4)
+#define STM32_TIM_CCMR1_OC2PE       (1U << 11)
+#define STM32_TIM_CCMR1_OC2M(n)     ((n) << 12)
+#define STM32_TIM_CCMR1_OC2M_MASK   (7U << 12)
+
+/* TIM_CCMR2 register (output compare mode). */
+#define STM32_TIM_CCMR2_OC3PE       (1U << 3)
+#define STM32_TIM_CCMR2_OC3M(n)     ((n) << 4)
+#define STM32_TIM_CCMR2_OC3M_MASK   (7U << 4)
+#define STM32_TIM_CCMR2_OC4PE       (1U << 11)
+#define STM32_TIM_CCMR2_OC4M(n)     ((n) << 12)
+#define STM32_TIM_CCMR2_OC4M_MASK   (7U << 12)
+
+/* TIM_CCER register. */
+#define STM32_TIM_CCER_CC1E         (1U << 0)
+#define STM32_TIM_CCER_CC1P         (1U << 1)
+#define STM32_TIM_CCER_CC1NE        (1U << 2)
+#define STM32_TIM_CCER_CC1NP        (1U << 3)
+#define STM32_TIM_CCER_CC2E         (1U << 4)
+#define STM32_TIM_CCER_CC2P         (1U << 5)
+#define STM32_TIM_CCER_CC2NE        (1U << 6)
+#define STM32_TIM_CCER_CC2NP        (1U << 7)
+#define STM32_TIM_CCER_CC3E         (1U << 8)
+#define STM32_TIM_CCER_CC3P         (1U << 9)
+#define STM32_TIM_CCER_CC3NE        (1U << 10)
+#define STM32_TIM_CCER_CC3NP        (1U << 11)
+#define STM32_TIM_CCER_CC4E         (1U << 12)
+#define STM32_TIM_CCER_CC4P         (1U << 13)
+
+/* TIM_BDTR register. */
+#define STM32_TIM_BDTR_DTG(n)       ((n) & 0xFFU)
+#define STM32_TIM_BDTR_LOCK(n)      ((n) << 8)
+#define STM32_TIM_BDTR_OSSI         (1U << 10)
+#define STM32_TIM_BDTR_OSSR         (1U << 11)
+#define STM32_TIM_BDTR_BKE          (1U << 12)
+#define STM32_TIM_BDTR_BKP          (1U << 13)
+#define STM32_TIM_BDTR_AOE          (1U << 14)
+#define STM32_TIM_BDTR_MOE          (1U << 15)
+
+/**
+ * @brief Timer register block. Unlike on the target, writing these registers
+ *        has no side effects.
+ */
+typedef struct {
+  volatile uint32_t CR1;
+  volatile uint32_t CR2;
+  volatile uint32_t SMCR;
+  volatile uint32_t DIER;
+  volatile uint32_t SR;
+  volatile uint32_t EGR;
+  volatile uint32_t CCMR1;
+  volatile uint32_t CCMR2;
+  volatile uint32_t CCER;
+  volatile uint32_t CNT;
+  volatile uint32_t PSC;
+  volatile uint32_t ARR;
+  volatile uint32_t RCR;
+  volatile uint32_t CCR[4];
+  volatile uint32_t BDTR;
+  volatile uint32_t DCR;
+  volatile uint32_t DMAR;
+  volatile uint32_t OR;
+  volatile uint32_t CCMR3;
+  volatile uint32_t CCR5;
+  volatile uint32_t CCR6;
+} stm32_tim_t;
+
+#endif  /* HOST_STM32_TIM_H_ */
@@ -0,0 +1,84 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares BusVoltageAdc, which measures the DC bus voltage through a
+ *       resistive divider.
+ */
+
+#ifndef MOTOR_BUS_VOLTAGE_ADC_H_
+#define MOTOR_BUS_VOLTAGE_ADC_H_
+
+#include <cstddef>
+
+#include "hal.h"
+
+#include "motor/bus_voltage_sensor_interface.h"
+
+/**
+ * @brief Converts the PVDD divider output on demand, corrected for the analog
+ *        supply voltage.
+ *
+ * @note ADC3 and ADC4 run in dual mode like ADC1 and ADC2, so ADC4 converts the
+ *       internal reference at the same time as ADC3 converts the divider. The
+ *       ratio of the two against the factory calibration of the internal
+ *       reference cancels any error in VDDA, which the ADC measures against.
+ *
+ * @note Corn3 doesn't have a PVDD divider; this is for a board that adds one.
+ */
+class BusVoltageAdc: public BusVoltageSensorInterface {
+ public:
+  /**
+   * @brief Creates a bus voltage sensor.
+   *
+   * @param adc_driver ADC driver, in dual mode with its slave.
+   */
+  explicit BusVoltageAdc(ADCDriver *adc_driver);
+
+  /**
+   * @brief Sets the divider pin to analog and starts the ADC.
+   */
+  void Start();
+
+  /**
+   * @brief Converts the divider output and the internal reference, and scales
+   *        their ratio to the bus voltage.
+   *
+   * @note Blocks for the conversion, which takes a few microseconds.
+   */
+  bool ComputeBusVoltage(Voltage16 *voltage);
+
+ protected:
+  static constexpr size_t kNumAdcChannels = 2;  ///< Divider, then reference.
+
+  static const ADCConfig kAdcConfig;
+  static const ADCConversionGroup kConversionGroup;
+
+  ADCDriver * const adc_driver_;
+  adcsample_t samples_[kNumAdcChannels];  ///< DMA buffer.
+};
+
+#endif  /* MOTOR_BUS_VOLTAGE_ADC_H_ */
@@ -0,0 +1,56 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares BusVoltageSensorInterface, an interface that reports the DC
+ *       bus voltage.
+ */
+
+#ifndef MOTOR_BUS_VOLTAGE_SENSOR_INTERFACE_H_
+#define MOTOR_BUS_VOLTAGE_SENSOR_INTERFACE_H_
+
+#include "motor/common.h"
+
+/**
+ * @brief Reports the inverter supply voltage.
+ */
+class BusVoltageSensorInterface {
+ public:
+  virtual ~BusVoltageSensorInterface() {}
+
+  /**
+   * @brief Measures the voltage between the positive and negative bus rails.
+   *
+   * @note May block while the voltage is sampled, so must be called from a
+   *       thread.
+   *
+   * @param voltage Pointer that the bus voltage is written to (if valid).
+   * @return True if the voltage is valid and was written to the output param.
+   */
+  virtual bool ComputeBusVoltage(Voltage16 *voltage) = 0;
+};
+
+#endif  /* MOTOR_BUS_VOLTAGE_SENSOR_INTERFACE_H_ */
@@ -52,8 +52,12 @@ typedef int16_t Angle16Diff;
  *
  * @note The Corntroller direction convention: positive direction is counter-
  *       clockwise.
+ *
+ * @note This is a fixed-point format of electrical revolutions per second with
+ *       16 fractional bits (Q16.16), i.e. Angle16 units per second. It is an
+ *       integer so that velocity can be computed and used without the FPU.
  */
-typedef float Velocity32;
+typedef int32_t Velocity32;
 
 /**
  * @brief Data type to represent width of inverter output. A value of this type
@@ -67,6 +71,25 @@ typedef uint16_t Width16;
  */
 typedef int16_t Width16Diff;
 
+/**
+ * @brief Data type to represent a phase current, in milliamperes.
+ *
+ * @note The Corntroller current convention: positive current flows from the
+ *       inverter into the motor lead.
+ */
+typedef int16_t Current16;
+
+/**
+ * @brief Data type to represent a voltage, in volts with 8 fractional bits
+ *        (Q8.8), i.e. 1/256 V units from -128 V to 128 V.
+ */
+typedef int16_t Voltage16;
+
+/**
+ * @brief Pi, for compile-time conversions between fixed-point and SI units.
+ */
+constexpr double kPi = 3.14159265358979323846;
+
 /**
  * @brief Convert degrees to fixed-point, with rounding.
  *
@@ -91,11 +114,58 @@ static inline constexpr unsigned Angle16ToDegrees(Angle16 angle) {
  * @brief Convert angular velocity to revolutions per minute (RPM), with
  *        rounding.
  *
- * @param velocity Angular velocity in floating point format.
+ * @param velocity Angular velocity in fixed-point format.
  * @return Angular velocity in RPM.
  */
 static inline constexpr long Velocity32ToRPM(Velocity32 velocity) {
-  return (60 * static_cast<long>(velocity) + (1 << 15)) >> 16;
+  return static_cast<long>((60 * static_cast<int64_t>(velocity) + (1 << 15)) >>
+                           16);
+}
+
+/**
+ * @brief Convert revolutions per minute (RPM) to angular velocity, rounding
+ *        towards zero.
+ *
+ * @param rpm Angular velocity in RPM. Must be within +/-1966050 RPM.
+ * @return Angular velocity in fixed-point format.
+ */
+static inline constexpr Velocity32 RPMToVelocity32(long rpm) {
+  return static_cast<Velocity32>((static_cast<int64_t>(rpm) << 16) / 60);
+}
+
+/**
+ * @brief Compute angular speed from the timer counts taken to rotate 60
+ *        degrees (one hall or commutation sector).
+ *
+ * @note The speed is one sixth of a revolution (65536 / 6 velocity units)
+ *       times the timer frequency over the counts elapsed. That dividend needs
+ *       33 bits, so the division is split into the whole part of frequency / 6
+ *       / counts, and the remainder scaled by 2^16 divided again. Both fit in
+ *       32 bits as long as the count is at most 16 bits, so that only 32-bit
+ *       integer division, which the Cortex-M4 does in hardware, is used at
+ *       speed; longer counts fall back to a 64-bit division.
+ *
+ * @tparam kCounterFrequency Timer frequency in Hz. Must be a multiple of 6.
+ * @param counts Timer counts taken to rotate 60 degrees. Must not be zero.
+ * @return Angular speed in fixed-point format. Always positive; saturated to
+ *         the largest Velocity32.
+ */
+template<uint32_t kCounterFrequency>
+static inline Velocity32 SectorCountsToSpeed(uint32_t counts) {
+  static_assert(kCounterFrequency % 6 == 0,
+                "Timer frequency must be a multiple of 6.");
+  constexpr uint32_t sixths_per_second_per_count = kCounterFrequency / 6;
+  const uint32_t whole = sixths_per_second_per_count / counts;
+  if (whole >= (1 << 15)) {
+    return INT32_MAX;
+  }
+  const uint32_t remainder = sixths_per_second_per_count % counts;
+  if (counts > 0xFFFF) {
+    return (whole << 16) +
+           static_cast<uint32_t>((static_cast<uint64_t>(remainder) << 16) /
+                                 counts);
+  }
+  return (whole << 16) + (remainder << 16) / counts;
 }
 
 #endif  /* MOTOR_COMMON_H_ */
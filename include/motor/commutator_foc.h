@@ -0,0 +1,179 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares CommutatorFoc, a field-oriented commutator that regulates the
+ *       motor currents in the rotor reference frame.
+ */
+
+#ifndef MOTOR_COMMUTATOR_FOC_H_
+#define MOTOR_COMMUTATOR_FOC_H_
+
+#include <cstdint>
+
+#include "ch.h"
+
+#include "motor/common.h"
+#include "base/utility.h"
+#include "motor/commutator_interface.h"
+#include "motor/modulator_space_vector.h"
+
+class RotorInterface;
+class InverterInterface;
+class CurrentSensorInterface;
+class RotorFlux;
+
+/**
+ * @brief Drives sinusoidal phase voltages to produce torque proportional to
+ *        the commanded amplitude, using field-oriented control (FOC).
+ *
+ * @note Each update transforms the phase currents into the direct (d, along
+ *       the rotor flux) and quadrature (q, 90 degrees ahead of it) axes, with
+ *       the Clarke then Park transforms. Two PI loops then regulate the d
+ *       current to zero and the q (torque-producing) current to the amplitude
+ *       scaled to FOC_MAX_CURRENT. Their outputs are transformed back into
+ *       the stator frame and written with space vector modulation.
+ *
+ * @note Without a current sensor, the loops are bypassed and the amplitude
+ *       sets the q axis voltage directly (voltage-mode FOC).
+ *
+ * @note A flux observer set with @c SetObserver is updated at the start of each
+ *       period, before the rotor angle is read, with the sampled currents and
+ *       the voltage put out over the last period.
+ *
+ * @note Updates must run once per PWM period, so @c SignalPeriod should be
+ *       called from the PWM update interrupt. All of the arithmetic is integer,
+ *       to fit in a small fraction of the period.
+ */
+class CommutatorFoc: public CommutatorInterface {
+ public:
+  /**
+   * @brief Creates commutator structure with references to necessary motor
+   *        interfaces.
+   *
+   * @param rotor Rotor angle interface. Should interpolate between sensor
+   *              edges for smooth output.
+   * @param inverter Power stage output interface.
+   * @param current_sensor Phase current interface, or nullptr for voltage
+   *                       mode.
+   */
+  CommutatorFoc(RotorInterface *rotor,
+                InverterInterface *inverter,
+                CurrentSensorInterface *current_sensor);
+
+  /**
+   * @brief Runs an update of the inverter outputs whenever signaled through
+   *        @c SignalPeriod.
+   */
+  NORETURN void CommutationLoop();
+
+  /**
+   * @brief Runs one control period: samples the rotor angle and currents,
+   *        updates the current loops, and writes the inverter outputs.
+   *
+   * @note Called by @c CommutationLoop for each period; may also be called
+   *       directly to run a single period (e.g. on the build host).
+   */
+  void Update();
+
+  /**
+   * @brief Does nothing, as updates are paced by the PWM period instead of by
+   *        rotor or amplitude changes.
+   */
+  void SignalChange() {
+  }
+
+  /**
+   * @brief Writes the torque command.
+   *
+   * @param semi_amplitude Commanded torque, as a fraction of
+   *                       @c GetMaxAmplitude of the maximum current (or of
+   *                       the maximum voltage in voltage mode).
+   */
+  void WriteAmplitude(Width16Diff semi_amplitude);
+
+  Width16Diff GetMaxAmplitude();
+
+  void SetEnable(bool enable) {
+    enable_ = enable;
+  }
+
+  /**
+   * @brief Connects a flux observer to be updated each period.
+   *
+   * @note Needs a current sensor. The observer is usually also the rotor given
+   *       to the constructor.
+   *
+   * @param observer Sensorless rotor angle observer.
+   */
+  void SetObserver(RotorFlux *observer) {
+    observer_ = observer;
+  }
+
+  /**
+   * @brief Wakes the commutation loop for a new PWM period.
+   *
+   * @note Can be passed to InverterPWM::SetUpdateCallback; runs in interrupt
+   *       context.
+   *
+   * @param commutator_foc Pointer to the CommutatorFoc to signal.
+   */
+  static void SignalPeriod(void *commutator_foc);
+
+ protected:
+  /**
+   * @brief Runs one step of a current PI loop.
+   *
+   * @param error Current error, in milliamperes.
+   * @param limit Absolute value of the largest output, in PWM counts.
+   * @param integral Integral term of the loop, in Q16 PWM counts. Clamped to
+   *                 @p limit so that it does not wind up when the output
+   *                 saturates.
+   * @return Voltage output, in PWM counts.
+   */
+  static int32_t UpdatePi(int32_t error, int32_t limit, int32_t *integral);
+
+  /**
+   * @brief Puts all inverter channels in high impedance and resets the loops.
+   */
+  void Disable();
+
+  RotorInterface * const rotor_;
+  InverterInterface * const inverter_;
+  CurrentSensorInterface * const current_sensor_;
+  RotorFlux *observer_;  ///< Flux observer fed each period, if any.
+  ModulatorSpaceVector modulator_;  ///< Converts voltages to channel widths.
+  Width16Diff semi_amplitude_;  ///< Commanded torque.
+  int32_t integral_d_;  ///< Direct axis current loop integral term.
+  int32_t integral_q_;  ///< Quadrature axis current loop integral term.
+  int32_t voltage_alpha_;  ///< Alpha axis voltage put out, in mV.
+  int32_t voltage_beta_;  ///< Beta axis voltage put out, in mV.
+  bool driven_;  ///< True if the inverter was driven over the last period.
+  Semaphore semaphore_;  ///< Synchronization for PWM periods.
+  bool enable_;  ///< Flag for whether motor is driven or free-spinning.
+};
+
+#endif  /* MOTOR_COMMUTATOR_FOC_H_ */
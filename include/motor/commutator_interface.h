@@ -0,0 +1,89 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares CommutatorInterface, an interface that drives the inverter
+ *       from the rotor state and a commanded amplitude.
+ */
+
+#ifndef MOTOR_COMMUTATOR_INTERFACE_H_
+#define MOTOR_COMMUTATOR_INTERFACE_H_
+
+#include "motor/common.h"
+#include "base/utility.h"
+
+/**
+ * @brief Sequences the inverter output to turn the motor, at a commanded
+ *        amplitude.
+ *
+ * @note Sensor and command drivers (e.g. RotorHall and ServoInput) talk to the
+ *       commutator through this interface, so that the commutation scheme can
+ *       be selected without changing them.
+ */
+class CommutatorInterface {
+ public:
+  virtual ~CommutatorInterface() {}
+
+  /**
+   * @brief Runs the commutation in the calling thread.
+   */
+  NORETURN virtual void CommutationLoop() = 0;
+
+  /**
+   * @brief Notifies the commutation logic that amplitude or rotor angle has
+   *        changed.
+   *
+   * @note Must be called under a ChibiOS lock.
+   */
+  virtual void SignalChange() = 0;
+
+  /**
+   * @brief Writes the commanded amplitude.
+   *
+   * @param semi_amplitude Signed amplitude, where positive drives the rotor
+   *                       counterclockwise. Absolute value must be less than
+   *                       or equal to @c GetMaxAmplitude.
+   */
+  virtual void WriteAmplitude(Width16Diff semi_amplitude) = 0;
+
+  /**
+   * @brief Retrieves the maximum amplitude setting.
+   *
+   * @return Absolute value of the largest semi-amplitude that can be set with
+   *         @c WriteAmplitude.
+   */
+  virtual Width16Diff GetMaxAmplitude() = 0;
+
+  /**
+   * @brief Write the motor drive enable flag.
+   *
+   * @param enable True if motor is to be driven or braked (and not free-
+   *               spinning).
+   */
+  virtual void SetEnable(bool enable) = 0;
+};
+
+#endif  /* MOTOR_COMMUTATOR_INTERFACE_H_ */
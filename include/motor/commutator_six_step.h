@@ -28,12 +28,15 @@
 #define MOTOR_COMMUTATOR_SIX_STEP_H_
 
 #include "ch.h"
+#include "hal.h"
 
 #include "common.h"
 #include "base/utility.h"
+#include "motor/commutator_interface.h"
 
 class RotorInterface;
 class InverterInterface;
+class BusVoltageSensorInterface;
 
 /**
  * @brief Configures inverter based on rotor angle quantized to six steps and
@@ -46,17 +49,77 @@ class InverterInterface;
  *
  * @note This class has controllable amplitude, which is the "scale" of the
  *       voltage pushed into the motor phases.
+ *
+ * @note Given a timer, the commutation points are advanced ahead of the rotor
+ *       angle by an angle that grows with speed, looked up in
+ *       @c SIX_STEP_ADVANCE_TABLE, to make up for the current lagging the
+ *       voltage at speed. The advanced points fall between the rotor's
+ *       updates (e.g. hall edges), so each commutation also schedules the
+ *       next one on the timer, from the rotor velocity. This needs a rotor
+ *       that interpolates its angle within the sector, like RotorHall, and is
+ *       only done while driving in the direction of rotation.
+ *
+ * @note The two driven phases are modulated in one of the modes selected with
+ *       @c SetModulation:
+ *         1) Bipolar: both phases switch complementarily, around half of the
+ *            PWM period, so both half bridges switch every cycle.
+ *         2) Unipolar: only the high side of the phase driven high switches,
+ *            at twice the amplitude, while the other phase's low side is held
+ *            on; the current freewheels through the low-side diode. This
+ *            halves the switching per cycle and the current ripple at part
+ *            amplitude, at the cost of diode conduction loss.
+ *         3) Synchronous: as unipolar, but the switching phase's low side is
+ *            driven complementarily, rectifying the freewheeling current
+ *            synchronously.
+ *
+ * @note A zero amplitude brakes the motor, in one of the modes selected with
+ *       @c SetBrake:
+ *         1) Coast: all phases float, and the rotor spins down on its load.
+ *         2) Dynamic: the low sides short the phases together for the brake
+ *            strength as a fraction of each PWM period, dissipating the
+ *            rotor's energy in the windings. At full strength, all low sides
+ *            are held on.
+ *         3) Regenerative: the phases are driven as for the direction of
+ *            rotation, but below their back EMF by the resistive drop at the
+ *            braking current, so that the current flows back into the bus.
+ *            The back EMF is estimated from the rotor velocity and
+ *            @c MOTOR_FLUX_LINKAGE, and the amplitude is scaled for the
+ *            measured bus voltage. With no bus voltage measurement, with the
+ *            bus at or above @c SIX_STEP_BRAKE_MAX_VOLTAGE, or too slow for the
+ *            back EMF to drive the braking current, the motor is braked
+ *            dynamically at the same strength instead.
  */
-class CommutatorSixStep {
+class CommutatorSixStep: public CommutatorInterface {
  public:
+  enum Modulation {
+    kModulationBipolar,     ///< Switch both driven phases.
+    kModulationUnipolar,    ///< Chop the high side, freewheel on the diode.
+    kModulationSynchronous  ///< Chop the high side, rectify with the low side.
+  };
+
+  enum BrakeMode {
+    kBrakeCoast,         ///< Float all phases.
+    kBrakeDynamic,       ///< Short the phases through the low sides.
+    kBrakeRegenerative   ///< Drive current back into the bus.
+  };
+
   /**
    * @brief Creates commutator structure with references to necessary motor
    *        interfaces.
    *
    * @param rotor Rotor angle approximation interface.
    * @param inverter Power stage output interface.
+   * @param gpt_driver Timer that schedules advanced commutations, or nullptr
+   *                   to commutate only on rotor updates, without advance.
    */
-  CommutatorSixStep(RotorInterface *rotor, InverterInterface *inverter);
+  CommutatorSixStep(RotorInterface *rotor,
+                    InverterInterface *inverter,
+                    GPTDriver *gpt_driver);
+
+  /**
+   * @brief Starts the commutation timer, if any.
+   */
+  void Start();
 
   /**
    * @brief Performs an update of inverter state and configuration whenever
@@ -65,11 +128,14 @@ class CommutatorSixStep {
   NORETURN void CommutationLoop();
 
   /**
-   * @brief Notifies the commutation logic that amplitude or rotor angle has
-   *        changed.
+   * @brief Computes and writes the inverter state for the current rotor angle
+   *        and amplitude.
    *
-   * @note Must be called under a ChibiOS lock.
+   * @note Called by @c CommutationLoop for each update; may also be called
+   *       directly to run a single commutation step (e.g. on the build host).
    */
+  void Commutate();
+
   void SignalChange();
 
   /**
@@ -81,30 +147,91 @@ class CommutatorSixStep {
    */
   void WriteAmplitude(Width16Diff semi_amplitude);
 
+  Width16Diff GetMaxAmplitude();
+
+  void SetEnable(bool enable) {
+    enable_ = enable;
+  }
+
   /**
-   * @brief Retrieves the maximum amplitude setting.
+   * @brief Selects how the driven phases are switched.
+   *
+   * @note Takes effect at the next commutation.
    *
-   * @return Absolute value of the largest semi-amplitude that can be set with
-   *         @c WriteAmplitude.
+   * @param modulation Modulation mode.
    */
-  Width16Diff GetMaxAmplitude();
+  void SetModulation(Modulation modulation) {
+    modulation_ = modulation;
+  }
 
   /**
-   * @brief Write the motor drive enable flag.
+   * @brief Selects how a zero amplitude brakes the motor.
+   *
+   * @note Takes effect at the next commutation.
    *
-   * @param enable True if motor is to be driven or braked (and not free-
-   *               spinning).
+   * @param mode Braking mode.
+   * @param strength Percentage of the PWM period that the phases are shorted
+   *                 for dynamic braking, or of @c SIX_STEP_BRAKE_CURRENT for
+   *                 regenerative braking, up to 100.
    */
-  void SetEnable(bool enable) {
-    enable_ = enable;
+  void SetBrake(BrakeMode mode, unsigned strength);
+
+  /**
+   * @brief Sets the bus voltage measurement that regenerative braking is
+   *        scaled and limited by.
+   *
+   * @note The measurement is taken in each braking commutation, so it must not
+   *       block, e.g. the filtered measurement of a VoltageCompensator.
+   *
+   * @param bus_voltage_sensor Bus voltage source, or nullptr for none.
+   */
+  void SetBusVoltageSensor(BusVoltageSensorInterface *bus_voltage_sensor) {
+    bus_voltage_sensor_ = bus_voltage_sensor;
   }
 
  protected:
+  static const GPTConfig kGptConfig;  ///< Commutation timer configuration.
+
+  /**
+   * @brief Looks up the commutation advance for a speed.
+   *
+   * @param speed Absolute value of the rotor velocity.
+   * @return Advance, interpolated in @c SIX_STEP_ADVANCE_TABLE.
+   */
+  static Angle16 ComputeAdvance(Velocity32 speed);
+
+  /**
+   * @brief Writes the inverter state for coasting or dynamic braking.
+   */
+  void Brake();
+
+  /**
+   * @brief Computes the amplitude that brakes the rotor regeneratively.
+   *
+   * @param amplitude Output for the signed amplitude, in the direction of
+   *                  rotation.
+   * @return True if regenerative braking is selected and possible, else the
+   *         rotor is to be braked with @c Brake.
+   */
+  bool ComputeRegenerativeAmplitude(Width16Diff *amplitude);
+
+  /**
+   * @brief Signals the commutation thread when the timer expires.
+   *
+   * @param gpt_driver Timer whose @c self points to the CommutatorSixStep.
+   */
+  static void GptCallback(GPTDriver *gpt_driver);
+
   RotorInterface * const rotor_;
   InverterInterface * const inverter_;
+  GPTDriver * const gpt_driver_;  ///< Timer for advanced commutations.
   Width16Diff semi_amplitude_;  ///< Width by which driven phases are biased.
   Semaphore semaphore_;  ///< Synchronization for commutation updates.
   bool enable_;  ///< Flag for whether motor is driven or free-spinning.
+  Modulation modulation_;  ///< Switching of the driven phases.
+  BrakeMode brake_mode_;  ///< Braking for a zero amplitude.
+  unsigned brake_strength_;  ///< Braking strength, in percent.
+  BusVoltageSensorInterface *bus_voltage_sensor_;  ///< Limits regeneration.
 };
 
 #endif  /* MOTOR_COMMUTATOR_SIX_STEP_H_ */
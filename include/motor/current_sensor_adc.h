@@ -0,0 +1,144 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares CurrentSensorAdc, which samples the low-side shunt current
+ *       amplifiers in step with the inverter PWM.
+ */
+
+#ifndef MOTOR_CURRENT_SENSOR_ADC_H_
+#define MOTOR_CURRENT_SENSOR_ADC_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "hal.h"
+
+#include "motor/current_sensor_interface.h"
+
+class InverterPWM;
+
+/**
+ * @brief Reads the phase currents from the dual low-side shunts, through the
+ *        DRV8303 current sense amplifiers.
+ *
+ * @note Phase B and C are converted simultaneously by ADC1 and ADC2 in dual
+ *       mode, triggered by the inverter timer near the top of its count, where
+ *       all the low sides are on. DMA moves the results into a circular double
+ *       buffer, so the only CPU time taken per sample is the end of conversion
+ *       callback, which keeps the raw counts for @c ComputeCurrents to scale.
+ *       Phase A is reconstructed from the sum of the currents being zero.
+ *
+ * @note A shunt only carries its phase's current while the low side is on. A
+ *       sample is discarded if either sensed channel's width leaves less than
+ *       @c CURRENT_SENSE_SETTLE of low-side on time before sampling, in either
+ *       the period that was sampled or the one after, as a width read back is
+ *       preloaded and may already be the next period's. The last good sample
+ *       is reported for a few periods in its place, so that high duty peaks
+ *       don't interrupt the current loops.
+ *
+ * @note Currents are measured from each amplifier's own zero current output,
+ *       which is averaged over many samples by a calibration, with the
+ *       amplifier inputs shorted. Until then, half of the ADC range is used.
+ */
+class CurrentSensorAdc: public CurrentSensorInterface {
+ public:
+  /**
+   * @brief Creates a current sensor with no valid sample.
+   *
+   * @param adc_driver ADC driver, in dual mode with its slave.
+   * @param inverter Inverter whose timer triggers the conversions.
+   */
+  CurrentSensorAdc(ADCDriver *adc_driver, InverterPWM *inverter);
+
+  /**
+   * @brief Sets the inverter's ADC trigger and starts converting on it.
+   *
+   * @note The inverter must be started first.
+   */
+  void Start();
+
+  bool ComputeCurrents(Current16 currents[InverterInterface::kNumChannels]);
+
+  /**
+   * @brief Starts averaging the amplifier outputs, which are taken as their
+   *        zero current outputs when the calibration ends.
+   *
+   * @note The currents are reported invalid from this call until
+   *       @c EndCalibration, so it should be called before the amplifier
+   *       inputs are shorted. Calling it again discards the samples so far,
+   *       so the last call must come once the inputs are shorted and settled.
+   *       Samples are taken regardless of the inverter widths.
+   */
+  void StartCalibration();
+
+  /**
+   * @brief Stops averaging, and keeps the averages as the new zero current
+   *        outputs if all the calibration samples were taken and they are
+   *        plausible.
+   *
+   * @note The amplifier inputs must be reconnected and settled, as sampling
+   *       resumes immediately.
+   *
+   * @return True if the zero current outputs were updated.
+   */
+  bool EndCalibration();
+
+ protected:
+  static constexpr size_t kNumAdcChannels = 2;  ///< Phase C, then phase B.
+  static constexpr size_t kDepth = 2;  ///< Sample sets in the double buffer.
+
+  static const ADCConfig kAdcConfig;
+  static const ADCConversionGroup kConversionGroup;
+
+  /**
+   * @brief Checks the sampling window and keeps a converted sample set.
+   *
+   * @param adc_driver ADC driver whose @c self points to the sensor.
+   * @param buffer Half of the circular buffer that was just filled.
+   * @param n Number of sample sets in @p buffer.
+   */
+  static void AdcCallback(ADCDriver *adc_driver,
+                          adcsample_t *buffer,
+                          size_t n);
+
+  ADCDriver * const adc_driver_;
+  InverterPWM * const inverter_;
+  adcsample_t samples_[kNumAdcChannels * kDepth];  ///< DMA buffer.
+  adcsample_t sample_b_;  ///< Last good phase B amplifier output.
+  adcsample_t sample_c_;  ///< Last good phase C amplifier output.
+  bool sampled_;  ///< True once a good sample has been taken.
+  bool window_clear_;  ///< True if the last widths left a sampling window.
+  uint32_t held_;  ///< Samples discarded since the last good one.
+  int32_t offset_b_;  ///< Phase B zero current output, in Q4 ADC counts.
+  int32_t offset_c_;  ///< Phase C zero current output, in Q4 ADC counts.
+  bool calibrating_;  ///< True while the outputs are being averaged.
+  uint32_t calibration_count_;  ///< Sample sets summed in this calibration.
+  uint32_t calibration_sum_b_;  ///< Sum of phase B outputs.
+  uint32_t calibration_sum_c_;  ///< Sum of phase C outputs.
+};
+
+#endif  /* MOTOR_CURRENT_SENSOR_ADC_H_ */
@@ -0,0 +1,60 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares CurrentSensorInterface, an interface that reports the motor
+ *       phase currents.
+ */
+
+#ifndef MOTOR_CURRENT_SENSOR_INTERFACE_H_
+#define MOTOR_CURRENT_SENSOR_INTERFACE_H_
+
+#include "motor/common.h"
+#include "motor/inverter_interface.h"
+
+/**
+ * @brief Reports the currents flowing in the three motor phases.
+ */
+class CurrentSensorInterface {
+ public:
+  virtual ~CurrentSensorInterface() {}
+
+  /**
+   * @brief Retrieves the most recently sampled phase currents.
+   *
+   * @note For a wye- or delta-connected motor the three currents sum to zero,
+   *       so sensors that measure only two phases compute the third.
+   *
+   * @param currents Array that the current into each phase, indexed by
+   *                 @c InverterInterface::Channel, is written to (if valid).
+   * @return True if the currents are valid and were written to the output
+   *         param.
+   */
+  virtual bool ComputeCurrents(
+      Current16 currents[InverterInterface::kNumChannels]) = 0;
+};
+
+#endif  /* MOTOR_CURRENT_SENSOR_INTERFACE_H_ */
@@ -41,16 +41,26 @@
  * @note The inverter is defined as a set of three "phases" or "channels" for
  *       driving the three leads of of a motor.
  *
- * @note Each channel has two states:
- *         1) Disabled. This means that the channel driven to neither high nor
+ * @note Each channel is in one of four modes:
+ *         1) Floating. This means that the channel driven to neither high nor
  *            low voltage power rails. It is also known as "high-impedance."
  *            This is commonly used in "six-step" commutation for sensing the
  *            back EMF generated by the motor in one phase.
- *         2) Enabled. This means that the channel is driven either high or low
- *            in a cyclic fashion. The duration of each cycle is the period, and
- *            the time during which the channel is driven high, or is "active,"
- *            is the "pulse width," or just "width." Conversely, for the rest of
- *            the time per cycle, the channel is driven low, or is "inactive."
+ *         2) Complementary. This means that the channel is driven either high
+ *            or low in a cyclic fashion. The duration of each cycle is the
+ *            period, and the time during which the channel is driven high, or
+ *            is "active," is the "pulse width," or just "width." Conversely,
+ *            for the rest of the time per cycle, the channel is driven low, or
+ *            is "inactive."
+ *         3) Low side. This is the complementary mode without the high side:
+ *            the channel is driven low for the inactive time, and floats for
+ *            the width. All channels in this mode short the motor leads
+ *            together for a controlled fraction of each cycle, e.g. for
+ *            braking.
+ *         4) High side. This is the complementary mode without the low side:
+ *            the channel is driven high for the width, and floats for the
+ *            rest of the cycle, during which current into the motor
+ *            freewheels through the low-side diode.
  *
  * @note At a high enough frequency, this "pulse-width modulation" (PWM) scheme
  *       approximates a voltage source that generates a fraction of the voltage
@@ -65,6 +75,13 @@ class InverterInterface {
     kNumChannels
   };
 
+  enum Mode {
+    kModeFloat,          ///< Neither side driven (high impedance).
+    kModeComplementary,  ///< High side for the width, low side otherwise.
+    kModeLowSide,        ///< Low side outside of the width, floating in it.
+    kModeHighSide        ///< High side for the width, floating otherwise.
+  };
+
   virtual ~InverterInterface() {
   }
 
@@ -82,23 +99,23 @@ class InverterInterface {
   virtual Width16 GetPeriod() = 0;
 
   /**
-   * @brief Loads the state (output or high impedance) and active time (pulse
-   *        width) into an inverter channel.
+   * @brief Loads the mode (e.g. output or high impedance) and active time
+   *        (pulse width) into an inverter channel.
    *
    * @note This does not necessarily immediately change the status a channel.
    *       Instead the new widths and states may be loaded at a later time, e.g.
    *       to simultaneous configure all channels, and not necessarily together.
-   *       So, even a disabled channel should have some valid width, as it may
+   *       So, even a floating channel should have some valid width, as it may
    *       continue to generate a pulse of that width until its state takes
    *       effect.
    *
    * @param channel Channel to write to.
    * @param width Duration of each PWM period that channel is driven high.
-   * @param enable True if channel is driven (i.e. not high impedance).
+   * @param mode How the channel is driven.
    */
   virtual void WriteChannel(Channel channel,
                             Width16 width,
-                            bool enable = true) = 0;
+                            Mode mode = kModeComplementary) = 0;
 
   /**
    * @brief Forces mode changes to channels to take effect immediately.
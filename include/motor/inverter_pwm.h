@@ -31,6 +31,8 @@
 
 #include "inverter_interface.h"
 
+class CurrentSensorInterface;
+
 /**
  * @brief Drives a three phase inverter using three pulse width modulation (PWM)
  *        channels.
@@ -58,9 +60,27 @@
  *            sensing may occur in the off-time of the inverter, which sets a
  *            minimum duration to allow analog to digital converter (ADC)
  *            sampling.
+ *
+ * @note The deadtime is compensated for: while a driven phase's current flows
+ *       out of the inverter, it free-wheels through the low-side diode during
+ *       the deadtime, putting out less than the written width, and vice versa.
+ *       So each switching channel's width is lengthened or shortened by
+ *       @c INVERTER_DEADTIME_COMPENSATION according to its current direction.
+ *       The direction is taken from the current sensor when there is one,
+ *       ramping the compensation in over @c INVERTER_DEADTIME_CURRENT so that
+ *       noise near zero current doesn't toggle it. Otherwise, the current is
+ *       taken to flow in the direction that the channel is commanded, i.e.
+ *       out of a channel wider than half the period and into a narrower one.
  */
 class InverterPWM: public InverterInterface {
  public:
+  /**
+   * @brief Function called at the start of each PWM period.
+   *
+   * @param arg Argument passed to @c SetUpdateCallback.
+   */
+  typedef void (*UpdateCallback)(void *arg);
+
   /**
    * @brief Creates inverter driver structure.
    *
@@ -68,6 +88,36 @@ class InverterPWM: public InverterInterface {
    */
   InverterPWM(PWMDriver *pwm_driver);
 
+  /**
+   * @brief Sets a function to be called from the timer interrupt once per PWM
+   *        period, e.g. to run a control loop in step with the PWM.
+   *
+   * @note Without a callback at @c Start, the timer does not interrupt, so
+   *       one set afterwards only replaces one that was set before.
+   *
+   * @param callback Function to call, or nullptr for none; runs in interrupt
+   *                 context.
+   * @param arg Argument to pass to @p callback.
+   */
+  void SetUpdateCallback(UpdateCallback callback, void *arg) {
+    chSysLock();
+    update_callback_ = callback;
+    update_callback_arg_ = arg;
+    chSysUnlock();
+  }
+
+  /**
+   * @brief Sets the source of the phase current directions for deadtime
+   *        compensation.
+   *
+   * @note Without one, the directions are inferred from the widths written.
+   *
+   * @param current_sensor Phase current source, read from @c WriteChannel.
+   */
+  void SetCurrentSensor(CurrentSensorInterface *current_sensor) {
+    current_sensor_ = current_sensor;
+  }
+
   /**
    * @brief Initializes the PWM driver and configures each channel to put out an
    *        inactive (low) signal, which puts each inverter channel in high
@@ -96,32 +146,99 @@ class InverterPWM: public InverterInterface {
   /**
    * @brief Loads a channel configuration into hardware registers.
    *
-   * @note Neither the state (enabled/disabled) nor the pulse width for a
-   *       channel will take effect immediately, as both are "preloaded" by the
-   *       hardware. The pulse width will be effective at the next PWM cycle
-   *       and the state will be effective when and only if @c SyncModes is
-   *       called.
+   * @note Neither the mode nor the pulse width for a channel will take effect
+   *       immediately, as both are "preloaded" by the hardware. The pulse width
+   *       will be effective at the next PWM cycle and the mode will be
+   *       effective when and only if @c SyncModes is called.
+   *
+   * @note In low-side mode, the low-side output follows the channel reference
+   *       directly (inverted PWM mode), with the high-side output held off.
+   *       In high-side mode, the low-side output is held off instead. Either
+   *       way, no deadtime is inserted or compensated.
    *
    * @param channel Channel to configure.
    * @param width Duration of the PWM period that this inverter phase is driven
-   *              high (if enabled). For the rest of each period, the phase is
-   *              driven low. This is subject to inserted deadtime and maximum
-   *              on times.
-   * @param enable True if the inverter phase is driven; false to put it into a
-   *               high impedance state (default).
+   *              high (if complementary). For the rest of each period, the
+   *              phase is driven low. This is subject to inserted deadtime,
+   *              which is compensated for, and maximum on times.
+   * @param mode How the inverter phase is driven; floating puts it into a high
+   *             impedance state.
    */
-  void WriteChannel(Channel channel, Width16 width, bool enable = true);
+  void WriteChannel(Channel channel,
+                    Width16 width,
+                    Mode mode = kModeComplementary);
 
   /**
-   * @brief Synchronizes the hardware to the PWM channel states previously
+   * @brief Synchronizes the hardware to the PWM channel modes previously
    *        written.
    */
   void SyncModes();
 
+  /**
+   * @brief Reads the width that a channel was last written with.
+   *
+   * @note This is the preloaded width, which takes effect at the next PWM
+   *       cycle, so it may be ahead of the width being put out.
+   *
+   * @param channel Channel to read.
+   * @return Pulse width last passed to @c WriteChannel for @p channel, after
+   *         deadtime compensation.
+   */
+  Width16 GetWidth(Channel channel);
+
+  /**
+   * @brief Sets the counter value at which the ADC trigger output fires.
+   *
+   * @note The trigger (TRGO) is the reference of the otherwise unused fourth
+   *       timer channel, which falls when the counter passes @p count on its
+   *       way up, so a value close to the period fires once per PWM period
+   *       near the middle of the low-side on time.
+   *
+   * @param count Counter value to trigger at; must be less than the period.
+   */
+  void SetSampleCount(Width16 count);
+
+  /**
+   * @brief Checks if every channel was last written floating, so that no
+   *        inverter phase is driven.
+   *
+   * @note Like @c GetWidth, this reads the preloaded state, which may not have
+   *       been synchronized yet.
+   *
+   * @return True if all inverter phases are in high impedance.
+   */
+  bool IsFloating();
+
  protected:
   static const PWMConfig kPwmConfig;
 
+  /**
+   * @brief Passes counter update events to the update callback.
+   *
+   * @param pwm_driver Pointer to PWM driver that originated the update event.
+   */
+  static void PwmUpdateCallback(PWMDriver *pwm_driver);
+
+  /**
+   * @brief Adjusts a driven channel's width for the deadtime.
+   *
+   * @note Reads the phase currents at the first call after @c SyncModes, so
+   *       that they are read once for each set of channel writes.
+   *
+   * @param channel Channel being written.
+   * @param width Width to put out.
+   * @return Width to write, between zero and the period.
+   */
+  Width16 CompensateDeadtime(Channel channel, Width16 width);
+
   PWMDriver * const pwm_driver_;
+  PWMConfig pwm_config_;  ///< Copy of kPwmConfig with the update callback.
+  UpdateCallback update_callback_;  ///< Called once per PWM period.
+  void *update_callback_arg_;  ///< Argument to pass to update_callback_.
+  CurrentSensorInterface *current_sensor_;  ///< Current direction source.
+  Current16 currents_[kNumChannels];  ///< Currents for this set of writes.
+  bool currents_read_;  ///< True once currents_ was read since SyncModes.
+  bool currents_valid_;  ///< True if currents_ holds valid currents.
 };
 
 #endif  /* MOTOR_INVERTER_PWM_H_ */
@@ -0,0 +1,103 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares ModulatorSpaceVector, which converts voltage vectors into
+ *       inverter channel widths with space vector modulation.
+ */
+
+#ifndef MOTOR_MODULATOR_SPACE_VECTOR_H_
+#define MOTOR_MODULATOR_SPACE_VECTOR_H_
+
+#include <cstdint>
+
+#include "motor/common.h"
+
+class InverterInterface;
+
+/**
+ * @brief Writes a voltage vector in the stator frame to all three inverter
+ *        channels at once, using space vector pulse width modulation (SVPWM).
+ *
+ * @note Voltages are phase (line to neutral) peak voltages in PWM counts, so
+ *       that a width equal to the period puts out the bus voltage. Centering
+ *       sinusoidal phase voltages on half of the period only reaches a
+ *       magnitude of half of the period. SVPWM instead shifts all three widths
+ *       so that their highest and lowest are equally far from the ends of the
+ *       period, which reaches the period over sqrt(3): about 15% more voltage,
+ *       the most a wye-connected motor can get without distortion.
+ *
+ * @note Only the channel widths and modes are written; call
+ *       InverterInterface::SyncModes afterwards.
+ */
+class ModulatorSpaceVector {
+ public:
+  /**
+   * @brief Creates a modulator for an inverter.
+   *
+   * @param inverter Power stage output interface.
+   */
+  ModulatorSpaceVector(InverterInterface *inverter);
+
+  /**
+   * @brief Gets the largest voltage magnitude that can be put out undistorted.
+   *
+   * @return Period of the inverter divided by sqrt(3), in PWM counts.
+   */
+  Width16 GetMaxMagnitude();
+
+  /**
+   * @brief Writes a voltage vector given in polar form.
+   *
+   * @note Decodes the 60 degree sector of the angle with a multiply, then
+   *       times the two adjacent active vectors of that sector, without
+   *       computing each phase voltage.
+   *
+   * @param angle Direction of the voltage vector.
+   * @param magnitude Length of the voltage vector, which is limited to
+   *                  @c GetMaxMagnitude.
+   */
+  void Write(Angle16 angle, Width16 magnitude);
+
+  /**
+   * @brief Writes a voltage vector given in the alpha (along phase A) and
+   *        beta (90 degrees ahead) axes.
+   *
+   * @note Computes each phase voltage and offsets them by the average of the
+   *       highest and lowest (min-max injection), which is equivalent to
+   *       SVPWM. Vectors longer than @c GetMaxMagnitude are clipped per
+   *       channel.
+   *
+   * @param alpha Alpha axis voltage.
+   * @param beta Beta axis voltage.
+   */
+  void WriteAlphaBeta(int32_t alpha, int32_t beta);
+
+ protected:
+  InverterInterface * const inverter_;
+};
+
+#endif  /* MOTOR_MODULATOR_SPACE_VECTOR_H_ */
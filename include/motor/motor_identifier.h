@@ -0,0 +1,279 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares MotorIdentifier, which measures the electrical parameters of
+ *       the motor and recommends current loop gains for it.
+ */
+
+#ifndef MOTOR_MOTOR_IDENTIFIER_H_
+#define MOTOR_MOTOR_IDENTIFIER_H_
+
+#include <cstdint>
+
+#include "ch.h"
+
+#include "motor/common.h"
+#include "motor/inverter_interface.h"
+
+class RotorInterface;
+class CurrentSensorInterface;
+class BusVoltageSensorInterface;
+
+/**
+ * @brief Self-commissioning sequence that drives the inverter with test
+ *        voltages and measures the phase currents to find the phase
+ *        resistance, inductance, and flux linkage.
+ *
+ * @note The sequence runs in steps of one PWM period:
+ *         1) Resistance: the amplitude of a DC vector into phase A (and out of
+ *            B and C) is ramped up until the current reaches half of
+ *            @c MOTOR_IDENTIFY_CURRENT, then all of it, holding each level to
+ *            settle and average, and holding it again at a rescaled amplitude
+ *            if the current overshot the ramp. This also aligns the rotor.
+ *            The resistance is the change in voltage over the change in
+ *            current, which cancels the fixed voltage error of deadtime and
+ *            current sense offsets. Phase A carries the current and B and C
+ *            half of it each, so the resistance seen is 1.5 times the phase
+ *            resistance.
+ *         2) Inductance: the amplitude is switched between the two levels,
+ *            and the current decays exponentially towards each, with the time
+ *            constant of the phase inductance over its resistance. The ratio of
+ *            the summed deviations of consecutive samples, taken over many
+ *            steps, is the decay per period, which doesn't depend on when the
+ *            first sample falls after a step. Steps that end before the
+ *            current has settled are doubled in length, up to
+ *            @c kMaxStepPeriods.
+ *         3) Flux linkage: the rotor is spun by six-step commutation on the
+ *            rotor angle, at @c MOTOR_IDENTIFY_SPIN_AMPLITUDE. Once it has
+ *            settled, the voltage across the driven phases, less the resistive
+ *            drop, is the line to line back EMF averaged over each step, which
+ *            is 3 * sqrt(3) / pi of the peak phase back EMF, at the rotor
+ *            velocity.
+ *
+ * @note The FOC current loop gains are then recommended for a loop bandwidth
+ *       of @c MOTOR_IDENTIFY_BANDWIDTH, in the units of @c FOC_CURRENT_KP and
+ *       @c FOC_CURRENT_KI.
+ *
+ * @note Updates must run once per PWM period, so @c SignalPeriod should be
+ *       called from the PWM update interrupt while identifying. The inverter
+ *       must not be written by anything else meanwhile.
+ */
+class MotorIdentifier {
+ public:
+  /**
+   * @brief Identified parameters, in the units of the corresponding options
+   *        in config.h.
+   */
+  struct Parameters {
+    int32_t resistance;    ///< Phase resistance, in milliohms.
+    int32_t inductance;    ///< Phase inductance, in nH.
+    int32_t flux_linkage;  ///< Peak phase back EMF per rad/s, in nWb.
+    int32_t current_kp;    ///< Recommended @c FOC_CURRENT_KP.
+    int32_t current_ki;    ///< Recommended @c FOC_CURRENT_KI.
+  };
+
+  /**
+   * @brief Creates an idle identifier.
+   *
+   * @param rotor Rotor angle and velocity source, for spinning the rotor.
+   * @param inverter Power stage output interface.
+   * @param current_sensor Phase current source.
+   */
+  MotorIdentifier(RotorInterface *rotor,
+                  InverterInterface *inverter,
+                  CurrentSensorInterface *current_sensor);
+
+  /**
+   * @brief Sets the bus voltage measurement that the test voltages are
+   *        computed from.
+   *
+   * @note Read once per update, so it must not block. Without one, the bus is
+   *       taken to be at @c MOTOR_BUS_VOLTAGE.
+   *
+   * @param bus_voltage_sensor Bus voltage source, or nullptr for none.
+   */
+  void SetBusVoltageSensor(BusVoltageSensorInterface *bus_voltage_sensor) {
+    bus_voltage_sensor_ = bus_voltage_sensor;
+  }
+
+  /**
+   * @brief Starts the sequence from the beginning, at the next update.
+   */
+  void Start();
+
+  /**
+   * @brief Runs one PWM period of the sequence: reads the currents, and writes
+   *        the inverter outputs for the next period.
+   *
+   * @note Called by @c Run for each period; may also be called directly to
+   *       run a single period (e.g. on the build host). Must be called from a
+   *       thread, not holding a ChibiOS lock.
+   */
+  void Update();
+
+  /**
+   * @brief Checks if the sequence has finished, successfully or not.
+   *
+   * @return True unless started and still running.
+   */
+  bool IsDone() const {
+    return state_ == kIdle || state_ == kDone || state_ == kFailed;
+  }
+
+  /**
+   * @brief Retrieves the parameters identified by the last sequence.
+   *
+   * @param parameters Output for the parameters (if identified).
+   * @return True if the last sequence finished successfully.
+   */
+  bool GetParameters(Parameters *parameters) const;
+
+  /**
+   * @brief Runs the whole sequence in the calling thread, one update per
+   *        @c SignalPeriod.
+   *
+   * @note Takes a few seconds, and leaves the inverter floating.
+   *
+   * @param parameters Output for the parameters (if identified).
+   * @return True if the motor was identified.
+   */
+  bool Run(Parameters *parameters);
+
+  /**
+   * @brief Wakes @c Run for a new PWM period.
+   *
+   * @note Can be passed to InverterPWM::SetUpdateCallback; runs in interrupt
+   *       context, and does nothing unless @c Run is running.
+   *
+   * @param motor_identifier Pointer to an instance of this class.
+   */
+  static void SignalPeriod(void *motor_identifier);
+
+ protected:
+  enum State {
+    kIdle,
+    kRampLow,   ///< Ramping up to the low current.
+    kHoldLow,   ///< Settling and averaging the low current.
+    kRampHigh,  ///< Ramping up to the high current.
+    kHoldHigh,  ///< Settling and averaging the high current.
+    kStep,      ///< Stepping between the two currents.
+    kSpin,      ///< Spinning the rotor by six-step commutation.
+    kDone,
+    kFailed
+  };
+
+  /// Bins that the response to each step is summed in.
+  static constexpr int kDecayBins = 64;
+  /// Longest step between the current levels, in PWM periods.
+  static constexpr uint32_t kMaxStepPeriods = kDecayBins * 16;
+
+  /**
+   * @brief Moves to a new state, restarting the period count.
+   *
+   * @param state State to enter.
+   */
+  void Enter(State state);
+
+  /**
+   * @brief Floats the inverter and ends the sequence.
+   *
+   * @param state @c kDone or @c kFailed.
+   * @param message Reason to log on failure, or nullptr.
+   */
+  void Finish(State state, const char *message);
+
+  /**
+   * @brief Writes a DC vector into phase A and out of phases B and C.
+   *
+   * @param amplitude Amplitude of phase A above and of B and C below half of
+   *                  the period.
+   */
+  void WriteAligned(int32_t amplitude);
+
+  /**
+   * @brief Writes the six-step outputs for a rotor angle.
+   *
+   * @param rotor_angle Rotor angle.
+   * @param amplitude Semi-amplitude of the driven phases.
+   */
+  void WriteSixStep(Angle16 rotor_angle, int32_t amplitude);
+
+  /**
+   * @brief Finds how many bins of the step response to fit the decay over.
+   *
+   * @return Last bin to fit, or zero if the response hasn't settled within
+   *         the step.
+   */
+  int FindDecayEnd() const;
+
+  /**
+   * @brief Computes the resistance and inductance from the measurements.
+   *
+   * @param end Last bin of the step response to fit, from @c FindDecayEnd.
+   * @return True if the measurements were consistent.
+   */
+  bool ComputeImpedance(int end);
+
+  /**
+   * @brief Computes the flux linkage and current loop gains from the
+   *        measurements.
+   *
+   * @return True if the measurements were consistent.
+   */
+  bool ComputeFluxLinkage();
+
+  /**
+   * @brief Gets the bus voltage to compute test voltages from.
+   *
+   * @return Bus voltage, in millivolts.
+   */
+  int32_t GetBusVoltage();
+
+  RotorInterface * const rotor_;
+  InverterInterface * const inverter_;
+  CurrentSensorInterface * const current_sensor_;
+  BusVoltageSensorInterface *bus_voltage_sensor_;
+
+  volatile State state_;  ///< Step of the sequence.
+  uint32_t count_;  ///< Periods since entering the state.
+  uint32_t holds_;  ///< Times the current level was held since the ramp.
+  int32_t amplitude_;  ///< Amplitude being written.
+  int32_t amplitude_low_;  ///< Amplitude for the low current.
+  int32_t amplitude_high_;  ///< Amplitude for the high current.
+  int64_t current_sum_;  ///< Sum of the current being averaged.
+  int64_t velocity_sum_;  ///< Sum of the velocity being averaged.
+  int32_t current_low_;  ///< Averaged low current, in mA.
+  int32_t current_high_;  ///< Averaged high current, in mA.
+  uint32_t step_periods_;  ///< Periods per step between the currents.
+  int64_t decay_[kDecayBins];  ///< Deviations after steps, in mA.
+  int64_t resistance_;  ///< Identified resistance, in micro-ohms.
+  Parameters parameters_;  ///< Results of the last successful sequence.
+  bool running_;  ///< True while @c Run waits for periods.
+  Semaphore semaphore_;  ///< Signaled for each PWM period.
+};
+
+#endif  /* MOTOR_MOTOR_IDENTIFIER_H_ */
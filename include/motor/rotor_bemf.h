@@ -0,0 +1,221 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares RotorBemf, a sensorless rotor angle driver that detects back
+ *       EMF zero crossings on the floating phase.
+ */
+
+#ifndef MOTOR_ROTOR_BEMF_H_
+#define MOTOR_ROTOR_BEMF_H_
+
+#include "ch.h"
+#include "hal.h"
+
+#include "motor/rotor_interface.h"
+
+class CommutatorInterface;
+class VoltageSensorInterface;
+
+/**
+ * @brief Back EMF zero crossing rotor angle driver, for sensorless six-step
+ *        commutation.
+ *
+ * @note The phase voltages are sampled once per PWM period, through
+ *       @c SignalPeriod. In each six-step sector one phase floats, and its
+ *       back EMF (its voltage less the average of the two driven phases)
+ *       crosses zero at the center of the sector. The crossing is interpolated
+ *       between samples, and the commutation to the next sector is scheduled
+ *       on a one-shot timer 30 degrees later, using the time between the last
+ *       two crossings as the time taken for 60 degrees.
+ *
+ * @note Until locked, the inverter is expected to be disabled, so that the back
+ *       EMF shows on all three phases. Two crossings in adjacent sectors give
+ *       the angle, direction, and speed to lock on. Lock is lost if a crossing
+ *       does not come within two sector times of the last commutation.
+ */
+class RotorBemf: public RotorInterface {
+ public:
+  /**
+   * @brief Creates an unlocked sensorless rotor driver.
+   *
+   * @param voltage_sensor Phase voltage source. Must be safe to read from an
+   *                       ISR.
+   * @param gpt_driver Timer that schedules the commutations.
+   */
+  RotorBemf(VoltageSensorInterface *voltage_sensor, GPTDriver *gpt_driver);
+
+  /**
+   * @brief Starts the commutation timer.
+   */
+  void Start();
+
+  /**
+   * @brief Retrieves the center angle of the commutation sector.
+   *
+   * @param angle Output; center of the sector that the rotor is in.
+   * @return True if locked on the back EMF and the angle was written to
+   *         @p angle.
+   */
+  bool ComputeAngle(Angle16 *angle);
+
+  /**
+   * @brief Computes the rotor velocity from the time between zero crossings.
+   *
+   * @param velocity Output; velocity of rotor.
+   * @return True if locked on the back EMF and the velocity was written to
+   *         @p velocity.
+   */
+  bool ComputeVelocity(Velocity32 *velocity);
+
+  /**
+   * @brief Connects a commutator to be signaled on each commutation and on
+   *        gaining or losing lock.
+   *
+   * @param commutator Motor driving sequencer.
+   */
+  void SetCommutator(CommutatorInterface *commutator) {
+    commutator_ = commutator;
+  }
+
+  /**
+   * @brief Samples the phase voltages for a new PWM period.
+   *
+   * @note Can be passed to InverterPWM::SetUpdateCallback; runs in interrupt
+   *       context.
+   *
+   * @param rotor_bemf Pointer to the RotorBemf to sample.
+   */
+  static void SignalPeriod(void *rotor_bemf);
+
+ protected:
+  /**
+   * @brief Zero crossing detection states.
+   */
+  enum State {
+    kUnlocked,          ///< Searching all phases for crossings.
+    kBlanking,          ///< Ignoring samples after a commutation.
+    kWaitCrossing,      ///< Watching the floating phase for its crossing.
+    kWaitCommutation,   ///< Waiting for the timer to commutate.
+  };
+
+  static const GPTConfig kGptConfig;  ///< Commutation timer configuration.
+
+  /**
+   * @brief Phase that floats in each sector.
+   */
+  static const uint8_t kFloatingPhases[6];
+
+  /**
+   * @brief Sector centered on each phase's falling (index 0) and rising
+   *        (index 1) back EMF zero crossing.
+   */
+  static const uint8_t kCrossingSectors[3][2];
+
+  /**
+   * @brief Handles a new sample of the phase voltages.
+   *
+   * @note Must be called from an ISR.
+   */
+  void HandleSample();
+
+  /**
+   * @brief Looks for crossings on all phases while unlocked.
+   *
+   * @note Must be called from a locked state.
+   */
+  void DetectUnlockedI(const Voltage16 voltages[]);
+
+  /**
+   * @brief Looks for the crossing of the floating phase.
+   *
+   * @note Must be called from a locked state.
+   */
+  void DetectLockedI(const Voltage16 voltages[]);
+
+  /**
+   * @brief Updates the sector time from a crossing and schedules the next
+   *        commutation.
+   *
+   * @note Must be called from a locked state.
+   *
+   * @param time Time of the crossing in timer counts.
+   */
+  void HandleCrossingI(uint32_t time);
+
+  /**
+   * @brief Starts the timer to commutate at @c commutation_time_.
+   *
+   * @note Must be called from a locked state.
+   */
+  void ScheduleCommutationI();
+
+  /**
+   * @brief Advances to the next sector when the timer expires.
+   *
+   * @note Must be called from an ISR.
+   */
+  void HandleCommutation();
+
+  /**
+   * @brief Drops lock on the back EMF.
+   *
+   * @note Must be called from a locked state.
+   */
+  void UnlockI();
+
+  /**
+   * @brief Signals the commutator, if any, that the angle has changed.
+   *
+   * @note Must be called from a locked state.
+   */
+  void SignalCommutatorI();
+
+  /**
+   * @brief Redirects timer expiry to the RotorBemf that started it.
+   */
+  static void GptCallback(GPTDriver *gpt_driver);
+
+  VoltageSensorInterface * const voltage_sensor_;  ///< Phase voltage source.
+  GPTDriver * const gpt_driver_;  ///< Commutation timer.
+  CommutatorInterface *commutator_;  ///< Commutation signal sink.
+
+  State state_;  ///< Zero crossing detection state.
+  uint32_t time_;  ///< Time of the last sample, in timer counts.
+  int sector_;  ///< Sector being commutated, from 0 to 5.
+  int direction_;  ///< Direction of rotation once locked.
+  uint32_t sector_time_;  ///< Filtered timer counts per 60 degrees.
+  uint32_t crossing_time_;  ///< Time of the last crossing.
+  uint32_t commutation_time_;  ///< Time of the last or next commutation.
+  int32_t last_back_emf_;  ///< Last floating phase sample, toward crossing.
+  bool armed_;  ///< True if the floating phase was seen before its crossing.
+  int32_t back_emf_slope_;  ///< Back EMF change per sample at last crossing.
+  int8_t polarities_[3];  ///< Back EMF polarity of each phase while unlocked.
+  int candidate_sector_;  ///< Sector of the last crossing while unlocked.
+  uint32_t candidate_time_;  ///< Time of the last crossing while unlocked.
+};
+
+#endif  /* MOTOR_ROTOR_BEMF_H_ */
@@ -0,0 +1,126 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares RotorFlux, a sensorless rotor angle observer that estimates
+ *       the rotor flux from the phase currents and voltages.
+ */
+
+#ifndef MOTOR_ROTOR_FLUX_H_
+#define MOTOR_ROTOR_FLUX_H_
+
+#include <cstdint>
+
+#include "motor/common.h"
+#include "motor/inverter_interface.h"
+#include "motor/rotor_interface.h"
+
+/**
+ * @brief Estimates the rotor angle of a sinusoidal motor with a nonlinear flux
+ *        observer, and the speed with a phase-locked loop on that angle.
+ *
+ * @note In the stator (alpha, beta) frame, the stator flux is the integral of
+ *       the phase voltage less the resistive drop, and the rotor flux is the
+ *       stator flux less the inductance times the current. The rotor flux
+ *       points along the rotor's d axis, so its angle is the rotor angle. Pure
+ *       integration drifts with any error in the voltage or resistance, so the
+ *       integrator is pulled towards the circle of radius
+ *       @c MOTOR_FLUX_LINKAGE, which the rotor flux must lie on (Ortega et al.,
+ *       2010). The pull is proportional to how far the estimate is from the
+ *       circle, at a rate of @c ROTOR_FLUX_GAIN.
+ *
+ * @note The back EMF, and with it the angle, is unobservable at standstill, and
+ *       poorly observed at low speed where the resistive drop dominates. Below
+ *       @c ROTOR_FLUX_MIN_SPEED, or until the flux estimate has settled on the
+ *       flux linkage and the loop has tracked it for a while, the estimates
+ *       are taken from a fallback rotor, if given.
+ *
+ * @note All of the arithmetic is integer, with fluxes in nanowebers, voltages
+ *       in millivolts, and currents in milliamperes. The update has no
+ *       division, and computes the angle with CORDIC, so that it fits in the
+ *       PWM period along with the current loops.
+ */
+class RotorFlux: public RotorInterface {
+ public:
+  /**
+   * @brief Creates an observer that has not yet locked on.
+   *
+   * @param fallback Rotor whose estimates are used while not locked, e.g. for
+   *                 starting, or nullptr to report none.
+   */
+  explicit RotorFlux(RotorInterface *fallback);
+
+  /**
+   * @brief Retrieves the rotor angle as of the last update.
+   *
+   * @param angle Output; estimated rotor angle.
+   * @return True if the angle is valid and was written to @p angle.
+   */
+  bool ComputeAngle(Angle16 *angle);
+
+  /**
+   * @brief Retrieves the rotor velocity from the phase-locked loop.
+   *
+   * @param velocity Output; estimated rotor velocity.
+   * @return True if the velocity is valid and was written to @p velocity.
+   */
+  bool ComputeVelocity(Velocity32 *velocity);
+
+  /**
+   * @brief Advances the observer by one PWM period.
+   *
+   * @note Called from the commutator once per PWM period, and must not be
+   *       called holding a ChibiOS lock.
+   *
+   * @param currents Phase currents sampled at the end of the period.
+   * @param voltage_alpha Alpha axis phase voltage put out over the period, in
+   *                      millivolts.
+   * @param voltage_beta Beta axis phase voltage put out over the period, in
+   *                     millivolts.
+   */
+  void Update(const Current16 currents[InverterInterface::kNumChannels],
+              int32_t voltage_alpha,
+              int32_t voltage_beta);
+
+  /**
+   * @brief Drops lock and clears the flux estimate, e.g. when the voltage put
+   *        out is not known because the inverter is disabled.
+   */
+  void Reset();
+
+ protected:
+  RotorInterface * const fallback_;  ///< Estimates used while not locked.
+
+  int32_t flux_alpha_;  ///< Stator flux estimate, alpha axis, in nWb.
+  int32_t flux_beta_;  ///< Stator flux estimate, beta axis, in nWb.
+  Angle16 angle_;  ///< Angle of the rotor flux estimate.
+  uint32_t pll_angle_;  ///< Q16.16 angle tracked by the phase-locked loop.
+  Velocity32 velocity_;  ///< Velocity tracked by the phase-locked loop.
+  uint32_t lock_count_;  ///< Consecutive updates that the estimate settled.
+  bool locked_;  ///< True if the estimates track the rotor.
+};
+
+#endif  /* MOTOR_ROTOR_FLUX_H_ */
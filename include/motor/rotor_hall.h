@@ -30,9 +30,11 @@
 #include "ch.h"
 #include "hal.h"
 
+#include "base/utility.h"
 #include "motor/rotor_interface.h"
 
-class CommutatorSixStep;
+class CommutatorInterface;
+class RotorPll;
 
 /**
  * @brief Hall sensor rotor angle sensor driver.
@@ -58,7 +60,16 @@ class RotorHall: public RotorInterface {
   void Start();
 
   /**
-   * @brief Computes the current rotor angle based on its hall state.
+   * @brief Computes the current rotor angle based on its hall state, and
+   *        interpolates it within the hall sector if the rotor is turning.
+   *
+   * @note The angle is the center of the hall sector if the direction of
+   *       rotation is unknown or the timer has overflowed since the last edge.
+   *       Otherwise, it advances from the edge that started the sector at the
+   *       rate measured across the previous sector, and stops just short of
+   *       the next sector.
+   *
+   * @note Must be called from a thread that is not holding a ChibiOS lock.
    *
    * @param angle Output; angle from hall state.
    * @return True if hall state is valid and the corresponding rotor angle was
@@ -76,10 +87,38 @@ class RotorHall: public RotorInterface {
    */
   bool ComputeVelocity(Velocity32 *velocity);
 
-  void SetCommutatorSixStep(CommutatorSixStep *commutator_six_step) {
-    commutator_six_step_ = commutator_six_step;
+  /**
+   * @brief Connects a commutator to be signaled on each hall transition.
+   *
+   * @param commutator Motor driving sequencer.
+   */
+  void SetCommutator(CommutatorInterface *commutator) {
+    commutator_ = commutator;
   }
 
+  /**
+   * @brief Connects an observer to be updated on each hall transition, from
+   *        the hall thread.
+   *
+   * @param observer Angle and speed tracking observer.
+   */
+  void SetObserver(RotorPll *observer) {
+    observer_ = observer;
+  }
+
+  /**
+   * @brief Reads the time since the last hall transition.
+   *
+   * @note Must be called under a ChibiOS lock.
+   *
+   * @param counts Output; ICU timer counts since the last transition, or the
+   *               largest count if a transition has been captured but not yet
+   *               handled.
+   * @return True if the timer has not overflowed since the last transition,
+   *         and the count was written to @p counts.
+   */
+  bool GetCountsSinceEdgeS(icucnt_t *counts);
+
  protected:
   /**
    * @brief Possible hall states based on a 3-bit field of [HALL_A..HALL_C].
@@ -144,7 +183,14 @@ class RotorHall: public RotorInterface {
   /**
    * @brief Computes and updates observed state using information passed by ISR.
    */
-  void ThreadHall();
+  NORETURN void ThreadHall();
+
+  /**
+   * @brief Updates direction and velocity from the latest hall transition.
+   *
+   * @note Called by @c ThreadHall each time it is woken by @c HandleEdge.
+   */
+  void UpdateState();
 
   /**
    * @brief Invokes @c ThreadHall; used as a thread function.
@@ -152,7 +198,7 @@ class RotorHall: public RotorInterface {
    * @param rotor_hall Pointer to an instance of this class.
    * @return Should never return.
    */
-  static msg_t ThreadHallWrapper(void *rotor_hall);
+  NORETURN static msg_t ThreadHallWrapper(void *rotor_hall);
 
   /**
    * @brief Checks if a hall state is valid.
@@ -170,13 +216,15 @@ class RotorHall: public RotorInterface {
    * @brief Compute angular speed from the timer counts elapsed between hall
    *        state transitions.
    *
-   * @param counts_elapsed Timer counts taken to rotate 60 degrees.
-   * @return Angular speed in floating point format. Always positive.
+   * @note Uses only 32-bit integer division, which the Cortex-M4 does in
+   *       hardware, unless the count exceeds 16 bits.
+   *
+   * @param counts_elapsed Timer counts taken to rotate 60 degrees. Must not be
+   *                       zero.
+   * @return Angular speed in fixed-point format. Always positive; saturated to
+   *         the largest Velocity32.
    */
-  static Velocity32 ComputeSpeed(icucnt_t counts_elapsed) {
-    return Velocity32(kHallIcuConfig.frequency / 6) * Velocity32(1 << 16) /
-           counts_elapsed;
-  }
+  static Velocity32 ComputeSpeed(icucnt_t counts_elapsed);
 
   /**
    * @brief Reads the ICU capture value and passes it to the edge handler.
@@ -202,7 +250,8 @@ class RotorHall: public RotorInterface {
   ICUDriver * const icu_driver_;  ///< Points to OS capture driver.
   Semaphore semaphore_update_;  ///< Synchronizes update thread to ISR.
   Thread * const thread_hall_;  ///< Points to state update thread.
-  CommutatorSixStep *commutator_six_step_;  ///< Hall transitions signal sink.
+  CommutatorInterface *commutator_;  ///< Hall transitions signal sink.
+  RotorPll *observer_;  ///< Hall transitions timing sink.
 
   bool timer_overflowed_;  ///< True if timer overflowed since last edge.
   HallState hall_state_;  ///< Current hall state bitfield.
@@ -0,0 +1,122 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares RotorPll, a phase-locked loop rotor angle and speed observer
+ *       fed by hall sensor transitions.
+ */
+
+#ifndef MOTOR_ROTOR_PLL_H_
+#define MOTOR_ROTOR_PLL_H_
+
+#include "hal.h"
+
+#include "motor/rotor_interface.h"
+
+class RotorHall;
+
+/**
+ * @brief Tracks the rotor angle and speed with a type 2 phase-locked loop,
+ *        corrected at each hall transition.
+ *
+ * @note Between transitions, the angle advances at the estimated speed. At each
+ *       transition, the phase error is the difference between the estimate at
+ *       the time of the edge and the angle of the sector boundary that was
+ *       crossed, and it corrects both the angle and the speed. The loop is
+ *       critically damped with a natural frequency of @c ROTOR_PLL_BANDWIDTH,
+ *       but the gains are limited so that no correction overshoots, which
+ *       lowers the effective bandwidth when edges are far apart.
+ *
+ * @note If the loop is not locked, because the rotor has stopped or a hall
+ *       transition was invalid, estimates are taken from the hall sensor
+ *       driver until the next valid transition.
+ */
+class RotorPll: public RotorInterface {
+ public:
+  /**
+   * @brief Creates an unlocked observer.
+   *
+   * @param rotor_hall Hall sensor driver whose timer and fallback estimates
+   *                   are used. Must have this set as its observer.
+   */
+  explicit RotorPll(RotorHall *rotor_hall);
+
+  /**
+   * @brief Computes the rotor angle at this instant.
+   *
+   * @note Must be called from a thread that is not holding a ChibiOS lock.
+   *
+   * @param angle Output; estimated rotor angle.
+   * @return True if the angle is valid and was written to @p angle.
+   */
+  bool ComputeAngle(Angle16 *angle);
+
+  /**
+   * @brief Retrieves the estimated rotor velocity.
+   *
+   * @param velocity Output; estimated rotor velocity.
+   * @return True if the velocity is valid and was written to @p velocity.
+   */
+  bool ComputeVelocity(Velocity32 *velocity);
+
+  /**
+   * @brief Corrects the loop at a hall transition.
+   *
+   * @note Called from the hall thread, after the edge ISR, and must not be
+   *       called holding a ChibiOS lock.
+   *
+   * @param sector_center Angle at the center of the new hall sector.
+   * @param direction Direction of rotation, or 0 if the transition was not
+   *                  between adjacent hall sectors.
+   * @param counts_elapsed ICU timer counts between the last two transitions.
+   * @param velocity Velocity measured across the last sector.
+   */
+  void HandleEdge(Angle16 sector_center,
+                  int direction,
+                  icucnt_t counts_elapsed,
+                  Velocity32 velocity);
+
+ protected:
+  /**
+   * @brief Computes the angle advanced in a number of ICU timer counts at a
+   *        velocity.
+   *
+   * @param velocity Angular velocity.
+   * @param counts Time in ICU timer counts.
+   * @return Angle advanced, in Q16.16 fixed-point units of @c Angle16.
+   */
+  static int64_t ComputeAdvance(Velocity32 velocity, icucnt_t counts);
+
+  RotorHall * const rotor_hall_;  ///< Timing source and fallback estimates.
+
+  bool locked_;  ///< True if the estimates track the rotor.
+  uint32_t angle_;  ///< Q16.16 angle estimate at the last transition.
+  Velocity32 velocity_;  ///< Velocity estimate.
+  Angle16 edge_angle_;  ///< Sector boundary crossed at the last transition.
+  int direction_;  ///< Direction of rotation at the last transition.
+};
+
+#endif  /* MOTOR_ROTOR_PLL_H_ */
@@ -0,0 +1,156 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares SpeedGovernor, which regulates the rotor speed to a command
+ *       by setting the commutator amplitude.
+ */
+
+#ifndef MOTOR_SPEED_GOVERNOR_H_
+#define MOTOR_SPEED_GOVERNOR_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "motor/commutator_interface.h"
+
+class RotorInterface;
+
+/**
+ * @brief Closed-loop speed control, which takes speed commands in place of
+ *        amplitude and drives the commutator with the amplitude that holds
+ *        the rotor at that speed.
+ *
+ * @note Sits between the command source (e.g. ServoInput) and the commutator.
+ *       A commanded amplitude is taken as a fraction of
+ *       @c SPEED_GOVERNOR_MAX_SPEED. A PI loop on the error from the rotor
+ *       velocity runs at @c SPEED_GOVERNOR_FREQ, woken by a continuous timer
+ *       so that its gains don't depend on the rate of the rotor updates (e.g.
+ *       hall edges). The update runs in its own thread, as the rotor estimates
+ *       can't be computed from an ISR.
+ *
+ * @note The amplitude is kept in the direction of the commanded speed, so that
+ *       an overspeeding motor coasts down rather than being driven backwards,
+ *       and the integral is clamped to the same range so that it does not wind
+ *       up while the output saturates. A zero command puts out zero amplitude
+ *       (braking in six-step) and clears the integral.
+ */
+class SpeedGovernor: public CommutatorInterface {
+ public:
+  /**
+   * @brief Creates a governor with a zero speed command.
+   *
+   * @param rotor Rotor velocity source.
+   * @param gpt_driver Timer that paces the updates.
+   * @param wa_update Working area for the update thread.
+   * @param wa_size Size of @p wa_update.
+   */
+  SpeedGovernor(RotorInterface *rotor,
+                GPTDriver *gpt_driver,
+                void *wa_update,
+                size_t wa_size);
+
+  /**
+   * @brief Connects the commutator that is driven.
+   *
+   * @param commutator Motor driving sequencer.
+   */
+  void SetCommutator(CommutatorInterface *commutator) {
+    commutator_ = commutator;
+  }
+
+  /**
+   * @brief Starts the update timer.
+   */
+  void Start();
+
+  /**
+   * @brief Runs the commutator's loop in the calling thread.
+   */
+  NORETURN void CommutationLoop();
+
+  void SignalChange();
+
+  /**
+   * @brief Writes the speed command.
+   *
+   * @param semi_amplitude Signed speed command, as a fraction of
+   *                       @c GetMaxAmplitude of @c SPEED_GOVERNOR_MAX_SPEED.
+   */
+  void WriteAmplitude(Width16Diff semi_amplitude);
+
+  Width16Diff GetMaxAmplitude();
+
+  void SetEnable(bool enable);
+
+  /**
+   * @brief Runs one step of the speed loop and writes the commutator
+   *        amplitude.
+   *
+   * @note Called by the update thread each time the timer expires; may also be
+   *       called directly to run a single step (e.g. on the build host). Must
+   *       not be called holding a ChibiOS lock.
+   */
+  void Update();
+
+ protected:
+  static const GPTConfig kGptConfig;  ///< Update timer configuration.
+
+  /**
+   * @brief Runs @c Update each time it is woken by the timer.
+   */
+  NORETURN void ThreadUpdate();
+
+  /**
+   * @brief Invokes @c ThreadUpdate; used as a thread function.
+   *
+   * @param speed_governor Pointer to an instance of this class.
+   * @return Should never return.
+   */
+  NORETURN static msg_t ThreadUpdateWrapper(void *speed_governor);
+
+  /**
+   * @brief Wakes the update thread.
+   *
+   * @param gpt_driver Timer whose @c self points to the SpeedGovernor.
+   */
+  static void GptCallback(GPTDriver *gpt_driver);
+
+  RotorInterface * const rotor_;  ///< Velocity source.
+  GPTDriver * const gpt_driver_;  ///< Update timer.
+  Semaphore semaphore_update_;  ///< Signaled by the timer for each update.
+  Thread * const thread_update_;  ///< Points to speed loop thread.
+  CommutatorInterface *commutator_;  ///< Commutator driven.
+
+  Width16Diff command_;  ///< Commanded speed, as an amplitude.
+  bool enable_;  ///< Commanded drive enable flag.
+  int32_t integral_;  ///< Integral term of the loop, in Q16 amplitude.
+};
+
+#endif  /* MOTOR_SPEED_GOVERNOR_H_ */
@@ -0,0 +1,196 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares StartupSequencer, which starts the motor open-loop and hands
+ *       over to a closed-loop rotor estimate once it has locked on.
+ */
+
+#ifndef MOTOR_STARTUP_SEQUENCER_H_
+#define MOTOR_STARTUP_SEQUENCER_H_
+
+#include <cstdint>
+
+#include "ch.h"
+
+#include "motor/commutator_interface.h"
+#include "motor/rotor_interface.h"
+
+/**
+ * @brief Starts the motor from standstill with an aligned then rotating open-
+ *        loop field, and otherwise passes the rotor estimate and commands
+ *        through.
+ *
+ * @note Sits between the command source (e.g. ServoInput) and the commutator,
+ *       and is the commutator's rotor. When driving is enabled with a non-zero
+ *       amplitude while the closed-loop rotor has no estimate (e.g. a
+ *       sensorless rotor at standstill, or an invalid hall state), it reports
+ *       a fixed angle for @c STARTUP_ALIGN_TIME, so that the rotor is pulled
+ *       into line with the field, then an angle that accelerates at
+ *       @c STARTUP_ACCELERATION in the commanded direction, which the rotor
+ *       follows with some lag. Meanwhile the commutator is driven at an
+ *       amplitude for @c STARTUP_CURRENT instead of the commanded one.
+ *
+ * @note Once the field is turning faster than @c STARTUP_HANDOVER_SPEED, and
+ *       the closed-loop rotor has reported a velocity within a quarter of the
+ *       open-loop one for @c STARTUP_HANDOVER_TIME, the commutator gets its
+ *       estimates and the commanded amplitude. If that doesn't happen within
+ *       @c STARTUP_HOLD_TIME of reaching @c STARTUP_MAX_SPEED, the rotor is
+ *       assumed to have stalled and the sequence starts over. If the closed-
+ *       loop rotor loses lock while running, the motor coasts for
+ *       @c STARTUP_ALIGN_TIME to give it the chance to lock on again before
+ *       starting over.
+ *
+ * @note Time is kept in PWM periods, counted by @c SignalPeriod, and the
+ *       sequence advances when the commutator computes the angle. The
+ *       commutator is signaled each period while the sequence is timed.
+ */
+class StartupSequencer: public CommutatorInterface, public RotorInterface {
+ public:
+  /**
+   * @brief Creates a stopped sequencer.
+   *
+   * @param rotor Closed-loop rotor estimate.
+   * @param regulates_current True if the commutator's amplitude commands
+   *                          current (e.g. CommutatorFoc with a current
+   *                          sensor) rather than voltage.
+   */
+  StartupSequencer(RotorInterface *rotor, bool regulates_current);
+
+  /**
+   * @brief Connects the commutator that is driven, which must take this as its
+   *        rotor.
+   *
+   * @param commutator Motor driving sequencer.
+   */
+  void SetCommutator(CommutatorInterface *commutator) {
+    commutator_ = commutator;
+  }
+
+  /**
+   * @brief Runs the commutator's loop in the calling thread.
+   */
+  NORETURN void CommutationLoop();
+
+  void SignalChange();
+
+  /**
+   * @brief Writes the commanded amplitude, which is passed on to the
+   *        commutator unless the motor is being started.
+   *
+   * @param semi_amplitude Signed amplitude, whose sign also sets the direction
+   *                       to start in.
+   */
+  void WriteAmplitude(Width16Diff semi_amplitude);
+
+  Width16Diff GetMaxAmplitude();
+
+  void SetEnable(bool enable);
+
+  /**
+   * @brief Advances the startup sequence and retrieves the angle for the
+   *        commutator.
+   *
+   * @note Must be called from the commutator's thread, not holding a ChibiOS
+   *       lock.
+   *
+   * @param angle Output; open-loop angle while starting, or else the closed-
+   *              loop rotor angle.
+   * @return True if the angle is valid and was written to @p angle.
+   */
+  bool ComputeAngle(Angle16 *angle);
+
+  /**
+   * @brief Retrieves the open-loop velocity while starting, or else the closed-
+   *        loop rotor velocity.
+   *
+   * @param velocity Output; rotor velocity.
+   * @return True if the velocity is valid and was written to @p velocity.
+   */
+  bool ComputeVelocity(Velocity32 *velocity);
+
+  /**
+   * @brief Checks whether the motor is being started.
+   *
+   * @return True if aligning, ramping, or coasting to pick up the rotor again.
+   */
+  bool IsStarting();
+
+  /**
+   * @brief Counts a PWM period.
+   *
+   * @note Can be passed to InverterPWM::SetUpdateCallback; runs in interrupt
+   *       context.
+   *
+   * @param startup_sequencer Pointer to the StartupSequencer to advance.
+   */
+  static void SignalPeriod(void *startup_sequencer);
+
+ protected:
+  /**
+   * @brief Startup sequence states.
+   */
+  enum State {
+    kIdle,   ///< Not driving; estimates are passed through.
+    kAlign,  ///< Holding the field at a fixed angle.
+    kRamp,   ///< Accelerating the field open-loop.
+    kRun,    ///< Driving on the closed-loop estimates.
+    kCoast,  ///< Waiting for the closed-loop rotor to lock on again.
+  };
+
+  /**
+   * @brief Enters a state, and restarts its timing.
+   *
+   * @note Must be called holding a ChibiOS lock.
+   *
+   * @param state State to enter.
+   */
+  void EnterS(State state);
+
+  /**
+   * @brief Computes the amplitude that drives the startup current.
+   *
+   * @return Semi-amplitude in the direction of startup.
+   */
+  Width16Diff ComputeStartupAmplitude() const;
+
+  RotorInterface * const rotor_;  ///< Closed-loop rotor estimate.
+  const bool regulates_current_;  ///< True if amplitude commands current.
+  CommutatorInterface *commutator_;  ///< Commutator driven.
+
+  State state_;  ///< Startup sequence state.
+  Width16Diff semi_amplitude_;  ///< Commanded amplitude.
+  bool enable_;  ///< Commanded drive enable flag.
+  int direction_;  ///< Direction of the open-loop field.
+  uint32_t periods_;  ///< PWM periods counted by @c SignalPeriod.
+  uint32_t state_periods_;  ///< Value of @c periods_ on entering the state.
+  uint32_t last_periods_;  ///< Value of @c periods_ at the last advance.
+  uint32_t angle_;  ///< Q16.16 open-loop angle.
+  Velocity32 velocity_;  ///< Open-loop velocity.
+  uint32_t handover_count_;  ///< Periods that the closed-loop rotor agreed.
+};
+
+#endif  /* MOTOR_STARTUP_SEQUENCER_H_ */
@@ -0,0 +1,93 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares fixed-point trigonometric functions of Angle16, using tables
+ *       that are generated at compile time.
+ */
+
+#ifndef MOTOR_TRIG_H_
+#define MOTOR_TRIG_H_
+
+#include <cstdint>
+
+#include "motor/common.h"
+
+/**
+ * @brief Full scale of the fixed-point results, which represents 1.
+ */
+constexpr int16_t kTrigOne = 32767;
+
+/**
+ * @brief Computes the sine of an angle.
+ *
+ * @note Interpolates linearly in a 256 step table of a quarter wave, so the
+ *       error is under two least significant bits.
+ *
+ * @param angle Angle in fixed-point angular format.
+ * @return Sine scaled by @c kTrigOne.
+ */
+int16_t Sine16(Angle16 angle);
+
+/**
+ * @brief Computes the cosine of an angle.
+ *
+ * @param angle Angle in fixed-point angular format.
+ * @return Cosine scaled by @c kTrigOne.
+ */
+static inline int16_t Cosine16(Angle16 angle) {
+  return Sine16(angle + DegreesToAngle16(90));
+}
+
+/**
+ * @brief Computes the angle and magnitude of a vector with CORDIC.
+ *
+ * @note Takes a fixed number of shift-and-add iterations, with no multiplies
+ *       or divides except to scale the magnitude. The angle is accurate to a
+ *       few least significant bits.
+ *
+ * @param x X component of the vector.
+ * @param y Y component of the vector.
+ * @param magnitude Pointer that the length of the vector is written to, or
+ *                  nullptr if not needed. Only valid if both components are
+ *                  less than 2^30 in absolute value.
+ * @return Angle of the vector counterclockwise from the x axis, or 0 for the
+ *         zero vector.
+ */
+Angle16 CordicVector(int32_t x, int32_t y, int32_t *magnitude);
+
+/**
+ * @brief Computes the angle of a vector, as atan2 does.
+ *
+ * @param y Y component of the vector.
+ * @param x X component of the vector.
+ * @return Angle of the vector counterclockwise from the x axis.
+ */
+static inline Angle16 ArcTangent16(int32_t y, int32_t x) {
+  return CordicVector(x, y, nullptr);
+}
+
+#endif  /* MOTOR_TRIG_H_ */
@@ -0,0 +1,164 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares VoltageCompensator, which scales amplitude commands by the
+ *       bus voltage so that they set a phase voltage.
+ */
+
+#ifndef MOTOR_VOLTAGE_COMPENSATOR_H_
+#define MOTOR_VOLTAGE_COMPENSATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ch.h"
+
+#include "motor/bus_voltage_sensor_interface.h"
+#include "motor/commutator_interface.h"
+
+/**
+ * @brief Takes amplitude commands as a fraction of the nominal bus voltage, and
+ *        drives the commutator with the amplitude that puts out that voltage
+ *        from the measured bus.
+ *
+ * @note Sits in front of the commutator, after the command source (e.g.
+ *       ServoInput or SpeedGovernor). A full command is
+ *       @c BUS_VOLTAGE_NOMINAL, which is put out at full amplitude on a bus
+ *       at the nominal voltage, at less on a freshly charged pack, and is
+ *       limited to full amplitude on a sagging one.
+ *
+ * @note The bus voltage is measured and low-pass filtered every
+ *       @c BUS_VOLTAGE_INTERVAL in its own thread, as the measurement blocks.
+ *       Each update also rewrites the amplitude for the last command at the
+ *       new scale. Until the first valid measurement, commands are passed
+ *       through unscaled.
+ *
+ * @note The filtered bus voltage is also reported as a bus voltage sensor,
+ *       which doesn't block, e.g. to limit regenerative braking.
+ */
+class VoltageCompensator: public CommutatorInterface,
+                          public BusVoltageSensorInterface {
+ public:
+  /**
+   * @brief Creates a compensator with a zero command.
+   *
+   * @param bus_voltage_sensor Bus voltage source.
+   * @param wa_update Working area for the update thread.
+   * @param wa_size Size of @p wa_update.
+   */
+  VoltageCompensator(BusVoltageSensorInterface *bus_voltage_sensor,
+                     void *wa_update,
+                     size_t wa_size);
+
+  /**
+   * @brief Connects the commutator that is driven.
+   *
+   * @param commutator Motor driving sequencer.
+   */
+  void SetCommutator(CommutatorInterface *commutator) {
+    commutator_ = commutator;
+  }
+
+  /**
+   * @brief Starts the update thread.
+   *
+   * @note The bus voltage sensor must be started first.
+   */
+  void Start();
+
+  /**
+   * @brief Runs the commutator's loop in the calling thread.
+   */
+  NORETURN void CommutationLoop();
+
+  void SignalChange();
+
+  /**
+   * @brief Writes the voltage command, and the commutator amplitude for it.
+   *
+   * @param semi_amplitude Signed voltage command, as a fraction of
+   *                       @c GetMaxAmplitude of @c BUS_VOLTAGE_NOMINAL.
+   */
+  void WriteAmplitude(Width16Diff semi_amplitude);
+
+  Width16Diff GetMaxAmplitude();
+
+  void SetEnable(bool enable);
+
+  /**
+   * @brief Measures the bus voltage, and rescales the amplitude for the last
+   *        command.
+   *
+   * @note Called by the update thread every @c BUS_VOLTAGE_INTERVAL; may also
+   *       be called directly to run a single update (e.g. on the build host).
+   *       Must not be called holding a ChibiOS lock.
+   */
+  void Update();
+
+  /**
+   * @brief Reads the filtered bus voltage.
+   *
+   * @note Does not block, so may be called from any thread.
+   *
+   * @param voltage Pointer that the bus voltage is written to (if valid).
+   * @return True once the bus voltage has been measured.
+   */
+  bool ComputeBusVoltage(Voltage16 *voltage);
+
+ protected:
+  /**
+   * @brief Scales a voltage command to an amplitude at the current scale.
+   *
+   * @param command Signed voltage command.
+   * @return Amplitude for the commutator, limited to its maximum.
+   */
+  Width16Diff Compensate(Width16Diff command);
+
+  /**
+   * @brief Runs @c Update periodically.
+   */
+  NORETURN void ThreadUpdate();
+
+  /**
+   * @brief Invokes @c ThreadUpdate; used as a thread function.
+   *
+   * @param voltage_compensator Pointer to an instance of this class.
+   * @return Should never return.
+   */
+  NORETURN static msg_t ThreadUpdateWrapper(void *voltage_compensator);
+
+  BusVoltageSensorInterface * const bus_voltage_sensor_;  ///< Bus source.
+  void * const wa_update_;  ///< Update thread working area.
+  const size_t wa_size_;  ///< Size of wa_update_.
+  CommutatorInterface *commutator_;  ///< Commutator driven.
+
+  Width16Diff command_;  ///< Commanded voltage, as an amplitude.
+  int32_t bus_voltage_;  ///< Filtered bus voltage, in Q16 volts; 0 if none.
+  uint32_t scale_;  ///< Amplitude per unit command, in Q16.
+};
+
+#endif  /* MOTOR_VOLTAGE_COMPENSATOR_H_ */
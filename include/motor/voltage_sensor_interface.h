@@ -0,0 +1,61 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares VoltageSensorInterface, an interface that reports the motor
+ *       phase terminal voltages.
+ */
+
+#ifndef MOTOR_VOLTAGE_SENSOR_INTERFACE_H_
+#define MOTOR_VOLTAGE_SENSOR_INTERFACE_H_
+
+#include "motor/common.h"
+#include "motor/inverter_interface.h"
+
+/**
+ * @brief Reports the voltages at the three motor leads.
+ */
+class VoltageSensorInterface {
+ public:
+  virtual ~VoltageSensorInterface() {}
+
+  /**
+   * @brief Retrieves the most recently sampled phase voltages.
+   *
+   * @note Voltages are measured from each motor lead to the negative bus rail.
+   *       A floating (high impedance) phase is at the motor neutral voltage
+   *       plus its back EMF, which sensorless commutation detects.
+   *
+   * @param voltages Array that the voltage of each phase, indexed by
+   *                 @c InverterInterface::Channel, is written to (if valid).
+   * @return True if the voltages are valid and were written to the output
+   *         param.
+   */
+  virtual bool ComputeVoltages(
+      Voltage16 voltages[InverterInterface::kNumChannels]) = 0;
+};
+
+#endif  /* MOTOR_VOLTAGE_SENSOR_INTERFACE_H_ */
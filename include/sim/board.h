@@ -0,0 +1,95 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares the board of the simulator build. Pin names match
+ *       /include/board/board.h so that config.h can be shared, but there are
+ *       no alternate functions or electrical settings to configure.
+ */
+
+#ifndef SIM_BOARD_H_
+#define SIM_BOARD_H_
+
+/*
+ * Board identifier.
+ */
+#define BOARD_CORN3_SIM
+#define BOARD_NAME                  "Corn3 simulator"
+
+/*
+ * GPIO ports, named as on the STM32.
+ */
+#define GPIOA                       IOPORT1
+#define GPIOB                       IOPORT2
+
+/*
+ * IO pins assignments.
+ */
+#define GPIOA_HALL_A                0
+#define GPIOA_HALL_B                1
+#define GPIOA_HALL_C                2
+#define GPIOA_PWM_C                 8
+#define GPIOA_PWM_B                 9
+#define GPIOA_PWM_A                 10
+#define GPIOA_DRV_EN                15
+
+#define GPIOB_LEDZ                  1
+#define GPIOB_DRV_SCK               3
+#define GPIOB_DRV_MISO              4
+#define GPIOB_DRV_MOSI              5
+#define GPIOB_PWM_IN                6
+#define GPIOB_DRV_NSS               8
+#define GPIOB_LEDX                  9
+#define GPIOB_UART_TX               10
+#define GPIOB_UART_RX               11
+#define GPIOB_LEDY                  12
+#define GPIOB_PWM_CN                13
+#define GPIOB_PWM_BN                14
+#define GPIOB_PWM_AN                15
+
+/*
+ * Initial port states. LEDs start on, as on the target, and the hall sensor
+ * inputs start in the 0 degree state.
+ */
+#define VAL_GPIOA_IDR               (3U << GPIOA_HALL_A)
+#define VAL_GPIOA_ODR               0x00000000
+#define VAL_GPIOB_IDR               0x00000000
+#define VAL_GPIOB_ODR               ((1U << GPIOB_LEDX) | \
+                                     (1U << GPIOB_LEDY) | \
+                                     (1U << GPIOB_LEDZ) | \
+                                     (1U << GPIOB_DRV_NSS))
+
+#if !defined(_FROM_ASM_)
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void boardInit(void);
+#ifdef __cplusplus
+}
+#endif
+#endif /* _FROM_ASM_ */
+
+#endif  /* SIM_BOARD_H_ */
@@ -0,0 +1,114 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares the simulator GPT low level driver. It has the same
+ *       configuration as the STM32 driver, with 16-bit timers behind GPTD3,
+ *       GPTD6 and GPTD7.
+ */
+
+#ifndef SIM_GPT_LLD_H_
+#define SIM_GPT_LLD_H_
+
+#include "host/stm32_tim.h"
+
+#if HAL_USE_GPT || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+typedef uint32_t gptfreq_t;
+typedef uint16_t gptcnt_t;
+
+/**
+ * @brief   Driver configuration structure, identical to the target's.
+ */
+typedef struct {
+  gptfreq_t                 frequency;
+  gptcallback_t             callback;
+  /* End of the mandatory fields.*/
+  uint16_t                  dier;
+} GPTConfig;
+
+/**
+ * @brief   Structure representing a virtual basic timer.
+ */
+struct GPTDriver {
+  gptstate_t                state;
+  const GPTConfig           *config;
+#if defined(GPT_DRIVER_EXT_FIELDS)
+  GPT_DRIVER_EXT_FIELDS
+#endif
+  /* End of the mandatory fields.*/
+  uint32_t                  clock;
+  /**
+   * @brief Pointer to the virtual TIMx registers block.
+   */
+  stm32_tim_t               *tim;
+  /**
+   * @brief Simulation time that the counter was started.
+   */
+  uint64_t                  start_ns;
+  /**
+   * @brief Simulation time of the next counter update event, or zero if the
+   *        counter is stopped.
+   */
+  uint64_t                  next_update_ns;
+};
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+#define gpt_lld_change_interval(gptp, interval)                             \
+  ((gptp)->tim->ARR = (uint32_t)((interval) - 1))
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+extern GPTDriver GPTD3;
+extern GPTDriver GPTD6;
+extern GPTDriver GPTD7;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void gpt_lld_init(void);
+  void gpt_lld_start(GPTDriver *gptp);
+  void gpt_lld_stop(GPTDriver *gptp);
+  void gpt_lld_start_timer(GPTDriver *gptp, gptcnt_t interval);
+  void gpt_lld_stop_timer(GPTDriver *gptp);
+  void gpt_lld_polled_delay(GPTDriver *gptp, gptcnt_t interval);
+  bool gpt_lld_serve_sim(uint64_t now_ns);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_USE_GPT */
+
+#endif /* SIM_GPT_LLD_H_ */
@@ -0,0 +1,118 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares the simulator HAL low level driver, which replaces the STM32
+ *       platform when building Corn3 as a Linux process with the ChibiOS
+ *       SIMIA32 port.
+ *
+ * @note Interrupts are simulated by polling each virtual peripheral in
+ *       @c ChkIntSources, which the port calls from the idle thread. So, a
+ *       peripheral event is only delivered when no thread is ready to run,
+ *       similar to an interrupt that preempts only the idle thread.
+ */
+
+#ifndef SIM_HAL_LLD_H_
+#define SIM_HAL_LLD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Platform name.
+ */
+#define PLATFORM_NAME   "Corn3 simulator (Linux)"
+
+/**
+ * @brief   The simulator does not implement the realtime counter API.
+ */
+#define HAL_IMPLEMENTS_COUNTERS FALSE
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Input signals generated by the virtual peripherals, read from the
+ *          environment at startup.
+ */
+typedef struct {
+  /**
+   * @brief Electrical rotation rate seen by the hall sensors, in revolutions
+   *        per second (CORN_SIM_HALL_HZ). Negative rotates clockwise and zero
+   *        holds the rotor still.
+   */
+  double                    hall_frequency;
+  /**
+   * @brief Servo pulse width in microseconds (CORN_SIM_SERVO_US). Zero
+   *        disables the servo signal.
+   */
+  uint32_t                  servo_width_us;
+  /**
+   * @brief Servo pulse period in microseconds (CORN_SIM_SERVO_PERIOD_US).
+   */
+  uint32_t                  servo_period_us;
+} SimStimulus;
+
+/**
+ * @brief   Counts of events processed by the virtual peripherals.
+ */
+typedef struct {
+  uint32_t                  hall_edges;       /**< ICUD2 captures.          */
+  uint32_t                  servo_pulses;     /**< ICUD4 width captures.    */
+  uint32_t                  icu_overflows;    /**< ICU overflow callbacks.  */
+  uint32_t                  gpt_updates;      /**< GPTD3/6/7 update events. */
+  uint32_t                  pwm_com_events;   /**< PWMD1 COM events.        */
+  uint32_t                  spi_transfers;    /**< SPID1 frames exchanged.  */
+  uint32_t                  serial_bytes_out; /**< SD3 bytes written.       */
+  uint32_t                  interrupts;       /**< Simulated IRQs served.   */
+} SimStatistics;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+extern SimStimulus sim_stimulus;
+extern SimStatistics sim_statistics;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void hal_lld_init(void);
+  void ChkIntSources(void);
+  uint64_t sim_lld_get_nanoseconds(void);
+  uint32_t sim_lld_get_counts(uint64_t nanoseconds, uint32_t frequency);
+  void sim_lld_report(void);
+  void NVIC_SystemReset(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SIM_HAL_LLD_H_ */
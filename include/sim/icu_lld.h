@@ -0,0 +1,185 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares the simulator ICU low level driver. It has the same
+ *       configuration as the Corn3 modified STM32 driver in /include/lld, and
+ *       generates hall sensor and servo pulse captures from @c sim_stimulus.
+ */
+
+#ifndef SIM_ICU_LLD_H_
+#define SIM_ICU_LLD_H_
+
+#include "host/stm32_tim.h"
+
+#if HAL_USE_ICU || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+typedef enum {
+  ICU_INPUT_ACTIVE_HIGH = 0,        /**< Trigger on rising edge.            */
+  ICU_INPUT_ACTIVE_LOW = 1,         /**< Trigger on falling edge.           */
+} icumode_t;
+
+typedef uint32_t icufreq_t;
+
+typedef enum {
+  ICU_CHANNEL_1 = 0,              /**< Use TIMxCH1.      */
+  ICU_CHANNEL_2 = 1,              /**< Use TIMxCH2.      */
+  ICU_CHANNEL_3 = 2,              /**< Use TIMxCH3.      */
+  ICU_CHANNEL_4 = 3,              /**< Use TIMxCH4.      */
+} icuchannel_t;
+
+typedef enum {
+  ICU_RESET_NEVER       = 0,    /**< Timer starts enabled and never resets.  */
+  ICU_RESET_ON_ACTIVE   = 1,    /**< Timer resets when driver enters ACTIVE. */
+  ICU_RESET_ON_CH1_EDGE = 2,    /**< Timer resets when CH1 detects edge.     */
+} icuresetmode_t;
+
+typedef enum {
+  ICU_CHANNEL_1_INPUT_1 = 0,        /**< Channel 1 connected input 1.        */
+  ICU_CHANNEL_1_XOR_123 = 1,        /**< Channel 1 is XORed inputs 1, 2, 3.  */
+} icuxormode_t;
+
+/**
+ * @brief   ICU sample rate and filter configuration. Accepted for
+ *          compatibility; the simulated inputs never glitch.
+ */
+typedef enum {
+  ICU_FILTER_F_1_N_1 = 0,
+  ICU_FILTER_F_1_N_2 = 1,
+  ICU_FILTER_F_1_N_4 = 2,
+  ICU_FILTER_F_1_N_8 = 3,
+  ICU_FILTER_F_2_N_6 = 4,
+  ICU_FILTER_F_2_N_8 = 5,
+  ICU_FILTER_F_4_N_6 = 6,
+  ICU_FILTER_F_4_N_8 = 7,
+  ICU_FILTER_F_8_N_6 = 8,
+  ICU_FILTER_F_8_N_8 = 9,
+  ICU_FILTER_F_16_N_5 = 10,
+  ICU_FILTER_F_16_N_6 = 11,
+  ICU_FILTER_F_16_N_8 = 12,
+  ICU_FILTER_F_32_N_5 = 13,
+  ICU_FILTER_F_32_N_6 = 14,
+  ICU_FILTER_F_32_N_8 = 15,
+} icufilter_t;
+
+typedef uint32_t icucnt_t;
+
+/**
+ * @brief   Driver configuration structure, identical to the target's.
+ */
+typedef struct {
+  icumode_t                 mode;
+  icufreq_t                 frequency;
+  icucallback_t             width_cb;
+  icucallback_t             period_cb;
+  icucallback_t             overflow_cb;
+  /* End of the mandatory fields.*/
+  icuchannel_t              channel;
+  uint32_t                  dier;
+  icuresetmode_t            resetmode;
+  icuxormode_t              xormode;
+  icufilter_t               filter;
+} ICUConfig;
+
+/**
+ * @brief   Structure representing a virtual ICU.
+ */
+struct ICUDriver {
+  icustate_t                state;
+  const ICUConfig           *config;
+#if defined(ICU_DRIVER_EXT_FIELDS)
+  ICU_DRIVER_EXT_FIELDS
+#endif
+  /* End of the mandatory fields.*/
+  /**
+   * @brief Timer base clock.
+   */
+  uint32_t                  clock;
+  /**
+   * @brief Pointer to the virtual TIMx registers block.
+   */
+  stm32_tim_t               *tim;
+  /**
+   * @brief CCR register used for width capture.
+   */
+  volatile uint32_t         *wccrp;
+  /**
+   * @brief CCR register used for period capture.
+   */
+  volatile uint32_t         *pccrp;
+  /**
+   * @brief Simulation time that the counter was last reset.
+   */
+  uint64_t                  reset_ns;
+  /**
+   * @brief Simulation time of the next input edge.
+   */
+  uint64_t                  next_edge_ns;
+  /**
+   * @brief Counter value at the last overflow check.
+   */
+  uint64_t                  last_counts;
+  /**
+   * @brief Index of the next edge in the simulated input sequence.
+   */
+  uint32_t                  edge_index;
+};
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+#define icu_lld_get_width(icup) (*((icup)->wccrp) + 1)
+
+#define icu_lld_get_period(icup) (*((icup)->pccrp) + 1)
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+extern ICUDriver ICUD2;
+extern ICUDriver ICUD4;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void icu_lld_init(void);
+  void icu_lld_start(ICUDriver *icup);
+  void icu_lld_stop(ICUDriver *icup);
+  void icu_lld_enable(ICUDriver *icup);
+  void icu_lld_disable(ICUDriver *icup);
+  bool icu_lld_serve_sim(uint64_t now_ns);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_USE_ICU */
+
+#endif /* SIM_ICU_LLD_H_ */
@@ -0,0 +1,130 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares the simulator PAL low level driver, which models GPIO ports
+ *       as plain memory.
+ *
+ * @note Virtual peripherals drive inputs by writing @p IDR (e.g. the hall
+ *       sensor pins), and outputs (e.g. LEDs) are latched in @p ODR.
+ */
+
+#ifndef SIM_PAL_LLD_H_
+#define SIM_PAL_LLD_H_
+
+#if HAL_USE_PAL || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* I/O Ports Types and constants.                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Width, in bits, of an I/O port.
+ */
+#define PAL_IOPORTS_WIDTH 16
+
+/**
+ * @brief   Whole port mask.
+ */
+#define PAL_WHOLE_PORT ((ioportmask_t)0xFFFF)
+
+/**
+ * @brief   Digital I/O port sized unsigned type.
+ */
+typedef uint32_t ioportmask_t;
+
+/**
+ * @brief   Digital I/O modes.
+ */
+typedef uint32_t iomode_t;
+
+/**
+ * @brief   Virtual GPIO port.
+ */
+typedef struct {
+  volatile uint32_t         IDR;  /**< Input levels, set by the simulator. */
+  volatile uint32_t         ODR;  /**< Output latch.                       */
+} GPIO_TypeDef;
+
+/**
+ * @brief   Port identifier.
+ */
+typedef GPIO_TypeDef *ioportid_t;
+
+/**
+ * @brief   Initial port values.
+ */
+typedef struct {
+  uint32_t                  idr;
+  uint32_t                  odr;
+} sim_gpio_setup_t;
+
+/**
+ * @brief   PAL configuration, with the initial state of each port.
+ */
+typedef struct {
+  sim_gpio_setup_t          PAData;
+  sim_gpio_setup_t          PBData;
+} PALConfig;
+
+/*===========================================================================*/
+/* I/O Ports Identifiers.                                                    */
+/*===========================================================================*/
+
+#define IOPORT1         (&sim_gpioa)
+#define IOPORT2         (&sim_gpiob)
+
+/*===========================================================================*/
+/* Implementation, some of the following macros could be implemented as     */
+/* functions, if so please put them in pal_lld.c.                            */
+/*===========================================================================*/
+
+#define pal_lld_init(config) _pal_lld_init(config)
+
+#define pal_lld_readport(port) ((port)->IDR)
+
+#define pal_lld_readlatch(port) ((port)->ODR)
+
+#define pal_lld_writeport(port, bits) ((port)->ODR = (bits))
+
+#define pal_lld_setgroupmode(port, mask, offset, mode) \
+    ((void)(port), (void)(mask), (void)(offset), (void)(mode))
+
+extern GPIO_TypeDef sim_gpioa;
+extern GPIO_TypeDef sim_gpiob;
+extern const PALConfig pal_default_config;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void _pal_lld_init(const PALConfig *config);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_USE_PAL */
+
+#endif /* SIM_PAL_LLD_H_ */
@@ -0,0 +1,142 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares the simulator PWM low level driver. It has the same
+ *       configuration as the Corn3 modified STM32 driver in /include/lld, and
+ *       latches the preloaded output modes when a COM event is generated.
+ */
+
+#ifndef SIM_PWM_LLD_H_
+#define SIM_PWM_LLD_H_
+
+#include "host/stm32_tim.h"
+
+#if HAL_USE_PWM || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+#define PWM_CHANNELS                            4
+
+#define PWM_COMPLEMENTARY_OUTPUT_MASK           0xF0
+#define PWM_COMPLEMENTARY_OUTPUT_DISABLED       0x00
+#define PWM_COMPLEMENTARY_OUTPUT_ACTIVE_HIGH    0x10
+#define PWM_COMPLEMENTARY_OUTPUT_ACTIVE_LOW     0x20
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+typedef uint32_t pwmmode_t;
+typedef uint8_t pwmchannel_t;
+typedef uint16_t pwmcnt_t;
+
+typedef struct {
+  pwmmode_t                 mode;
+  pwmcallback_t             callback;
+  /* End of the mandatory fields.*/
+} PWMChannelConfig;
+
+/**
+ * @brief   Driver configuration structure, identical to the target's.
+ */
+typedef struct {
+  uint32_t                  frequency;
+  pwmcnt_t                  period;
+  pwmcallback_t             callback;
+  PWMChannelConfig          channels[PWM_CHANNELS];
+  /* End of the mandatory fields.*/
+  uint32_t                  cr1;
+  uint32_t                  cr2;
+  uint32_t                  bdtr;
+  uint32_t                  dier;
+} PWMConfig;
+
+/**
+ * @brief   Structure representing a virtual advanced-control timer.
+ */
+struct PWMDriver {
+  pwmstate_t                state;
+  const PWMConfig           *config;
+  pwmcnt_t                  period;
+#if defined(PWM_DRIVER_EXT_FIELDS)
+  PWM_DRIVER_EXT_FIELDS
+#endif
+  /* End of the mandatory fields.*/
+  uint32_t                  clock;
+  /**
+   * @brief Pointer to the virtual TIMx registers block.
+   */
+  stm32_tim_t               *tim;
+  /**
+   * @brief Output modes in effect, latched from the preload registers by the
+   *        last COM event.
+   */
+  uint32_t                  active_ccer;
+  uint32_t                  active_ccmr1;
+  uint32_t                  active_ccmr2;
+  /**
+   * @brief Simulation time of the next counter update event.
+   */
+  uint64_t                  next_update_ns;
+};
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+#define pwm_lld_change_period(pwmp, period)                                 \
+  ((pwmp)->tim->ARR = (uint16_t)((period) - 1))
+
+#define pwm_lld_is_channel_enabled(pwmp, channel)                           \
+  (((pwmp)->tim->CCER & (1U << ((channel) * 4))) != 0)
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+extern PWMDriver PWMD1;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void pwm_lld_init(void);
+  void pwm_lld_start(PWMDriver *pwmp);
+  void pwm_lld_stop(PWMDriver *pwmp);
+  void pwm_lld_enable_channel(PWMDriver *pwmp,
+                              pwmchannel_t channel,
+                              pwmcnt_t width);
+  void pwm_lld_disable_channel(PWMDriver *pwmp, pwmchannel_t channel);
+  bool pwm_lld_serve_sim(uint64_t now_ns);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_USE_PWM */
+
+#endif /* SIM_PWM_LLD_H_ */
@@ -0,0 +1,62 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Overrides of the ChibiOS/RT and HAL configuration for the simulator
+ *       build. Force-included ahead of every source file by src/sim/sim.mk, so
+ *       that chconf.h and halconf.h keep the target's settings otherwise.
+ */
+
+#ifndef SIM_SIMCONF_H_
+#define SIM_SIMCONF_H_
+
+/* There is no USB peripheral to simulate. */
+#define HAL_USE_USB                 FALSE
+#define HAL_USE_SERIAL_USB          FALSE
+
+/* Nor an analog front end, so current sensing can't be enabled. */
+#define HAL_USE_ADC                 FALSE
+
+/* Needed by sim_lld_report to walk the thread list. */
+#define CH_USE_REGISTRY             TRUE
+
+/* The SIMIA32 port has no stack limit checking. */
+#define CH_DBG_ENABLE_STACK_CHECK   FALSE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void ChkIntSources(void);
+#ifdef __cplusplus
+}
+#endif
+
+/* Deliver simulated interrupts whenever no thread is ready to run. */
+#define IDLE_LOOP_HOOK() {                                                  \
+  ChkIntSources();                                                          \
+}
+
+#endif  /* SIM_SIMCONF_H_ */
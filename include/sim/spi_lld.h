@@ -0,0 +1,135 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Declares the simulator SPI low level driver. Frames sent to the
+ *       virtual SPID1 are answered by a register model of the DRV8303, so the
+ *       gate driver initialization and fault polling run unchanged.
+ */
+
+#ifndef SIM_SPI_LLD_H_
+#define SIM_SPI_LLD_H_
+
+#if HAL_USE_SPI || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/* SPI_CR1 and SPI_CR2 bits used by SPIConfig, as on the STM32F30x. These are
+ * accepted for compatibility and otherwise ignored. */
+#define SPI_CR1_CPHA                ((uint16_t)0x0001)
+#define SPI_CR1_CPOL                ((uint16_t)0x0002)
+#define SPI_CR1_BR_0                ((uint16_t)0x0008)
+#define SPI_CR1_BR_1                ((uint16_t)0x0010)
+#define SPI_CR1_BR_2                ((uint16_t)0x0020)
+#define SPI_CR2_DS_0                ((uint16_t)0x0100)
+#define SPI_CR2_DS_1                ((uint16_t)0x0200)
+#define SPI_CR2_DS_2                ((uint16_t)0x0400)
+#define SPI_CR2_DS_3                ((uint16_t)0x0800)
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+typedef struct SPIDriver SPIDriver;
+
+typedef void (*spicallback_t)(SPIDriver *spip);
+
+/**
+ * @brief   Driver configuration structure, identical to the target's.
+ */
+typedef struct {
+  spicallback_t             end_cb;
+  /* End of the mandatory fields.*/
+  ioportid_t                ssport;
+  uint16_t                  sspad;
+  uint16_t                  cr1;
+  uint16_t                  cr2;
+} SPIConfig;
+
+/**
+ * @brief   Structure representing a virtual SPI peripheral.
+ */
+struct SPIDriver {
+  spistate_t                state;
+  const SPIConfig           *config;
+#if SPI_USE_WAIT || defined(__DOXYGEN__)
+  Thread                    *thread;
+#endif /* SPI_USE_WAIT */
+#if SPI_USE_MUTUAL_EXCLUSION || defined(__DOXYGEN__)
+#if CH_USE_MUTEXES || defined(__DOXYGEN__)
+  Mutex                     mutex;
+#elif CH_USE_SEMAPHORES
+  Semaphore                 semaphore;
+#endif
+#endif /* SPI_USE_MUTUAL_EXCLUSION */
+#if defined(SPI_DRIVER_EXT_FIELDS)
+  SPI_DRIVER_EXT_FIELDS
+#endif
+  /* End of the mandatory fields.*/
+  /**
+   * @brief Frames to receive, or zero if no transfer is in progress.
+   */
+  size_t                    pending;
+  /**
+   * @brief Buffer to receive into, or NULL to discard received frames.
+   */
+  uint16_t                  *rxbuf;
+  /**
+   * @brief Word shifted out by the device in the next frame.
+   */
+  uint16_t                  response;
+};
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+extern SPIDriver SPID1;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void spi_lld_init(void);
+  void spi_lld_start(SPIDriver *spip);
+  void spi_lld_stop(SPIDriver *spip);
+  void spi_lld_select(SPIDriver *spip);
+  void spi_lld_unselect(SPIDriver *spip);
+  void spi_lld_ignore(SPIDriver *spip, size_t n);
+  void spi_lld_exchange(SPIDriver *spip, size_t n,
+                        const void *txbuf, void *rxbuf);
+  void spi_lld_send(SPIDriver *spip, size_t n, const void *txbuf);
+  void spi_lld_receive(SPIDriver *spip, size_t n, void *rxbuf);
+  uint16_t spi_lld_polled_exchange(SPIDriver *spip, uint16_t frame);
+  bool spi_lld_serve_sim(uint64_t now_ns);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_USE_SPI */
+
+#endif /* SIM_SPI_LLD_H_ */
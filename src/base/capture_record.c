@@ -0,0 +1,101 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "base/capture_record.h"
+
+#include "ch.h"
+
+#include "config.h"
+
+/* One recorded event. */
+typedef struct CaptureRecordEvent {
+  uint32_t time_us;
+  uint32_t count;
+  uint32_t period;
+  char type;
+  uint8_t hall_state;
+} CaptureRecordEvent;
+
+static CaptureRecordEvent g_events[CAPTURE_RECORD_EVENTS];
+static unsigned g_num_events;
+static systime_t g_start_time;  /* System time at the start of recording. */
+
+void CaptureRecordInit(void) {
+  CaptureRecordReset();
+}
+
+void CaptureRecordEventFromIsr(char type,
+                               unsigned hall_state,
+                               uint32_t count,
+                               uint32_t period) {
+  chSysLockFromIsr();
+  if (g_num_events < CAPTURE_RECORD_EVENTS) {
+    CaptureRecordEvent * const event = &g_events[g_num_events++];
+    event->time_us = (uint32_t)(chTimeNow() - g_start_time) *
+                     (1000000 / CH_FREQUENCY);
+    event->count = count;
+    event->period = period;
+    event->type = type;
+    event->hall_state = (uint8_t)hall_state;
+  }
+  chSysUnlockFromIsr();
+}
+
+void CaptureRecordReset(void) {
+  chSysLock();
+  g_num_events = 0;
+  g_start_time = chTimeNow();
+  chSysUnlock();
+}
+
+/* Events are only appended, so each one can be copied out under a short lock
+ * while the recording continues. */
+void CaptureRecordPrintAll(CaptureRecordPrint print) {
+  chSysLock();
+  const unsigned num_events = g_num_events;
+  chSysUnlock();
+
+  print("# Corn3 capture, %u of %u events", num_events,
+        (unsigned)CAPTURE_RECORD_EVENTS);
+  for (unsigned i = 0; i < num_events; i++) {
+    chSysLock();
+    const CaptureRecordEvent event = g_events[i];
+    chSysUnlock();
+    switch (event.type) {
+      case 'H':
+        print("H %lu %u %lu", (unsigned long)event.time_us,
+              (unsigned)event.hall_state, (unsigned long)event.count);
+        break;
+      case 'S':
+        print("S %lu %lu %lu", (unsigned long)event.time_us,
+              (unsigned long)event.count, (unsigned long)event.period);
+        break;
+      default:
+        print("%c %lu", event.type, (unsigned long)event.time_us);
+        break;
+    }
+  }
+}
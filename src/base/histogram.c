@@ -0,0 +1,81 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "base/histogram.h"
+
+#include <string.h>
+
+/* Largest value that falls in a bin. The last bin also counts all values past
+ * it, so it has no limit. */
+static uint32_t HistogramBinLimit(unsigned bin) {
+  if (bin < 8) {
+    return bin;
+  }
+  if (bin == HISTOGRAM_NUM_BINS - 1) {
+    return UINT32_MAX;
+  }
+  const unsigned exponent = (bin - 8) / 4 + 3;
+  const uint32_t lower = (4U + (bin - 8) % 4) << (exponent - 2);
+  return lower + (1U << (exponent - 2)) - 1;
+}
+
+void HistogramClear(Histogram *histogram) {
+  memset(histogram, 0, sizeof(*histogram));
+}
+
+uint32_t HistogramPercentile(const Histogram *histogram, uint32_t per_mille) {
+  const uint32_t rank =
+      (uint32_t)(((uint64_t)histogram->count * per_mille + 999) / 1000);
+  uint32_t cumulative = 0;
+  for (unsigned bin = 0; bin < HISTOGRAM_NUM_BINS; bin++) {
+    cumulative += histogram->bins[bin];
+    if (cumulative >= rank) {
+      const uint32_t limit = HistogramBinLimit(bin);
+      return limit < histogram->max ? limit : histogram->max;
+    }
+  }
+  return histogram->max;
+}
+
+void HistogramSummarize(const Histogram *histogram,
+                        uint32_t scale_numerator,
+                        uint32_t scale_denominator,
+                        uint32_t summary[HISTOGRAM_NUM_SUMMARY_VALUES]) {
+  static const uint32_t kPerMilles[] = { 500, 900, 990, 999 };
+  memset(summary, 0, HISTOGRAM_NUM_SUMMARY_VALUES * sizeof(summary[0]));
+  if (histogram->count == 0) {
+    return;
+  }
+  summary[0] = histogram->min;
+  for (unsigned i = 0; i < 4; i++) {
+    summary[i + 1] = HistogramPercentile(histogram, kPerMilles[i]);
+  }
+  summary[5] = histogram->max;
+  for (unsigned i = 0; i < HISTOGRAM_NUM_SUMMARY_VALUES; i++) {
+    summary[i] = (uint32_t)((uint64_t)summary[i] * scale_numerator /
+                            scale_denominator);
+  }
+}
@@ -0,0 +1,109 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "base/isr_profile.h"
+
+#include <string.h>
+
+#include "ch.h"
+
+static IsrProfile g_isr_profiles[ISR_PROFILE_NUM_IDS];
+
+static const char * const g_isr_profile_names[ISR_PROFILE_NUM_IDS] = {
+  "tim1_up",
+  "tim1_cc",
+  "tim2",
+  "tim4",
+};
+
+/* Copy of one histogram, so that it can be summarized without holding a lock
+ * while the profiled interrupt may be writing to it. */
+static Histogram g_histogram_snapshot;
+
+static void PrintHistogram(IsrProfilePrint print,
+                           const char *name,
+                           const char *measure,
+                           const Histogram *histogram,
+                           uint32_t scale_numerator,
+                           uint32_t scale_denominator) {
+  chSysLock();
+  memcpy(&g_histogram_snapshot, histogram, sizeof(g_histogram_snapshot));
+  chSysUnlock();
+
+  uint32_t values[HISTOGRAM_NUM_SUMMARY_VALUES];
+  HistogramSummarize(&g_histogram_snapshot, scale_numerator, scale_denominator,
+                     values);
+  print("%s %s " CYCLE_COUNTER_UNIT " %lu %lu %lu %lu %lu %lu %lu",
+        name, measure, (unsigned long)g_histogram_snapshot.count,
+        (unsigned long)values[0], (unsigned long)values[1],
+        (unsigned long)values[2], (unsigned long)values[3],
+        (unsigned long)values[4], (unsigned long)values[5]);
+}
+
+void IsrProfileInit(void) {
+  CycleCounterEnable();
+  IsrProfileReset();
+}
+
+void IsrProfileSetTickFrequency(IsrProfileId id, uint32_t frequency) {
+  g_isr_profiles[id].latency_tick_frequency = frequency;
+}
+
+/* The duration excludes exception entry, which is counted in the latency, and
+ * the kernel epilogue, which may reschedule. */
+void IsrProfileRecordI(IsrProfileId id,
+                       uint32_t latency_ticks,
+                       uint32_t entry_time) {
+  const uint32_t duration = CycleCounterRead() - entry_time;
+  IsrProfile *profile = &g_isr_profiles[id];
+  HistogramAdd(&profile->latency, latency_ticks);
+  HistogramAdd(&profile->duration, duration);
+}
+
+void IsrProfileReset(void) {
+  for (unsigned i = 0; i < ISR_PROFILE_NUM_IDS; i++) {
+    chSysLock();
+    HistogramClear(&g_isr_profiles[i].latency);
+    HistogramClear(&g_isr_profiles[i].duration);
+    chSysUnlock();
+  }
+}
+
+/* Latency ticks are converted to cycle counter units, so that both measures
+ * of each interrupt are in the same unit. */
+void IsrProfilePrintAll(IsrProfilePrint print) {
+  print("# name measure unit count min p50 p90 p99 p999 max");
+  for (unsigned i = 0; i < ISR_PROFILE_NUM_IDS; i++) {
+    const IsrProfile *profile = &g_isr_profiles[i];
+    const uint32_t tick_frequency = profile->latency_tick_frequency;
+    PrintHistogram(print, g_isr_profile_names[i], "latency",
+                   &profile->latency,
+                   tick_frequency != 0 ? CYCLE_COUNTER_FREQ : 0,
+                   tick_frequency != 0 ? tick_frequency : 1);
+    PrintHistogram(print, g_isr_profile_names[i], "duration",
+                   &profile->duration, 1, 1);
+  }
+}
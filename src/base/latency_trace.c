@@ -0,0 +1,132 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "base/latency_trace.h"
+
+#include <string.h>
+
+#include "ch.h"
+
+#include "base/histogram.h"
+
+/* One histogram per pair of successive stages, plus one for the total. */
+#define LATENCY_NUM_INTERVALS LATENCY_NUM_STAGES
+
+static const char * const g_latency_interval_names[LATENCY_NUM_INTERVALS] = {
+  "capture_to_isr",
+  "isr_to_signal",
+  "signal_to_resume",
+  "resume_to_sync",
+  "total",
+};
+
+static uint32_t g_stage_times[LATENCY_NUM_STAGES];  /* Stamps of this trace. */
+static unsigned g_stages_stamped;  /* Bit set of stages stamped so far. */
+static Histogram g_intervals[LATENCY_NUM_INTERVALS];
+static uint32_t g_overruns;
+
+/* Copy of one histogram, so that it can be summarized without holding a lock
+ * while a trace may be recorded into it. */
+static Histogram g_histogram_snapshot;
+
+#define STAGE_BIT(stage) (1U << (stage))
+
+void LatencyTraceInit(void) {
+  CycleCounterEnable();
+  LatencyTraceReset();
+}
+
+/* An edge that was signaled but not yet synchronized is still waiting for the
+ * commutation thread, so the new edge overruns it. An edge that was never
+ * signaled was filtered out by the edge handler and is just abandoned. */
+void LatencyTraceStartI(uint32_t entry_time, uint32_t capture_age) {
+  if ((g_stages_stamped & STAGE_BIT(LATENCY_STAGE_SIGNAL)) != 0) {
+    g_overruns++;
+  }
+  g_stage_times[LATENCY_STAGE_CAPTURE] = entry_time - capture_age;
+  g_stage_times[LATENCY_STAGE_ISR_ENTRY] = entry_time;
+  g_stages_stamped = STAGE_BIT(LATENCY_STAGE_CAPTURE) |
+                     STAGE_BIT(LATENCY_STAGE_ISR_ENTRY);
+}
+
+void LatencyTraceStampI(LatencyStage stage) {
+  const uint32_t now = CycleCounterRead();
+  if (stage == LATENCY_STAGE_CAPTURE ||
+      (g_stages_stamped & STAGE_BIT(stage - 1)) == 0 ||
+      (g_stages_stamped & STAGE_BIT(stage)) != 0) {
+    return;
+  }
+  g_stage_times[stage] = now;
+  g_stages_stamped |= STAGE_BIT(stage);
+
+  if (stage == LATENCY_STAGE_SYNC) {
+    for (unsigned i = 1; i < LATENCY_NUM_STAGES; i++) {
+      HistogramAdd(&g_intervals[i - 1],
+                   g_stage_times[i] - g_stage_times[i - 1]);
+    }
+    HistogramAdd(&g_intervals[LATENCY_NUM_INTERVALS - 1],
+                 now - g_stage_times[LATENCY_STAGE_CAPTURE]);
+    g_stages_stamped = 0;
+  }
+}
+
+void LatencyTraceStamp(LatencyStage stage) {
+  chSysLock();
+  LatencyTraceStampI(stage);
+  chSysUnlock();
+}
+
+void LatencyTraceReset(void) {
+  for (unsigned i = 0; i < LATENCY_NUM_INTERVALS; i++) {
+    chSysLock();
+    HistogramClear(&g_intervals[i]);
+    chSysUnlock();
+  }
+  chSysLock();
+  g_stages_stamped = 0;
+  g_overruns = 0;
+  chSysUnlock();
+}
+
+void LatencyTracePrintAll(LatencyTracePrint print) {
+  print("# interval unit count min p50 p90 p99 p999 max");
+  for (unsigned i = 0; i < LATENCY_NUM_INTERVALS; i++) {
+    chSysLock();
+    memcpy(&g_histogram_snapshot, &g_intervals[i],
+           sizeof(g_histogram_snapshot));
+    chSysUnlock();
+
+    uint32_t values[HISTOGRAM_NUM_SUMMARY_VALUES];
+    HistogramSummarize(&g_histogram_snapshot, 1, 1, values);
+    print("%s " CYCLE_COUNTER_UNIT " %lu %lu %lu %lu %lu %lu %lu",
+          g_latency_interval_names[i],
+          (unsigned long)g_histogram_snapshot.count,
+          (unsigned long)values[0], (unsigned long)values[1],
+          (unsigned long)values[2], (unsigned long)values[3],
+          (unsigned long)values[4], (unsigned long)values[5]);
+  }
+  print("# overruns %lu", (unsigned long)g_overruns);
+}
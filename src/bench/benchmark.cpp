@@ -0,0 +1,425 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "bench/benchmark.h"
+
+#include <cmath>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "config.h"
+#include "base/cycle_counter.h"
+#include "base/integer.h"
+#include "base/log.h"
+#include "driver/servo_input.h"
+#include "motor/commutator_foc.h"
+#include "motor/commutator_six_step.h"
+#include "motor/current_sensor_interface.h"
+#include "motor/inverter_pwm.h"
+#include "motor/modulator_space_vector.h"
+#include "motor/rotor_flux.h"
+#include "motor/rotor_hall.h"
+#include "motor/rotor_interface.h"
+#include "motor/rotor_pll.h"
+#include "motor/trig.h"
+
+namespace {
+
+// Consumes kernel results so that the compiler can't remove the computation.
+volatile int32_t g_sink;
+
+// Conversions between fixed-point angles and radians for the C library.
+constexpr float kAngle16ToRadians = 2 * static_cast<float>(kPi) / 65536;
+constexpr float kRadiansToAngle16 = 65536 / (2 * static_cast<float>(kPi));
+
+// Rotor that steps through the six commutation sectors on each call, so that
+// every branch of the commutator is exercised in turn.
+class BenchRotor: public RotorInterface {
+ public:
+  BenchRotor() : angle_(0) {
+  }
+
+  bool ComputeAngle(Angle16 *angle) {
+    angle_ += DegreesToAngle16(60);
+    *angle = angle_;
+    return true;
+  }
+
+  bool ComputeVelocity(Velocity32 *velocity) {
+    *velocity = 0;
+    return false;
+  }
+
+ protected:
+  Angle16 angle_;
+};
+
+// Reports the configured period even though the PWM driver is not started, so
+// that the commutators compute real widths instead of dividing by zero.
+class BenchInverterPWM: public InverterPWM {
+ public:
+  BenchInverterPWM(PWMDriver *pwm_driver) : InverterPWM(pwm_driver) {
+  }
+
+  Width16 GetPeriod() {
+    return INVERTER_PWM_PERIOD;
+  }
+};
+
+// Current sensor with fixed, nonzero readings, so that both current loops run.
+class BenchCurrentSensor: public CurrentSensorInterface {
+ public:
+  bool ComputeCurrents(Current16 currents[InverterInterface::kNumChannels]) {
+    currents[InverterInterface::kChannelA] = 1000;
+    currents[InverterInterface::kChannelB] = -300;
+    currents[InverterInterface::kChannelC] = -700;
+    return true;
+  }
+};
+
+// Exposes the rotor state to set it up as after a forward hall transition,
+// without starting the capture driver.
+class BenchRotorHall: public RotorHall {
+ public:
+  BenchRotorHall(void *wa_update, size_t wa_size)
+      : RotorHall(&HALL_ICU, wa_update, wa_size) {
+    timer_overflowed_ = false;
+    hall_state_ = kHall60Deg;
+    last_hall_state_ = kHall0Deg;
+    counts_elapsed_ = HALL_ICU_FREQ / 1000;
+    velocity_ = ComputeSpeed(counts_elapsed_);
+    direction_ = 1;
+  }
+
+  using RotorHall::ComputeSpeed;
+};
+
+// Exposes the servo pulse mapping.
+class BenchServoInput: public ServoInput {
+ public:
+  using ServoInput::MapRange;
+};
+
+// Objects shared by the kernels, set up by RunBenchmarks.
+BenchRotor *g_rotor;
+InverterPWM *g_inverter;
+CommutatorSixStep *g_commutator;
+CommutatorFoc *g_commutator_foc;
+ModulatorSpaceVector *g_modulator;
+BenchRotorHall *g_rotor_hall;
+RotorPll *g_rotor_pll;
+RotorFlux *g_rotor_flux;
+
+// Measures the loop and sink store that every other kernel includes.
+void KernelLoop(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    g_sink = i;
+  }
+}
+
+// One pass of the CommutationLoop body, cycling through the six sectors.
+void KernelCommutate(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    g_commutator->Commutate();
+    g_sink = i;
+  }
+}
+
+// One FOC control period, with the rotor stepping between sectors.
+void KernelFocUpdate(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    g_commutator_foc->Update();
+    g_sink = i;
+  }
+}
+
+void KernelModulatePolar(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    g_modulator->Write(i * 1237, INVERTER_PWM_PERIOD / 4);
+    g_sink = i;
+  }
+}
+
+void KernelModulateAlphaBeta(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    g_modulator->WriteAlphaBeta((i & 0x7FF) - 0x400, 0x200 - (i & 0x3FF));
+    g_sink = i;
+  }
+}
+
+// Fixed-point trigonometry, each followed by the C library function it
+// replaces, on the same inputs.
+void KernelSine16(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    g_sink = Sine16(i * 1237);
+  }
+}
+
+void KernelSinf(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    const float angle = static_cast<Angle16>(i * 1237) * kAngle16ToRadians;
+    g_sink = static_cast<int32_t>(sinf(angle) * kTrigOne);
+  }
+}
+
+void KernelCosine16(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    g_sink = Cosine16(i * 1237);
+  }
+}
+
+void KernelCosf(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    const float angle = static_cast<Angle16>(i * 1237) * kAngle16ToRadians;
+    g_sink = static_cast<int32_t>(cosf(angle) * kTrigOne);
+  }
+}
+
+void KernelArcTangent16(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    g_sink = ArcTangent16(static_cast<int>(i & 0x7FF) - 0x400,
+                          0x200 - static_cast<int>(i & 0x3FF));
+  }
+}
+
+void KernelAtan2f(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    const float angle = atan2f(static_cast<int>(i & 0x7FF) - 0x400,
+                               0x200 - static_cast<int>(i & 0x3FF));
+    g_sink = static_cast<int32_t>(angle * kRadiansToAngle16);
+  }
+}
+
+void KernelCordicVector(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    int32_t magnitude;
+    g_sink = CordicVector(0x200 - static_cast<int>(i & 0x3FF),
+                          static_cast<int>(i & 0x7FF) - 0x400,
+                          &magnitude) + magnitude;
+  }
+}
+
+void KernelAtan2fSqrtf(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    const float x = 0x200 - static_cast<int>(i & 0x3FF);
+    const float y = static_cast<int>(i & 0x7FF) - 0x400;
+    g_sink = static_cast<int32_t>(atan2f(y, x) * kRadiansToAngle16) +
+             static_cast<int32_t>(sqrtf(x * x + y * y));
+  }
+}
+
+void KernelWriteChannel(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    const auto channel = static_cast<InverterInterface::Channel>(
+        i % InverterInterface::kNumChannels);
+    g_inverter->WriteChannel(channel, i & 0xFFF,
+                             i & 1 ? InverterInterface::kModeComplementary :
+                                     InverterInterface::kModeFloat);
+    g_sink = i;
+  }
+}
+
+void KernelComputeVelocity(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    Velocity32 velocity;
+    g_rotor_hall->ComputeVelocity(&velocity);
+    g_sink = velocity;
+  }
+}
+
+void KernelComputeSpeed(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    g_sink = BenchRotorHall::ComputeSpeed(i + 100);
+  }
+}
+
+// Feeds forward transitions at 1 kHz with a little jitter.
+void KernelPllEdge(uint32_t iterations) {
+  constexpr icucnt_t counts = HALL_ICU_FREQ / 1000;
+  const Velocity32 velocity = BenchRotorHall::ComputeSpeed(counts);
+  for (uint32_t i = 0; i < iterations; i++) {
+    const Angle16 sector_center = (i % 6) * DegreesToAngle16(60);
+    g_rotor_pll->HandleEdge(sector_center, 1, counts + (i & 7) - 4, velocity);
+    g_sink = i;
+  }
+}
+
+void KernelPllAngle(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    Angle16 angle;
+    g_rotor_pll->ComputeAngle(&angle);
+    g_sink = angle;
+  }
+}
+
+// One flux observer period, with the voltage varying so that the estimate moves.
+void KernelFluxUpdate(uint32_t iterations) {
+  const Current16 currents[InverterInterface::kNumChannels] = { 1000,
+                                                                -300,
+                                                                -700 };
+  for (uint32_t i = 0; i < iterations; i++) {
+    g_rotor_flux->Update(currents, 1000 + (i & 0xFF), -500);
+    g_sink = i;
+  }
+}
+
+void KernelMapRange(uint32_t iterations) {
+  for (uint32_t i = 0; i < iterations; i++) {
+    g_sink = BenchServoInput::MapRange(SERVO_INPUT_MIN_COMMAND,
+                                       SERVO_INPUT_MAX_COMMAND,
+                                       SERVO_INPUT_MIN_COMMAND + i % 1000,
+                                       -INVERTER_PWM_PERIOD / 2,
+                                       INVERTER_PWM_PERIOD / 2,
+                                       SERVO_INPUT_DEADBAND);
+  }
+}
+
+struct Kernel {
+  const char *name;
+  void (*function)(uint32_t iterations);
+};
+
+const Kernel kKernels[] = {
+  { "loop",             KernelLoop },
+  { "commutate",        KernelCommutate },
+  { "foc_update",       KernelFocUpdate },
+  { "svm_polar",        KernelModulatePolar },
+  { "svm_alpha_beta",   KernelModulateAlphaBeta },
+  { "sine16",           KernelSine16 },
+  { "sinf",             KernelSinf },
+  { "cosine16",         KernelCosine16 },
+  { "cosf",             KernelCosf },
+  { "arc_tangent16",    KernelArcTangent16 },
+  { "atan2f",           KernelAtan2f },
+  { "cordic_vector",    KernelCordicVector },
+  { "atan2f_sqrtf",     KernelAtan2fSqrtf },
+  { "write_channel",    KernelWriteChannel },
+  { "compute_velocity", KernelComputeVelocity },
+  { "compute_speed",    KernelComputeSpeed },
+  { "pll_edge",         KernelPllEdge },
+  { "pll_angle",        KernelPllAngle },
+  { "flux_update",      KernelFluxUpdate },
+  { "map_range",        KernelMapRange },
+};
+
+// Runs one batch of a kernel with the system locked, and returns its duration
+// in counter units.
+uint32_t TimeBatch(const Kernel &kernel, uint32_t iterations) {
+  chSysLock();
+  const uint32_t start = CycleCounterRead();
+  kernel.function(iterations);
+  const uint32_t end = CycleCounterRead();
+  chSysUnlock();
+  return end - start;
+}
+
+// Sorts a small array in place.
+void InsertionSort(uint32_t *values, uint32_t size) {
+  for (uint32_t i = 1; i < size; i++) {
+    const uint32_t value = values[i];
+    uint32_t j = i;
+    for (; j > 0 && values[j - 1] > value; j--) {
+      values[j] = values[j - 1];
+    }
+    values[j] = value;
+  }
+}
+
+}  // namespace
+
+// Statistics are computed with integers in hundredths of a counter unit per
+// call, as the target's printf has no floating point support.
+void RunBenchmarks(BenchmarkPrint print,
+                   uint32_t iterations,
+                   uint32_t num_samples) {
+  CHECK(iterations > 0);
+  CHECK(num_samples > 0 && num_samples <= kBenchmarkMaxSamples);
+
+  CycleCounterEnable();
+
+  static WORKING_AREA(wa_rotor_hall, 128);
+  static BenchRotor rotor;
+  static BenchInverterPWM inverter(&INVERTER_PWM);
+  static CommutatorSixStep commutator(&rotor, &inverter, nullptr);
+  static BenchCurrentSensor current_sensor;
+  static CommutatorFoc commutator_foc(&rotor, &inverter, &current_sensor);
+  static ModulatorSpaceVector modulator(&inverter);
+  static BenchRotorHall rotor_hall(&wa_rotor_hall, sizeof(wa_rotor_hall));
+  static RotorPll rotor_pll(&rotor_hall);
+  static RotorFlux rotor_flux(nullptr);
+  g_rotor = &rotor;
+  g_inverter = &inverter;
+  g_commutator = &commutator;
+  g_commutator_foc = &commutator_foc;
+  g_modulator = &modulator;
+  g_rotor_hall = &rotor_hall;
+  g_rotor_pll = &rotor_pll;
+  g_rotor_flux = &rotor_flux;
+  commutator.WriteAmplitude(commutator.GetMaxAmplitude() / 2);
+  commutator.SetEnable(true);
+  commutator_foc.WriteAmplitude(commutator_foc.GetMaxAmplitude() / 2);
+  commutator_foc.SetEnable(true);
+
+  print("# name unit iterations samples min median mean stddev");
+  for (const Kernel &kernel : kKernels) {
+    kernel.function(iterations);
+
+    uint32_t samples[kBenchmarkMaxSamples];
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < num_samples; i++) {
+      samples[i] = static_cast<uint64_t>(TimeBatch(kernel, iterations)) * 100 /
+                   iterations;
+      sum += samples[i];
+    }
+    InsertionSort(samples, num_samples);
+
+    const uint32_t mean = sum / num_samples;
+    uint64_t sum_squares = 0;
+    for (uint32_t i = 0; i < num_samples; i++) {
+      const int64_t deviation = int64_t(samples[i]) - mean;
+      sum_squares += deviation * deviation;
+    }
+    const uint32_t stddev =
+        num_samples > 1 ? IntegerSqrt(sum_squares / (num_samples - 1)) : 0;
+    const uint32_t min = samples[0];
+    const uint32_t median = samples[num_samples / 2];
+
+    print("%s " CYCLE_COUNTER_UNIT " %lu %lu"
+          " %lu.%02lu %lu.%02lu %lu.%02lu %lu.%02lu",
+          kernel.name,
+          static_cast<unsigned long>(iterations),
+          static_cast<unsigned long>(num_samples),
+          static_cast<unsigned long>(min / 100),
+          static_cast<unsigned long>(min % 100),
+          static_cast<unsigned long>(median / 100),
+          static_cast<unsigned long>(median % 100),
+          static_cast<unsigned long>(mean / 100),
+          static_cast<unsigned long>(mean % 100),
+          static_cast<unsigned long>(stddev / 100),
+          static_cast<unsigned long>(stddev % 100));
+  }
+}
@@ -29,20 +29,104 @@
 #include "ch.h"
 #include "hal.h"
 
+#include "base/capture_record.h"
+#include "base/isr_profile.h"
+#include "base/latency_trace.h"
 #include "base/log.h"
 #include "base/utility.h"
+#include "bench/benchmark.h"
 #include "config.h"
 #include "driver/usb_device.h"
 #include "version/version.h"
 
+#if BENCHMARK_AT_STARTUP && !LOGGING_USE_CHPRINTF
+#error "Benchmark output needs chprintf; build with LOGGING_USE_CHPRINTF=yes."
+#endif
+
+#if CURRENT_SENSE_ENABLE && !HAL_USE_ADC
+#error "Current sensing needs the ADC driver, which the simulator doesn't have."
+#endif
+
+#if BUS_VOLTAGE_ENABLE && !HAL_USE_ADC
+#error "Bus voltage sensing needs the ADC driver, which the simulator lacks."
+#endif
+
+#if BUS_VOLTAGE_ENABLE && MOTOR_COMMUTATOR_FOC && CURRENT_SENSE_ENABLE
+#error "FOC with current sensing takes current commands, not voltage commands."
+#endif
+
+#if MOTOR_IDENTIFY_ENABLE && !CURRENT_SENSE_ENABLE
+#error "Motor identification needs current sensing."
+#endif
+
+#if CURRENT_SENSE_ENABLE
+// Time for the current sense amplifier outputs to settle after their inputs
+// are shorted or reconnected, and to take the calibration samples at one per
+// PWM period, plus a tick.
+static constexpr systime_t kCalibrationSettleTime = MS2ST(1);
+static constexpr systime_t kCalibrationTime = MS2ST(
+    static_cast<uint64_t>(CURRENT_SENSE_CALIBRATION_SAMPLES) * 2 *
+        INVERTER_PWM_PERIOD * 1000 / INVERTER_COUNTER_FREQ + 1);
+#endif
+
+#if LOGGING_USE_CHPRINTF
+#include <cstdarg>
+
+#include "chprintf.h"
+
+// Writes a line of machine-readable output to the debug serial port.
+static void PrintDebugLine(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  chvprintf(reinterpret_cast<BaseSequentialStream *>(&DEBUG_SERIAL), format,
+            args);
+  va_end(args);
+  chprintf(reinterpret_cast<BaseSequentialStream *>(&DEBUG_SERIAL), "\r\n");
+}
+#endif  // #if LOGGING_USE_CHPRINTF
+
 // Does whole-system initialization, and uses many static variables as if they
 // were instance variables, because this object is constructed under the
 // assumption that only one will be made.
 Corn::Corn()
     : rotor_hall_(&HALL_ICU, &wa_hall_, sizeof(wa_hall_)),
+#if ROTOR_PLL_ENABLE
+      rotor_pll_(&rotor_hall_),
+#endif
+#if STARTUP_ENABLE
+      // Only FOC regulates current, and only with current sensing.
+      startup_sequencer_(rotor(),
+                         CURRENT_SENSE_ENABLE && MOTOR_COMMUTATOR_FOC),
+#endif
+#if SPEED_GOVERNOR_ENABLE
+      speed_governor_(commutator_rotor(),
+                      &SPEED_GOVERNOR_GPT,
+                      &wa_governor_,
+                      sizeof(wa_governor_)),
+#endif
+#if BUS_VOLTAGE_ENABLE
+      bus_voltage_adc_(&BUS_VOLTAGE_ADC),
+      voltage_compensator_(&bus_voltage_adc_,
+                           &wa_compensator_,
+                           sizeof(wa_compensator_)),
+#endif
       inverter_pwm_(&INVERTER_PWM),
       drv8303_(&DRV_SPI),
-      commutator_six_step_(&rotor_hall_, &inverter_pwm_),
+#if CURRENT_SENSE_ENABLE
+      current_sensor_adc_(&CURRENT_SENSE_ADC, &inverter_pwm_),
+#endif
+#if MOTOR_IDENTIFY_ENABLE
+      motor_identifier_(rotor(), &inverter_pwm_, &current_sensor_adc_),
+      motor_storage_(MOTOR_IDENTIFY_STORAGE),
+#endif
+#if MOTOR_COMMUTATOR_FOC && CURRENT_SENSE_ENABLE
+      commutator_(commutator_rotor(), &inverter_pwm_, &current_sensor_adc_),
+#elif MOTOR_COMMUTATOR_FOC
+      // Without current sensing, FOC runs in voltage mode.
+      commutator_(commutator_rotor(), &inverter_pwm_, nullptr),
+#else
+      commutator_(commutator_rotor(), &inverter_pwm_, &SIX_STEP_GPT),
+#endif
       servo_input_(&SERVO_INPUT_ICU) {
 }
 
@@ -68,6 +152,17 @@ void Corn::Start() {
   // Print startup message.
   LogInfo("Firmware version %s built %s.", g_build_version, g_build_time);
 
+#if ISR_PROFILE_ENABLE
+  // Start measuring interrupts before any of their drivers are started.
+  IsrProfileInit();
+#endif
+#if LATENCY_TRACE_ENABLE
+  LatencyTraceInit();
+#endif
+#if CAPTURE_RECORD_ENABLE
+  CaptureRecordInit();
+#endif
+
   // Start heartbeat thread.
   chThdCreateStatic(wa_heartbeat_,
                     sizeof(wa_heartbeat_),
@@ -75,22 +170,87 @@ void Corn::Start() {
                     ThreadHeartbeat,
                     nullptr);
 
+#if BENCHMARK_AT_STARTUP
+  // Time the commutation path while the timers it writes are still stopped.
+  LogInfo("Running benchmarks...");
+  RunBenchmarks(PrintDebugLine, BENCHMARK_ITERATIONS, BENCHMARK_SAMPLES);
+#endif
+
   // Start USB CDC ACM serial device.
   UsbDevice::Start();
 
   // Start three-phase PWM driver.
+#if STARTUP_ENABLE
+  startup_sequencer_.SetCommutator(&commutator_);
+#endif
+#if MOTOR_IDENTIFY_ENABLE
+  // Pace the identification, until the motor control takes over.
+  inverter_pwm_.SetUpdateCallback(MotorIdentifier::SignalPeriod,
+                                  &motor_identifier_);
+#else
+  SetUpdateCallback();
+#endif
+#if CURRENT_SENSE_ENABLE
+  // Compensate deadtime by the sensed current directions, once sampling.
+  inverter_pwm_.SetCurrentSensor(&current_sensor_adc_);
+#endif
   inverter_pwm_.Start();
 
+#if !MOTOR_COMMUTATOR_FOC
+  // Start timer for advanced six-step commutations.
+  commutator_.Start();
+#endif
+
   // Start gate driver and current sense amplifiers driver.
   drv8303_.Start();
   drv8303_.ResetSoft();
 
+#if CURRENT_SENSE_ENABLE
+  // Start sampling the current sense amplifiers on the inverter's trigger, and
+  // measure their offsets before the motor is driven.
+  current_sensor_adc_.Start();
+  if (CalibrateCurrentSense()) {
+    LogInfo("Calibrated current sense amplifier offsets.");
+  } else {
+    LogError("Failed to calibrate current sense amplifier offsets.");
+  }
+#endif
+
   // Start hall sensor rotor angle driver.
-  rotor_hall_.SetCommutatorSixStep(&commutator_six_step_);
+  rotor_hall_.SetCommutator(commutator_input());
+#if ROTOR_PLL_ENABLE
+  rotor_hall_.SetObserver(&rotor_pll_);
+#endif
   rotor_hall_.Start();
 
+#if BUS_VOLTAGE_ENABLE
+  // Start bus voltage compensation, in front of the commutator.
+  bus_voltage_adc_.Start();
+  voltage_compensator_.SetCommutator(commutator_input());
+  voltage_compensator_.Start();
+#if !MOTOR_COMMUTATOR_FOC
+  // Scale and limit regenerative braking by the filtered bus voltage.
+  commutator_.SetBusVoltageSensor(&voltage_compensator_);
+#endif
+#endif
+
+#if MOTOR_IDENTIFY_ENABLE
+  // Identify the motor on the measured bus voltage, before any commands.
+#if BUS_VOLTAGE_ENABLE
+  motor_identifier_.SetBusVoltageSensor(&voltage_compensator_);
+#endif
+  IdentifyMotor();
+  SetUpdateCallback();
+#endif
+
+#if SPEED_GOVERNOR_ENABLE
+  // Start speed loop, between the servo commands and the commutator.
+  speed_governor_.SetCommutator(voltage_input());
+  speed_governor_.Start();
+#endif
+
   // Start servo pulse input driver.
-  servo_input_.SetCommutatorSixStep(&commutator_six_step_);
+  servo_input_.SetCommutator(command_input());
   servo_input_.Start();
 
   // Start error polling thread.
@@ -101,14 +261,71 @@ void Corn::Start() {
                     &drv8303_);
   LogInfo("Started gate driver error polling.");
 
+#if CURRENT_SENSE_ENABLE
+  // Start current sense recalibration thread.
+  chThdCreateStatic(wa_calibrate_,
+                    sizeof(wa_calibrate_),
+                    LOWPRIO + 1,
+                    ThreadCalibrate,
+                    this);
+#endif
+
   // Signal end of initialization.
   LogInfo("Initialized in %lu ms.", chTimeNow() * 1000 / CH_FREQUENCY);
   INVOKE(palClearPad, GPIO_LED_INIT);
 }
 
 NORETURN void Corn::MainLoop() {
-  commutator_six_step_.CommutationLoop();
+  commutator_.CommutationLoop();
+}
+
+// Without a callback for the motor control, a callback set for identification
+// is cleared once it is done.
+void Corn::SetUpdateCallback() {
+#if STARTUP_ENABLE && MOTOR_COMMUTATOR_FOC
+  inverter_pwm_.SetUpdateCallback(SignalPeriod, this);
+#elif STARTUP_ENABLE
+  inverter_pwm_.SetUpdateCallback(StartupSequencer::SignalPeriod,
+                                  &startup_sequencer_);
+#elif MOTOR_COMMUTATOR_FOC
+  inverter_pwm_.SetUpdateCallback(Commutator::SignalPeriod, &commutator_);
+#else
+  inverter_pwm_.SetUpdateCallback(nullptr, nullptr);
+#endif
+}
+
+#if MOTOR_IDENTIFY_ENABLE
+// Identifying spins the motor unattended, so it is only done when nothing is
+// stored, e.g. on the first startup after a full chip erase.
+void Corn::IdentifyMotor() {
+  MotorIdentifier::Parameters parameters;
+  if (motor_storage_.Read(&parameters, sizeof(parameters))) {
+    LogInfo("Loaded stored motor parameters.");
+  } else {
+    LogInfo("Identifying motor...");
+    if (!motor_identifier_.Run(&parameters)) {
+      return;
+    }
+    if (!motor_storage_.Write(&parameters, sizeof(parameters))) {
+      LogError("Failed to store motor parameters.");
+    }
+  }
+  LogInfo("Motor resistance %ld mOhm, inductance %ld nH, flux linkage %ld nWb.",
+          parameters.resistance, parameters.inductance,
+          parameters.flux_linkage);
+  LogInfo("Recommended FOC_CURRENT_KP %ld, FOC_CURRENT_KI %ld.",
+          parameters.current_kp, parameters.current_ki);
+}
+#endif
+
+#if STARTUP_ENABLE && MOTOR_COMMUTATOR_FOC
+// The inverter has a single update callback, so both are called from here.
+void Corn::SignalPeriod(void *corn) {
+  Corn * const self = static_cast<Corn *>(corn);
+  StartupSequencer::SignalPeriod(&self->startup_sequencer_);
+  Commutator::SignalPeriod(&self->commutator_);
 }
+#endif
 
 // Serial settings for 8N1 at configured baud rate, with no flow control.
 const SerialConfig Corn::kDebugSerialConfig = { DEBUG_BAUDRATE,
@@ -116,7 +333,9 @@ const SerialConfig Corn::kDebugSerialConfig = { DEBUG_BAUDRATE,
                                                 USART_CR2_STOP1_BITS,
                                                 0 };
 
-// Resets the system if two ^C characters are received in succession.
+// Resets the system if two ^C characters are received in succession. Also
+// handles the interrupt profile, latency trace, and capture recording commands,
+// which are not echoed.
 NORETURN msg_t Corn::ThreadReset(void *arg) {
   (void) arg;
 
@@ -125,6 +344,39 @@ NORETURN msg_t Corn::ThreadReset(void *arg) {
   bool etx_received = false;
   while (true) {
     const uint8_t c = chnGetTimeout(&DEBUG_SERIAL, TIME_INFINITE);
+#if ISR_PROFILE_ENABLE && LOGGING_USE_CHPRINTF
+    if (c == 'i') {
+      IsrProfilePrintAll(PrintDebugLine);
+      etx_received = false;
+      continue;
+    } else if (c == 'I') {
+      IsrProfileReset();
+      etx_received = false;
+      continue;
+    }
+#endif
+#if LATENCY_TRACE_ENABLE && LOGGING_USE_CHPRINTF
+    if (c == 'l') {
+      LatencyTracePrintAll(PrintDebugLine);
+      etx_received = false;
+      continue;
+    } else if (c == 'L') {
+      LatencyTraceReset();
+      etx_received = false;
+      continue;
+    }
+#endif
+#if CAPTURE_RECORD_ENABLE && LOGGING_USE_CHPRINTF
+    if (c == 'c') {
+      CaptureRecordPrintAll(PrintDebugLine);
+      etx_received = false;
+      continue;
+    } else if (c == 'C') {
+      CaptureRecordReset();
+      etx_received = false;
+      continue;
+    }
+#endif
     if (c == '\x03') {
       if (etx_received) {
         break;
@@ -169,9 +421,68 @@ NORETURN msg_t Corn::ThreadError(void *drv8303_pointer) {
   chThdExit(0);
 }
 
+#if CURRENT_SENSE_ENABLE
+// The offsets drift with temperature, so they are measured whenever the motor
+// is not being driven.
+NORETURN msg_t Corn::ThreadCalibrate(void *corn) {
+  chRegSetThreadName("calibrate");
+
+  Corn * const self = static_cast<Corn *>(corn);
+  while (true) {
+    chThdSleepMilliseconds(CURRENT_SENSE_CALIBRATION_INTERVAL);
+    self->CalibrateCurrentSense();
+  }
+
+  chThdExit(0);
+}
+
+// The amplifiers don't sense the shunts while their inputs are shorted, so the
+// calibration is only started with the inverter floating, and cut short if it
+// is driven. The currents are marked invalid before the inputs are shorted,
+// and the samples taken while they settle are discarded by starting again.
+// Samples from a calibration cut short are discarded too, so that the few
+// taken as the inputs reconnect can't complete the count.
+bool Corn::CalibrateCurrentSense() {
+  if (!inverter_pwm_.IsFloating()) {
+    return false;
+  }
+  current_sensor_adc_.StartCalibration();
+  if (!drv8303_.SetDcCalibration(true)) {
+    current_sensor_adc_.EndCalibration();
+    return false;
+  }
+  chThdSleep(kCalibrationSettleTime);
+  current_sensor_adc_.StartCalibration();
+  bool floating = true;
+  for (systime_t t = 0; t < kCalibrationTime && floating; t++) {
+    chThdSleep(1);
+    floating = inverter_pwm_.IsFloating();
+  }
+  if (!floating) {
+    current_sensor_adc_.StartCalibration();
+  }
+  if (!drv8303_.SetDcCalibration(false)) {
+    // Leave the currents invalid rather than report the shorted inputs.
+    LogError("Failed to reconnect current sense amplifiers.");
+    return false;
+  }
+  chThdSleep(kCalibrationSettleTime);
+  return current_sensor_adc_.EndCalibration();
+}
+#endif
+
 // Thread working area definitions.
 // TODO(Xo): Define the stack sizes in a single location.
-WORKING_AREA(Corn::wa_reset_, 128);
+WORKING_AREA(Corn::wa_reset_, 512);
 WORKING_AREA(Corn::wa_heartbeat_, 128);
 WORKING_AREA(Corn::wa_hall_, 1024);
 WORKING_AREA(Corn::wa_error_, 512);
+#if SPEED_GOVERNOR_ENABLE
+WORKING_AREA(Corn::wa_governor_, 512);
+#endif
+#if BUS_VOLTAGE_ENABLE
+WORKING_AREA(Corn::wa_compensator_, 256);
+#endif
+#if CURRENT_SENSE_ENABLE
+WORKING_AREA(Corn::wa_calibrate_, 512);
+#endif
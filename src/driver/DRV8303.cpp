@@ -45,7 +45,8 @@ void DRV8303::Start() {
     Deactivate();
     Activate();
   } while (CheckFaults());
-  // TODO: Calibrate analog inputs for amplifier offsets.
+  // Amplifier offsets are calibrated by the current sensor's owner, using
+  // SetDcCalibration, once the ADC is sampling.
   LogInfo("Started gate driver and current sense amplifiers.");
 }
 
@@ -95,6 +96,23 @@ void DRV8303::Deactivate() {
   chThdSleepMicroseconds(10);
 }
 
+// Reads Control register 2 first, so that the gain and the other settings are
+// kept.
+bool DRV8303::SetDcCalibration(bool enable) {
+  uint16_t control2;
+  if (!Read(kRegisterControl2, &control2)) {
+    return false;
+  }
+  const uint16_t dc_cal_mask = (1 << kControl2DcCalChannel1Offset) |
+                               (1 << kControl2DcCalChannel2Offset);
+  if (enable) {
+    control2 |= dc_cal_mask;
+  } else {
+    control2 &= ~dc_cal_mask;
+  }
+  return Write(kRegisterControl2, control2);
+}
+
 // Configures the SPI driver to communicate with the DRV8303.
 //
 // Note that the data sheet specifies that data is latched on clock falling
@@ -0,0 +1,131 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "driver/flash_storage.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "base/log.h"
+
+namespace {
+
+// Sequence that unlocks FLASH_CR for writing.
+constexpr uint32_t kFlashKey1 = 0x45670123;
+constexpr uint32_t kFlashKey2 = 0xCDEF89AB;
+
+}  // namespace
+
+FlashStorage::FlashStorage(uint32_t address)
+    : address_(address) {
+}
+
+bool FlashStorage::Read(void *data, size_t size) const {
+  const Header * const header = reinterpret_cast<const Header *>(address_);
+  const uint8_t * const record = reinterpret_cast<const uint8_t *>(
+      address_ + sizeof(Header));
+  if (header->magic != kMagic || header->size != size ||
+      header->checksum != ComputeChecksum(record, size)) {
+    return false;
+  }
+  std::memcpy(data, record, size);
+  return true;
+}
+
+// The header is programmed last, so that an interrupted write leaves the page
+// without a record rather than with a bad one.
+bool FlashStorage::Write(const void *data, size_t size) {
+  if (size > kPageSize - sizeof(Header)) {
+    LogError("Record too large for flash page (%d).", static_cast<int>(size));
+    return false;
+  }
+  const uint8_t * const record = static_cast<const uint8_t *>(data);
+  const Header header = { kMagic,
+                          static_cast<uint16_t>(size),
+                          ComputeChecksum(record, size) };
+
+  FLASH->KEYR = kFlashKey1;
+  FLASH->KEYR = kFlashKey2;
+  bool success = WaitReady();
+  if (success) {
+    FLASH->CR |= FLASH_CR_PER;
+    FLASH->AR = address_;
+    FLASH->CR |= FLASH_CR_STRT;
+    success = WaitReady();
+    FLASH->CR &= ~FLASH_CR_PER;
+  }
+  success = success &&
+            Program(address_ + sizeof(Header), record, size) &&
+            Program(address_, reinterpret_cast<const uint8_t *>(&header),
+                    sizeof(header));
+  FLASH->CR |= FLASH_CR_LOCK;
+
+  if (!success) {
+    LogError("Failed to write flash page at %x.",
+             static_cast<unsigned>(address_));
+    return false;
+  }
+  return std::memcmp(reinterpret_cast<const void *>(address_), &header,
+                     sizeof(header)) == 0 &&
+         std::memcmp(reinterpret_cast<const void *>(address_ + sizeof(Header)),
+                     record, size) == 0;
+}
+
+uint16_t FlashStorage::ComputeChecksum(const uint8_t *data, size_t size) {
+  uint16_t sum1 = 0;
+  uint16_t sum2 = 0;
+  for (size_t i = 0; i < size; i++) {
+    sum1 = (sum1 + data[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return (sum2 << 8) | sum1;
+}
+
+// Flash is programmed a half-word at a time. Copying through a half-word keeps
+// the source free of alignment requirements.
+bool FlashStorage::Program(uint32_t address, const uint8_t *data, size_t size) {
+  FLASH->CR |= FLASH_CR_PG;
+  bool success = true;
+  for (size_t i = 0; i < size && success; i += sizeof(uint16_t)) {
+    uint16_t half_word = 0xFFFF;
+    std::memcpy(&half_word, data + i, std::min(size - i, sizeof(half_word)));
+    *reinterpret_cast<volatile uint16_t *>(address + i) = half_word;
+    success = WaitReady();
+  }
+  FLASH->CR &= ~FLASH_CR_PG;
+  return success;
+}
+
+bool FlashStorage::WaitReady() {
+  while ((FLASH->SR & FLASH_SR_BSY) != 0)
+    ;
+  const uint32_t status = FLASH->SR;
+  FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPERR;
+  return (status & (FLASH_SR_PGERR | FLASH_SR_WRPERR)) == 0;
+}
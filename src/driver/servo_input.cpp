@@ -29,14 +29,15 @@
 #include <algorithm>
 
 #include "config.h"
+#include "base/capture_record.h"
 #include "base/integer.h"
 #include "base/log.h"
 #include "base/utility.h"
-#include "motor/commutator_six_step.h"
+#include "motor/commutator_interface.h"
 
 ServoInput::ServoInput(ICUDriver *icu_driver)
     : icu_driver_(icu_driver),
-      commutator_six_step_(nullptr),
+      commutator_(nullptr),
       num_overflows_(0),
       last_amplitude_(0) {
 }
@@ -67,14 +68,14 @@ const ICUConfig ServoInput::kServoIcuConfig = { ICU_INPUT_ACTIVE_HIGH,
                                                 ICU_FILTER_F_1_N_8 };
 
 void ServoInput::HandlePulse(int width, int period, bool valid) {
-  if (commutator_six_step_ != nullptr) {
+  if (commutator_ != nullptr) {
     if ((width < (kInputLow - kInputMargin)) ||
         (width > (kInputHigh + kInputMargin))) {
       valid = false;
     }
     if (valid) {
       const int bounded_command = Clamp(width, kInputLow, kInputHigh);
-      const Width16 period_2 = commutator_six_step_->GetMaxAmplitude();
+      const Width16 period_2 = commutator_->GetMaxAmplitude();
       const Width16Diff amplitude = MapRange(kInputLow,
                                              kInputHigh,
                                              bounded_command,
@@ -88,17 +89,17 @@ void ServoInput::HandlePulse(int width, int period, bool valid) {
           Clamp<int>(amplitude,
                      last_amplitude_ - slew_margin,
                      last_amplitude_ + slew_margin);
-      commutator_six_step_->WriteAmplitude(slew_limited_amplitude);
+      commutator_->WriteAmplitude(slew_limited_amplitude);
       last_amplitude_ = slew_limited_amplitude;
       chSysLockFromIsr();
-      commutator_six_step_->SetEnable(true);
-      commutator_six_step_->SignalChange();
+      commutator_->SetEnable(true);
+      commutator_->SignalChange();
       chSysUnlockFromIsr();
     } else {
       last_amplitude_ = 0;
       chSysLockFromIsr();
-      commutator_six_step_->SetEnable(false);
-      commutator_six_step_->SignalChange();
+      commutator_->SetEnable(false);
+      commutator_->SignalChange();
       chSysUnlockFromIsr();
     }
   }
@@ -110,6 +111,9 @@ void ServoInput::IcuWidthCallback(ICUDriver *icu_driver) {
   const uint16_t pulse_width = icuGetWidth(icu_driver);
   const uint16_t pulse_period = icuGetPeriod(icu_driver);
   ServoInput * const servo_input = static_cast<ServoInput *>(icu_driver->self);
+#if CAPTURE_RECORD_ENABLE
+  CaptureRecordEventFromIsr('S', 0, pulse_width, pulse_period);
+#endif
   if (servo_input->num_overflows_ > 0) {
     servo_input->HandlePulse(-1, -1, false);
   } else {
@@ -124,6 +128,9 @@ void ServoInput::IcuPeriodCallback(ICUDriver *icu_driver) {
 
 // Disables commutation if more than one overflow has ocurred.
 void ServoInput::IcuOverflowCallback(ICUDriver *icu_driver) {
+#if CAPTURE_RECORD_ENABLE
+  CaptureRecordEventFromIsr('V', 0, 0, 0);
+#endif
   ServoInput * const servo_input = static_cast<ServoInput *>(icu_driver->self);
   // Increment with saturation.
   servo_input->num_overflows_ =
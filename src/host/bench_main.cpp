@@ -0,0 +1,167 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+// Runs the commutation path micro-benchmarks on the build host, or compares
+// two sets of benchmark results, e.g. a stored baseline against a new run on
+// the host or a log captured from the target's debug serial port.
+//
+// Usage: corn_bench [iterations] [samples]
+//   iterations   Calls per timed batch (default 10000).
+//   samples      Timed batches per kernel (default 31).
+//
+// Usage: corn_bench --compare baseline current [threshold_percent]
+//   Prints the change in median cost of each kernel found in both files. Lines
+//   that aren't results (e.g. log messages) are skipped. Exits with failure if
+//   any kernel's median rose by more than threshold_percent (default 5) and by
+//   more than three standard errors.
+
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "bench/benchmark.h"
+
+namespace {
+
+constexpr int kMaxResults = 32;
+
+struct Result {
+  char name[32];
+  char unit[16];
+  unsigned long iterations;
+  unsigned long samples;
+  double min;
+  double median;
+  double mean;
+  double stddev;
+};
+
+void PrintLine(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  std::vprintf(format, args);
+  va_end(args);
+  std::putchar('\n');
+}
+
+// Reads every result line in a file, returning the number read or -1 if the
+// file couldn't be opened.
+int ReadResults(const char *path, Result *results) {
+  std::FILE *file = std::fopen(path, "r");
+  if (file == nullptr) {
+    std::perror(path);
+    return -1;
+  }
+  int num_results = 0;
+  char line[256];
+  while (num_results < kMaxResults &&
+         std::fgets(line, sizeof(line), file) != nullptr) {
+    Result &result = results[num_results];
+    if (line[0] != '#' &&
+        std::sscanf(line, "%31s %15s %lu %lu %lf %lf %lf %lf",
+                    result.name, result.unit, &result.iterations,
+                    &result.samples, &result.min, &result.median,
+                    &result.mean, &result.stddev) == 8) {
+      num_results++;
+    }
+  }
+  std::fclose(file);
+  return num_results;
+}
+
+// Standard error of the median of normally distributed samples.
+double MedianStandardError(const Result &result) {
+  return 1.2533 * result.stddev / std::sqrt(double(result.samples));
+}
+
+int Compare(const char *baseline_path, const char *current_path,
+            double threshold_percent) {
+  Result baseline[kMaxResults];
+  Result current[kMaxResults];
+  const int num_baseline = ReadResults(baseline_path, baseline);
+  const int num_current = ReadResults(current_path, current);
+  if (num_baseline < 0 || num_current < 0) {
+    return EXIT_FAILURE;
+  }
+
+  bool regressed = false;
+  std::printf("# name unit baseline current delta delta_percent z\n");
+  for (int i = 0; i < num_current; i++) {
+    const Result *match = nullptr;
+    for (int j = 0; j < num_baseline; j++) {
+      if (std::strcmp(baseline[j].name, current[i].name) == 0 &&
+          std::strcmp(baseline[j].unit, current[i].unit) == 0) {
+        match = &baseline[j];
+      }
+    }
+    if (match == nullptr) {
+      std::printf("%s %s - %.2f - - -\n", current[i].name, current[i].unit,
+                  current[i].median);
+      continue;
+    }
+    const double delta = current[i].median - match->median;
+    const double delta_percent =
+        match->median != 0 ? delta / match->median * 100 : 0;
+    const double standard_error = std::hypot(MedianStandardError(*match),
+                                             MedianStandardError(current[i]));
+    const double z = standard_error > 0 ? delta / standard_error : 0;
+    std::printf("%s %s %.2f %.2f %+.2f %+.1f %+.1f\n", current[i].name,
+                current[i].unit, match->median, current[i].median, delta,
+                delta_percent, z);
+    if (delta_percent > threshold_percent && z > 3) {
+      regressed = true;
+    }
+  }
+  return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 && std::strcmp(argv[1], "--compare") == 0) {
+    if (argc < 4) {
+      std::fprintf(stderr, "usage: %s --compare baseline current "
+                   "[threshold_percent]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+    return Compare(argv[2], argv[3],
+                   argc > 4 ? std::strtod(argv[4], nullptr) : 5.0);
+  }
+
+  const unsigned long iterations =
+      argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 10000;
+  const unsigned long samples =
+      argc > 2 ? std::strtoul(argv[2], nullptr, 0) : 31;
+  if (iterations < 1 || samples < 1 || samples > kBenchmarkMaxSamples) {
+    std::fprintf(stderr, "iterations must be at least 1 and samples from 1 to "
+                 "%lu\n", static_cast<unsigned long>(kBenchmarkMaxSamples));
+    return EXIT_FAILURE;
+  }
+  RunBenchmarks(PrintLine, iterations, samples);
+  return EXIT_SUCCESS;
+}
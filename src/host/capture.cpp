@@ -0,0 +1,95 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "host/capture.h"
+
+#include <cinttypes>
+#include <cstring>
+
+// Reads whole lines so that a malformed line is reported by its number rather
+// than by where scanf stopped.
+CaptureReadResult ReadCaptureEvent(std::FILE *file,
+                                   CaptureEvent *event,
+                                   unsigned *line_number) {
+  char line[128];
+  while (std::fgets(line, sizeof(line), file) != nullptr) {
+    (*line_number)++;
+    const char *text = line + std::strspn(line, " \t");
+    if (*text == '\0' || *text == '\n' || *text == '\r' || *text == '#') {
+      continue;
+    }
+
+    CaptureEvent parsed = CaptureEvent();
+    parsed.type = static_cast<CaptureEvent::Type>(*text);
+    text++;
+    int fields;
+    switch (parsed.type) {
+      case CaptureEvent::kHallEdge:
+        fields = std::sscanf(text, "%" SCNu32 " %u %" SCNu32,
+                             &parsed.time_us, &parsed.hall_state,
+                             &parsed.count);
+        if (fields != 3 || parsed.hall_state > 7) {
+          return kCaptureReadError;
+        }
+        break;
+      case CaptureEvent::kServoPulse:
+        fields = std::sscanf(text, "%" SCNu32 " %" SCNu32 " %" SCNu32,
+                             &parsed.time_us, &parsed.count, &parsed.period);
+        if (fields != 3) {
+          return kCaptureReadError;
+        }
+        break;
+      case CaptureEvent::kHallOverflow:
+      case CaptureEvent::kServoOverflow:
+        if (std::sscanf(text, "%" SCNu32, &parsed.time_us) != 1) {
+          return kCaptureReadError;
+        }
+        break;
+      default:
+        return kCaptureReadError;
+    }
+    *event = parsed;
+    return kCaptureReadOk;
+  }
+  return kCaptureReadEnd;
+}
+
+void WriteCaptureEvent(std::FILE *file, const CaptureEvent &event) {
+  switch (event.type) {
+    case CaptureEvent::kHallEdge:
+      std::fprintf(file, "H %" PRIu32 " %u %" PRIu32 "\n",
+                   event.time_us, event.hall_state, event.count);
+      break;
+    case CaptureEvent::kServoPulse:
+      std::fprintf(file, "S %" PRIu32 " %" PRIu32 " %" PRIu32 "\n",
+                   event.time_us, event.count, event.period);
+      break;
+    default:
+      std::fprintf(file, "%c %" PRIu32 "\n",
+                   static_cast<char>(event.type), event.time_us);
+      break;
+  }
+}
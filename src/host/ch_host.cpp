@@ -0,0 +1,61 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "ch.h"
+
+#include <cstdlib>
+
+namespace {
+
+systime_t g_host_time = 0;  // Simulated system tick count.
+
+}  // namespace
+
+// Stores the thread function in the working area, where the real kernel keeps
+// its thread structure, but does not run it.
+Thread *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf,
+                          void *arg) {
+  if (size < sizeof(Thread)) {
+    std::abort();
+  }
+  Thread * const tp = static_cast<Thread *>(wsp);
+  tp->p_func = pf;
+  tp->p_arg = arg;
+  tp->p_prio = prio;
+  return tp;
+}
+
+void chThdExit(msg_t msg) {
+  std::exit(msg);
+}
+
+systime_t chTimeNow(void) {
+  return g_host_time;
+}
+
+void chThdSleep(systime_t time) {
+  g_host_time += time;
+}
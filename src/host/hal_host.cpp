@@ -0,0 +1,243 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "hal.h"
+
+#include "config.h"
+#include "base/latency_trace.h"
+
+namespace {
+
+stm32_tim_t g_tim1;  // Backs PWMD1.
+stm32_tim_t g_tim2;  // Backs ICUD2.
+stm32_tim_t g_tim3;  // Backs GPTD3.
+stm32_tim_t g_tim4;  // Backs ICUD4.
+stm32_tim_t g_tim6;  // Backs GPTD6.
+stm32_tim_t g_tim7;  // Backs GPTD7.
+
+}  // namespace
+
+GPIO_TypeDef host_gpioa;
+GPIO_TypeDef host_gpiob;
+
+ICUDriver ICUD2 = { ICU_STOP, nullptr, nullptr, 0, &g_tim2, nullptr, nullptr };
+ICUDriver ICUD4 = { ICU_STOP, nullptr, nullptr, 0, &g_tim4, nullptr, nullptr };
+PWMDriver PWMD1 = { PWM_STOP, nullptr, 0, nullptr, 0, &g_tim1 };
+GPTDriver GPTD3 = { GPT_STOP, nullptr, nullptr, 0, &g_tim3 };
+GPTDriver GPTD6 = { GPT_STOP, nullptr, nullptr, 0, &g_tim6 };
+GPTDriver GPTD7 = { GPT_STOP, nullptr, nullptr, 0, &g_tim7 };
+
+ADCDriver ADCD1 = { ADC_STOP, nullptr, nullptr, 0, nullptr, nullptr, 0 };
+ADCDriver ADCD3 = { ADC_STOP, nullptr, nullptr, 0, nullptr, nullptr, 0 };
+
+void adcStart(ADCDriver *adcp, const ADCConfig *config) {
+  adcp->config = config;
+  adcp->state = ADC_READY;
+}
+
+void adcStop(ADCDriver *adcp) {
+  adcp->state = ADC_STOP;
+}
+
+void adcStartConversion(ADCDriver *adcp,
+                        const ADCConversionGroup *grpp,
+                        adcsample_t *samples,
+                        size_t depth) {
+  adcp->grpp = grpp;
+  adcp->samples = samples;
+  adcp->depth = depth;
+  adcp->next_half = 0;
+  adcp->state = ADC_ACTIVE;
+}
+
+void adcStopConversion(ADCDriver *adcp) {
+  adcp->state = ADC_READY;
+}
+
+msg_t adcConvert(ADCDriver *adcp,
+                 const ADCConversionGroup *grpp,
+                 adcsample_t *samples,
+                 size_t depth) {
+  (void) adcp;
+  (void) grpp;
+  (void) samples;
+  (void) depth;
+  return RDY_RESET;
+}
+
+// A circular conversion calls back once per half buffer, as the DMA half and
+// full transfer interrupts do.
+void adcHostInvokeConversion(ADCDriver *adcp, const adcsample_t *samples) {
+  if (adcp->state != ADC_ACTIVE) {
+    return;
+  }
+  const size_t half_depth = adcp->depth / 2;
+  const size_t num_channels = adcp->grpp->num_channels;
+  adcsample_t * const half = adcp->samples +
+                             adcp->next_half * half_depth * num_channels;
+  for (size_t i = 0; i < half_depth * num_channels; i++) {
+    half[i] = samples[i % num_channels];
+  }
+  adcp->next_half ^= 1;
+  if (adcp->grpp->end_cb != nullptr) {
+    adcp->grpp->end_cb(adcp, half, half_depth);
+  }
+}
+
+void gptStart(GPTDriver *gptp, const GPTConfig *config) {
+  gptp->config = config;
+  gptp->clock = config->frequency;
+  gptp->state = GPT_READY;
+}
+
+void gptStop(GPTDriver *gptp) {
+  gptp->state = GPT_STOP;
+}
+
+// Loads the interval as the target driver does, for the host program to read.
+void gptStartOneShotI(GPTDriver *gptp, gptcnt_t interval) {
+  gptp->tim->ARR = interval - 1;
+  gptp->tim->CNT = 0;
+  gptp->state = GPT_ONESHOT;
+}
+
+void gptStartContinuous(GPTDriver *gptp, gptcnt_t interval) {
+  gptp->tim->ARR = interval - 1;
+  gptp->tim->CNT = 0;
+  gptp->state = GPT_CONTINUOUS;
+}
+
+void gptStopTimerI(GPTDriver *gptp) {
+  gptp->state = GPT_READY;
+}
+
+// A one-shot timer stops before its callback runs, so the callback can start
+// it again.
+void gptHostInvokeCallback(GPTDriver *gptp) {
+  if (gptp->state != GPT_ONESHOT && gptp->state != GPT_CONTINUOUS) {
+    return;
+  }
+  if (gptp->state == GPT_ONESHOT) {
+    gptp->state = GPT_READY;
+  }
+  if (gptp->config->callback != nullptr) {
+    gptp->config->callback(gptp);
+  }
+}
+
+// Selects the capture registers like the target driver does, so that width
+// and period are read from the same CCRs.
+void icuStart(ICUDriver *icup, const ICUConfig *config) {
+  icup->config = config;
+  icup->clock = config->frequency;
+  icup->tim->CNT = 0;
+  if (config->channel == ICU_CHANNEL_1) {
+    icup->wccrp = &icup->tim->CCR[1];
+    icup->pccrp = &icup->tim->CCR[0];
+  } else {
+    icup->wccrp = &icup->tim->CCR[0];
+    icup->pccrp = &icup->tim->CCR[1];
+  }
+  icup->state = ICU_READY;
+}
+
+void icuStop(ICUDriver *icup) {
+  icup->state = ICU_STOP;
+}
+
+void icuEnable(ICUDriver *icup) {
+  icup->tim->CNT = 0;
+  icup->state = ICU_WAITING;
+}
+
+void icuDisable(ICUDriver *icup) {
+  icup->state = ICU_READY;
+}
+
+#if LATENCY_TRACE_ENABLE
+namespace {
+
+// Starts a latency trace for hall edges as the target ISR does. The capture is
+// taken to happen as the simulated ISR is entered.
+void StartLatencyTrace(ICUDriver *icup) {
+  if (icup == &HALL_ICU) {
+    LatencyTraceStartI(CycleCounterRead(), 0);
+  }
+}
+
+}  // namespace
+#endif
+
+// Latches the captured count into the CCR as (count - 1), which is what the
+// hardware stores for a timer that is reset on the capture edge.
+void icuHostInvokeWidth(ICUDriver *icup, icucnt_t width) {
+#if LATENCY_TRACE_ENABLE
+  StartLatencyTrace(icup);
+#endif
+  *icup->wccrp = width - 1;
+  icup->state = ICU_ACTIVE;
+  if (icup->config->width_cb != nullptr) {
+    icup->config->width_cb(icup);
+  }
+}
+
+void icuHostInvokePeriod(ICUDriver *icup, icucnt_t period) {
+#if LATENCY_TRACE_ENABLE
+  StartLatencyTrace(icup);
+#endif
+  *icup->pccrp = period - 1;
+  icup->state = ICU_ACTIVE;
+  if (icup->config->period_cb != nullptr) {
+    icup->config->period_cb(icup);
+  }
+}
+
+void icuHostInvokeOverflow(ICUDriver *icup) {
+  if (icup->config->overflow_cb != nullptr) {
+    icup->config->overflow_cb(icup);
+  }
+}
+
+// Loads the configuration into the timer registers so that code that reads
+// them back (e.g. the period) sees the same values as on the target.
+void pwmStart(PWMDriver *pwmp, const PWMConfig *config) {
+  pwmp->config = config;
+  pwmp->period = config->period;
+  pwmp->clock = config->frequency;
+  pwmp->tim->CR1 = config->cr1;
+  pwmp->tim->CR2 = config->cr2;
+  pwmp->tim->BDTR = config->bdtr | STM32_TIM_BDTR_MOE;
+  pwmp->tim->DIER = config->dier;
+  pwmp->tim->ARR = config->period - 1;
+  pwmp->tim->PSC = 0;
+  pwmp->tim->CCER = 0;
+  pwmp->tim->CNT = 0;
+  pwmp->state = PWM_READY;
+}
+
+void pwmStop(PWMDriver *pwmp) {
+  pwmp->state = PWM_STOP;
+}
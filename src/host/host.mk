@@ -0,0 +1,125 @@
+# Rules for compiling the portable Corn3 code natively on the build host, using
+# the ChibiOS/HAL stand-ins in /include/host and /src/host in place of the real
+# kernel and STM32 drivers.
+#
+# Invoked through "make host" from the top level Makefile. Does not need
+# ChibiOS or the ARM toolchain.
+
+# Host toolchain. Override HOSTPREFIX to cross-compile for another host.
+HOSTPREFIX ?=
+HOSTCC   = $(HOSTPREFIX)gcc
+HOSTCPPC = $(HOSTPREFIX)g++
+HOSTAR   = $(HOSTPREFIX)ar
+
+HOSTBUILDDIR = build/host
+HOSTOBJDIR   = $(HOSTBUILDDIR)/obj
+
+# Same language options and warnings as the target, so that code that compiles
+# here also compiles for the target.
+HOSTOPT    = -O2 -g
+HOSTCOPT   = -std=gnu99 -Wall -Wextra -Wstrict-prototypes
+HOSTCPPOPT = -std=c++11 -fno-rtti -fno-exceptions -Wall -Wextra
+HOSTDEFS   = -DCORN_HOST=1 -DLOGGING_USE_CHPRINTF=0 -DUSE_NEW_DELETE=1
+HOSTINC    = -Iinclude/host -Iinclude -Iinclude/board
+
+# ChibiOS/HAL stand-ins and simulation models.
+HOSTSHIMSRC = src/host/ch_host.cpp \
+              src/host/hal_host.cpp \
+              src/host/utility_host.cpp \
+              src/host/motor_model.cpp \
+              src/host/capture.cpp \
+
+# Portable Corn3 sources under test.
+HOSTCSRC = src/base/capture_record.c \
+           src/base/histogram.c \
+           src/base/latency_trace.c \
+           src/base/log.c \
+
+HOSTCPPSRC = $(HOSTSHIMSRC) \
+             src/driver/servo_input.cpp \
+             src/motor/bus_voltage_adc.cpp \
+             src/motor/commutator_foc.cpp \
+             src/motor/commutator_six_step.cpp \
+             src/motor/current_sensor_adc.cpp \
+             src/motor/inverter_pwm.cpp \
+             src/motor/modulator_space_vector.cpp \
+             src/motor/motor_identifier.cpp \
+             src/motor/rotor_bemf.cpp \
+             src/motor/rotor_flux.cpp \
+             src/motor/rotor_hall.cpp \
+             src/motor/rotor_pll.cpp \
+             src/motor/speed_governor.cpp \
+             src/motor/startup_sequencer.cpp \
+             src/motor/trig.cpp \
+             src/motor/voltage_compensator.cpp \
+             src/bench/benchmark.cpp \
+
+# Host programs, each built from one source file linked against HOSTLIB:
+#   corn_plant   Runs a commutator in closed loop with MotorModel.
+#   corn_replay  Replays a capture through RotorHall and ServoInput.
+#   corn_bench   Times the commutation path and compares benchmark results.
+HOSTTOOLSRC = src/host/plant_main.cpp \
+              src/host/replay_main.cpp \
+              src/host/bench_main.cpp \
+
+HOSTTOOLS = $(HOSTBUILDDIR)/corn_plant \
+            $(HOSTBUILDDIR)/corn_replay \
+            $(HOSTBUILDDIR)/corn_bench \
+
+# Captures replayed by "make host", each against the trace of the same name
+# that it must reproduce exactly. After a deliberate change in commutation,
+# "make host-traces" rewrites the traces, to be reviewed and committed.
+HOSTREPLAYDIR    = test/replay
+HOSTREPLAYCHECKS = $(patsubst $(HOSTREPLAYDIR)/%.capture, \
+                              $(HOSTBUILDDIR)/replay/%.ok, \
+                              $(wildcard $(HOSTREPLAYDIR)/*.capture))
+
+HOSTOBJS = $(addprefix $(HOSTOBJDIR)/, $(HOSTCSRC:.c=.o) $(HOSTCPPSRC:.cpp=.o))
+HOSTTOOLOBJS = $(addprefix $(HOSTOBJDIR)/, $(HOSTTOOLSRC:.cpp=.o))
+HOSTLIB  = $(HOSTBUILDDIR)/libcorn_host.a
+
+.PHONY: host host-traces host-clean
+
+# Keep tool objects, which are otherwise intermediate to the pattern rule.
+.SECONDARY: $(HOSTTOOLOBJS)
+
+host: $(HOSTLIB) $(HOSTTOOLS) $(HOSTREPLAYCHECKS)
+
+$(HOSTLIB): $(HOSTOBJS)
+	@echo Archiving $@
+	@$(HOSTAR) rcs $@ $^
+
+$(HOSTBUILDDIR)/corn_%: $(HOSTOBJDIR)/src/host/%_main.o $(HOSTLIB)
+	@echo Linking $@
+	@$(HOSTCPPC) $(HOSTOPT) $^ -o $@ -lm
+
+$(HOSTBUILDDIR)/replay/%.ok: $(HOSTREPLAYDIR)/%.capture \
+                             $(HOSTREPLAYDIR)/%.trace \
+                             $(HOSTBUILDDIR)/corn_replay
+	@mkdir -p $(dir $@)
+	@echo Checking replay of $<
+	@$(HOSTBUILDDIR)/corn_replay $< $(@:.ok=.trace) 2> /dev/null
+	@diff -u $(HOSTREPLAYDIR)/$*.trace $(@:.ok=.trace)
+	@touch $@
+
+host-traces: $(HOSTBUILDDIR)/corn_replay
+	@for capture in $(HOSTREPLAYDIR)/*.capture; do \
+	  echo Writing $${capture%.capture}.trace; \
+	  $(HOSTBUILDDIR)/corn_replay $$capture $${capture%.capture}.trace \
+	      2> /dev/null; \
+	done
+
+$(HOSTOBJDIR)/%.o: %.c
+	@mkdir -p $(dir $@)
+	@echo Compiling $< for host
+	@$(HOSTCC) -c $(HOSTOPT) $(HOSTCOPT) $(HOSTDEFS) $(HOSTINC) -MMD -MP $< -o $@
+
+$(HOSTOBJDIR)/%.o: %.cpp
+	@mkdir -p $(dir $@)
+	@echo Compiling $< for host
+	@$(HOSTCPPC) -c $(HOSTOPT) $(HOSTCPPOPT) $(HOSTDEFS) $(HOSTINC) -MMD -MP $< -o $@
+
+host-clean:
+	rm -rf $(HOSTBUILDDIR)
+
+-include $(HOSTOBJS:.o=.d) $(HOSTTOOLOBJS:.o=.d)
@@ -0,0 +1,334 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "host/motor_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "config.h"
+
+namespace {
+
+constexpr double kTwoPi = 2 * kPi;
+
+// Hall states in counterclockwise order, for sectors centered on 0, 60, ...,
+// 300 electrical degrees. Matches RotorHall::HallState.
+constexpr unsigned kHallSequence[] = { 0x3, 0x2, 0x6, 0x4, 0x5, 0x1 };
+constexpr int kNumHallSectors = 6;
+
+// Time for the 32-bit hall timer to overflow, after which RotorHall stops
+// interpolating.
+constexpr double kHallTimerPeriod = 4294967296.0 / HALL_ICU_FREQ;
+
+}  // namespace
+
+MotorModel::MotorModel(const Parameters &parameters)
+    : parameters_(parameters),
+      angle_mode_(kAngleHall),
+      width_(),
+      mode_preload_(),
+      mode_(),
+      time_(0),
+      electrical_angle_(0),
+      mechanical_velocity_(0),
+      current_(),
+      terminal_voltage_(),
+      torque_(0),
+      bus_current_(0),
+      hall_edge_time_(0),
+      hall_sector_duration_(0),
+      hall_direction_(0) {
+  ResetStatistics();
+}
+
+// About 1900 RPM/V with 14 poles, e.g. a 2204-size gimbal or racing motor.
+MotorModel::Parameters MotorModel::DefaultParameters() {
+  Parameters parameters;
+  parameters.resistance = 0.1;
+  parameters.inductance = 20e-6;
+  parameters.back_emf_constant = 0.005;
+  parameters.pole_pairs = 7;
+  parameters.inertia = 5e-6;
+  parameters.viscous_friction = 1e-6;
+  parameters.load_torque = 0.005;
+  parameters.bus_voltage = 12;
+  parameters.pwm_period = INVERTER_PWM_PERIOD;
+  return parameters;
+}
+
+// Steps at most max_step at a time, stopping early on a hall transition so
+// that the caller can commutate at the right time.
+bool MotorModel::Advance(double duration, double max_step) {
+  const double end_time = time_ + duration;
+  const int hall_sector = GetHallSector();
+  while (time_ < end_time) {
+    Step(std::min(max_step, end_time - time_));
+    const int new_hall_sector = GetHallSector();
+    if (new_hall_sector != hall_sector) {
+      statistics_.hall_transitions++;
+      if (new_hall_sector == (hall_sector + 1) % kNumHallSectors) {
+        hall_direction_ = 1;
+      } else if (hall_sector == (new_hall_sector + 1) % kNumHallSectors) {
+        hall_direction_ = -1;
+      } else {
+        hall_direction_ = 0;
+      }
+      hall_sector_duration_ = time_ - hall_edge_time_;
+      hall_edge_time_ = time_;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MotorModel::ComputeAngle(Angle16 *angle) {
+  double reported_angle = electrical_angle_;
+  if (angle_mode_ == kAngleHall || angle_mode_ == kAngleHallInterpolated) {
+    reported_angle = GetHallSector() * (kPi / 3);
+  }
+  const double time_since_edge = time_ - hall_edge_time_;
+  if (angle_mode_ == kAngleHallInterpolated && hall_direction_ != 0 &&
+      hall_sector_duration_ > 0 && time_since_edge < kHallTimerPeriod) {
+    const double progress = std::min(time_since_edge / hall_sector_duration_,
+                                     1.0);
+    reported_angle += hall_direction_ * (progress - 0.5) * (kPi / 3);
+  }
+  *angle = static_cast<Angle16>(
+      static_cast<long>(std::lround(reported_angle / kTwoPi * 65536)) & 0xFFFF);
+  return true;
+}
+
+bool MotorModel::ComputeVelocity(Velocity32 *velocity) {
+  *velocity = static_cast<Velocity32>(std::lround(
+      mechanical_velocity_ * parameters_.pole_pairs / kTwoPi * 65536));
+  return true;
+}
+
+bool MotorModel::ComputeCurrents(Current16 currents[kNumChannels]) {
+  constexpr double kMin = std::numeric_limits<Current16>::min();
+  constexpr double kMax = std::numeric_limits<Current16>::max();
+  for (int i = 0; i < kNumChannels; i++) {
+    const double milliamperes = std::round(current_[i] * 1000);
+    currents[i] = static_cast<Current16>(
+        std::max(kMin, std::min(milliamperes, kMax)));
+  }
+  return true;
+}
+
+bool MotorModel::ComputeVoltages(Voltage16 voltages[kNumChannels]) {
+  constexpr double kMin = std::numeric_limits<Voltage16>::min();
+  constexpr double kMax = std::numeric_limits<Voltage16>::max();
+  for (int i = 0; i < kNumChannels; i++) {
+    const double scaled = std::round(terminal_voltage_[i] * 256);
+    voltages[i] = static_cast<Voltage16>(std::max(kMin,
+                                                  std::min(scaled, kMax)));
+  }
+  return true;
+}
+
+bool MotorModel::ComputeBusVoltage(Voltage16 *voltage) {
+  constexpr double kMax = std::numeric_limits<Voltage16>::max();
+  *voltage = static_cast<Voltage16>(
+      std::min(std::round(parameters_.bus_voltage * 256), kMax));
+  return true;
+}
+
+void MotorModel::WriteChannel(Channel channel, Width16 width, Mode mode) {
+  width_[channel] = std::min(width, parameters_.pwm_period);
+  mode_preload_[channel] = mode;
+}
+
+void MotorModel::SyncModes() {
+  std::copy(mode_preload_, mode_preload_ + kNumChannels, mode_);
+}
+
+unsigned MotorModel::GetHallState() const {
+  return kHallSequence[GetHallSector()];
+}
+
+int MotorModel::GetHallSector() const {
+  return static_cast<int>(std::floor((electrical_angle_ + kPi / 6) /
+                                     (kPi / 3))) % kNumHallSectors;
+}
+
+void MotorModel::ResetStatistics() {
+  statistics_ = Statistics();
+  statistics_.torque_min = std::numeric_limits<double>::infinity();
+  statistics_.torque_max = -std::numeric_limits<double>::infinity();
+  statistics_.stop_time = -1;
+}
+
+// Solves for the neutral point voltage from the phases that carry current, then
+// integrates the phase currents and the rotor. Phases with no current and no
+// drive (floating) are excluded, and take on the neutral voltage plus their
+// back EMF.
+void MotorModel::Step(double dt) {
+  const double bus_voltage = parameters_.bus_voltage;
+  const double speed_constant =
+      parameters_.back_emf_constant * mechanical_velocity_;
+
+  double back_emf[kNumChannels];
+  double torque_coefficient[kNumChannels];
+  bool conducting[kNumChannels];
+  int num_conducting = 0;
+  double conducting_voltage_sum = 0;
+  for (int i = 0; i < kNumChannels; i++) {
+    const Channel channel = static_cast<Channel>(i);
+    torque_coefficient[i] = TorqueCoefficient(channel, electrical_angle_);
+    back_emf[i] = speed_constant * torque_coefficient[i];
+    if (mode_[i] == kModeComplementary) {
+      terminal_voltage_[i] = bus_voltage * width_[i] / parameters_.pwm_period;
+      conducting[i] = true;
+    } else if (mode_[i] == kModeLowSide &&
+               (current_[i] > 0 || width_[i] < parameters_.pwm_period)) {
+      // Grounded outside of the width. Within it, current flowing into the
+      // motor freewheels through the low-side diode, and current flowing out
+      // returns through the high-side diode to the bus.
+      terminal_voltage_[i] = current_[i] < 0 ?
+                                 bus_voltage * width_[i] /
+                                     parameters_.pwm_period :
+                                 0;
+      conducting[i] = true;
+    } else if (mode_[i] == kModeHighSide &&
+               (current_[i] < 0 || width_[i] > 0)) {
+      // At the bus for the width. Outside of it, current flowing into the
+      // motor freewheels through the low-side diode, and current flowing out
+      // returns through the high-side diode to the bus.
+      terminal_voltage_[i] = current_[i] < 0 ?
+                                 bus_voltage :
+                                 bus_voltage * width_[i] /
+                                     parameters_.pwm_period;
+      conducting[i] = true;
+    } else if (current_[i] != 0) {
+      // Freewheeling through the low-side diode if current flows into the
+      // motor, or the high-side diode if it flows out.
+      terminal_voltage_[i] = current_[i] > 0 ? 0 : bus_voltage;
+      conducting[i] = true;
+    } else {
+      conducting[i] = false;
+    }
+    if (conducting[i]) {
+      num_conducting++;
+      conducting_voltage_sum += terminal_voltage_[i] - back_emf[i];
+    }
+  }
+
+  // With fewer than two conducting phases there is no path for current, and
+  // the neutral follows the single driven phase (if any).
+  const double neutral_voltage =
+      num_conducting > 0 ? conducting_voltage_sum / num_conducting
+                         : -(back_emf[0] + back_emf[1] + back_emf[2]) / 3;
+
+  torque_ = 0;
+  bus_current_ = 0;
+  double copper_power = 0;
+  for (int i = 0; i < kNumChannels; i++) {
+    if (!conducting[i] || num_conducting < 2) {
+      terminal_voltage_[i] = neutral_voltage + back_emf[i];
+      current_[i] = 0;
+      continue;
+    }
+    const double last_current = current_[i];
+    const double di = (terminal_voltage_[i] - back_emf[i] - neutral_voltage -
+                       parameters_.resistance * last_current) /
+                      parameters_.inductance * dt;
+    current_[i] = last_current + di;
+    // A diode stops conducting when its current reaches zero.
+    if (mode_[i] == kModeFloat && (last_current > 0) != (current_[i] > 0)) {
+      current_[i] = 0;
+    }
+    torque_ += parameters_.back_emf_constant * torque_coefficient[i] *
+               current_[i];
+    bus_current_ += terminal_voltage_[i] / bus_voltage * current_[i];
+    copper_power += parameters_.resistance * current_[i] * current_[i];
+  }
+
+  // Clipping a diode current leaves the sum of currents nonzero; put the error
+  // back into the other conducting phases so the neutral stays unloaded.
+  const double current_sum = current_[0] + current_[1] + current_[2];
+  int num_floating_after = 0;
+  for (int i = 0; i < kNumChannels; i++) {
+    num_floating_after += current_[i] == 0 && mode_[i] == kModeFloat;
+  }
+  if (current_sum != 0 && num_floating_after < kNumChannels) {
+    const int num_adjusted = kNumChannels - num_floating_after;
+    for (int i = 0; i < kNumChannels; i++) {
+      if (mode_[i] != kModeFloat || current_[i] != 0) {
+        current_[i] -= current_sum / num_adjusted;
+      }
+    }
+  }
+
+  // Load and friction oppose motion, but static load can't start rotation.
+  double load_torque = parameters_.viscous_friction * mechanical_velocity_;
+  if (mechanical_velocity_ != 0) {
+    load_torque += std::copysign(parameters_.load_torque, mechanical_velocity_);
+  } else if (std::abs(torque_) > parameters_.load_torque) {
+    load_torque += std::copysign(parameters_.load_torque, torque_);
+  } else {
+    load_torque = torque_;
+  }
+  const double last_velocity = mechanical_velocity_;
+  mechanical_velocity_ += (torque_ - load_torque) / parameters_.inertia * dt;
+  // Coulomb friction stops the rotor rather than reversing it.
+  if (last_velocity != 0 && (last_velocity > 0) != (mechanical_velocity_ > 0) &&
+      std::abs(torque_) <= parameters_.load_torque) {
+    mechanical_velocity_ = 0;
+  }
+  electrical_angle_ = std::fmod(
+      electrical_angle_ + mechanical_velocity_ * parameters_.pole_pairs * dt,
+      kTwoPi);
+  if (electrical_angle_ < 0) {
+    electrical_angle_ += kTwoPi;
+  }
+  time_ += dt;
+
+  statistics_.duration += dt;
+  statistics_.electrical_energy += bus_voltage * bus_current_ * dt;
+  statistics_.returned_energy += std::max(-bus_voltage * bus_current_, 0.0) *
+                                 dt;
+  statistics_.mechanical_energy += torque_ * mechanical_velocity_ * dt;
+  statistics_.copper_loss += copper_power * dt;
+  statistics_.torque_sum += torque_ * dt;
+  statistics_.torque_min = std::min(statistics_.torque_min, torque_);
+  statistics_.torque_max = std::max(statistics_.torque_max, torque_);
+  for (int i = 0; i < kNumChannels; i++) {
+    statistics_.current_peak = std::max(statistics_.current_peak,
+                                        std::abs(current_[i]));
+  }
+  if (statistics_.stop_time < 0 && mechanical_velocity_ == 0) {
+    statistics_.stop_time = statistics_.duration;
+  }
+}
+
+// Phase A's back EMF crosses zero going negative at angle 0, where current into
+// A and out of B and C produces a restoring torque; B and C lag by 120 and 240
+// degrees.
+double MotorModel::TorqueCoefficient(Channel channel, double electrical_angle) {
+  return -std::sin(electrical_angle - channel * (kTwoPi / 3));
+}
@@ -0,0 +1,746 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+// Runs a commutator in closed loop with MotorModel, and reports steady-state
+// figures of merit once the motor has settled. CommutatorSixStep commutates on
+// each hall transition as RotorHall would signal, with the hall angle
+// interpolated as RotorHall does, and on its advance timer. CommutatorFoc
+// updates once per PWM period with the same interpolated angle, and the phase
+// currents of the model. Sensorless six-step commutates on RotorBemf,
+// which samples the model's phase voltages every PWM period and commutates on
+// its timer. Sensorless FOC takes its angle from RotorFlux, fed with the
+// model's phase currents and the voltages commanded by CommutatorFoc, and the
+// error of its angle is also reported. Both sensorless modes start the rotor
+// from standstill with StartupSequencer, and report the time it took.
+// Speed-governed six-step runs hall six-step under SpeedGovernor, which takes
+// the amplitude as a speed command and is updated at its own rate.
+// Bus-compensated six-step runs hall six-step under VoltageCompensator, which
+// takes the amplitude as a fraction of the nominal bus voltage, and is updated
+// with the model's bus voltage at its own rate.
+// The braking modes run hall six-step at the amplitude for the first half,
+// then brake it with a zero amplitude for the second, which is measured; the
+// regenerative mode measures the model's bus voltage. Instead of the motoring
+// figures, they report the time until the rotor stopped, the energy returned
+// to the bus, and the peak phase current. The unipolar and
+// synchronous modes run hall six-step with those modulations.
+// The identification mode runs MotorIdentifier on the motor at rest, updated
+// every PWM period, for up to the simulated time (the amplitude is unused),
+// and reports the identified parameters next to those of the model.
+//
+// Usage: corn_plant [amplitude] [seconds] [load_torque] [bus_voltage]
+//                   [commutator] [inductance]
+//   amplitude    Fraction of the maximum semi-amplitude, -1 to 1 (default 0.5);
+//                of the maximum speed for the speed-governed mode, and of the
+//                nominal bus voltage for the bus-compensated mode.
+//   seconds      Simulated time (default 2); the first half is for settling.
+//   load_torque  Constant load in N m (default from the model).
+//   bus_voltage  Supply voltage in V (default from the model).
+//   commutator   "six_step" (default), "foc", "six_step_bemf", "foc_flux",
+//                "six_step_speed", "six_step_vbus", "six_step_coast",
+//                "six_step_brake", "six_step_regen", "six_step_unipolar",
+//                "six_step_sync", or "identify".
+//   inductance   Phase inductance in H (default from the model).
+//
+// Results are printed as "key value" lines.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "hal.h"
+
+#include "config.h"
+#include "host/motor_model.h"
+#include "motor/commutator_foc.h"
+#include "motor/commutator_six_step.h"
+#include "motor/motor_identifier.h"
+#include "motor/rotor_bemf.h"
+#include "motor/rotor_flux.h"
+#include "motor/speed_governor.h"
+#include "motor/startup_sequencer.h"
+#include "motor/voltage_compensator.h"
+
+namespace {
+
+// Integration step, well under the default model's 200 us time constant.
+constexpr double kStep = 1e-6;
+
+// Commutator names accepted on the command line; the first is the default.
+const char * const kCommutatorNames[] = {
+  "six_step", "foc", "six_step_bemf", "foc_flux", "six_step_speed",
+  "six_step_vbus", "six_step_coast", "six_step_brake", "six_step_regen",
+  "six_step_unipolar", "six_step_sync", "identify"
+};
+
+void PrintUsage(std::FILE *file, const char *program) {
+  std::fprintf(file, "usage: %s [amplitude] [seconds] [load_torque] "
+                     "[bus_voltage] [commutator] [inductance]\n"
+                     "  amplitude    -1 to 1 (default 0.5)\n"
+                     "  seconds      simulated time (default 2)\n"
+                     "  load_torque  N m (default from the model)\n"
+                     "  bus_voltage  V (default from the model)\n"
+                     "  commutator  ",
+               program);
+  for (const char *name : kCommutatorNames) {
+    std::fprintf(file, " %s", name);
+  }
+  std::fprintf(file, "\n"
+                     "  inductance   H (default from the model)\n");
+}
+
+// Parses an optional numeric argument, leaving the default in place if it is
+// absent. Fails unless the whole argument is a number from low to high.
+bool ParseArgument(int argc,
+                   char *argv[],
+                   int index,
+                   double low,
+                   double high,
+                   double *value) {
+  if (argc <= index) {
+    return true;
+  }
+  char *end;
+  const double parsed = std::strtod(argv[index], &end);
+  if (end == argv[index] || *end != '\0' || !std::isfinite(parsed) ||
+      parsed < low || parsed > high) {
+    std::fprintf(stderr, "invalid argument %d: \"%s\"\n", index,
+                 argv[index]);
+    return false;
+  }
+  *value = parsed;
+  return true;
+}
+
+bool IsCommutatorName(const char *name) {
+  for (const char *known : kCommutatorNames) {
+    if (std::strcmp(name, known) == 0) {
+      return true;
+    }
+  }
+  std::fprintf(stderr, "unknown commutator \"%s\"\n", name);
+  return false;
+}
+
+// PWM period of the inverter, at which CommutatorFoc is updated.
+constexpr double kPwmPeriod = 1.0 / INVERTER_PWM_FREQ;
+
+// Interval between speed governor updates.
+constexpr double kGovernorPeriod = 1.0 / SPEED_GOVERNOR_FREQ;
+
+// Interval between bus voltage compensation updates.
+constexpr double kCompensatorPeriod = BUS_VOLTAGE_INTERVAL / 1000.0;
+
+// Gets the index of the first PWM period starting at or after a time. Period
+// start times are computed from their index rather than accumulated, so that
+// they stay evenly spaced when the loop is stopped and run again.
+long NextPeriod(double time) {
+  return std::lround(std::ceil(time / kPwmPeriod - 1e-6));
+}
+
+// Times the expiry of a one-shot timer in simulated time. A timer start resets
+// the count, so the count is marked once the expiry has been scheduled. The
+// expiry is kept here so that it carries over between runs of the loop.
+class SimulatedTimer {
+ public:
+  explicit SimulatedTimer(GPTDriver *gpt_driver)
+      : gpt_driver_(gpt_driver),
+        expiry_(0) {
+  }
+
+  // Schedules a timer started before a simulated time, and gets the time that
+  // it expires at, or a default if it is not running.
+  double GetExpiry(double time, double fallback) {
+    if (gpt_driver_->state == GPT_ONESHOT && gpt_driver_->tim->CNT == 0) {
+      gpt_driver_->tim->CNT = 1;
+      expiry_ = time + (gpt_driver_->tim->ARR + 1.0) / gpt_driver_->clock;
+    }
+    return gpt_driver_->state == GPT_ONESHOT ? expiry_ : fallback;
+  }
+
+  // Invokes the callback if a scheduled timer has expired by a simulated time.
+  bool Expire(double time) {
+    if (gpt_driver_->state != GPT_ONESHOT || gpt_driver_->tim->CNT == 0 ||
+        time < expiry_) {
+      return false;
+    }
+    gptHostInvokeCallback(gpt_driver_);
+    return true;
+  }
+
+ private:
+  GPTDriver * const gpt_driver_;
+  double expiry_;
+};
+
+// Six-step commutation on the hall sensors, advanced on its timer.
+class HallSixStep {
+ public:
+  explicit HallSixStep(MotorModel *model)
+      : commutator_(model, model, &GPTD7),
+        timer_(&GPTD7) {
+    commutator_.Start();
+  }
+
+  void WriteAmplitude(Width16Diff semi_amplitude) {
+    commutator_.WriteAmplitude(semi_amplitude);
+  }
+
+  Width16Diff GetMaxAmplitude() {
+    return commutator_.GetMaxAmplitude();
+  }
+
+  void SetEnable(bool enable) {
+    commutator_.SetEnable(enable);
+  }
+
+  CommutatorSixStep *commutator() {
+    return &commutator_;
+  }
+
+  SimulatedTimer *timer() {
+    return &timer_;
+  }
+
+ private:
+  CommutatorSixStep commutator_;
+  SimulatedTimer timer_;
+};
+
+// Hall six-step commutation, driven at the amplitude that SpeedGovernor finds
+// for the commanded speed. The governor's thread never runs on the host, so it
+// is updated directly.
+class GovernedSixStep {
+ public:
+  explicit GovernedSixStep(MotorModel *model)
+      : hall_(model),
+        governor_(model, &GPTD3, &wa_governor_, sizeof(wa_governor_)) {
+    governor_.SetCommutator(hall_.commutator());
+    governor_.Start();
+  }
+
+  void WriteAmplitude(Width16Diff semi_amplitude) {
+    governor_.WriteAmplitude(semi_amplitude);
+  }
+
+  Width16Diff GetMaxAmplitude() {
+    return governor_.GetMaxAmplitude();
+  }
+
+  void SetEnable(bool enable) {
+    governor_.SetEnable(enable);
+  }
+
+  HallSixStep *hall() {
+    return &hall_;
+  }
+
+  SpeedGovernor *governor() {
+    return &governor_;
+  }
+
+ private:
+  static WORKING_AREA(wa_governor_, 512);
+
+  HallSixStep hall_;
+  SpeedGovernor governor_;
+};
+
+WORKING_AREA(GovernedSixStep::wa_governor_, 512);
+
+// Hall six-step commutation, driven at the amplitude that VoltageCompensator
+// scales to the model's bus voltage. The compensator's thread never runs on the
+// host, so it is updated directly.
+class CompensatedSixStep {
+ public:
+  explicit CompensatedSixStep(MotorModel *model)
+      : hall_(model),
+        compensator_(model, &wa_compensator_, sizeof(wa_compensator_)) {
+    compensator_.SetCommutator(hall_.commutator());
+    compensator_.Start();
+  }
+
+  void WriteAmplitude(Width16Diff semi_amplitude) {
+    compensator_.WriteAmplitude(semi_amplitude);
+  }
+
+  Width16Diff GetMaxAmplitude() {
+    return compensator_.GetMaxAmplitude();
+  }
+
+  void SetEnable(bool enable) {
+    compensator_.SetEnable(enable);
+  }
+
+  HallSixStep *hall() {
+    return &hall_;
+  }
+
+  VoltageCompensator *compensator() {
+    return &compensator_;
+  }
+
+ private:
+  static WORKING_AREA(wa_compensator_, 256);
+
+  HallSixStep hall_;
+  VoltageCompensator compensator_;
+};
+
+WORKING_AREA(CompensatedSixStep::wa_compensator_, 256);
+
+// Six-step commutation on the back EMF zero crossings seen by RotorBemf.
+class SensorlessSixStep {
+ public:
+  explicit SensorlessSixStep(MotorModel *model)
+      : rotor_(model, &GPTD6),
+        sequencer_(&rotor_, false),
+        commutator_(&sequencer_, model, nullptr),
+        timer_(&GPTD6),
+        startup_time_(0) {
+    sequencer_.SetCommutator(&commutator_);
+    rotor_.Start();
+  }
+
+  void WriteAmplitude(Width16Diff semi_amplitude) {
+    sequencer_.WriteAmplitude(semi_amplitude);
+  }
+
+  Width16Diff GetMaxAmplitude() {
+    return sequencer_.GetMaxAmplitude();
+  }
+
+  void SetEnable(bool enable) {
+    sequencer_.SetEnable(enable);
+  }
+
+  CommutatorSixStep *commutator() {
+    return &commutator_;
+  }
+
+  SimulatedTimer *timer() {
+    return &timer_;
+  }
+
+  // Counts a PWM period ending at a simulated time, and commutates.
+  void SignalPeriod(double time) {
+    RotorBemf::SignalPeriod(&rotor_);
+    StartupSequencer::SignalPeriod(&sequencer_);
+    commutator_.Commutate();
+    if (sequencer_.IsStarting()) {
+      startup_time_ = time;
+    }
+  }
+
+  // Gets the simulated time that the startup sequence last ended at.
+  double GetStartupTime() const {
+    return startup_time_;
+  }
+
+ private:
+  RotorBemf rotor_;
+  StartupSequencer sequencer_;
+  CommutatorSixStep commutator_;
+  SimulatedTimer timer_;
+  double startup_time_;
+};
+
+// FOC on the angle estimated by RotorFlux, which accumulates the error of each
+// angle that the commutator is given.
+class SensorlessFoc {
+ public:
+  explicit SensorlessFoc(MotorModel *model)
+      : model_(model),
+        rotor_(nullptr),
+        sequencer_(&rotor_, true),
+        commutator_(&sequencer_, model, model),
+        error_square_sum_(0),
+        error_max_(0),
+        num_errors_(0),
+        startup_time_(0) {
+    sequencer_.SetCommutator(&commutator_);
+    commutator_.SetObserver(&rotor_);
+  }
+
+  void WriteAmplitude(Width16Diff semi_amplitude) {
+    sequencer_.WriteAmplitude(semi_amplitude);
+  }
+
+  Width16Diff GetMaxAmplitude() {
+    return sequencer_.GetMaxAmplitude();
+  }
+
+  void SetEnable(bool enable) {
+    sequencer_.SetEnable(enable);
+  }
+
+  // Runs a control period, then compares the angle estimated with the model's.
+  void Update() {
+    StartupSequencer::SignalPeriod(&sequencer_);
+    commutator_.Update();
+    if (sequencer_.IsStarting()) {
+      startup_time_ = model_->GetTime();
+    }
+    Angle16 angle;
+    if (rotor_.ComputeAngle(&angle)) {
+      const Angle16 true_angle = static_cast<Angle16>(
+          model_->GetElectricalAngle() * 65536 / (2 * kPi));
+      const double error = static_cast<Angle16Diff>(angle - true_angle) *
+                           360.0 / 65536;
+      error_square_sum_ += error * error;
+      error_max_ = std::max(error_max_, std::abs(error));
+      num_errors_++;
+    }
+  }
+
+  void ResetStatistics() {
+    error_square_sum_ = 0;
+    error_max_ = 0;
+    num_errors_ = 0;
+  }
+
+  double GetErrorRms() const {
+    return num_errors_ > 0 ? std::sqrt(error_square_sum_ / num_errors_) : 0;
+  }
+
+  double GetErrorMax() const {
+    return error_max_;
+  }
+
+  double GetStartupTime() const {
+    return startup_time_;
+  }
+
+ private:
+  MotorModel * const model_;
+  RotorFlux rotor_;
+  StartupSequencer sequencer_;
+  CommutatorFoc commutator_;
+  double error_square_sum_;
+  double error_max_;
+  unsigned num_errors_;
+  double startup_time_;
+};
+
+// Runs the loop until the given simulated time, commutating at the start, on
+// hall edges, and when the commutation timer expires.
+void RunUntil(MotorModel *model, HallSixStep *hall, double t_end) {
+  SimulatedTimer * const timer = hall->timer();
+  hall->commutator()->Commutate();
+  while (model->GetTime() < t_end) {
+    const double t_stop = std::min(timer->GetExpiry(model->GetTime(), t_end),
+                                   t_end);
+    if (model->Advance(t_stop - model->GetTime(), kStep)) {
+      hall->commutator()->Commutate();
+    }
+    if (timer->Expire(model->GetTime())) {
+      hall->commutator()->Commutate();
+    }
+  }
+}
+
+// Runs the hall loop between governor updates, until the given simulated time.
+void RunUntil(MotorModel *model, GovernedSixStep *governed, double t_end) {
+  long update = std::lround(std::ceil(model->GetTime() / kGovernorPeriod -
+                                      1e-6));
+  while (model->GetTime() < t_end) {
+    if (model->GetTime() >= update * kGovernorPeriod) {
+      governed->governor()->Update();
+      update++;
+    }
+    RunUntil(model, governed->hall(), std::min(update * kGovernorPeriod,
+                                               t_end));
+  }
+}
+
+// Runs the hall loop between compensator updates, until the given simulated
+// time.
+void RunUntil(MotorModel *model, CompensatedSixStep *compensated, double t_end) {
+  long update = std::lround(std::ceil(model->GetTime() / kCompensatorPeriod -
+                                      1e-6));
+  while (model->GetTime() < t_end) {
+    if (model->GetTime() >= update * kCompensatorPeriod) {
+      compensated->compensator()->Update();
+      update++;
+    }
+    RunUntil(model, compensated->hall(), std::min(update * kCompensatorPeriod,
+                                                  t_end));
+  }
+}
+
+// Runs the loop until the given simulated time, updating every PWM period.
+void RunUntil(MotorModel *model, CommutatorFoc *commutator, double t_end) {
+  long period = NextPeriod(model->GetTime());
+  double t_update = period * kPwmPeriod;
+  while (model->GetTime() < t_end) {
+    if (model->GetTime() >= t_update) {
+      commutator->Update();
+      t_update = ++period * kPwmPeriod;
+    }
+    model->Advance(std::min(t_update, t_end) - model->GetTime(), kStep);
+  }
+}
+
+// Runs the loop until the given simulated time, updating every PWM period.
+void RunUntil(MotorModel *model, SensorlessFoc *sensorless, double t_end) {
+  long period = NextPeriod(model->GetTime());
+  double t_update = period * kPwmPeriod;
+  while (model->GetTime() < t_end) {
+    if (model->GetTime() >= t_update) {
+      sensorless->Update();
+      t_update = ++period * kPwmPeriod;
+    }
+    model->Advance(std::min(t_update, t_end) - model->GetTime(), kStep);
+  }
+}
+
+// Runs the loop until the given simulated time, sampling every PWM period and
+// expiring the commutation timer on time. The commutator runs after each, as
+// the rotor may have signaled it.
+void RunUntil(MotorModel *model, SensorlessSixStep *sensorless, double t_end) {
+  SimulatedTimer * const timer = sensorless->timer();
+  long period = NextPeriod(model->GetTime());
+  double t_sample = period * kPwmPeriod;
+  sensorless->commutator()->Commutate();
+  while (model->GetTime() < t_end) {
+    model->Advance(std::min(t_sample,
+                            timer->GetExpiry(model->GetTime(), t_end)) -
+                       model->GetTime(),
+                   kStep);
+    if (timer->Expire(model->GetTime())) {
+      sensorless->commutator()->Commutate();
+    }
+    if (model->GetTime() >= t_sample) {
+      sensorless->SignalPeriod(model->GetTime());
+      t_sample = ++period * kPwmPeriod;
+    }
+  }
+}
+
+// Settles the motor for the first half of the duration, then measures it.
+template<typename Commutator>
+void Run(MotorModel *model,
+         Commutator *commutator,
+         double amplitude,
+         double duration) {
+  commutator->WriteAmplitude(static_cast<Width16Diff>(
+      amplitude * commutator->GetMaxAmplitude()));
+  commutator->SetEnable(true);
+  RunUntil(model, commutator, duration / 2);
+  model->ResetStatistics();
+  RunUntil(model, commutator, duration);
+}
+
+// Drives the motor for the first half of the duration, then brakes it and
+// measures the braking.
+void RunBraking(MotorModel *model,
+                HallSixStep *hall,
+                CommutatorSixStep::BrakeMode mode,
+                double amplitude,
+                double duration) {
+  hall->commutator()->SetBrake(mode, SIX_STEP_BRAKE_STRENGTH);
+  hall->commutator()->SetBusVoltageSensor(model);
+  hall->WriteAmplitude(static_cast<Width16Diff>(
+      amplitude * hall->GetMaxAmplitude()));
+  hall->SetEnable(true);
+  RunUntil(model, hall, duration / 2);
+  model->ResetStatistics();
+  hall->WriteAmplitude(0);
+  RunUntil(model, hall, duration);
+
+  const MotorModel::Statistics &statistics = model->GetStatistics();
+  std::printf("speed_rpm %.1f\n",
+              model->GetMechanicalVelocity() * 60 / (2 * kPi));
+  std::printf("stopped %d\n", statistics.stop_time >= 0);
+  if (statistics.stop_time >= 0) {
+    std::printf("stop_s %.4f\n", statistics.stop_time);
+  }
+  std::printf("returned_energy_j %.4f\n", statistics.returned_energy);
+  std::printf("current_peak_a %.3f\n", statistics.current_peak);
+  std::printf("copper_loss_j %.4f\n", statistics.copper_loss);
+  std::printf("hall_transitions %u\n", statistics.hall_transitions);
+}
+
+// Runs the identification sequence until it finishes or the duration runs out,
+// updating every PWM period, then compares its results with the model.
+void RunIdentify(MotorModel *model,
+                 const MotorModel::Parameters &parameters,
+                 double duration) {
+  MotorIdentifier identifier(model, model, model);
+  identifier.SetBusVoltageSensor(model);
+  identifier.Start();
+  long period = NextPeriod(model->GetTime());
+  double t_update = period * kPwmPeriod;
+  while (!identifier.IsDone() && model->GetTime() < duration) {
+    if (model->GetTime() >= t_update) {
+      identifier.Update();
+      t_update = ++period * kPwmPeriod;
+    }
+    model->Advance(std::min(t_update, duration) - model->GetTime(), kStep);
+  }
+  std::printf("identify_s %.3f\n", model->GetTime());
+
+  MotorIdentifier::Parameters identified;
+  if (!identifier.GetParameters(&identified)) {
+    std::printf("identified 0\n");
+    return;
+  }
+  // Current loop gains for the model, from the FOC_CURRENT_KP comment.
+  const double bandwidth = 2 * kPi * MOTOR_IDENTIFY_BANDWIDTH;
+  const double counts_per_volt = parameters.pwm_period /
+                                 parameters.bus_voltage;
+  std::printf("identified 1\n");
+  std::printf("resistance_mohm %d model %.1f\n", identified.resistance,
+              parameters.resistance * 1e3);
+  std::printf("inductance_nh %d model %.1f\n", identified.inductance,
+              parameters.inductance * 1e9);
+  std::printf("flux_linkage_nwb %d model %.1f\n", identified.flux_linkage,
+              parameters.back_emf_constant / parameters.pole_pairs * 1e9);
+  std::printf("current_kp %d model %.1f\n", identified.current_kp,
+              parameters.inductance * bandwidth * counts_per_volt / 1000 *
+                  65536);
+  std::printf("current_ki %d model %.1f\n", identified.current_ki,
+              parameters.resistance * bandwidth * kPwmPeriod *
+                  counts_per_volt / 1000 * 65536);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 && (std::strcmp(argv[1], "-h") == 0 ||
+                   std::strcmp(argv[1], "--help") == 0)) {
+    PrintUsage(stdout, argv[0]);
+    return EXIT_SUCCESS;
+  }
+
+  // The run must span at least a PWM period, and the bus must be able to
+  // drive the motor at all.
+  MotorModel::Parameters parameters = MotorModel::DefaultParameters();
+  double amplitude = 0.5;
+  double duration = 2.0;
+  const char * const commutator_name = argc > 5 ? argv[5] :
+                                                  kCommutatorNames[0];
+  if (argc > 7 ||
+      !ParseArgument(argc, argv, 1, -1.0, 1.0, &amplitude) ||
+      !ParseArgument(argc, argv, 2, kPwmPeriod, HUGE_VAL, &duration) ||
+      !ParseArgument(argc, argv, 3, -HUGE_VAL, HUGE_VAL,
+                     &parameters.load_torque) ||
+      !ParseArgument(argc, argv, 4, 1.0, HUGE_VAL,
+                     &parameters.bus_voltage) ||
+      !ParseArgument(argc, argv, 6, 1e-9, 1.0, &parameters.inductance) ||
+      !IsCommutatorName(commutator_name)) {
+    PrintUsage(stderr, argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  MotorModel model(parameters);
+  if (std::strcmp(commutator_name, "foc") == 0) {
+    model.SetAngleMode(MotorModel::kAngleHallInterpolated);
+    CommutatorFoc commutator(&model, &model, &model);
+    Run(&model, &commutator, amplitude, duration);
+  } else if (std::strcmp(commutator_name, "six_step_bemf") == 0) {
+    SensorlessSixStep sensorless(&model);
+    Run(&model, &sensorless, amplitude, duration);
+    std::printf("startup_s %.3f\n", sensorless.GetStartupTime());
+  } else if (std::strcmp(commutator_name, "foc_flux") == 0) {
+    SensorlessFoc sensorless(&model);
+    sensorless.WriteAmplitude(static_cast<Width16Diff>(
+        amplitude * sensorless.GetMaxAmplitude()));
+    sensorless.SetEnable(true);
+    RunUntil(&model, &sensorless, duration / 2);
+    model.ResetStatistics();
+    sensorless.ResetStatistics();
+    RunUntil(&model, &sensorless, duration);
+    std::printf("angle_error_rms_deg %.2f\n", sensorless.GetErrorRms());
+    std::printf("angle_error_max_deg %.2f\n", sensorless.GetErrorMax());
+    std::printf("startup_s %.3f\n", sensorless.GetStartupTime());
+  } else if (std::strcmp(commutator_name, "six_step_speed") == 0) {
+    model.SetAngleMode(MotorModel::kAngleHallInterpolated);
+    GovernedSixStep governed(&model);
+    Run(&model, &governed, amplitude, duration);
+    std::printf("target_rpm %.1f\n",
+                amplitude * SPEED_GOVERNOR_MAX_SPEED / parameters.pole_pairs);
+  } else if (std::strcmp(commutator_name, "six_step_vbus") == 0) {
+    model.SetAngleMode(MotorModel::kAngleHallInterpolated);
+    CompensatedSixStep compensated(&model);
+    Run(&model, &compensated, amplitude, duration);
+    std::printf("command_v %.3f\n", amplitude * BUS_VOLTAGE_NOMINAL / 1000.0);
+  } else if (std::strcmp(commutator_name, "six_step_coast") == 0 ||
+             std::strcmp(commutator_name, "six_step_brake") == 0 ||
+             std::strcmp(commutator_name, "six_step_regen") == 0) {
+    model.SetAngleMode(MotorModel::kAngleHallInterpolated);
+    HallSixStep hall(&model);
+    CommutatorSixStep::BrakeMode mode = CommutatorSixStep::kBrakeRegenerative;
+    if (std::strcmp(commutator_name, "six_step_coast") == 0) {
+      mode = CommutatorSixStep::kBrakeCoast;
+    } else if (std::strcmp(commutator_name, "six_step_brake") == 0) {
+      mode = CommutatorSixStep::kBrakeDynamic;
+    }
+    RunBraking(&model, &hall, mode, amplitude, duration);
+    return EXIT_SUCCESS;
+  } else if (std::strcmp(commutator_name, "six_step_unipolar") == 0 ||
+             std::strcmp(commutator_name, "six_step_sync") == 0) {
+    model.SetAngleMode(MotorModel::kAngleHallInterpolated);
+    HallSixStep hall(&model);
+    hall.commutator()->SetModulation(
+        std::strcmp(commutator_name, "six_step_sync") == 0 ?
+            CommutatorSixStep::kModulationSynchronous :
+            CommutatorSixStep::kModulationUnipolar);
+    Run(&model, &hall, amplitude, duration);
+  } else if (std::strcmp(commutator_name, "identify") == 0) {
+    model.SetAngleMode(MotorModel::kAngleHallInterpolated);
+    RunIdentify(&model, parameters, duration);
+  } else {
+    model.SetAngleMode(MotorModel::kAngleHallInterpolated);
+    HallSixStep hall(&model);
+    Run(&model, &hall, amplitude, duration);
+  }
+
+  const MotorModel::Statistics &statistics = model.GetStatistics();
+  const double torque_mean = statistics.torque_sum / statistics.duration;
+  const double speed_rpm = model.GetMechanicalVelocity() * 60 / (2 * kPi);
+  std::printf("speed_rpm %.1f\n", speed_rpm);
+  std::printf("torque_mean_nm %.6f\n", torque_mean);
+  std::printf("torque_ripple %.4f\n",
+              torque_mean != 0 ?
+                  (statistics.torque_max - statistics.torque_min) /
+                      std::abs(torque_mean) :
+                  0.0);
+  std::printf("current_peak_a %.3f\n", statistics.current_peak);
+  std::printf("power_in_w %.3f\n",
+              statistics.electrical_energy / statistics.duration);
+  std::printf("power_out_w %.3f\n",
+              statistics.mechanical_energy / statistics.duration);
+  std::printf("copper_loss_w %.3f\n",
+              statistics.copper_loss / statistics.duration);
+  std::printf("efficiency %.4f\n",
+              statistics.electrical_energy > 0 ?
+                  statistics.mechanical_energy / statistics.electrical_energy :
+                  0.0);
+  std::printf("hall_transitions %u\n", statistics.hall_transitions);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,255 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+// Replays a capture (see host/capture.h) through RotorHall and ServoInput by
+// invoking their ICU callbacks as the ISRs would, runs the hall update thread
+// body and CommutatorSixStep::Commutate whenever they are signaled, and writes
+// every resulting commutation decision. Replays are deterministic, so traces
+// from two builds can be compared with diff.
+//
+// Usage: corn_replay [capture_file] [trace_file]
+//   capture_file  Capture to replay (default standard input).
+//   trace_file    Where to write the trace (default standard output).
+//
+// Each commutation is written as one line:
+//   C <line> <time_us> <hall_state> <angle> <velocity> <A> <B> <C>
+// where <line> is the capture line that caused it, <angle> is the fixed-point
+// rotor angle or -1 if invalid, <velocity> is in fixed-point angle units per
+// second or 0 if invalid, and each phase is "z" if high impedance, its pulse
+// width prefixed with "l" or "h" if only its low or high side is driven, or
+// else its pulse width.
+//
+// The delays from each hall edge to its commutation, as traced by
+// base/latency_trace.h, are summarized to standard error at the end. These
+// are host times, so are only useful to compare builds run on the same host.
+
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "config.h"
+#include "base/latency_trace.h"
+#include "driver/servo_input.h"
+#include "host/capture.h"
+#include "motor/commutator_six_step.h"
+#include "motor/inverter_interface.h"
+#include "motor/rotor_hall.h"
+
+namespace {
+
+// Exposes the hall update thread body and its wakeup signal.
+class ReplayRotorHall: public RotorHall {
+ public:
+  using RotorHall::RotorHall;
+  using RotorHall::UpdateState;
+
+  bool TakeUpdateSignal() {
+    return chSemWait(&semaphore_update_) == RDY_OK;
+  }
+};
+
+// Exposes the commutation wakeup signal.
+class ReplayCommutator: public CommutatorSixStep {
+ public:
+  using CommutatorSixStep::CommutatorSixStep;
+
+  bool TakeChangeSignal() {
+    bool signaled = false;
+    while (chSemWait(&semaphore_) == RDY_OK) {
+      signaled = true;
+    }
+    return signaled;
+  }
+};
+
+// Records the channel configuration, which is latched by SyncModes.
+class RecordingInverter: public InverterInterface {
+ public:
+  RecordingInverter() : width_(), mode_() {
+  }
+
+  Width16 GetPeriod() {
+    return INVERTER_PWM_PERIOD;
+  }
+
+  void WriteChannel(Channel channel, Width16 width, Mode mode) {
+    width_[channel] = width;
+    mode_[channel] = mode;
+  }
+
+  void SyncModes() {
+  }
+
+  void PrintChannels(std::FILE *file) const {
+    for (int i = 0; i < kNumChannels; i++) {
+      switch (mode_[i]) {
+        case kModeComplementary:
+          std::fprintf(file, " %u", width_[i]);
+          break;
+        case kModeLowSide:
+          std::fprintf(file, " l%u", width_[i]);
+          break;
+        case kModeHighSide:
+          std::fprintf(file, " h%u", width_[i]);
+          break;
+        default:
+          std::fprintf(file, " z");
+          break;
+      }
+    }
+  }
+
+ private:
+  Width16 width_[kNumChannels];
+  Mode mode_[kNumChannels];
+};
+
+WORKING_AREA(wa_hall, 1024);
+
+// Drives a group of GPIO inputs, with the same arguments as palReadGroup.
+void WriteInputGroup(ioportid_t port, ioportmask_t mask, unsigned offset,
+                     unsigned bits) {
+  port->IDR = (port->IDR & ~(mask << offset)) | ((bits & mask) << offset);
+}
+
+// Writes a line of latency trace results to standard error.
+void PrintStderrLine(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  std::vfprintf(stderr, format, args);
+  va_end(args);
+  std::fputc('\n', stderr);
+}
+
+// Sets the simulated system time to the event time, for code that reads it.
+void AdvanceTime(uint32_t time_us) {
+  const systime_t now = time_us / (1000000 / CH_FREQUENCY);
+  if (now > chTimeNow()) {
+    chThdSleep(now - chTimeNow());
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::FILE *capture = stdin;
+  if (argc > 1 && (capture = std::fopen(argv[1], "r")) == nullptr) {
+    std::perror(argv[1]);
+    return EXIT_FAILURE;
+  }
+  std::FILE *trace = stdout;
+  if (argc > 2 && (trace = std::fopen(argv[2], "w")) == nullptr) {
+    std::perror(argv[2]);
+    return EXIT_FAILURE;
+  }
+
+  RecordingInverter inverter;
+  ReplayRotorHall rotor_hall(&HALL_ICU, wa_hall, sizeof(wa_hall));
+  ReplayCommutator commutator(&rotor_hall, &inverter, nullptr);
+  ServoInput servo_input(&SERVO_INPUT_ICU);
+#if LATENCY_TRACE_ENABLE
+  LatencyTraceInit();
+#endif
+  rotor_hall.SetCommutator(&commutator);
+  rotor_hall.Start();
+  servo_input.SetCommutator(&commutator);
+  servo_input.Start();
+
+  std::fprintf(trace,
+               "# line time_us hall_state angle velocity A B C\n");
+  CaptureEvent event;
+  unsigned line_number = 0;
+  unsigned num_events = 0;
+  bool rising_edge = true;
+  CaptureReadResult result;
+  while ((result = ReadCaptureEvent(capture, &event, &line_number)) ==
+         kCaptureReadOk) {
+    num_events++;
+    AdvanceTime(event.time_us);
+    switch (event.type) {
+      case CaptureEvent::kHallEdge:
+        // The hall timer is reset on every edge, and the XOR of the sensors
+        // alternates between rising (period) and falling (width) captures.
+        INVOKE(WriteInputGroup, GPIO_GROUP_HALL, event.hall_state);
+        HALL_ICU.tim->CNT = 0;
+        if (rising_edge) {
+          icuHostInvokePeriod(&HALL_ICU, event.count);
+        } else {
+          icuHostInvokeWidth(&HALL_ICU, event.count);
+        }
+        rising_edge = !rising_edge;
+        break;
+      case CaptureEvent::kHallOverflow:
+        icuHostInvokeOverflow(&HALL_ICU);
+        break;
+      case CaptureEvent::kServoPulse:
+        icuHostInvokePeriod(&SERVO_INPUT_ICU, event.period);
+        icuHostInvokeWidth(&SERVO_INPUT_ICU, event.count);
+        break;
+      case CaptureEvent::kServoOverflow:
+        icuHostInvokeOverflow(&SERVO_INPUT_ICU);
+        break;
+    }
+
+    // Run the threads that the ISRs would have woken, in priority order.
+    if (rotor_hall.TakeUpdateSignal()) {
+      rotor_hall.UpdateState();
+    }
+    if (commutator.TakeChangeSignal()) {
+#if LATENCY_TRACE_ENABLE
+      LatencyTraceStamp(LATENCY_STAGE_RESUME);
+#endif
+      commutator.Commutate();
+      Angle16 angle;
+      const long angle_out = rotor_hall.ComputeAngle(&angle) ? angle : -1;
+      Velocity32 velocity;
+      if (!rotor_hall.ComputeVelocity(&velocity)) {
+        velocity = 0;
+      }
+      std::fprintf(trace, "C %u %" PRIu32 " %u %ld %" PRId32,
+                   line_number, event.time_us,
+                   static_cast<unsigned>(INVOKE(palReadGroup,
+                                                GPIO_GROUP_HALL)),
+                   angle_out, velocity);
+      inverter.PrintChannels(trace);
+      std::fprintf(trace, "\n");
+    }
+  }
+
+  if (result == kCaptureReadError) {
+    std::fprintf(stderr, "Malformed capture at line %u.\n", line_number);
+    return EXIT_FAILURE;
+  }
+  std::fprintf(stderr, "Replayed %u events.\n", num_events);
+#if LATENCY_TRACE_ENABLE
+  LatencyTracePrintAll(PrintStderrLine);
+#endif
+  return EXIT_SUCCESS;
+}
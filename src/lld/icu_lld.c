@@ -54,8 +54,10 @@
 #include "ch.h"
 #include "hal.h"
 
-/* Includes macros for blinking the ISR LED while handling interrupts. */
+/* Includes the interrupt profiling option. */
 #include "config.h"
+#include "base/isr_profile.h"
+#include "base/latency_trace.h"
 #include "base/utility.h"
 
 #if HAL_USE_ICU || defined(__DOXYGEN__)
@@ -139,6 +141,41 @@ ICUDriver ICUD4;
 /* Driver local functions.                                                   */
 /*===========================================================================*/
 
+#if ISR_PROFILE_ENABLE || LATENCY_TRACE_ENABLE || defined(__DOXYGEN__)
+/**
+ * @brief   Computes the timer ticks elapsed since the event that caused an
+ *          interrupt.
+ * @note    If the edge that was captured also reset the counter, then the
+ *          counter value is the age of the edge. Otherwise, it is the
+ *          difference between the counter and the captured value. A timer
+ *          overflow resets the counter as well.
+ *
+ * @param[in] icup      pointer to the @p ICUDriver object
+ * @param[in] sr        interrupt flags being served
+ * @param[in] cnt       counter value at the start of the handler
+ * @return              Ticks of the ICU timer since the event.
+ */
+static icucnt_t icu_lld_event_age(ICUDriver *icup, uint16_t sr, icucnt_t cnt) {
+  /* Capture flags are in the same order as the capture registers.*/
+  const uint16_t period_sr = STM32_TIM_SR_CC1IF <<
+                             (icup->pccrp - &icup->tim->CCR[0]);
+  const uint16_t width_sr = STM32_TIM_SR_CC1IF <<
+                            (icup->wccrp - &icup->tim->CCR[0]);
+
+  if ((sr & period_sr) != 0) {
+    if (icup->config->resetmode != ICU_RESET_NEVER)
+      return cnt;
+    return cnt - *icup->pccrp;
+  }
+  if ((sr & width_sr) != 0) {
+    if (icup->config->resetmode == ICU_RESET_ON_CH1_EDGE)
+      return cnt;
+    return cnt - *icup->wccrp;
+  }
+  return cnt;
+}
+#endif /* ISR_PROFILE_ENABLE || LATENCY_TRACE_ENABLE */
+
 /**
  * @brief   Shared IRQ handler.
  *
@@ -146,12 +183,25 @@ ICUDriver ICUD4;
  */
 static void icu_lld_serve_interrupt(ICUDriver *icup) {
   uint16_t sr;
-
-  INVOKE(palSetPad, GPIO_LED_ISR);
+#if ISR_PROFILE_ENABLE || LATENCY_TRACE_ENABLE
+  const uint32_t entry_time = CycleCounterRead();
+  const icucnt_t cnt = icup->tim->CNT;
+#endif
 
   sr  = icup->tim->SR;
   sr &= icup->tim->DIER & STM32_TIM_DIER_IRQ_MASK;
   icup->tim->SR = ~sr;
+#if LATENCY_TRACE_ENABLE
+  /* Hall edges start a trace before the edge callbacks run. The event age is
+     converted to cycles, with a resolution of one capture tick.*/
+  if (&HALL_ICU == icup &&
+      (sr & (STM32_TIM_SR_CC1IF | STM32_TIM_SR_CC2IF |
+             STM32_TIM_SR_CC3IF | STM32_TIM_SR_CC4IF)) != 0) {
+    LatencyTraceStartI(entry_time,
+                       icu_lld_event_age(icup, sr, cnt) *
+                           (CYCLE_COUNTER_FREQ / icup->config->frequency));
+  }
+#endif
   switch (icup->config->channel) {
   case ICU_CHANNEL_1:
     if ((sr & STM32_TIM_SR_CC1IF) != 0)
@@ -176,7 +226,11 @@ static void icu_lld_serve_interrupt(ICUDriver *icup) {
   if ((sr & STM32_TIM_SR_UIF) != 0)
     _icu_isr_invoke_overflow_cb(icup);
 
-  INVOKE(palClearPad, GPIO_LED_ISR);
+#if ISR_PROFILE_ENABLE
+  IsrProfileRecordI(&ICUD2 == icup ? ISR_PROFILE_TIM2 : ISR_PROFILE_TIM4,
+                    icu_lld_event_age(icup, sr, cnt),
+                    entry_time);
+#endif
 }
 
 /*===========================================================================*/
@@ -321,6 +375,11 @@ void icu_lld_start(ICUDriver *icup) {
               ((psc + 1) * icup->config->frequency) == icup->clock,
               "icu_lld_start(), #5", "invalid frequency");
   icup->tim->PSC  = (uint16_t)psc;
+#if ISR_PROFILE_ENABLE
+  IsrProfileSetTickFrequency(&ICUD2 == icup ? ISR_PROFILE_TIM2 :
+                                              ISR_PROFILE_TIM4,
+                             icup->config->frequency);
+#endif
   if (&ICUD2 == icup) {
     icup->tim->ARR = 0xFFFFFFFF;
   } else {
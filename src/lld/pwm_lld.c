@@ -50,6 +50,10 @@
 #include "ch.h"
 #include "hal.h"
 
+/* Includes the interrupt profiling option. */
+#include "config.h"
+#include "base/isr_profile.h"
+
 #if HAL_USE_PWM || defined(__DOXYGEN__)
 
 /*===========================================================================*/
@@ -124,6 +128,25 @@ PWMDriver PWMD9;
 /* Driver local functions.                                                   */
 /*===========================================================================*/
 
+#if (STM32_PWM_USE_TIM1 && ISR_PROFILE_ENABLE) || defined(__DOXYGEN__)
+/**
+ * @brief   Computes the timer ticks elapsed since a counter value was passed.
+ * @note    In center-aligned mode the counter may have passed @p event_cnt
+ *          while counting either up or down.
+ *
+ * @param[in] cr1       control register value at the start of the handler
+ * @param[in] event_cnt counter value at which the event happened
+ * @param[in] cnt       counter value at the start of the handler
+ * @return              Ticks of the timer since the event.
+ */
+static uint32_t pwm_lld_event_age(uint32_t cr1, uint32_t event_cnt,
+                                  uint32_t cnt) {
+  if ((cr1 & STM32_TIM_CR1_DIR) != 0)
+    return event_cnt - cnt;
+  return cnt - event_cnt;
+}
+#endif /* STM32_PWM_USE_TIM1 && ISR_PROFILE_ENABLE */
+
 #if STM32_PWM_USE_TIM2 || STM32_PWM_USE_TIM3 || STM32_PWM_USE_TIM4 ||       \
     STM32_PWM_USE_TIM5 || STM32_PWM_USE_TIM9 || defined(__DOXYGEN__)
 /**
@@ -173,9 +196,25 @@ CH_IRQ_HANDLER(STM32_TIM1_UP_HANDLER) {
 
   CH_IRQ_PROLOGUE();
 
+#if ISR_PROFILE_ENABLE
+  const uint32_t entry_time = IsrProfileEnter();
+  const uint32_t cnt = STM32_TIM1->CNT;
+  const uint32_t cr1 = STM32_TIM1->CR1;
+#endif
+
   STM32_TIM1->SR = ~STM32_TIM_SR_UIF;
   PWMD1.config->callback(&PWMD1);
 
+#if ISR_PROFILE_ENABLE
+  /* Updates happen at zero, or at the top when counting center-aligned.*/
+  IsrProfileRecordI(ISR_PROFILE_TIM1_UP,
+                    pwm_lld_event_age(cr1,
+                                      (cr1 & STM32_TIM_CR1_DIR) != 0 ?
+                                          STM32_TIM1->ARR : 0,
+                                      cnt),
+                    entry_time);
+#endif
+
   CH_IRQ_EPILOGUE();
 }
 
@@ -195,6 +234,12 @@ CH_IRQ_HANDLER(STM32_TIM1_CC_HANDLER) {
 
   CH_IRQ_PROLOGUE();
 
+#if ISR_PROFILE_ENABLE
+  const uint32_t entry_time = IsrProfileEnter();
+  const uint32_t cnt = STM32_TIM1->CNT;
+  const uint32_t cr1 = STM32_TIM1->CR1;
+#endif
+
   sr = STM32_TIM1->SR & STM32_TIM1->DIER & STM32_TIM_DIER_IRQ_MASK;
   STM32_TIM1->SR = ~sr;
   if ((sr & STM32_TIM_SR_CC1IF) != 0)
@@ -206,6 +251,19 @@ CH_IRQ_HANDLER(STM32_TIM1_CC_HANDLER) {
   if ((sr & STM32_TIM_SR_CC4IF) != 0)
     PWMD1.config->channels[3].callback(&PWMD1);
 
+#if ISR_PROFILE_ENABLE
+  /* Measured from the match of the lowest numbered channel served. The
+     update flag is below the channel flags, so it is masked off.*/
+  const uint16_t sr_cc = sr & (STM32_TIM_SR_CC1IF | STM32_TIM_SR_CC2IF |
+                               STM32_TIM_SR_CC3IF | STM32_TIM_SR_CC4IF);
+  if (sr_cc != 0) {
+    const unsigned channel = __builtin_ctz(sr_cc) - 1;
+    IsrProfileRecordI(ISR_PROFILE_TIM1_CC,
+                      pwm_lld_event_age(cr1, STM32_TIM1->CCR[channel], cnt),
+                      entry_time);
+  }
+#endif
+
   CH_IRQ_EPILOGUE();
 }
 #endif /* STM32_PWM_USE_TIM1 */
@@ -527,6 +585,12 @@ void pwm_lld_start(PWMDriver *pwmp) {
               ((psc + 1) * pwmp->config->frequency) == pwmp->clock,
               "pwm_lld_start(), #1", "invalid frequency");
   pwmp->tim->PSC  = (uint16_t)psc;
+#if STM32_PWM_USE_TIM1 && ISR_PROFILE_ENABLE
+  if (&PWMD1 == pwmp) {
+    IsrProfileSetTickFrequency(ISR_PROFILE_TIM1_UP, pwmp->config->frequency);
+    IsrProfileSetTickFrequency(ISR_PROFILE_TIM1_CC, pwmp->config->frequency);
+  }
+#endif
   pwmp->tim->ARR  = (uint16_t)(pwmp->period - 1);
   pwmp->tim->CR2  = pwmp->config->cr2;
 
@@ -0,0 +1,100 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "motor/bus_voltage_adc.h"
+
+#include <cstdint>
+#include <limits>
+
+#include "config.h"
+#include "base/log.h"
+
+namespace {
+
+// Factory measurement of the internal reference with VDDA at 3.3 V, from the
+// system memory (see "Internal reference voltage calibration values" in the
+// STM32F303xC data sheet).
+const uint16_t * const kVrefintCal =
+    reinterpret_cast<const uint16_t *>(0x1FFFF7BA);
+
+// Bus voltage that reads as full scale with VDDA at 3.3 V, in Q8.8 volts.
+constexpr uint64_t kFullScaleVoltage =
+    static_cast<uint64_t>(BUS_VOLTAGE_FULL_SCALE) * 256 / 1000;
+
+// Largest ADC reading.
+constexpr uint32_t kFullScaleSample = 4095;
+
+}  // namespace
+
+BusVoltageAdc::BusVoltageAdc(ADCDriver *adc_driver)
+    : adc_driver_(adc_driver) {
+}
+
+void BusVoltageAdc::Start() {
+  palSetPadMode(GPIOB, GPIOB_PIN0, PAL_MODE_INPUT_ANALOG);
+  adcStart(adc_driver_, &kAdcConfig);
+  LogInfo("Started bus voltage sensing.");
+}
+
+// The divider reading is scaled as if VDDA were 3.3 V by the ratio of the
+// calibrated to the measured internal reference.
+bool BusVoltageAdc::ComputeBusVoltage(Voltage16 *voltage) {
+  if (adcConvert(adc_driver_, &kConversionGroup, samples_, 1) != RDY_OK) {
+    return false;
+  }
+  const uint32_t divider = samples_[0];
+  const uint32_t reference = samples_[1];
+  if (reference == 0) {
+    return false;
+  }
+  const uint64_t scaled = divider * *kVrefintCal * kFullScaleVoltage /
+                          (static_cast<uint64_t>(kFullScaleSample) * reference);
+  *voltage = static_cast<Voltage16>(
+      scaled < static_cast<uint64_t>(std::numeric_limits<Voltage16>::max()) ?
+          scaled : std::numeric_limits<Voltage16>::max());
+  return true;
+}
+
+// All inputs single-ended.
+const ADCConfig BusVoltageAdc::kAdcConfig = { 0 };
+
+// One software-triggered conversion on each ADC: the PVDD divider (on PB0) on
+// ADC3 channel 12, and the internal reference on ADC4 channel 18. The
+// reference needs at least 2.2 us of sampling, and both ADCs sample for the
+// same time in dual mode.
+const ADCConversionGroup BusVoltageAdc::kConversionGroup = {
+  false,  // Linear.
+  kNumAdcChannels,
+  nullptr,  // No end callback; adcConvert waits for it.
+  nullptr,  // No error callback.
+  0,  // CFGR: software trigger.
+  ADC_TR(0, 4095),  // TR1.
+  ADC_CCR_DUAL(6) | ADC_CCR_VREFEN,  // CCR: regular simultaneous mode only.
+  { 0, ADC_SMPR2_SMP_AN12(ADC_SMPR_SMP_181P5) },  // SMPR.
+  { ADC_SQR1_SQ1_N(ADC_CHANNEL_IN12), 0, 0, 0 },  // SQR.
+  { 0, ADC_SMPR2_SMP_AN18(ADC_SMPR_SMP_181P5) },  // SSMPR.
+  { ADC_SQR1_SQ1_N(ADC_CHANNEL_IN18), 0, 0, 0 }  // SSQR.
+};
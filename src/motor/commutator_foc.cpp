@@ -0,0 +1,204 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "motor/commutator_foc.h"
+
+#include <cstdlib>
+
+#include "config.h"
+#include "base/integer.h"
+#include "base/latency_trace.h"
+#include "motor/current_sensor_interface.h"
+#include "motor/inverter_interface.h"
+#include "motor/rotor_flux.h"
+#include "motor/rotor_interface.h"
+#include "motor/trig.h"
+
+namespace {
+
+constexpr int32_t kInverseSqrt3 = 18919;  // 1 / sqrt(3) in Q15.
+
+// Multiplies by a Q15 fraction, such as the output of Sine16.
+inline int32_t MultiplyQ15(int32_t a, int32_t b) {
+  return static_cast<int32_t>((static_cast<int64_t>(a) * b) >> 15);
+}
+
+}  // namespace
+
+CommutatorFoc::CommutatorFoc(RotorInterface *rotor,
+                             InverterInterface *inverter,
+                             CurrentSensorInterface *current_sensor)
+    : rotor_(rotor),
+      inverter_(inverter),
+      current_sensor_(current_sensor),
+      observer_(nullptr),
+      modulator_(inverter),
+      semi_amplitude_(0),
+      integral_d_(0),
+      integral_q_(0),
+      voltage_alpha_(0),
+      voltage_beta_(0),
+      driven_(false),
+      semaphore_(_SEMAPHORE_DATA(semaphore_, 0)),
+      enable_(false) {
+}
+
+// Repeats the update when a PWM period starts.
+NORETURN void CommutatorFoc::CommutationLoop() {
+  while (true) {
+    Update();
+    chSemWait(&semaphore_);
+#if LATENCY_TRACE_ENABLE
+    LatencyTraceStamp(LATENCY_STAGE_RESUME);
+#endif
+  }
+}
+
+void CommutatorFoc::Update() {
+  Current16 currents[InverterInterface::kNumChannels];
+  const bool currents_valid = current_sensor_ != nullptr &&
+                              current_sensor_->ComputeCurrents(currents);
+
+  // The voltage put out is only known if the inverter was driven for the whole
+  // period; otherwise the observer starts over.
+  if (observer_ != nullptr) {
+    if (driven_ && currents_valid) {
+      observer_->Update(currents, voltage_alpha_, voltage_beta_);
+    } else {
+      observer_->Reset();
+    }
+  }
+
+  Angle16 rotor_angle;
+  if (!enable_ || !rotor_->ComputeAngle(&rotor_angle)) {
+    Disable();
+    return;
+  }
+
+  const int32_t sine = Sine16(rotor_angle);
+  const int32_t cosine = Cosine16(rotor_angle);
+  const int32_t period_2 = inverter_->GetPeriod() / 2;
+  const int32_t voltage_max = modulator_.GetMaxMagnitude();
+
+  int32_t voltage_d;
+  int32_t voltage_q;
+  if (currents_valid) {
+    // Clarke transform into stator frame, using ia + ib + ic = 0.
+    const int32_t current_alpha = currents[InverterInterface::kChannelA];
+    const int32_t current_beta = MultiplyQ15(
+        current_alpha + 2 * currents[InverterInterface::kChannelB],
+        kInverseSqrt3);
+
+    // Park transform into rotor frame.
+    const int32_t current_d = MultiplyQ15(current_alpha, cosine) +
+                              MultiplyQ15(current_beta, sine);
+    const int32_t current_q = MultiplyQ15(current_beta, cosine) -
+                              MultiplyQ15(current_alpha, sine);
+
+    // Regulate d current to zero and q current to the command. The d loop
+    // gets priority over the available voltage, as it keeps the current in
+    // phase with the back EMF; q gets what is left of the voltage circle.
+    const int32_t current_q_command = semi_amplitude_ * FOC_MAX_CURRENT /
+                                      period_2;
+    voltage_d = UpdatePi(-current_d, voltage_max, &integral_d_);
+    const int32_t limit_q = IntegerSqrt(static_cast<uint32_t>(
+        voltage_max * voltage_max - voltage_d * voltage_d));
+    voltage_q = UpdatePi(current_q_command - current_q, limit_q, &integral_q_);
+  } else {
+    // Without currents, apply the command as q voltage, scaled to the full
+    // range of the modulator.
+    integral_d_ = 0;
+    integral_q_ = 0;
+    voltage_d = 0;
+    voltage_q = semi_amplitude_ * voltage_max / period_2;
+  }
+
+  // Inverse Park transform back into stator frame.
+  const int32_t voltage_alpha = MultiplyQ15(voltage_d, cosine) -
+                                MultiplyQ15(voltage_q, sine);
+  const int32_t voltage_beta = MultiplyQ15(voltage_d, sine) +
+                               MultiplyQ15(voltage_q, cosine);
+
+  modulator_.WriteAlphaBeta(voltage_alpha, voltage_beta);
+  inverter_->SyncModes();
+  if (observer_ != nullptr) {
+    voltage_alpha_ = voltage_alpha * MOTOR_BUS_VOLTAGE / inverter_->GetPeriod();
+    voltage_beta_ = voltage_beta * MOTOR_BUS_VOLTAGE / inverter_->GetPeriod();
+    driven_ = true;
+  }
+#if LATENCY_TRACE_ENABLE
+  LatencyTraceStamp(LATENCY_STAGE_SYNC);
+#endif
+}
+
+void CommutatorFoc::WriteAmplitude(Width16Diff semi_amplitude) {
+  CHECK(std::abs(static_cast<int>(semi_amplitude)) <=
+        inverter_->GetPeriod() / 2);
+  semi_amplitude_ = semi_amplitude;
+}
+
+Width16Diff CommutatorFoc::GetMaxAmplitude() {
+  return inverter_->GetPeriod() / 2;
+}
+
+// Skips the period if the previous update is still running, rather than
+// letting updates queue up behind it.
+void CommutatorFoc::SignalPeriod(void *commutator_foc) {
+  CommutatorFoc * const commutator = static_cast<CommutatorFoc *>(
+      commutator_foc);
+  chSysLockFromIsr();
+  if (chSemGetCounterI(&commutator->semaphore_) < 0) {
+    chSemSignalI(&commutator->semaphore_);
+  }
+  chSysUnlockFromIsr();
+}
+
+// Gains are Q16 PWM counts per milliampere (per period, for the integral).
+int32_t CommutatorFoc::UpdatePi(int32_t error,
+                                int32_t limit,
+                                int32_t *integral) {
+  const int64_t integral_limit = static_cast<int64_t>(limit) << 16;
+  *integral = static_cast<int32_t>(Clamp<int64_t>(
+      *integral + static_cast<int64_t>(FOC_CURRENT_KI) * error,
+      -integral_limit,
+      integral_limit));
+  const int64_t output =
+      (static_cast<int64_t>(FOC_CURRENT_KP) * error + *integral) >> 16;
+  return static_cast<int32_t>(Clamp<int64_t>(output, -limit, limit));
+}
+
+void CommutatorFoc::Disable() {
+  inverter_->WriteChannel(InverterInterface::kChannelA, 0,
+                          InverterInterface::kModeFloat);
+  inverter_->WriteChannel(InverterInterface::kChannelB, 0,
+                          InverterInterface::kModeFloat);
+  inverter_->WriteChannel(InverterInterface::kChannelC, 0,
+                          InverterInterface::kModeFloat);
+  inverter_->SyncModes();
+  integral_d_ = 0;
+  integral_q_ = 0;
+  driven_ = false;
+}
@@ -29,83 +29,236 @@
 #include <cstdlib>
 #include <algorithm>
 
+#include "config.h"
+#include "base/latency_trace.h"
 #include "base/log.h"
+#include "motor/bus_voltage_sensor_interface.h"
 #include "motor/rotor_interface.h"
 #include "motor/inverter_interface.h"
 
+namespace {
+
+// Advance at speeds spaced SIX_STEP_ADVANCE_SPEED_STEP apart, from zero.
+constexpr uint8_t kAdvanceDegrees[] = SIX_STEP_ADVANCE_TABLE;
+constexpr uint32_t kAdvanceTableSize = sizeof(kAdvanceDegrees) /
+                                  sizeof(kAdvanceDegrees[0]);
+constexpr Velocity32 kAdvanceSpeedStep =
+    RPMToVelocity32(SIX_STEP_ADVANCE_SPEED_STEP);
+
+// Longest delay that the 16-bit timer can schedule; later commutations are
+// rescheduled when it expires.
+constexpr uint32_t kMaxDelay = 0xFFFF;
+
+static_assert(SIX_STEP_MODULATION == SIX_STEP_MODULATION_BIPOLAR ||
+                  SIX_STEP_MODULATION == SIX_STEP_MODULATION_UNIPOLAR ||
+                  SIX_STEP_MODULATION == SIX_STEP_MODULATION_SYNCHRONOUS,
+              "Unknown six-step modulation.");
+static_assert(SIX_STEP_BRAKE_MODE == SIX_STEP_BRAKE_COAST ||
+                  SIX_STEP_BRAKE_MODE == SIX_STEP_BRAKE_DYNAMIC ||
+                  SIX_STEP_BRAKE_MODE == SIX_STEP_BRAKE_REGENERATIVE,
+              "Unknown six-step braking mode.");
+static_assert(SIX_STEP_BRAKE_STRENGTH <= 100,
+              "Six-step braking strength out of range.");
+static_assert(SIX_STEP_BRAKE_MAX_VOLTAGE > 0 &&
+                  SIX_STEP_BRAKE_MAX_VOLTAGE < 128000,
+              "Six-step braking voltage limit out of range.");
+
+// Bus voltage limit for regenerative braking, in Voltage16 units.
+constexpr Voltage16 kBrakeMaxVoltage =
+    static_cast<int64_t>(SIX_STEP_BRAKE_MAX_VOLTAGE) * 256 / 1000;
+
+// Resistive drop across the two driven phases at the full braking current, in
+// millivolts.
+constexpr int32_t kBrakeResistiveVoltage =
+    static_cast<int64_t>(2 * SIX_STEP_BRAKE_CURRENT) * MOTOR_RESISTANCE / 1000;
+
+// Back EMF across the two driven phases per unit of velocity, in Q32 of
+// millivolts. For a sinusoidal back EMF, the line to line voltage averaged over
+// a step is 3 * sqrt(3) / pi of the peak phase back EMF, i.e. 6 * sqrt(3) times
+// the flux linkage per electrical revolution per second.
+constexpr int64_t kBrakeBackEmfPerVelocity = static_cast<int64_t>(
+    MOTOR_FLUX_LINKAGE * 6 * 1.7320508075688772 / 65536 / 1e6 * 4294967296.0 +
+    0.5);
+
+}  // namespace
+
 CommutatorSixStep::CommutatorSixStep(RotorInterface *rotor,
-                                     InverterInterface *inverter)
+                                     InverterInterface *inverter,
+                                     GPTDriver *gpt_driver)
     : rotor_(rotor),
       inverter_(inverter),
+      gpt_driver_(gpt_driver),
       semi_amplitude_(0),
       semaphore_(_SEMAPHORE_DATA(semaphore_, 0)),
-      enable_(false) {
+      enable_(false),
+      modulation_(static_cast<Modulation>(SIX_STEP_MODULATION)),
+      brake_mode_(static_cast<BrakeMode>(SIX_STEP_BRAKE_MODE)),
+      brake_strength_(SIX_STEP_BRAKE_STRENGTH),
+      bus_voltage_sensor_(nullptr) {
 }
 
-// Classifies the rotor angle into one of six buckets, then computes the channel
-// output modes and widths to generate a flux vector perpendicular to the center
-// of the bucket. Finally, repeat when a "state updated" signal is received.
+void CommutatorSixStep::Start() {
+  if (gpt_driver_ != nullptr) {
+    gpt_driver_->self = this;
+    gptStart(gpt_driver_, &kGptConfig);
+  }
+}
+
+// Repeats the commutation when a "state updated" signal is received.
 NORETURN void CommutatorSixStep::CommutationLoop() {
   while (true) {
-    Angle16 rotor_angle;
-    if (!enable_ || !rotor_->ComputeAngle(&rotor_angle)) {
-      // Disable inverter.
-      inverter_->WriteChannel(InverterInterface::kChannelA, 0, false);
-      inverter_->WriteChannel(InverterInterface::kChannelB, 0, false);
-      inverter_->WriteChannel(InverterInterface::kChannelC, 0, false);
-    } else if (semi_amplitude_ == 0) {
-      LogDebug("Zero throttle; maximum braking.");
-      // Switch all low-side transistors on to short out phases (full braking).
-      inverter_->WriteChannel(InverterInterface::kChannelA, 0, true);
-      inverter_->WriteChannel(InverterInterface::kChannelB, 0, true);
-      inverter_->WriteChannel(InverterInterface::kChannelC, 0, true);
-    } else {
-      // Advance by a half step so that the six steps are split along the 0 to
-      // 180 degrees axis. This makes the following arithmetic simpler.
-      rotor_angle += DegreesToAngle16(30);
-
-      Width16 period_2 = inverter_->GetPeriod() / 2;
-      Width16 pos_width = period_2 + semi_amplitude_;
-      Width16 neg_width = period_2 - semi_amplitude_;
-
-      // Exploit the symmetry of the commutation: in the range
-      // 150 deg <= rotor position < 330 deg, the commutation is similar to the
-      // other half circle of rotor positions, except with reversed polarities.
-      if (rotor_angle >= DegreesToAngle16(180)) {
-        // This reverse the polarities of the two driven phases.
-        std::swap(pos_width, neg_width);
-        // Map this half of rotor angles to the normal polarity half.
-        rotor_angle -= DegreesToAngle16(180);
-      }
+    Commutate();
+    // Wait for rotor angle to be updated.
+    chSemWait(&semaphore_);
+#if LATENCY_TRACE_ENABLE
+    LatencyTraceStamp(LATENCY_STAGE_RESUME);
+#endif
+  }
+}
 
-      // Use angle to search for the correct commutation step.
-      if (rotor_angle < DegreesToAngle16(60)) {
-        // 330 deg <= rotor position <  30 deg or
-        // 150 deg <= rotor position < 210 deg
-        inverter_->WriteChannel(InverterInterface::kChannelA, period_2, false);
-        inverter_->WriteChannel(InverterInterface::kChannelB, pos_width, true);
-        inverter_->WriteChannel(InverterInterface::kChannelC, neg_width, true);
-        LogDebug("Aoff B+ C-");
-      } else if (rotor_angle < DegreesToAngle16(120)) {
-        //  30 deg <= rotor position <  90 deg or
-        // 210 deg <= rotor position < 270 deg
-        inverter_->WriteChannel(InverterInterface::kChannelA, neg_width, true);
-        inverter_->WriteChannel(InverterInterface::kChannelB, pos_width, true);
-        inverter_->WriteChannel(InverterInterface::kChannelC, period_2, false);
-        LogDebug("A- B+ Coff");
+// Classifies the rotor angle into one of six buckets, then computes the channel
+// output modes and widths to generate a flux vector perpendicular to the center
+// of the bucket. With advance, the angle is moved ahead before classifying it,
+// and the time until it reaches the next bucket is scheduled on the timer.
+void CommutatorSixStep::Commutate() {
+  if (gpt_driver_ != nullptr) {
+    chSysLock();
+    if (gpt_driver_->state == GPT_ONESHOT) {
+      gptStopTimerI(gpt_driver_);
+    }
+    chSysUnlock();
+  }
+
+  Angle16 rotor_angle;
+  Width16Diff amplitude = semi_amplitude_;
+  const bool braking = amplitude == 0;
+  if (!enable_ || !rotor_->ComputeAngle(&rotor_angle)) {
+    // Disable inverter.
+    inverter_->WriteChannel(InverterInterface::kChannelA, 0,
+                            InverterInterface::kModeFloat);
+    inverter_->WriteChannel(InverterInterface::kChannelB, 0,
+                            InverterInterface::kModeFloat);
+    inverter_->WriteChannel(InverterInterface::kChannelC, 0,
+                            InverterInterface::kModeFloat);
+  } else if (braking && !ComputeRegenerativeAmplitude(&amplitude)) {
+    Brake();
+  } else {
+    Velocity32 velocity = 0;
+    const bool velocity_valid = gpt_driver_ != nullptr &&
+                                rotor_->ComputeVelocity(&velocity) &&
+                                velocity != 0;
+    // Regenerative braking drives in the direction of rotation, but the
+    // advance for the current lagging a motoring voltage doesn't apply to it.
+    const bool motoring = !braking && velocity_valid &&
+                          (velocity > 0) == (amplitude > 0);
+    const Angle16 advance = motoring ? ComputeAdvance(std::abs(velocity)) : 0;
+
+    // Advance by a half step so that the six steps are split along the 0 to
+    // 180 degrees axis. This makes the following arithmetic simpler. The
+    // timing advance is added in the direction of rotation.
+    rotor_angle += DegreesToAngle16(30) + (velocity > 0 ? advance : -advance);
+
+    const Width16 period_2 = inverter_->GetPeriod() / 2;
+    Width16 pos_width;
+    Width16 neg_width;
+    InverterInterface::Mode pos_mode = InverterInterface::kModeComplementary;
+    InverterInterface::Mode neg_mode = InverterInterface::kModeComplementary;
+    if (modulation_ == kModulationBipolar) {
+      // Both driven phases switch, around half of the period.
+      pos_width = period_2 + amplitude;
+      neg_width = period_2 - amplitude;
+    } else {
+      // The phase driven high switches at twice the amplitude, and the other is
+      // held low. Regenerative braking always rectifies synchronously, as its
+      // current flows out of the switching phase, which a diode can't chop.
+      const InverterInterface::Mode mode =
+          modulation_ == kModulationUnipolar && !braking ?
+              InverterInterface::kModeHighSide :
+              InverterInterface::kModeComplementary;
+      if (amplitude > 0) {
+        pos_width = 2 * amplitude;
+        pos_mode = mode;
+        neg_width = 0;
       } else {
-        //  90 deg <= rotor position < 150 deg or
-        // 270 deg <= rotor position < 330 deg
-        inverter_->WriteChannel(InverterInterface::kChannelA, neg_width, true);
-        inverter_->WriteChannel(InverterInterface::kChannelB, period_2, false);
-        inverter_->WriteChannel(InverterInterface::kChannelC, pos_width, true);
-        LogDebug("A- Boff C+");
+        pos_width = 0;
+        neg_width = -2 * amplitude;
+        neg_mode = mode;
       }
     }
-    inverter_->SyncModes();
-    // Wait for rotor angle to be updated.
-    chSemWait(&semaphore_);
+
+    // Exploit the symmetry of the commutation: in the range
+    // 150 deg <= rotor position < 330 deg, the commutation is similar to the
+    // other half circle of rotor positions, except with reversed polarities.
+    if (rotor_angle >= DegreesToAngle16(180)) {
+      // This reverse the polarities of the two driven phases.
+      std::swap(pos_width, neg_width);
+      std::swap(pos_mode, neg_mode);
+      // Map this half of rotor angles to the normal polarity half.
+      rotor_angle -= DegreesToAngle16(180);
+    }
+
+    // Use angle to search for the correct commutation step.
+    Angle16 step_start;
+    Angle16 step_end;
+    if (rotor_angle < DegreesToAngle16(60)) {
+      step_start = 0;
+      step_end = DegreesToAngle16(60);
+      // 330 deg <= rotor position <  30 deg or
+      // 150 deg <= rotor position < 210 deg
+      inverter_->WriteChannel(InverterInterface::kChannelA, period_2,
+                              InverterInterface::kModeFloat);
+      inverter_->WriteChannel(InverterInterface::kChannelB, pos_width,
+                              pos_mode);
+      inverter_->WriteChannel(InverterInterface::kChannelC, neg_width,
+                              neg_mode);
+      LogDebug("Aoff B+ C-");
+    } else if (rotor_angle < DegreesToAngle16(120)) {
+      step_start = DegreesToAngle16(60);
+      step_end = DegreesToAngle16(120);
+      //  30 deg <= rotor position <  90 deg or
+      // 210 deg <= rotor position < 270 deg
+      inverter_->WriteChannel(InverterInterface::kChannelA, neg_width,
+                              neg_mode);
+      inverter_->WriteChannel(InverterInterface::kChannelB, pos_width,
+                              pos_mode);
+      inverter_->WriteChannel(InverterInterface::kChannelC, period_2,
+                              InverterInterface::kModeFloat);
+      LogDebug("A- B+ Coff");
+    } else {
+      step_start = DegreesToAngle16(120);
+      step_end = DegreesToAngle16(180);
+      //  90 deg <= rotor position < 150 deg or
+      // 270 deg <= rotor position < 330 deg
+      inverter_->WriteChannel(InverterInterface::kChannelA, neg_width,
+                              neg_mode);
+      inverter_->WriteChannel(InverterInterface::kChannelB, period_2,
+                              InverterInterface::kModeFloat);
+      inverter_->WriteChannel(InverterInterface::kChannelC, pos_width,
+                              pos_mode);
+      LogDebug("A- Boff C+");
+    }
+
+    // Schedule the next commutation for when the advanced angle crosses into
+    // the next step, rounding up so that it has crossed by then.
+    if (velocity_valid) {
+      const uint32_t distance = velocity > 0 ?
+                                    step_end - rotor_angle :
+                                    rotor_angle - step_start + 1;
+      const uint32_t speed = std::abs(velocity);
+      const uint64_t delay = (static_cast<uint64_t>(distance) *
+                                  SIX_STEP_GPT_FREQ + speed - 1) / speed;
+      chSysLock();
+      gptStartOneShotI(gpt_driver_,
+                       std::max<uint64_t>(std::min<uint64_t>(delay,
+                                                             kMaxDelay),
+                                          2));
+      chSysUnlock();
+    }
   }
+  inverter_->SyncModes();
+#if LATENCY_TRACE_ENABLE
+  LatencyTraceStamp(LATENCY_STAGE_SYNC);
+#endif
 }
 
 void CommutatorSixStep::SignalChange() {
@@ -121,3 +274,95 @@ void CommutatorSixStep::WriteAmplitude(Width16Diff semi_amplitude) {
 Width16Diff CommutatorSixStep::GetMaxAmplitude() {
   return inverter_->GetPeriod() / 2;
 }
+
+void CommutatorSixStep::SetBrake(BrakeMode mode, unsigned strength) {
+  CHECK(strength <= 100);
+  brake_mode_ = mode;
+  brake_strength_ = strength;
+}
+
+const GPTConfig CommutatorSixStep::kGptConfig = { SIX_STEP_GPT_FREQ,
+                                                  GptCallback,
+                                                  0 };
+
+// Interpolates linearly between table entries, and holds the last entry above
+// the end of the table.
+Angle16 CommutatorSixStep::ComputeAdvance(Velocity32 speed) {
+  const uint32_t index = speed / kAdvanceSpeedStep;
+  if (index >= kAdvanceTableSize - 1) {
+    return DegreesToAngle16(kAdvanceDegrees[kAdvanceTableSize - 1]);
+  }
+  const int32_t low = DegreesToAngle16(kAdvanceDegrees[index]);
+  const int32_t high = DegreesToAngle16(kAdvanceDegrees[index + 1]);
+  const int32_t fraction = speed - index * kAdvanceSpeedStep;
+  return low + static_cast<int64_t>(high - low) * fraction / kAdvanceSpeedStep;
+}
+
+// The low sides are on outside of the width, so at full strength the width is
+// zero and they are held on.
+void CommutatorSixStep::Brake() {
+  if (brake_mode_ == kBrakeCoast) {
+    LogDebug("Zero throttle; coasting.");
+    inverter_->WriteChannel(InverterInterface::kChannelA, 0,
+                            InverterInterface::kModeFloat);
+    inverter_->WriteChannel(InverterInterface::kChannelB, 0,
+                            InverterInterface::kModeFloat);
+    inverter_->WriteChannel(InverterInterface::kChannelC, 0,
+                            InverterInterface::kModeFloat);
+    return;
+  }
+
+  LogDebug("Zero throttle; dynamic braking.");
+  const uint32_t period = inverter_->GetPeriod();
+  const Width16 width = period - period * brake_strength_ / 100;
+  inverter_->WriteChannel(InverterInterface::kChannelA, width,
+                          InverterInterface::kModeLowSide);
+  inverter_->WriteChannel(InverterInterface::kChannelB, width,
+                          InverterInterface::kModeLowSide);
+  inverter_->WriteChannel(InverterInterface::kChannelC, width,
+                          InverterInterface::kModeLowSide);
+}
+
+// The driven pair puts out twice the amplitude, as a fraction of the period, of
+// the bus voltage. Setting that to the back EMF less the resistive drop at the
+// braking current makes the current flow against the back EMF, and so back
+// into the bus.
+bool CommutatorSixStep::ComputeRegenerativeAmplitude(Width16Diff *amplitude) {
+  Velocity32 velocity;
+  Voltage16 bus_voltage;
+  if (brake_mode_ != kBrakeRegenerative || bus_voltage_sensor_ == nullptr ||
+      !rotor_->ComputeVelocity(&velocity) || velocity == 0 ||
+      !bus_voltage_sensor_->ComputeBusVoltage(&bus_voltage) ||
+      bus_voltage <= 0) {
+    return false;
+  }
+  if (bus_voltage >= kBrakeMaxVoltage) {
+    LogDebug("Bus overvoltage; dynamic braking.");
+    return false;
+  }
+
+  const int64_t back_emf =
+      (std::abs(velocity) * kBrakeBackEmfPerVelocity) >> 32;
+  const int64_t voltage = back_emf -
+                          kBrakeResistiveVoltage * brake_strength_ / 100;
+  if (voltage <= 0) {
+    return false;
+  }
+  const int64_t max_amplitude = GetMaxAmplitude();
+  const int64_t semi_amplitude = std::min(
+      voltage * max_amplitude * 256 / (static_cast<int64_t>(bus_voltage) *
+                                       1000),
+      max_amplitude);
+  *amplitude = static_cast<Width16Diff>(velocity > 0 ? semi_amplitude :
+                                                       -semi_amplitude);
+  LogDebug("Zero throttle; regenerative braking.");
+  return true;
+}
+
+void CommutatorSixStep::GptCallback(GPTDriver *gpt_driver) {
+  CommutatorSixStep * const commutator = static_cast<CommutatorSixStep *>(
+      gpt_driver->self);
+  chSysLockFromIsr();
+  commutator->SignalChange();
+  chSysUnlockFromIsr();
+}
@@ -0,0 +1,245 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "motor/current_sensor_adc.h"
+
+#include <cstdlib>
+#include <limits>
+
+#include "ch.h"
+
+#include "config.h"
+#include "base/integer.h"
+#include "base/log.h"
+#include "base/utility.h"
+#include "motor/inverter_pwm.h"
+
+namespace {
+
+// ADC sampling time, in ADC clocks at the undivided 72 MHz AHB clock, and in
+// inverter timer counts.
+constexpr uint32_t kAdcFrequency = 72000000;
+constexpr double kSampleCycles = 7.5;
+constexpr uint32_t kSampleCounts = static_cast<uint32_t>(
+    kSampleCycles * INVERTER_COUNTER_FREQ / kAdcFrequency + 0.5);
+
+// Counter value that triggers each conversion on the up count, so that its
+// sampling is centered on the top of the count (the period minus one).
+constexpr Width16 kTriggerCount = INVERTER_PWM_PERIOD - 1 - kSampleCounts / 2;
+
+// Largest width that leaves the low side on for the settle time before the
+// sampling starts.
+constexpr Width16 kMaxSampledWidth = kTriggerCount -
+    static_cast<uint64_t>(CURRENT_SENSE_SETTLE) * INVERTER_COUNTER_FREQ /
+        1000000000;
+
+// Amplifier output at zero current, half of the 12-bit range, before
+// calibration.
+constexpr int32_t kZeroCurrentSample = 2048;
+
+// Fractional bits of the calibrated zero current outputs.
+constexpr int kOffsetFractionBits = 4;
+
+// Largest difference of a calibrated zero current output from half range,
+// about 5% of the ADC range; anything further means the calibration failed.
+constexpr int32_t kMaxOffsetError = 200;
+
+// Phase current per ADC count, in Q16 milliamperes.
+constexpr int64_t kCurrentPerSample =
+    static_cast<int64_t>(CURRENT_SENSE_VREF) * 1000000 * 65536 /
+    (4096 * CURRENT_SENSE_GAIN * static_cast<int64_t>(CURRENT_SENSE_SHUNT));
+
+static_assert(static_cast<uint64_t>(CURRENT_SENSE_CALIBRATION_SAMPLES) * 4095 <=
+                  std::numeric_limits<uint32_t>::max(),
+              "Calibration sums overflow.");
+
+// Discarded samples that the last good one stands in for, before the currents
+// are reported invalid.
+constexpr uint32_t kMaxHeldSamples = 4;
+
+// Converts an amplifier output to milliamperes into the phase, given the
+// output at zero current in Q4 counts.
+inline int32_t SampleToCurrent(adcsample_t sample, int32_t offset) {
+  return static_cast<int32_t>(
+      (((static_cast<int32_t>(sample) << kOffsetFractionBits) - offset) *
+       kCurrentPerSample) >> (16 + kOffsetFractionBits));
+}
+
+// Rounds the average of a calibration sum to Q4 counts.
+inline int32_t AverageSamples(uint32_t sum, uint32_t count) {
+  return static_cast<int32_t>(
+      ((static_cast<uint64_t>(sum) << kOffsetFractionBits) + count / 2) /
+      count);
+}
+
+// Saturates a current to the range of Current16.
+inline Current16 ClampCurrent(int32_t current) {
+  return Clamp<int32_t>(current,
+                        std::numeric_limits<Current16>::min(),
+                        std::numeric_limits<Current16>::max());
+}
+
+}  // namespace
+
+CurrentSensorAdc::CurrentSensorAdc(ADCDriver *adc_driver,
+                                   InverterPWM *inverter)
+    : adc_driver_(adc_driver),
+      inverter_(inverter),
+      sample_b_(kZeroCurrentSample),
+      sample_c_(kZeroCurrentSample),
+      sampled_(false),
+      window_clear_(false),
+      held_(0),
+      offset_b_(kZeroCurrentSample << kOffsetFractionBits),
+      offset_c_(kZeroCurrentSample << kOffsetFractionBits),
+      calibrating_(false),
+      calibration_count_(0),
+      calibration_sum_b_(0),
+      calibration_sum_c_(0) {
+}
+
+void CurrentSensorAdc::Start() {
+  adc_driver_->self = this;
+  inverter_->SetSampleCount(kTriggerCount);
+  adcStart(adc_driver_, &kAdcConfig);
+  adcStartConversion(adc_driver_, &kConversionGroup, samples_, kDepth);
+  LogInfo("Started current sensing, up to %d%% duty.",
+          kMaxSampledWidth * 100 / INVERTER_PWM_PERIOD);
+}
+
+// Scales the last good sample, and derives phase A. Sums are clamped, as two
+// phases at full scale add up to more than the range of Current16.
+bool CurrentSensorAdc::ComputeCurrents(
+    Current16 currents[InverterInterface::kNumChannels]) {
+  chSysLock();
+  const adcsample_t sample_b = sample_b_;
+  const adcsample_t sample_c = sample_c_;
+  const int32_t offset_b = offset_b_;
+  const int32_t offset_c = offset_c_;
+  const bool valid = !calibrating_ && sampled_ && held_ <= kMaxHeldSamples;
+  chSysUnlock();
+
+  if (!valid) {
+    return false;
+  }
+  const int32_t current_b = SampleToCurrent(sample_b, offset_b);
+  const int32_t current_c = SampleToCurrent(sample_c, offset_c);
+  currents[InverterInterface::kChannelA] = ClampCurrent(-current_b - current_c);
+  currents[InverterInterface::kChannelB] = ClampCurrent(current_b);
+  currents[InverterInterface::kChannelC] = ClampCurrent(current_c);
+  return true;
+}
+
+void CurrentSensorAdc::StartCalibration() {
+  chSysLock();
+  calibrating_ = true;
+  calibration_count_ = 0;
+  calibration_sum_b_ = 0;
+  calibration_sum_c_ = 0;
+  chSysUnlock();
+}
+
+// Samples taken before the calibration hold shorted inputs, so a fresh sample
+// is needed before the currents are valid again.
+bool CurrentSensorAdc::EndCalibration() {
+  chSysLock();
+  const uint32_t count = calibration_count_;
+  const uint32_t sum_b = calibration_sum_b_;
+  const uint32_t sum_c = calibration_sum_c_;
+  calibrating_ = false;
+  sampled_ = false;
+  chSysUnlock();
+
+  if (count < CURRENT_SENSE_CALIBRATION_SAMPLES) {
+    return false;
+  }
+  const int32_t offset_b = AverageSamples(sum_b, count);
+  const int32_t offset_c = AverageSamples(sum_c, count);
+  const int32_t zero = kZeroCurrentSample << kOffsetFractionBits;
+  const int32_t max_error = kMaxOffsetError << kOffsetFractionBits;
+  if (std::abs(offset_b - zero) > max_error ||
+      std::abs(offset_c - zero) > max_error) {
+    LogWarning("Current sense offsets %d, %d (1/16 count) out of range.",
+               static_cast<int>(offset_b), static_cast<int>(offset_c));
+    return false;
+  }
+
+  chSysLock();
+  offset_b_ = offset_b;
+  offset_c_ = offset_c;
+  chSysUnlock();
+  return true;
+}
+
+// Runs from the DMA interrupt once per PWM period, so it only compares the
+// widths and copies or sums the raw samples.
+void CurrentSensorAdc::AdcCallback(ADCDriver *adc_driver,
+                                   adcsample_t *buffer,
+                                   size_t n) {
+  (void) n;
+  CurrentSensorAdc * const self = static_cast<CurrentSensorAdc *>(
+      adc_driver->self);
+  const bool window_clear =
+      self->inverter_->GetWidth(InverterInterface::kChannelB) <=
+          kMaxSampledWidth &&
+      self->inverter_->GetWidth(InverterInterface::kChannelC) <=
+          kMaxSampledWidth;
+  if (self->calibrating_) {
+    if (self->calibration_count_ < CURRENT_SENSE_CALIBRATION_SAMPLES) {
+      self->calibration_sum_c_ += buffer[0];
+      self->calibration_sum_b_ += buffer[1];
+      self->calibration_count_++;
+    }
+  } else if (window_clear && self->window_clear_) {
+    self->sample_c_ = buffer[0];
+    self->sample_b_ = buffer[1];
+    self->sampled_ = true;
+    self->held_ = 0;
+  } else if (self->held_ <= kMaxHeldSamples) {
+    self->held_++;
+  }
+  self->window_clear_ = window_clear;
+}
+
+// All inputs single-ended.
+const ADCConfig CurrentSensorAdc::kAdcConfig = { 0 };
+
+// One conversion per trigger on each ADC: phase C (SO2 on PA3) on ADC1 channel
+// 4, and phase B (SO1 on PA4) on ADC2 channel 1. The trigger is TIM1 TRGO
+// (external event 9), which falls when the channel 4 reference does.
+const ADCConversionGroup CurrentSensorAdc::kConversionGroup = {
+  true,  // Circular.
+  kNumAdcChannels,
+  AdcCallback,
+  nullptr,  // No error callback.
+  ADC_CFGR_EXTEN_FALLING | ADC_CFGR_EXTSEL_SRC(9),  // CFGR.
+  ADC_TR(0, 4095),  // TR1.
+  ADC_CCR_DUAL(6),  // CCR: regular simultaneous mode only.
+  { ADC_SMPR1_SMP_AN4(ADC_SMPR_SMP_7P5), 0 },  // SMPR.
+  { ADC_SQR1_SQ1_N(ADC_CHANNEL_IN4), 0, 0, 0 },  // SQR.
+  { ADC_SMPR1_SMP_AN1(ADC_SMPR_SMP_7P5), 0 },  // SSMPR.
+  { ADC_SQR1_SQ1_N(ADC_CHANNEL_IN1), 0, 0, 0 }  // SSQR.
+};
@@ -26,25 +26,43 @@
 
 #include "motor/inverter_pwm.h"
 
+#include "config.h"
+#include "base/integer.h"
 #include "base/log.h"
+#include "motor/current_sensor_interface.h"
 
 InverterPWM::InverterPWM(PWMDriver *pwm_driver)
-    : pwm_driver_(pwm_driver) {
+    : pwm_driver_(pwm_driver),
+      pwm_config_(kPwmConfig),
+      update_callback_(nullptr),
+      update_callback_arg_(nullptr),
+      current_sensor_(nullptr),
+      currents_(),
+      currents_read_(false),
+      currents_valid_(false) {
 }
 
 // Note that all the channels are disabled in the OS driver, and then separately
 // configured through the WriteChannel function.
 void InverterPWM::Start() {
-  pwmStart(pwm_driver_, &kPwmConfig);
-  // Enable each channel's output, but put them in disable mode. See comment for
-  // the OS driver configuration on the distinction.
-  WriteChannel(InverterPWM::kChannelA, 0, false);
-  WriteChannel(InverterPWM::kChannelB, 0, false);
-  WriteChannel(InverterPWM::kChannelC, 0, false);
+  pwm_driver_->self = this;
+  if (update_callback_ != nullptr) {
+    pwm_config_.callback = PwmUpdateCallback;
+  }
+  pwmStart(pwm_driver_, &pwm_config_);
+  if (update_callback_ != nullptr) {
+    // In center-aligned mode the counter updates at both ends of its count, so
+    // only interrupt on every other update to get one per PWM period.
+    pwm_driver_->tim->RCR = 1;
+  }
+  // Enable each channel's output, but put them in floating mode. See comment
+  // for the OS driver configuration on the distinction.
+  WriteChannel(InverterPWM::kChannelA, 0, InverterPWM::kModeFloat);
+  WriteChannel(InverterPWM::kChannelB, 0, InverterPWM::kModeFloat);
+  WriteChannel(InverterPWM::kChannelC, 0, InverterPWM::kModeFloat);
   SyncModes();
-  constexpr int pwm_frequency = INVERTER_COUNTER_FREQ / INVERTER_PWM_PERIOD / 2;
   LogInfo("Started inverter PWM driver at %d.%d kHz.",
-          pwm_frequency / 1000, (pwm_frequency % 1000 + 50) / 100);
+          INVERTER_PWM_FREQ / 1000, (INVERTER_PWM_FREQ % 1000 + 50) / 100);
 }
 
 // Writes channel configurations to preload registers. The widths don't take
@@ -52,39 +70,66 @@ void InverterPWM::Start() {
 // until a call to SyncModes().
 void InverterPWM::WriteChannel(InverterPWM::Channel channel,
                                Width16 width,
-                               bool enable) {
+                               InverterPWM::Mode mode) {
   CHECK(channel < InverterPWM::kNumChannels);
 
+  // Output compare mode of the channel reference, and which outputs are
+  // enabled. Even with the OSSR bit set in TIMx_BDTR, having both outputs for
+  // a channel disabled results in both outputs putting out high-impedance
+  // rather than both inactive, so a floating channel keeps its low-side output
+  // enabled. With only one output enabled, it follows the reference rather than
+  // its complement, and the other is held inactive. See table "Output control
+  // bits for complementary OCx and OCxN channels with break feature" in the
+  // reference manual (RM0316).
+  uint32_t output_mode;
+  bool high_side;
+  bool low_side;
+  switch (mode) {
+    case InverterPWM::kModeComplementary:
+      // Normal PWM mode, active for the width.
+      output_mode = 6;
+      high_side = true;
+      low_side = true;
+      width = CompensateDeadtime(channel, width);
+      break;
+    case InverterPWM::kModeLowSide:
+      // Inverted PWM mode, active outside of the width, i.e. when the low side
+      // would be on in the complementary mode.
+      output_mode = 7;
+      high_side = false;
+      low_side = true;
+      break;
+    case InverterPWM::kModeHighSide:
+      // Normal PWM mode, active for the width.
+      output_mode = 6;
+      high_side = true;
+      low_side = false;
+      break;
+    default:
+      // Lock the reference signal to inactive. Since OCxM is preloaded
+      // together with channel enable and polarity bits, this takes effect
+      // synchronously with them. This is better than just setting the pulse
+      // width compare register (CCR) to zero, as that takes effect on counter
+      // update events.
+      output_mode = 4;
+      high_side = false;
+      low_side = true;
+      break;
+  }
+
+  // Since the modes don't take effect until SyncModes() is called, the widths
+  // are updated regardless of the channel floating.
   uint32_t ccer = pwm_driver_->tim->CCER;
   switch (channel) {
     case InverterPWM::kChannelC: {
       uint32_t ccmr1 = pwm_driver_->tim->CCMR1;
       ccmr1 &= ~STM32_TIM_CCMR1_OC1M_MASK;
-      if (enable) {
-        // Set the normal PWM mode.
-        ccmr1 |= STM32_TIM_CCMR1_OC1M(6);
-        // Enable both PWM channels.
-        ccer |= STM32_TIM_CCER_CC1E | STM32_TIM_CCER_CC1NE;
-      } else {
-        // Lock the reference signal to inactive. Since OCxM is preloaded
-        // together with channel enable and polarity bits, this takes effect
-        // synchronously with them. This is better than just setting the pulse
-        // width compare register (CCR) to zero, as that takes effect on counter
-        // update events.
-        ccmr1 |= STM32_TIM_CCMR1_OC1M(4);
-        // Disable the high-side output, which sets the low-side (complementary)
-        // output as based on the reference signal. See table "Output control
-        // bits for complementary OCx and OCxN channels with break feature" in
-        // the reference manual (RM0316).
-        ccer &= ~STM32_TIM_CCER_CC1E;
-        // Enable the low side output. Even with the OSSR bit set in TIMx_BDTR,
-        // having both outputs for a channel disabled results in both outputs
-        // putting out high-impedance rather than both inactive.
-        ccer |= STM32_TIM_CCER_CC1NE;
-      }
+      ccmr1 |= STM32_TIM_CCMR1_OC1M(output_mode);
+      ccer = high_side ? ccer | STM32_TIM_CCER_CC1E :
+                         ccer & ~STM32_TIM_CCER_CC1E;
+      ccer = low_side ? ccer | STM32_TIM_CCER_CC1NE :
+                        ccer & ~STM32_TIM_CCER_CC1NE;
       pwm_driver_->tim->CCMR1 = ccmr1;
-      // Since the modes don't take effect until SyncModes() is called, update
-      // the width regardless of this channel being disabled.
       pwm_driver_->tim->CCR[0] = width;
       break;
     }
@@ -92,14 +137,11 @@ void InverterPWM::WriteChannel(InverterPWM::Channel channel,
     case InverterPWM::kChannelB: {
       uint32_t ccmr1 = pwm_driver_->tim->CCMR1;
       ccmr1 &= ~STM32_TIM_CCMR1_OC2M_MASK;
-      if (enable) {
-        ccmr1 |= STM32_TIM_CCMR1_OC2M(6);
-        ccer |= STM32_TIM_CCER_CC2E | STM32_TIM_CCER_CC2NE;
-      } else {
-        ccmr1 |= STM32_TIM_CCMR1_OC2M(4);
-        ccer &= ~STM32_TIM_CCER_CC2E;
-        ccer |= STM32_TIM_CCER_CC2NE;
-      }
+      ccmr1 |= STM32_TIM_CCMR1_OC2M(output_mode);
+      ccer = high_side ? ccer | STM32_TIM_CCER_CC2E :
+                         ccer & ~STM32_TIM_CCER_CC2E;
+      ccer = low_side ? ccer | STM32_TIM_CCER_CC2NE :
+                        ccer & ~STM32_TIM_CCER_CC2NE;
       pwm_driver_->tim->CCMR1 = ccmr1;
       pwm_driver_->tim->CCR[1] = width;
       break;
@@ -108,14 +150,11 @@ void InverterPWM::WriteChannel(InverterPWM::Channel channel,
     case InverterPWM::kChannelA: {
       uint32_t ccmr2 = pwm_driver_->tim->CCMR2;
       ccmr2 &= ~STM32_TIM_CCMR2_OC3M_MASK;
-      if (enable) {
-        ccmr2 |= STM32_TIM_CCMR2_OC3M(6);
-        ccer |= STM32_TIM_CCER_CC3E | STM32_TIM_CCER_CC3NE;
-      } else {
-        ccmr2 |= STM32_TIM_CCMR2_OC3M(4);
-        ccer &= ~STM32_TIM_CCER_CC3E;
-        ccer |= STM32_TIM_CCER_CC3NE;
-      }
+      ccmr2 |= STM32_TIM_CCMR2_OC3M(output_mode);
+      ccer = high_side ? ccer | STM32_TIM_CCER_CC3E :
+                         ccer & ~STM32_TIM_CCER_CC3E;
+      ccer = low_side ? ccer | STM32_TIM_CCER_CC3NE :
+                        ccer & ~STM32_TIM_CCER_CC3NE;
       pwm_driver_->tim->CCMR2 = ccmr2;
       pwm_driver_->tim->CCR[2] = width;
       break;
@@ -127,9 +166,84 @@ void InverterPWM::WriteChannel(InverterPWM::Channel channel,
   pwm_driver_->tim->CCER = ccer;
 }
 
+// Channel 4 is not remapped like the inverter channels, so its width is set
+// directly. Its output is never enabled, but its reference still drives TRGO.
+void InverterPWM::SetSampleCount(Width16 count) {
+  CHECK(count < GetPeriod());
+  pwm_driver_->tim->CCR[3] = count;
+}
+
+Width16 InverterPWM::GetWidth(InverterPWM::Channel channel) {
+  switch (channel) {
+    case InverterPWM::kChannelA:
+      return pwm_driver_->tim->CCR[2];
+    case InverterPWM::kChannelB:
+      return pwm_driver_->tim->CCR[1];
+    case InverterPWM::kChannelC:
+      return pwm_driver_->tim->CCR[0];
+    default:
+      return 0;
+  }
+}
+
+// A floating channel has its high-side output disabled, and its reference,
+// which the low-side output follows, forced inactive.
+bool InverterPWM::IsFloating() {
+  constexpr uint32_t kCcmr1Mask = STM32_TIM_CCMR1_OC1M_MASK |
+                                  STM32_TIM_CCMR1_OC2M_MASK;
+  constexpr uint32_t kCcmr1Floating = STM32_TIM_CCMR1_OC1M(4) |
+                                      STM32_TIM_CCMR1_OC2M(4);
+  return (pwm_driver_->tim->CCER & (STM32_TIM_CCER_CC1E |
+                                    STM32_TIM_CCER_CC2E |
+                                    STM32_TIM_CCER_CC3E)) == 0 &&
+         (pwm_driver_->tim->CCMR1 & kCcmr1Mask) == kCcmr1Floating &&
+         (pwm_driver_->tim->CCMR2 & STM32_TIM_CCMR2_OC3M_MASK) ==
+             STM32_TIM_CCMR2_OC3M(4);
+}
+
 // Generates commutation event, loading preloaded channel configurations.
+// The next write starts a new set, so it reads the currents again.
 void InverterPWM::SyncModes() {
   pwm_driver_->tim->EGR |= STM32_TIM_EGR_COMG;
+  currents_read_ = false;
+}
+
+void InverterPWM::PwmUpdateCallback(PWMDriver *pwm_driver) {
+  InverterPWM * const inverter_pwm = static_cast<InverterPWM *>(
+      pwm_driver->self);
+  if (inverter_pwm->update_callback_ != nullptr) {
+    inverter_pwm->update_callback_(inverter_pwm->update_callback_arg_);
+  }
+}
+
+// A channel held at zero or full width doesn't switch, so it has no deadtime
+// to make up for; this keeps braking with all low sides on exact.
+Width16 InverterPWM::CompensateDeadtime(InverterPWM::Channel channel,
+                                        Width16 width) {
+  const int32_t period = GetPeriod();
+  if (INVERTER_DEADTIME_COMPENSATION == 0 || width == 0 || width >= period) {
+    return width;
+  }
+  if (current_sensor_ != nullptr && !currents_read_) {
+    currents_valid_ = current_sensor_->ComputeCurrents(currents_);
+    currents_read_ = true;
+  }
+
+  int32_t compensation;
+  if (current_sensor_ != nullptr && currents_valid_) {
+    compensation = Clamp<int32_t>(
+        static_cast<int32_t>(currents_[channel]) *
+            INVERTER_DEADTIME_COMPENSATION / INVERTER_DEADTIME_CURRENT,
+        -INVERTER_DEADTIME_COMPENSATION,
+        INVERTER_DEADTIME_COMPENSATION);
+  } else if (width > period / 2) {
+    compensation = INVERTER_DEADTIME_COMPENSATION;
+  } else if (width < period / 2) {
+    compensation = -INVERTER_DEADTIME_COMPENSATION;
+  } else {
+    compensation = 0;
+  }
+  return static_cast<Width16>(Clamp<int32_t>(width + compensation, 0, period));
 }
 
 // All channels are disabled at the beginning. This results in them not driving
@@ -146,11 +260,15 @@ const PWMConfig InverterPWM::kPwmConfig = { INVERTER_COUNTER_FREQ,
                                             // Center-aligned (count up & down).
                                             STM32_TIM_CR1_CMS(3),
                                             // Preload channel configurations.
-                                            STM32_TIM_CR2_CCPC,
+                                            STM32_TIM_CR2_CCPC |
+                                            // Channel 4 reference to TRGO, for
+                                            // triggering the ADC.
+                                                STM32_TIM_CR2_MMS(7),
                                             // Drive channel even if disabled.
                                             STM32_TIM_BDTR_OSSR |
                                             // Drive channel if generator idle.
                                                 STM32_TIM_BDTR_OSSI |
-                                            // Deadtime of 4 * 125 ns.
+                                            // Deadtime of 4 timer clocks
+                                            // (28 ns at 144 MHz).
                                                 STM32_TIM_BDTR_DTG(4),
                                             0 };
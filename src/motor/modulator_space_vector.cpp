@@ -0,0 +1,121 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "motor/modulator_space_vector.h"
+
+#include <algorithm>
+
+#include "base/integer.h"
+#include "motor/inverter_interface.h"
+#include "motor/trig.h"
+
+namespace {
+
+constexpr int32_t kSqrt3 = 56756;  // sqrt(3) in Q15.
+constexpr int32_t kInverseSqrt3 = 18919;  // 1 / sqrt(3) in Q15.
+constexpr int32_t kSqrt3Over2 = 28378;  // sqrt(3) / 2 in Q15.
+
+constexpr int kNumSectors = 6;
+
+// Phases with the longest, middle, and shortest widths in each sector, where
+// sector k spans from k * 60 degrees to (k + 1) * 60 degrees.
+constexpr InverterInterface::Channel kMaxChannel[kNumSectors] = {
+  InverterInterface::kChannelA, InverterInterface::kChannelB,
+  InverterInterface::kChannelB, InverterInterface::kChannelC,
+  InverterInterface::kChannelC, InverterInterface::kChannelA
+};
+constexpr InverterInterface::Channel kMidChannel[kNumSectors] = {
+  InverterInterface::kChannelB, InverterInterface::kChannelA,
+  InverterInterface::kChannelC, InverterInterface::kChannelB,
+  InverterInterface::kChannelA, InverterInterface::kChannelC
+};
+constexpr InverterInterface::Channel kMinChannel[kNumSectors] = {
+  InverterInterface::kChannelC, InverterInterface::kChannelC,
+  InverterInterface::kChannelA, InverterInterface::kChannelA,
+  InverterInterface::kChannelB, InverterInterface::kChannelB
+};
+
+}  // namespace
+
+ModulatorSpaceVector::ModulatorSpaceVector(InverterInterface *inverter)
+    : inverter_(inverter) {
+}
+
+Width16 ModulatorSpaceVector::GetMaxMagnitude() {
+  return (inverter_->GetPeriod() * kInverseSqrt3) >> 15;
+}
+
+// The vector is made of the two active vectors bounding its sector, switched on
+// for t1 and t2, and zero vectors for the rest of the period, split evenly
+// between all phases off and all on. The phase that is on for both active
+// vectors has the longest width, and the one on for neither the shortest.
+void ModulatorSpaceVector::Write(Angle16 angle, Width16 magnitude) {
+  const int32_t period = inverter_->GetPeriod();
+  const int32_t scaled_magnitude =
+      (std::min(magnitude, GetMaxMagnitude()) * kSqrt3) >> 15;
+
+  // Multiplying by 6 puts the sector in the top bits, and the angle within
+  // the sector (as a fraction of 60 degrees) in the bottom 16 bits.
+  const uint32_t angle_6 = static_cast<uint32_t>(angle) * kNumSectors;
+  const int sector = angle_6 >> 16;
+  const Angle16 sector_angle = (angle_6 & 0xFFFF) / kNumSectors;
+
+  const int32_t t1 = (scaled_magnitude *
+      Sine16(DegreesToAngle16(60) - sector_angle)) >> 15;
+  const int32_t t2 = (scaled_magnitude * Sine16(sector_angle)) >> 15;
+  const int32_t t0_2 = (period - t1 - t2) / 2;
+
+  // The middle phase is on for the second active vector of even sectors and
+  // the first of odd sectors.
+  const int32_t t_mid = (sector & 1) == 0 ? t2 : t1;
+  inverter_->WriteChannel(kMaxChannel[sector], t0_2 + t1 + t2);
+  inverter_->WriteChannel(kMidChannel[sector], t0_2 + t_mid);
+  inverter_->WriteChannel(kMinChannel[sector], t0_2);
+}
+
+void ModulatorSpaceVector::WriteAlphaBeta(int32_t alpha, int32_t beta) {
+  const int32_t period = inverter_->GetPeriod();
+
+  // Inverse Clarke transform into phase voltages.
+  const int32_t beta_part = (beta * kSqrt3Over2) >> 15;
+  const int32_t voltage_a = alpha;
+  const int32_t voltage_b = -alpha / 2 + beta_part;
+  const int32_t voltage_c = -alpha / 2 - beta_part;
+
+  // Center the highest and lowest widths in the period.
+  const int32_t voltage_max = std::max(voltage_a, std::max(voltage_b,
+                                                           voltage_c));
+  const int32_t voltage_min = std::min(voltage_a, std::min(voltage_b,
+                                                           voltage_c));
+  const int32_t offset = period / 2 - Average(voltage_max, voltage_min);
+
+  inverter_->WriteChannel(InverterInterface::kChannelA,
+                          Clamp<int32_t>(voltage_a + offset, 0, period));
+  inverter_->WriteChannel(InverterInterface::kChannelB,
+                          Clamp<int32_t>(voltage_b + offset, 0, period));
+  inverter_->WriteChannel(InverterInterface::kChannelC,
+                          Clamp<int32_t>(voltage_c + offset, 0, period));
+}
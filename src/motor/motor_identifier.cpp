@@ -0,0 +1,424 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "motor/motor_identifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "config.h"
+#include "base/log.h"
+#include "motor/bus_voltage_sensor_interface.h"
+#include "motor/current_sensor_interface.h"
+#include "motor/rotor_interface.h"
+
+namespace {
+
+// Length of one PWM period in nanoseconds.
+constexpr double kPeriodTime = 1e9 / INVERTER_PWM_FREQ;
+
+// Durations of the steps of the sequence, in PWM periods. Each current is held
+// to settle (and align the rotor) before it is averaged, and the rotor is
+// spun for the spin time with its last quarter averaged.
+constexpr uint32_t kSettlePeriods = INVERTER_PWM_FREQ / 5;
+constexpr uint32_t kAveragePeriods = INVERTER_PWM_FREQ / 10;
+constexpr uint32_t kStepCycles = 16;
+
+// Times a current level may be held again to correct for overshooting it.
+constexpr uint32_t kMaxHolds = 8;
+constexpr uint32_t kSpinPeriods = static_cast<uint64_t>(
+    MOTOR_IDENTIFY_SPIN_TIME) * INVERTER_PWM_FREQ / 1000;
+constexpr uint32_t kSpinAveragePeriods = kSpinPeriods / 4;
+static_assert(kSpinAveragePeriods > 0, "Identification spin time too short.");
+
+static_assert(MOTOR_IDENTIFY_SPIN_AMPLITUDE > 0 &&
+                  MOTOR_IDENTIFY_SPIN_AMPLITUDE <= 100,
+              "Identification spin amplitude out of range.");
+
+constexpr int32_t kLowCurrent = MOTOR_IDENTIFY_CURRENT / 2;
+constexpr int32_t kHighCurrent = MOTOR_IDENTIFY_CURRENT;
+static_assert(kLowCurrent > 0 && kHighCurrent <= 32767,
+              "Identification current out of range.");
+
+// Line to line back EMF averaged over a six-step step, per unit of velocity
+// and flux linkage: 3 * sqrt(3) / pi times 2 * pi / 2^16 rad/s.
+constexpr double kBackEmfPerVelocity = 6 * 1.7320508075688772 / 65536;
+
+}  // namespace
+
+MotorIdentifier::MotorIdentifier(RotorInterface *rotor,
+                                 InverterInterface *inverter,
+                                 CurrentSensorInterface *current_sensor)
+    : rotor_(rotor),
+      inverter_(inverter),
+      current_sensor_(current_sensor),
+      bus_voltage_sensor_(nullptr),
+      state_(kIdle),
+      count_(0),
+      holds_(0),
+      amplitude_(0),
+      amplitude_low_(0),
+      amplitude_high_(0),
+      current_sum_(0),
+      velocity_sum_(0),
+      current_low_(0),
+      current_high_(0),
+      step_periods_(kDecayBins),
+      decay_(),
+      resistance_(0),
+      parameters_(),
+      running_(false),
+      semaphore_(_SEMAPHORE_DATA(semaphore_, 0)) {
+}
+
+void MotorIdentifier::Start() {
+  amplitude_ = 0;
+  step_periods_ = kDecayBins;
+  for (int k = 0; k < kDecayBins; k++) {
+    decay_[k] = 0;
+  }
+  Enter(kRampLow);
+}
+
+// The current into phase A is compared against the levels, as it carries all
+// of the current. Ramping by one count per period is slow enough for the
+// current to follow, even for a motor with low resistance.
+void MotorIdentifier::Update() {
+  if (IsDone()) {
+    return;
+  }
+  Current16 currents[InverterInterface::kNumChannels];
+  if (!current_sensor_->ComputeCurrents(currents)) {
+    Finish(kFailed, "Phase currents invalid.");
+    return;
+  }
+  const int32_t current = currents[InverterInterface::kChannelA];
+
+  switch (state_) {
+    case kRampLow:
+    case kRampHigh:
+      if (current >= (state_ == kRampLow ? kLowCurrent : kHighCurrent)) {
+        holds_ = 0;
+        Enter(state_ == kRampLow ? kHoldLow : kHoldHigh);
+      } else if (amplitude_ >= inverter_->GetPeriod() / 4) {
+        Finish(kFailed, "Identification current not reached.");
+        return;
+      } else {
+        amplitude_++;
+      }
+      WriteAligned(amplitude_);
+      break;
+
+    case kHoldLow:
+    case kHoldHigh:
+      if (count_ >= kSettlePeriods) {
+        current_sum_ += current;
+      }
+      if (++count_ == kSettlePeriods + kAveragePeriods) {
+        const int32_t target = state_ == kHoldLow ? kLowCurrent : kHighCurrent;
+        const int32_t average = current_sum_ / kAveragePeriods;
+        // A motor with a long time constant lags the ramp, which overshoots
+        // the target. The current is close to proportional to the amplitude,
+        // so the amplitude is scaled to the target and held again.
+        if (std::abs(average - target) > target / 4) {
+          if (average <= 0 || ++holds_ == kMaxHolds) {
+            Finish(kFailed, "Identification current not settled.");
+            return;
+          }
+          amplitude_ = amplitude_ * target / average;
+          if (amplitude_ >= inverter_->GetPeriod() / 4) {
+            Finish(kFailed, "Identification current not reached.");
+            return;
+          }
+          Enter(state_);
+        } else if (state_ == kHoldLow) {
+          current_low_ = average;
+          amplitude_low_ = amplitude_;
+          Enter(kRampHigh);
+        } else {
+          current_high_ = average;
+          amplitude_high_ = amplitude_;
+          Enter(kStep);
+        }
+      }
+      WriteAligned(amplitude_);
+      break;
+
+    case kStep: {
+      // Each cycle steps down to the low current, then up to the high one.
+      // The sample read as a step is written still reflects the level before
+      // it, so the deviations are indexed from the write. Longer steps sum
+      // consecutive samples into each bin.
+      const uint32_t position = count_ % (2 * step_periods_);
+      const bool falling = position < step_periods_;
+      const uint32_t bin = position % step_periods_ * kDecayBins /
+                           step_periods_;
+      decay_[bin] += falling ? current - current_low_ :
+                               current_high_ - current;
+      if (++count_ == 2 * step_periods_ * kStepCycles) {
+        const int end = FindDecayEnd();
+        if (end == 0 && step_periods_ < kMaxStepPeriods) {
+          // Try again with longer steps, which start by stepping down from
+          // the high current at the next period.
+          step_periods_ *= 2;
+          for (int k = 0; k < kDecayBins; k++) {
+            decay_[k] = 0;
+          }
+          Enter(kStep);
+          WriteAligned(amplitude_high_);
+          break;
+        }
+        if (end == 0) {
+          Finish(kFailed, "Current step response too slow.");
+          return;
+        }
+        if (!ComputeImpedance(end)) {
+          Finish(kFailed, "Inconsistent resistance or inductance.");
+          return;
+        }
+        // Start spinning from the aligned rotor at the next period.
+        Enter(kSpin);
+        amplitude_ = static_cast<int32_t>(inverter_->GetPeriod() / 2) *
+                     MOTOR_IDENTIFY_SPIN_AMPLITUDE / 100;
+        break;
+      }
+      WriteAligned(falling ? amplitude_low_ : amplitude_high_);
+      break;
+    }
+
+    case kSpin: {
+      Angle16 rotor_angle;
+      if (!rotor_->ComputeAngle(&rotor_angle)) {
+        Finish(kFailed, "Rotor angle invalid.");
+        return;
+      }
+      if (count_ >= kSpinPeriods - kSpinAveragePeriods) {
+        Velocity32 velocity;
+        if (!rotor_->ComputeVelocity(&velocity)) {
+          Finish(kFailed, "Rotor velocity invalid.");
+          return;
+        }
+        velocity_sum_ += velocity;
+        // The driven pair carries the current in and out, and the floating
+        // phase none.
+        current_sum_ += (std::abs(currents[InverterInterface::kChannelA]) +
+                         std::abs(currents[InverterInterface::kChannelB]) +
+                         std::abs(currents[InverterInterface::kChannelC])) / 2;
+      }
+      if (++count_ == kSpinPeriods) {
+        if (!ComputeFluxLinkage()) {
+          Finish(kFailed, "Inconsistent flux linkage.");
+          return;
+        }
+        Finish(kDone, nullptr);
+        return;
+      }
+      WriteSixStep(rotor_angle, amplitude_);
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+bool MotorIdentifier::GetParameters(Parameters *parameters) const {
+  if (state_ != kDone) {
+    return false;
+  }
+  *parameters = parameters_;
+  return true;
+}
+
+bool MotorIdentifier::Run(Parameters *parameters) {
+  chSemReset(&semaphore_, 0);
+  Start();
+  chSysLock();
+  running_ = true;
+  chSysUnlock();
+  while (!IsDone()) {
+    chSemWait(&semaphore_);
+    Update();
+  }
+  chSysLock();
+  running_ = false;
+  chSysUnlock();
+  return GetParameters(parameters);
+}
+
+void MotorIdentifier::SignalPeriod(void *motor_identifier) {
+  MotorIdentifier * const identifier = static_cast<MotorIdentifier *>(
+      motor_identifier);
+  chSysLockFromIsr();
+  if (identifier->running_) {
+    chSemSignalI(&identifier->semaphore_);
+  }
+  chSysUnlockFromIsr();
+}
+
+void MotorIdentifier::Enter(State state) {
+  state_ = state;
+  count_ = 0;
+  current_sum_ = 0;
+  velocity_sum_ = 0;
+}
+
+void MotorIdentifier::Finish(State state, const char *message) {
+  inverter_->WriteChannel(InverterInterface::kChannelA, 0,
+                          InverterInterface::kModeFloat);
+  inverter_->WriteChannel(InverterInterface::kChannelB, 0,
+                          InverterInterface::kModeFloat);
+  inverter_->WriteChannel(InverterInterface::kChannelC, 0,
+                          InverterInterface::kModeFloat);
+  inverter_->SyncModes();
+  state_ = state;
+  if (message != nullptr) {
+    LogError("Motor identification failed: %s", message);
+  }
+}
+
+void MotorIdentifier::WriteAligned(int32_t amplitude) {
+  const int32_t period_2 = inverter_->GetPeriod() / 2;
+  inverter_->WriteChannel(InverterInterface::kChannelA, period_2 + amplitude);
+  inverter_->WriteChannel(InverterInterface::kChannelB, period_2 - amplitude);
+  inverter_->WriteChannel(InverterInterface::kChannelC, period_2 - amplitude);
+  inverter_->SyncModes();
+}
+
+// Same steps as CommutatorSixStep, without advance.
+void MotorIdentifier::WriteSixStep(Angle16 rotor_angle, int32_t amplitude) {
+  const int32_t period_2 = inverter_->GetPeriod() / 2;
+  Width16 pos_width = period_2 + amplitude;
+  Width16 neg_width = period_2 - amplitude;
+  rotor_angle += DegreesToAngle16(30);
+  if (rotor_angle >= DegreesToAngle16(180)) {
+    std::swap(pos_width, neg_width);
+    rotor_angle -= DegreesToAngle16(180);
+  }
+
+  InverterInterface::Channel pos_channel;
+  InverterInterface::Channel neg_channel;
+  InverterInterface::Channel floating_channel;
+  if (rotor_angle < DegreesToAngle16(60)) {
+    pos_channel = InverterInterface::kChannelB;
+    neg_channel = InverterInterface::kChannelC;
+    floating_channel = InverterInterface::kChannelA;
+  } else if (rotor_angle < DegreesToAngle16(120)) {
+    pos_channel = InverterInterface::kChannelB;
+    neg_channel = InverterInterface::kChannelA;
+    floating_channel = InverterInterface::kChannelC;
+  } else {
+    pos_channel = InverterInterface::kChannelC;
+    neg_channel = InverterInterface::kChannelA;
+    floating_channel = InverterInterface::kChannelB;
+  }
+  inverter_->WriteChannel(floating_channel, period_2,
+                          InverterInterface::kModeFloat);
+  inverter_->WriteChannel(pos_channel, pos_width);
+  inverter_->WriteChannel(neg_channel, neg_width);
+  inverter_->SyncModes();
+}
+
+// The fit runs from the second bin up to where the deviations have fallen to
+// an eighth, below which they are mostly noise. The last bin is only used as
+// the one after the fit, so the fit ends before it.
+int MotorIdentifier::FindDecayEnd() const {
+  int end = 2;
+  while (end < kDecayBins - 1 && decay_[end] > decay_[1] / 8) {
+    end++;
+  }
+  return decay_[end] > decay_[1] / 8 ? 0 : end;
+}
+
+// The aligned vector puts the amplitude difference across phase A in series
+// with B and C in parallel, i.e. 1.5 times the phase resistance. The decay per
+// bin is the ratio of the deviations summed from the second bin to those
+// summed from the first, which holds for bins of any number of samples.
+bool MotorIdentifier::ComputeImpedance(int end) {
+  const int64_t bus_voltage = GetBusVoltage();
+  const int64_t delta_current = current_high_ - current_low_;
+  const int64_t delta_voltage = 2 * (amplitude_high_ - amplitude_low_) *
+                                bus_voltage / inverter_->GetPeriod();
+  if (delta_current <= 0 || delta_voltage <= 0) {
+    return false;
+  }
+  resistance_ = delta_voltage * 2000000 / (3 * delta_current);
+
+  int64_t sum_first = 0;
+  int64_t sum_next = 0;
+  for (int k = 1; k < end; k++) {
+    sum_first += decay_[k];
+    sum_next += decay_[k + 1];
+  }
+  if (decay_[1] <= 0 || sum_next <= 0 || sum_next >= sum_first) {
+    return false;
+  }
+  const double bin_time = kPeriodTime * step_periods_ / kDecayBins;
+  const double time_constant = -bin_time /
+      std::log(static_cast<double>(sum_next) / sum_first);
+
+  parameters_.resistance = (resistance_ + 500) / 1000;
+  parameters_.inductance = static_cast<int32_t>(
+      resistance_ * time_constant / 1e6 + 0.5);
+  return parameters_.inductance > 0;
+}
+
+// The gains are those of the FOC_CURRENT_KP and FOC_CURRENT_KI comment: L * w
+// and R * w * T, in Q16 PWM counts per mA.
+bool MotorIdentifier::ComputeFluxLinkage() {
+  const int64_t bus_voltage = GetBusVoltage();
+  const int64_t velocity = std::abs(velocity_sum_ / kSpinAveragePeriods);
+  const int64_t current = current_sum_ / kSpinAveragePeriods;
+  const int64_t voltage = 2 * amplitude_ * bus_voltage /
+                              inverter_->GetPeriod() -
+                          2 * resistance_ * current / 1000000;
+  if (velocity == 0 || voltage <= 0) {
+    return false;
+  }
+  parameters_.flux_linkage = static_cast<int32_t>(
+      voltage * 1e6 / (velocity * kBackEmfPerVelocity) + 0.5);
+
+  const double bandwidth = 2 * kPi * MOTOR_IDENTIFY_BANDWIDTH;
+  const double counts_per_volt = inverter_->GetPeriod() * 1000.0 /
+                                 bus_voltage;
+  parameters_.current_kp = static_cast<int32_t>(
+      parameters_.inductance * 1e-9 * bandwidth * counts_per_volt / 1000 *
+          65536 + 0.5);
+  parameters_.current_ki = static_cast<int32_t>(
+      resistance_ * 1e-6 * bandwidth * kPeriodTime * 1e-9 * counts_per_volt /
+          1000 * 65536 + 0.5);
+  return parameters_.flux_linkage > 0;
+}
+
+int32_t MotorIdentifier::GetBusVoltage() {
+  Voltage16 voltage;
+  if (bus_voltage_sensor_ != nullptr &&
+      bus_voltage_sensor_->ComputeBusVoltage(&voltage) && voltage > 0) {
+    return static_cast<int32_t>(voltage) * 1000 / 256;
+  }
+  return MOTOR_BUS_VOLTAGE;
+}
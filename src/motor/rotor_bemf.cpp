@@ -0,0 +1,301 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "motor/rotor_bemf.h"
+
+#include <algorithm>
+
+#include "config.h"
+#include "base/integer.h"
+#include "motor/commutator_interface.h"
+#include "motor/inverter_interface.h"
+#include "motor/voltage_sensor_interface.h"
+
+namespace {
+
+// Samples are taken once per PWM period.
+static_assert(BEMF_GPT_FREQ % INVERTER_PWM_FREQ == 0,
+              "Commutation timer frequency must be a multiple of the PWM "
+              "frequency.");
+constexpr uint32_t kCountsPerSample = BEMF_GPT_FREQ / INVERTER_PWM_FREQ;
+
+// Back EMF is computed as three times the deviation of a phase from the
+// neutral, to stay in integers; the threshold is scaled to match.
+constexpr int32_t kThreshold = 3 * BEMF_ZC_THRESHOLD;
+
+// Longest sector time that the 16-bit timer can schedule half of, and that
+// the speed can be computed from.
+constexpr uint32_t kMaxSectorTime = 0xFFFF;
+
+constexpr int kNumSectors = 6;
+
+}  // namespace
+
+RotorBemf::RotorBemf(VoltageSensorInterface *voltage_sensor,
+                     GPTDriver *gpt_driver)
+    : voltage_sensor_(voltage_sensor),
+      gpt_driver_(gpt_driver),
+      commutator_(nullptr),
+      state_(kUnlocked),
+      time_(0),
+      sector_(0),
+      direction_(0),
+      sector_time_(0),
+      crossing_time_(0),
+      commutation_time_(0),
+      last_back_emf_(0),
+      armed_(false),
+      back_emf_slope_(0),
+      polarities_(),
+      candidate_sector_(-1),
+      candidate_time_(0) {
+}
+
+void RotorBemf::Start() {
+  gpt_driver_->self = this;
+  gptStart(gpt_driver_, &kGptConfig);
+}
+
+bool RotorBemf::ComputeAngle(Angle16 *angle) {
+  chSysLock();
+  const bool locked = state_ != kUnlocked;
+  const int sector = sector_;
+  chSysUnlock();
+
+  if (!locked) {
+    return false;
+  }
+  *angle = sector * DegreesToAngle16(60);
+  return true;
+}
+
+bool RotorBemf::ComputeVelocity(Velocity32 *velocity) {
+  chSysLock();
+  const bool locked = state_ != kUnlocked;
+  const uint32_t sector_time = sector_time_;
+  const int direction = direction_;
+  chSysUnlock();
+
+  if (!locked || sector_time == 0) {
+    return false;
+  }
+  const Velocity32 speed = SectorCountsToSpeed<BEMF_GPT_FREQ>(sector_time);
+  *velocity = direction > 0 ? speed : -speed;
+  return true;
+}
+
+void RotorBemf::SignalPeriod(void *rotor_bemf) {
+  static_cast<RotorBemf *>(rotor_bemf)->HandleSample();
+}
+
+// Configures the timer to count at the same rate that crossings are timed in,
+// so that delays can be scheduled without conversion.
+const GPTConfig RotorBemf::kGptConfig = { BEMF_GPT_FREQ,
+                                          GptCallback,
+                                          0 };
+
+// In sector k, the driven phases follow CommutatorSixStep. The phase that is
+// not driven crosses zero at the center of the sector.
+const uint8_t RotorBemf::kFloatingPhases[6] = { InverterInterface::kChannelA,
+                                                InverterInterface::kChannelC,
+                                                InverterInterface::kChannelB,
+                                                InverterInterface::kChannelA,
+                                                InverterInterface::kChannelC,
+                                                InverterInterface::kChannelB };
+
+// Phase A's back EMF falls through zero at 0 degrees and rises at 180; B and C
+// lag by 120 and 240 degrees. The slope at a crossing doesn't depend on the
+// direction of rotation, so neither does this table.
+const uint8_t RotorBemf::kCrossingSectors[3][2] = { { 0, 3 },
+                                                    { 2, 5 },
+                                                    { 4, 1 } };
+
+// Checks for the end of blanking before looking for a crossing, so that a
+// crossing already under way is seen on the first sample after blanking.
+// Samples during blanking are still passed on, as they may arm the detector.
+void RotorBemf::HandleSample() {
+  Voltage16 voltages[InverterInterface::kNumChannels];
+  const bool valid = voltage_sensor_->ComputeVoltages(voltages);
+
+  chSysLockFromIsr();
+  time_ += kCountsPerSample;
+  if (valid) {
+    if (state_ == kBlanking &&
+        time_ - commutation_time_ >=
+            sector_time_ * BEMF_BLANKING_ANGLE / 60) {
+      state_ = kWaitCrossing;
+    }
+    if (state_ == kUnlocked) {
+      DetectUnlockedI(voltages);
+    } else if (state_ == kBlanking || state_ == kWaitCrossing) {
+      DetectLockedI(voltages);
+    }
+  }
+  if ((state_ == kBlanking || state_ == kWaitCrossing) &&
+      time_ - commutation_time_ > 2 * sector_time_) {
+    UnlockI();
+  }
+  chSysUnlockFromIsr();
+}
+
+// With all phases floating, each one's back EMF is its deviation from the
+// average of the three. A change of polarity, with hysteresis, is a crossing,
+// and two in adjacent sectors lock on with the sector, direction, and time
+// between them.
+void RotorBemf::DetectUnlockedI(const Voltage16 voltages[]) {
+  const int32_t sum = voltages[0] + voltages[1] + voltages[2];
+  for (int phase = 0; phase < InverterInterface::kNumChannels; phase++) {
+    const int32_t back_emf = 3 * voltages[phase] - sum;
+    int8_t polarity = polarities_[phase];
+    if (back_emf > kThreshold) {
+      polarity = 1;
+    } else if (back_emf < -kThreshold) {
+      polarity = -1;
+    }
+    if (polarities_[phase] != 0 && polarity != polarities_[phase]) {
+      const int sector = kCrossingSectors[phase][polarity > 0];
+      if (candidate_sector_ >= 0 && time_ - candidate_time_ <= kMaxSectorTime) {
+        const int steps = (sector - candidate_sector_ + kNumSectors) %
+                          kNumSectors;
+        if (steps == 1 || steps == kNumSectors - 1) {
+          direction_ = steps == 1 ? 1 : -1;
+          sector_ = sector;
+          sector_time_ = time_ - candidate_time_;
+          crossing_time_ = time_;
+          commutation_time_ = time_ + sector_time_ / 2;
+          ScheduleCommutationI();
+          SignalCommutatorI();
+          return;
+        }
+      }
+      candidate_sector_ = sector;
+      candidate_time_ = time_;
+    }
+    polarities_[phase] = polarity;
+  }
+}
+
+// The floating phase's back EMF is its deviation from the average of the two
+// driven phases, which is the neutral voltage less half its back EMF (as the
+// three sum to zero). Crossings alternate falling and rising, starting with
+// falling in sector 0, so even sectors are negated to always rise. The crossing
+// is interpolated between the last sample before it and the first after.
+//
+// While the current in the phase that was just released decays, its diode
+// clamps it to the rail that looks like a crossing already passed. Blanking
+// ignores that, but a sample before the crossing is trusted even in blanking,
+// so that the crossing can still be interpolated when it comes right after.
+// Without a sample before it, the crossing is extrapolated back from the first
+// sample clearly past it, at the slope seen at the last interpolated crossing,
+// but not to before the commutation.
+void RotorBemf::DetectLockedI(const Voltage16 voltages[]) {
+  const int phase = kFloatingPhases[sector_];
+  int32_t back_emf = 2 * voltages[phase] -
+                     voltages[(phase + 1) % InverterInterface::kNumChannels] -
+                     voltages[(phase + 2) % InverterInterface::kNumChannels];
+  if ((sector_ & 1) == 0) {
+    back_emf = -back_emf;
+  }
+
+  if (back_emf < 0) {
+    if (back_emf < -kThreshold) {
+      armed_ = true;
+    }
+    last_back_emf_ = back_emf;
+    return;
+  }
+  if (state_ == kBlanking) {
+    last_back_emf_ = 0;
+    return;
+  }
+  if (armed_ || back_emf > kThreshold) {
+    uint32_t counts_since_crossing = 0;
+    if (last_back_emf_ < 0) {
+      back_emf_slope_ = back_emf - last_back_emf_;
+      counts_since_crossing = kCountsPerSample * back_emf / back_emf_slope_;
+    } else if (back_emf_slope_ > 0) {
+      counts_since_crossing = std::min<uint32_t>(
+          kCountsPerSample * back_emf / back_emf_slope_,
+          time_ - commutation_time_);
+    }
+    HandleCrossingI(time_ - counts_since_crossing);
+  }
+  last_back_emf_ = back_emf;
+}
+
+void RotorBemf::HandleCrossingI(uint32_t time) {
+  sector_time_ = (sector_time_ + (time - crossing_time_)) / 2;
+  crossing_time_ = time;
+  if (sector_time_ > kMaxSectorTime) {
+    UnlockI();
+    return;
+  }
+  commutation_time_ = time + sector_time_ / 2;
+  ScheduleCommutationI();
+}
+
+// Commutates as soon as possible if the time has already passed.
+void RotorBemf::ScheduleCommutationI() {
+  const int32_t delay = commutation_time_ - time_;
+  gptStartOneShotI(gpt_driver_,
+                   Clamp<int32_t>(delay, 2, kMaxSectorTime));
+  state_ = kWaitCommutation;
+}
+
+void RotorBemf::HandleCommutation() {
+  chSysLockFromIsr();
+  if (state_ == kWaitCommutation) {
+    sector_ = (sector_ + direction_ + kNumSectors) % kNumSectors;
+    state_ = kBlanking;
+    armed_ = false;
+    last_back_emf_ = 0;
+    SignalCommutatorI();
+  }
+  chSysUnlockFromIsr();
+}
+
+void RotorBemf::UnlockI() {
+  if (state_ == kWaitCommutation) {
+    gptStopTimerI(gpt_driver_);
+  }
+  state_ = kUnlocked;
+  for (int8_t &polarity : polarities_) {
+    polarity = 0;
+  }
+  candidate_sector_ = -1;
+  back_emf_slope_ = 0;
+  SignalCommutatorI();
+}
+
+void RotorBemf::SignalCommutatorI() {
+  if (commutator_ != nullptr) {
+    commutator_->SignalChange();
+  }
+}
+
+void RotorBemf::GptCallback(GPTDriver *gpt_driver) {
+  static_cast<RotorBemf *>(gpt_driver->self)->HandleCommutation();
+}
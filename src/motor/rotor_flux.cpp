@@ -0,0 +1,220 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "motor/rotor_flux.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+#include "ch.h"
+
+#include "config.h"
+#include "base/integer.h"
+#include "motor/trig.h"
+
+namespace {
+
+constexpr int32_t kInverseSqrt3 = 18919;  // 1 / sqrt(3) in Q15.
+
+// Flux in nWb gained over one period per uV of back EMF, in Q32.
+constexpr int64_t kFluxPerMicrovolt = static_cast<int64_t>(
+    1000 * 4294967296.0 / INVERTER_PWM_FREQ + 0.5);
+
+// Flux in nWb per mA of current, in Q32.
+constexpr int64_t kFluxPerMilliampere =
+    (static_cast<int64_t>(MOTOR_INDUCTANCE) << 32) / 1000;
+
+// Reciprocal of the flux linkage in Q44, which scales a flux in nWb to a
+// fraction of the flux linkage in Q14.
+constexpr int64_t kInverseFluxLinkage = static_cast<int64_t>(
+    17592186044416.0 / MOTOR_FLUX_LINKAGE + 0.5);
+
+// Half of the observer gain times the period, in Q16.
+constexpr int32_t kHalfGain = static_cast<int32_t>(
+    ROTOR_FLUX_GAIN * 65536.0 / (2 * INVERTER_PWM_FREQ) + 0.5);
+
+// Limit on the stator flux estimate, well beyond any real flux linkage, so
+// that a diverging estimate cannot overflow.
+constexpr int32_t kMaxFlux = 1 << 28;
+
+// Proportional and integral gains of the critically damped loop, 2 * omega_n
+// and omega_n^2 times the period, in Q16.
+constexpr int32_t kPllProportional = static_cast<int32_t>(
+    4 * kPi * ROTOR_FLUX_PLL_BANDWIDTH * 65536.0 / INVERTER_PWM_FREQ + 0.5);
+constexpr int64_t kPllIntegral = static_cast<int64_t>(
+    4 * kPi * kPi * ROTOR_FLUX_PLL_BANDWIDTH * ROTOR_FLUX_PLL_BANDWIDTH *
+        65536.0 / INVERTER_PWM_FREQ + 0.5);
+
+// Q16.16 angle advanced in one period per unit of velocity, in Q16.
+constexpr int64_t kAnglePerVelocity = (int64_t(1) << 32) / INVERTER_PWM_FREQ;
+
+constexpr Velocity32 kMinSpeed = RPMToVelocity32(ROTOR_FLUX_MIN_SPEED);
+
+// Conditions to lock on: the normalized flux error, in Q28, is small enough
+// for a magnitude within about 12% of the flux linkage, and the loop tracks
+// the angle within 15 degrees, for 20 ms on end.
+constexpr int64_t kMaxLockError = int64_t(1) << 26;
+constexpr Angle16Diff kMaxLockPhaseError = DegreesToAngle16(15);
+constexpr uint32_t kLockPeriods = INVERTER_PWM_FREQ / 50;
+
+// Multiplies by a Q15 fraction.
+inline int32_t MultiplyQ15(int32_t a, int32_t b) {
+  return static_cast<int32_t>((static_cast<int64_t>(a) * b) >> 15);
+}
+
+}  // namespace
+
+RotorFlux::RotorFlux(RotorInterface *fallback)
+    : fallback_(fallback),
+      flux_alpha_(0),
+      flux_beta_(0),
+      angle_(0),
+      pll_angle_(0),
+      velocity_(0),
+      lock_count_(0),
+      locked_(false) {
+}
+
+bool RotorFlux::ComputeAngle(Angle16 *angle) {
+  chSysLock();
+  const bool locked = locked_;
+  const Angle16 angle_estimate = angle_;
+  chSysUnlock();
+
+  if (!locked) {
+    return fallback_ != nullptr && fallback_->ComputeAngle(angle);
+  }
+  *angle = angle_estimate;
+  return true;
+}
+
+bool RotorFlux::ComputeVelocity(Velocity32 *velocity) {
+  chSysLock();
+  const bool locked = locked_;
+  const Velocity32 velocity_estimate = velocity_;
+  chSysUnlock();
+
+  if (!locked) {
+    return fallback_ != nullptr && fallback_->ComputeVelocity(velocity);
+  }
+  *velocity = velocity_estimate;
+  return true;
+}
+
+// The correction to the flux is gamma / 2 times the rotor flux times the
+// difference between the squares of the flux linkage and of its magnitude.
+// Normalizing the magnitude to the flux linkage makes gamma times the flux
+// linkage squared the rate of convergence, which is the configured gain. The
+// normalized error is limited to +/-1 so that the correction never exceeds the
+// rotor flux times the gain times the period.
+void RotorFlux::Update(const Current16 currents[InverterInterface::kNumChannels],
+                       int32_t voltage_alpha,
+                       int32_t voltage_beta) {
+  // Clarke transform into stator frame, using ia + ib + ic = 0.
+  const int32_t current_alpha = currents[InverterInterface::kChannelA];
+  const int32_t current_beta = MultiplyQ15(
+      current_alpha + 2 * currents[InverterInterface::kChannelB],
+      kInverseSqrt3);
+
+  // Integrate the back EMF, in uV, over the period.
+  const int32_t back_emf_alpha = voltage_alpha * 1000 -
+                                 MOTOR_RESISTANCE * current_alpha;
+  const int32_t back_emf_beta = voltage_beta * 1000 -
+                                MOTOR_RESISTANCE * current_beta;
+  flux_alpha_ += (static_cast<int64_t>(back_emf_alpha) * kFluxPerMicrovolt) >>
+                 32;
+  flux_beta_ += (static_cast<int64_t>(back_emf_beta) * kFluxPerMicrovolt) >>
+                32;
+
+  int32_t rotor_alpha = flux_alpha_ -
+      static_cast<int32_t>((current_alpha * kFluxPerMilliampere) >> 32);
+  int32_t rotor_beta = flux_beta_ -
+      static_cast<int32_t>((current_beta * kFluxPerMilliampere) >> 32);
+
+  const int64_t normalized_alpha =
+      (static_cast<int64_t>(rotor_alpha) * kInverseFluxLinkage) >> 30;
+  const int64_t normalized_beta =
+      (static_cast<int64_t>(rotor_beta) * kInverseFluxLinkage) >> 30;
+  const int64_t error = Clamp<int64_t>(
+      (int64_t(1) << 28) - normalized_alpha * normalized_alpha -
+          normalized_beta * normalized_beta,
+      -(int64_t(1) << 28),
+      int64_t(1) << 28);
+  const int32_t pull_alpha = static_cast<int32_t>(
+      (((rotor_alpha * error) >> 28) * kHalfGain) >> 16);
+  const int32_t pull_beta = static_cast<int32_t>(
+      (((rotor_beta * error) >> 28) * kHalfGain) >> 16);
+  flux_alpha_ = Clamp(flux_alpha_ + pull_alpha, -kMaxFlux, kMaxFlux);
+  flux_beta_ = Clamp(flux_beta_ + pull_beta, -kMaxFlux, kMaxFlux);
+  rotor_alpha += pull_alpha;
+  rotor_beta += pull_beta;
+
+  const Angle16 angle = ArcTangent16(rotor_beta, rotor_alpha);
+
+  // Track the angle with the phase-locked loop, for a smooth velocity.
+  const Angle16Diff phase_error = angle - (pll_angle_ >> 16);
+  const Velocity32 velocity = Clamp<int64_t>(
+      velocity_ + ((phase_error * kPllIntegral) >> 16),
+      -std::numeric_limits<Velocity32>::max(),
+      std::numeric_limits<Velocity32>::max());
+  const uint32_t pll_angle =
+      pll_angle_ +
+      static_cast<uint32_t>((velocity * kAnglePerVelocity) >> 16) +
+      static_cast<uint32_t>(phase_error * kPllProportional);
+
+  // Lock on once the estimate has settled above the minimum speed, and off
+  // below half of it, so that the estimates don't switch back and forth near
+  // the threshold.
+  const Velocity32 speed = std::abs(velocity);
+  if (speed >= kMinSpeed && std::abs(error) < kMaxLockError &&
+      std::abs(phase_error) < kMaxLockPhaseError) {
+    lock_count_ = std::min(lock_count_ + 1, kLockPeriods);
+  } else {
+    lock_count_ = 0;
+  }
+  const bool locked = locked_ ? speed >= kMinSpeed / 2 :
+                                lock_count_ >= kLockPeriods;
+
+  chSysLock();
+  angle_ = angle;
+  pll_angle_ = pll_angle;
+  velocity_ = velocity;
+  locked_ = locked;
+  chSysUnlock();
+}
+
+void RotorFlux::Reset() {
+  flux_alpha_ = 0;
+  flux_beta_ = 0;
+  lock_count_ = 0;
+
+  chSysLock();
+  pll_angle_ = 0;
+  velocity_ = 0;
+  locked_ = false;
+  chSysUnlock();
+}
@@ -26,6 +26,7 @@
 
 #include "motor/rotor_hall.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <limits>
 
@@ -33,9 +34,13 @@
 #include "hal.h"
 
 #include "config.h"
+#include "base/capture_record.h"
+#include "base/integer.h"
+#include "base/latency_trace.h"
 #include "base/log.h"
 #include "base/utility.h"
-#include "motor/commutator_six_step.h"
+#include "motor/commutator_interface.h"
+#include "motor/rotor_pll.h"
 
 // Sets up rotor state, and launches thread that computes state from hall sensor
 // signal changes.
@@ -47,11 +52,14 @@ RotorHall::RotorHall(ICUDriver *icu_driver, void *wa_update, size_t wa_size)
                                      NORMALPRIO,
                                      ThreadHallWrapper,
                                      this)),
-      commutator_six_step_(nullptr),
+      commutator_(nullptr),
+      observer_(nullptr),
       timer_overflowed_(true),
       hall_state_(kHallNumStates),
       last_hall_state_(kHallNumStates),
-      counts_elapsed_(0) {
+      counts_elapsed_(0),
+      velocity_(0),
+      direction_(0) {
 }
 
 // Initializes ICU driver, which enables hall sensor signal edge interrupts.
@@ -66,8 +74,20 @@ void RotorHall::Start() {
 
 // Converts current hall state to angle by lookup table. If the stored state is
 // invalid, then make an attempt to read the current state before aborting.
-// TODO(Xo): Extrapolate angle using velocity.
+//
+// While the rotor is turning steadily, the angle is then interpolated from the
+// edge that started the sector, assuming that this sector takes as long to
+// cross as the last. The ICU timer is reset on each edge, so its count is the
+// time since then.
 bool RotorHall::ComputeAngle(Angle16 *angle) {
+  // Take a consistent snapshot of the state written by the edge ISR.
+  chSysLock();
+  icucnt_t counts_since_edge = 0;
+  const bool timer_valid = GetCountsSinceEdgeS(&counts_since_edge);
+  const icucnt_t counts_elapsed = counts_elapsed_;
+  const int direction = direction_;
+  chSysUnlock();
+
   if (!HallStateValid(hall_state_)) {
     hall_state_ = ReadHallState();
     if (!HallStateValid(hall_state_)) {
@@ -77,6 +97,36 @@ bool RotorHall::ComputeAngle(Angle16 *angle) {
   }
 
   *angle = kHallAngles[hall_state_];
+  if (direction != 0 && timer_valid && counts_elapsed != 0) {
+    // Clamp the progress to within the sector, so that the estimate stops
+    // short of the next sector if its edge is late. Both counts are scaled
+    // down to 16 bits, so that the product can't overflow even for the
+    // longest sector the 32-bit timer can time.
+    constexpr uint32_t sector_width = DegreesToAngle16(60);
+    const uint32_t counts = std::min(counts_since_edge, counts_elapsed);
+    const unsigned shift = counts_elapsed > 0xFFFF ?
+                               16 - __builtin_clz(counts_elapsed) : 0;
+    const uint32_t progress = Clamp<uint32_t>(
+        sector_width * (counts >> shift) / (counts_elapsed >> shift),
+        1,
+        sector_width - 1);
+    const Angle16 center_offset = progress - DegreesToAngle16(30);
+    *angle += direction > 0 ? center_offset : -center_offset;
+  }
+  return true;
+}
+
+// An edge that was captured but not yet handled has already reset the timer,
+// so report the old sector as fully crossed until the ISR runs.
+bool RotorHall::GetCountsSinceEdgeS(icucnt_t *counts) {
+  if (timer_overflowed_) {
+    return false;
+  }
+  *counts = icu_driver_->tim->CNT;
+  const uint32_t edge_flags = STM32_TIM_SR_CC1IF | STM32_TIM_SR_CC2IF;
+  if ((icu_driver_->tim->SR & edge_flags) != 0) {
+    *counts = std::numeric_limits<icucnt_t>::max();
+  }
   return true;
 }
 
@@ -103,6 +153,10 @@ bool RotorHall::ComputeVelocity(Velocity32 *velocity) {
   return true;
 }
 
+Velocity32 RotorHall::ComputeSpeed(icucnt_t counts_elapsed) {
+  return SectorCountsToSpeed<HALL_ICU_FREQ>(counts_elapsed);
+}
+
 // Configures the ICU for capturing the edges on channel 1, which is set to be
 // the XOR of the three hall sensor signals. So any normal hall transition (only
 // a single bit change) creates an interrupt.
@@ -184,13 +238,18 @@ void RotorHall::HandleEdge(icucnt_t count) {
   // Atomically update the state variables using the latest hall signal edge.
   last_hall_state_ = hall_state_;
   hall_state_ = new_hall_state;
-  counts_elapsed_ = count;
+  // A sector that overflowed the timer is recorded as the longest count.
+  counts_elapsed_ = timer_overflowed_ ? std::numeric_limits<icucnt_t>::max() :
+                                        count;
   timer_overflowed_ = false;
   // Signals the update thread that state variables have changed.
   chSemSignalI(&semaphore_update_);
   // Signal change to commutator.
-  if (commutator_six_step_ != nullptr) {
-    commutator_six_step_->SignalChange();
+  if (commutator_ != nullptr) {
+    commutator_->SignalChange();
+#if LATENCY_TRACE_ENABLE
+    LatencyTraceStampI(LATENCY_STAGE_SIGNAL);
+#endif
   }
   chSysUnlockFromIsr();
 
@@ -209,35 +268,48 @@ NORETURN void RotorHall::ThreadHall() {
     // Woken by ICU ISR. A hall edge has changed sensor state.
     chSysUnlock();
 
-    Velocity32 velocity_magnitude = 0.f;
-    if (counts_elapsed_ != 0) {
-      velocity_magnitude = ComputeSpeed(counts_elapsed_);
-    }
+    UpdateState();
+  }
+}
 
-    if (HallStateValid(hall_state_) && HallStateValid(last_hall_state_)) {
-      if (hall_state_ == kNextHallStates[last_hall_state_]) {
-        velocity_ = velocity_magnitude;
-        direction_ = 1;
-      } else if (last_hall_state_ == kNextHallStates[hall_state_]) {
-        velocity_ = -velocity_magnitude;
-        direction_ = -1;
-      } else {
-        direction_ = 0;
-        velocity_ = 0.f;
-        LogError("Glitch transition (%x -> %x).",
-                 last_hall_state_, hall_state_);
-      }
+// Derives the direction of rotation from the last two hall states, and the
+// velocity from the time between them.
+void RotorHall::UpdateState() {
+  Velocity32 velocity_magnitude = 0;
+  if (counts_elapsed_ != 0) {
+    velocity_magnitude = ComputeSpeed(counts_elapsed_);
+  }
+
+  if (HallStateValid(hall_state_) && HallStateValid(last_hall_state_)) {
+    if (hall_state_ == kNextHallStates[last_hall_state_]) {
+      velocity_ = velocity_magnitude;
+      direction_ = 1;
+    } else if (last_hall_state_ == kNextHallStates[hall_state_]) {
+      velocity_ = -velocity_magnitude;
+      direction_ = -1;
     } else {
       direction_ = 0;
-      velocity_ = 0.f;
-      LogWarning("Invalid transition (%x -> %x).",
-                 last_hall_state_, hall_state_);
+      velocity_ = 0;
+      LogError("Glitch transition (%x -> %x).",
+               last_hall_state_, hall_state_);
     }
+  } else {
+    direction_ = 0;
+    velocity_ = 0;
+    LogWarning("Invalid transition (%x -> %x).",
+               last_hall_state_, hall_state_);
+  }
 
-    LogDebug("New state: %3u degrees @ %ld RPM.",
-             Angle16ToDegrees(kHallAngles[hall_state_]),
-             Velocity32ToRPM(velocity_));
+  if (observer_ != nullptr) {
+    observer_->HandleEdge(kHallAngles[hall_state_],
+                          direction_,
+                          counts_elapsed_,
+                          velocity_);
   }
+
+  LogDebug("New state: %3u degrees @ %ld RPM.",
+           Angle16ToDegrees(kHallAngles[hall_state_]),
+           Velocity32ToRPM(velocity_));
 }
 
 // Non-member function to pass to thread creation.
@@ -252,15 +324,26 @@ NORETURN msg_t RotorHall::ThreadHallWrapper(void *rotor_hall) {
 // the edge handler.
 void RotorHall::IcuWidthCallback(ICUDriver *icup) {
   const icucnt_t count = icuGetWidth(icup);
-  static_cast<RotorHall *>(icup->self)->HandleEdge(count);
+  RotorHall * const rotor_hall = static_cast<RotorHall *>(icup->self);
+#if CAPTURE_RECORD_ENABLE
+  CaptureRecordEventFromIsr('H', rotor_hall->ReadHallState(), count, 0);
+#endif
+  rotor_hall->HandleEdge(count);
 }
 
 // Redirects rising edge interrupts to the edge handler.
 void RotorHall::IcuPeriodCallback(ICUDriver *icup) {
   const icucnt_t count = icuGetPeriod(icup);
-  static_cast<RotorHall *>(icup->self)->HandleEdge(count);
+  RotorHall * const rotor_hall = static_cast<RotorHall *>(icup->self);
+#if CAPTURE_RECORD_ENABLE
+  CaptureRecordEventFromIsr('H', rotor_hall->ReadHallState(), count, 0);
+#endif
+  rotor_hall->HandleEdge(count);
 }
 
 void RotorHall::IcuOverflowCallback(ICUDriver *icup) {
+#if CAPTURE_RECORD_ENABLE
+  CaptureRecordEventFromIsr('O', 0, 0, 0);
+#endif
   static_cast<RotorHall *>(icup->self)->timer_overflowed_ = true;
 }
@@ -0,0 +1,184 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "motor/rotor_pll.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+#include "ch.h"
+
+#include "config.h"
+#include "base/integer.h"
+#include "motor/rotor_hall.h"
+
+namespace {
+
+// Seconds per ICU timer count, in Q32.
+constexpr uint64_t kSecondsPerCount =
+    ((uint64_t(1) << 32) + HALL_ICU_FREQ / 2) / HALL_ICU_FREQ;
+
+// Proportional gain of the critically damped loop, 2 * zeta * omega_n =
+// 4 * pi * bandwidth, in Q32 per ICU timer count. The per-transition phase
+// gain is this times the counts since the last transition.
+constexpr uint64_t kGainPerCount = static_cast<uint64_t>(
+    4 * kPi * ROTOR_PLL_BANDWIDTH * 4294967296.0 / HALL_ICU_FREQ + 0.5);
+static_assert(kGainPerCount <= UINT32_MAX,
+              "Gain times a 32-bit count must fit in 64 bits.");
+
+// Unity gain in Q16.
+constexpr uint32_t kGainOne = 1 << 16;
+
+// Limit on the estimate's distance from the last sector boundary, in Q16.16
+// units of Angle16, so that it stops short of the next sector.
+constexpr int32_t kMaxOffset = (DegreesToAngle16(60) - 1) << 16;
+
+}  // namespace
+
+RotorPll::RotorPll(RotorHall *rotor_hall)
+    : rotor_hall_(rotor_hall),
+      locked_(false),
+      angle_(0),
+      velocity_(0),
+      edge_angle_(0),
+      direction_(0) {
+}
+
+// Advances the angle from the last transition at the estimated velocity, using
+// the hall timer for the time since then.
+bool RotorPll::ComputeAngle(Angle16 *angle) {
+  chSysLock();
+  icucnt_t counts_since_edge = 0;
+  const bool timer_valid = rotor_hall_->GetCountsSinceEdgeS(&counts_since_edge);
+  const bool locked = locked_;
+  const uint32_t angle_at_edge = angle_;
+  const Velocity32 velocity = velocity_;
+  const uint32_t edge_angle = static_cast<uint32_t>(edge_angle_) << 16;
+  chSysUnlock();
+
+  if (!locked || !timer_valid) {
+    return rotor_hall_->ComputeAngle(angle);
+  }
+
+  const int64_t advance = ComputeAdvance(velocity, counts_since_edge);
+  const int32_t offset_at_edge = angle_at_edge - edge_angle;
+  const int32_t offset = Clamp<int64_t>(offset_at_edge + advance,
+                                        -kMaxOffset,
+                                        kMaxOffset);
+  *angle = (edge_angle + offset) >> 16;
+  return true;
+}
+
+bool RotorPll::ComputeVelocity(Velocity32 *velocity) {
+  chSysLock();
+  icucnt_t counts_since_edge = 0;
+  const bool timer_valid = rotor_hall_->GetCountsSinceEdgeS(&counts_since_edge);
+  const bool locked = locked_;
+  const Velocity32 velocity_estimate = velocity_;
+  chSysUnlock();
+
+  if (!locked || !timer_valid) {
+    return rotor_hall_->ComputeVelocity(velocity);
+  }
+  *velocity = velocity_estimate;
+  return true;
+}
+
+// The phase error is the boundary angle minus the estimate advanced to the
+// time of the edge. With T the time between transitions and g = Kp * T, the
+// angle is corrected by g times the error and the velocity by g^2 / 4 / T times
+// the error. 1 / T is the measured sector rate, i.e. six times the measured
+// speed, so no division is needed. Limiting g to 1 keeps the loop stable when
+// transitions are far apart.
+void RotorPll::HandleEdge(Angle16 sector_center,
+                          int direction,
+                          icucnt_t counts_elapsed,
+                          Velocity32 velocity) {
+  if (direction == 0) {
+    chSysLock();
+    locked_ = false;
+    chSysUnlock();
+    return;
+  }
+
+  const Angle16 edge_angle = sector_center - direction * DegreesToAngle16(30);
+  const uint32_t measured_angle = static_cast<uint32_t>(edge_angle) << 16;
+  uint32_t angle = measured_angle;
+  Velocity32 velocity_estimate = velocity;
+
+  // Relock on the boundary and measured speed after the rotor has stopped or
+  // reversed.
+  const bool relock = !locked_ ||
+                      direction != direction_ ||
+                      counts_elapsed == std::numeric_limits<icucnt_t>::max();
+  if (!relock) {
+    const uint32_t predicted_angle =
+        angle_ + static_cast<uint32_t>(ComputeAdvance(velocity_,
+                                                      counts_elapsed));
+    const int32_t error = measured_angle - predicted_angle;
+
+    const uint32_t gain = std::min<uint64_t>(
+        (kGainPerCount * counts_elapsed) >> 16,
+        kGainOne);
+    angle = predicted_angle +
+            static_cast<uint32_t>((static_cast<int64_t>(error) * gain) >> 16);
+
+    // Error in Angle16 units times g^2 / 4 in Q16 times the sector rate in
+    // Q16.16 needs at most 63 bits.
+    const uint32_t half_gain = gain >> 1;
+    const uint32_t quarter_gain_squared = (half_gain * half_gain) >> 16;
+    const int64_t sector_rate = static_cast<int64_t>(std::abs(velocity)) * 6;
+    velocity_estimate = Clamp<int64_t>(
+        velocity_ + ((static_cast<int64_t>(error >> 16) * quarter_gain_squared *
+                      sector_rate) >> 32),
+        -std::numeric_limits<Velocity32>::max(),
+        std::numeric_limits<Velocity32>::max());
+  }
+
+  chSysLock();
+  angle_ = angle;
+  velocity_ = velocity_estimate;
+  edge_angle_ = edge_angle;
+  direction_ = direction;
+  locked_ = true;
+  chSysUnlock();
+}
+
+// The angle is velocity times time, where time is counts times the Q32 seconds
+// per count. Speed times counts fits in 63 bits; the product with the seconds
+// per count saturates, which only a stalled rotor at a stale speed reaches.
+int64_t RotorPll::ComputeAdvance(Velocity32 velocity, icucnt_t counts) {
+  constexpr uint64_t kMaxSpeedCounts =
+      std::numeric_limits<int64_t>::max() / kSecondsPerCount;
+  const uint64_t speed_counts =
+      static_cast<uint64_t>(std::abs(static_cast<int64_t>(velocity))) * counts;
+  const int64_t advance =
+      speed_counts > kMaxSpeedCounts ?
+          std::numeric_limits<int64_t>::max() >> 16 :
+          static_cast<int64_t>(speed_counts * kSecondsPerCount) >> 16;
+  return velocity < 0 ? -advance : advance;
+}
@@ -0,0 +1,165 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "motor/speed_governor.h"
+
+#include "config.h"
+#include "base/integer.h"
+#include "base/utility.h"
+#include "motor/rotor_interface.h"
+
+namespace {
+
+// Timer counts between updates.
+constexpr uint32_t kUpdateInterval = SPEED_GOVERNOR_GPT_FREQ /
+                                     SPEED_GOVERNOR_FREQ;
+static_assert(kUpdateInterval >= 2 && kUpdateInterval <= 0xFFFF,
+              "Speed governor update interval out of timer range.");
+
+}  // namespace
+
+const GPTConfig SpeedGovernor::kGptConfig = {
+  SPEED_GOVERNOR_GPT_FREQ,
+  GptCallback,
+  0
+};
+
+// Launches the update thread, which waits for the timer to be started.
+SpeedGovernor::SpeedGovernor(RotorInterface *rotor,
+                             GPTDriver *gpt_driver,
+                             void *wa_update,
+                             size_t wa_size)
+    : rotor_(rotor),
+      gpt_driver_(gpt_driver),
+      semaphore_update_(_SEMAPHORE_DATA(semaphore_update_, 0)),
+      thread_update_(chThdCreateStatic(wa_update,
+                                       wa_size,
+                                       NORMALPRIO,
+                                       ThreadUpdateWrapper,
+                                       this)),
+      commutator_(nullptr),
+      command_(0),
+      enable_(false),
+      integral_(0) {
+}
+
+void SpeedGovernor::Start() {
+  gpt_driver_->self = this;
+  gptStart(gpt_driver_, &kGptConfig);
+  gptStartContinuous(gpt_driver_, kUpdateInterval);
+}
+
+NORETURN void SpeedGovernor::CommutationLoop() {
+  commutator_->CommutationLoop();
+  UNREACHABLE();
+}
+
+void SpeedGovernor::SignalChange() {
+  commutator_->SignalChange();
+}
+
+// Only stores the command, for the next update to act on. May be called from
+// an ISR.
+void SpeedGovernor::WriteAmplitude(Width16Diff semi_amplitude) {
+  command_ = semi_amplitude;
+}
+
+Width16Diff SpeedGovernor::GetMaxAmplitude() {
+  return commutator_->GetMaxAmplitude();
+}
+
+void SpeedGovernor::SetEnable(bool enable) {
+  enable_ = enable;
+  commutator_->SetEnable(enable);
+}
+
+// Runs the PI loop on the speed error in electrical RPM. The output and the
+// integral are limited to the direction of the command, so a rotor that is
+// too fast coasts down, and an integral that can't be applied stops growing.
+// A rotor without a valid velocity is taken to be standing still.
+void SpeedGovernor::Update() {
+  const Width16Diff command = command_;
+  const int32_t max_amplitude = commutator_->GetMaxAmplitude();
+  Width16Diff semi_amplitude = 0;
+  if (!enable_ || command == 0) {
+    integral_ = 0;
+  } else {
+    Velocity32 velocity = 0;
+    if (!rotor_->ComputeVelocity(&velocity)) {
+      velocity = 0;
+    }
+    const int32_t target = static_cast<int64_t>(command) *
+                           SPEED_GOVERNOR_MAX_SPEED / max_amplitude;
+    const int32_t error = target - Velocity32ToRPM(velocity);
+
+    const int32_t lower = command > 0 ? 0 : -max_amplitude;
+    const int32_t upper = command > 0 ? max_amplitude : 0;
+    integral_ = static_cast<int32_t>(Clamp<int64_t>(
+        integral_ + static_cast<int64_t>(SPEED_GOVERNOR_KI) * error,
+        static_cast<int64_t>(lower) << 16,
+        static_cast<int64_t>(upper) << 16));
+    const int64_t output =
+        (static_cast<int64_t>(SPEED_GOVERNOR_KP) * error + integral_) >> 16;
+    semi_amplitude = static_cast<Width16Diff>(Clamp<int64_t>(output,
+                                                             lower,
+                                                             upper));
+  }
+
+  commutator_->WriteAmplitude(semi_amplitude);
+  chSysLock();
+  commutator_->SignalChange();
+  chSysUnlock();
+}
+
+NORETURN void SpeedGovernor::ThreadUpdate() {
+  while (true) {
+    // Wait for the timer to wake this thread.
+    chSysLock();
+    chSemWaitS(&semaphore_update_);
+    chSysUnlock();
+
+    Update();
+  }
+}
+
+// Non-member function to pass to thread creation.
+NORETURN msg_t SpeedGovernor::ThreadUpdateWrapper(void *speed_governor) {
+  chRegSetThreadName("governor");
+  static_cast<SpeedGovernor *>(speed_governor)->ThreadUpdate();
+  chThdExit(0);
+}
+
+// Wakes the update thread; an update that is still running when the timer
+// expires again will run once more as soon as it is done.
+void SpeedGovernor::GptCallback(GPTDriver *gpt_driver) {
+  SpeedGovernor * const speed_governor =
+      static_cast<SpeedGovernor *>(gpt_driver->self);
+  chSysLockFromIsr();
+  if (chSemGetCounterI(&speed_governor->semaphore_update_) <= 0) {
+    chSemSignalI(&speed_governor->semaphore_update_);
+  }
+  chSysUnlockFromIsr();
+}
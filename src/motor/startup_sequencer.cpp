@@ -0,0 +1,279 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "motor/startup_sequencer.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "config.h"
+#include "base/integer.h"
+#include "base/utility.h"
+
+namespace {
+
+// Durations of the startup sequence, in PWM periods.
+constexpr uint32_t kAlignPeriods = STARTUP_ALIGN_TIME * INVERTER_PWM_FREQ /
+                                   1000;
+constexpr uint32_t kHandoverPeriods = STARTUP_HANDOVER_TIME *
+                                      INVERTER_PWM_FREQ / 1000;
+constexpr uint32_t kRampPeriods = static_cast<uint64_t>(STARTUP_MAX_SPEED) *
+                                  INVERTER_PWM_FREQ / STARTUP_ACCELERATION;
+constexpr uint32_t kHoldPeriods = STARTUP_HOLD_TIME * INVERTER_PWM_FREQ / 1000;
+
+// Open-loop speed limit and its increase each period, and the speed above
+// which the closed-loop rotor may take over.
+constexpr Velocity32 kMaxVelocity = RPMToVelocity32(STARTUP_MAX_SPEED);
+constexpr Velocity32 kVelocityStep =
+    (RPMToVelocity32(STARTUP_ACCELERATION) + INVERTER_PWM_FREQ / 2) /
+    INVERTER_PWM_FREQ;
+constexpr Velocity32 kHandoverVelocity =
+    RPMToVelocity32(STARTUP_HANDOVER_SPEED);
+static_assert(kVelocityStep > 0, "Startup acceleration is too low.");
+
+// Angle advanced in a period per unit of velocity, in Q32 of Q16.16 units.
+constexpr int64_t kAnglePerVelocity = (int64_t(1) << 48) / INVERTER_PWM_FREQ;
+
+// Resistive drop at the startup current, and peak phase back EMF per unit of
+// velocity in Q32, both in millivolts.
+constexpr int32_t kResistiveVoltage = static_cast<int64_t>(STARTUP_CURRENT) *
+                                      MOTOR_RESISTANCE / 1000;
+constexpr int64_t kBackEmfPerVelocity = static_cast<int64_t>(
+    MOTOR_FLUX_LINKAGE * 2 * kPi / 65536 / 1e6 * 4294967296.0 + 0.5);
+
+// Angle that the field is aligned to, at the center of the first six-step
+// sector.
+constexpr Angle16 kAlignAngle = 0;
+
+}  // namespace
+
+StartupSequencer::StartupSequencer(RotorInterface *rotor,
+                                   bool regulates_current)
+    : rotor_(rotor),
+      regulates_current_(regulates_current),
+      commutator_(nullptr),
+      state_(kIdle),
+      semi_amplitude_(0),
+      enable_(false),
+      direction_(0),
+      periods_(0),
+      state_periods_(0),
+      last_periods_(0),
+      angle_(0),
+      velocity_(0),
+      handover_count_(0) {
+}
+
+NORETURN void StartupSequencer::CommutationLoop() {
+  commutator_->CommutationLoop();
+  UNREACHABLE();
+}
+
+void StartupSequencer::SignalChange() {
+  commutator_->SignalChange();
+}
+
+// Only passes the amplitude on while running closed-loop, or while idle so
+// that a zero amplitude still brakes. Like the commutators, this may be called
+// from an ISR, which can't interrupt the locked sections that change state.
+void StartupSequencer::WriteAmplitude(Width16Diff semi_amplitude) {
+  semi_amplitude_ = semi_amplitude;
+  if (state_ == kIdle || state_ == kRun) {
+    commutator_->WriteAmplitude(semi_amplitude);
+  }
+}
+
+Width16Diff StartupSequencer::GetMaxAmplitude() {
+  return commutator_->GetMaxAmplitude();
+}
+
+void StartupSequencer::SetEnable(bool enable) {
+  enable_ = enable;
+  commutator_->SetEnable(enable);
+}
+
+// Takes the closed-loop estimates first, as they decide the state, then
+// advances the open-loop field over the periods since the last call. The
+// amplitude is written under the lock, so that a concurrent command is not
+// overwritten by a stale one.
+bool StartupSequencer::ComputeAngle(Angle16 *angle) {
+  Angle16 rotor_angle;
+  Velocity32 rotor_velocity;
+  const bool rotor_valid = rotor_->ComputeAngle(&rotor_angle);
+  const bool velocity_valid = rotor_valid &&
+                              rotor_->ComputeVelocity(&rotor_velocity);
+
+  chSysLock();
+  const bool commanded = enable_ && semi_amplitude_ != 0;
+  const int direction = semi_amplitude_ > 0 ? 1 : -1;
+  if (!commanded ||
+      ((state_ == kAlign || state_ == kRamp) && direction != direction_)) {
+    // Stopped, or reversed before the handover.
+    if (state_ != kIdle) {
+      EnterS(kIdle);
+      commutator_->WriteAmplitude(semi_amplitude_);
+    }
+  } else if (state_ == kIdle || state_ == kRun) {
+    if (!rotor_valid) {
+      // Give a spinning rotor a chance to be picked up before driving it.
+      EnterS(state_ == kRun ? kCoast : kAlign);
+    } else if (state_ == kIdle) {
+      EnterS(kRun);
+    }
+  }
+
+  const uint32_t elapsed = periods_ - last_periods_;
+  last_periods_ = periods_;
+  const uint32_t state_elapsed = periods_ - state_periods_;
+  switch (state_) {
+    case kCoast:
+      if (rotor_valid) {
+        EnterS(kRun);
+        commutator_->WriteAmplitude(semi_amplitude_);
+      } else if (state_elapsed >= kAlignPeriods) {
+        EnterS(kAlign);
+      }
+      break;
+    case kAlign:
+      if (state_elapsed >= kAlignPeriods) {
+        EnterS(kRamp);
+      }
+      break;
+    case kRamp:
+      for (uint32_t i = 0; i < elapsed; i++) {
+        velocity_ = Clamp<int32_t>(velocity_ + direction_ * kVelocityStep,
+                                   -kMaxVelocity,
+                                   kMaxVelocity);
+        angle_ += static_cast<uint32_t>(
+            (static_cast<int64_t>(velocity_) * kAnglePerVelocity) >> 32);
+      }
+      if (velocity_valid &&
+          std::abs(velocity_) >= kHandoverVelocity &&
+          std::abs(rotor_velocity - velocity_) <= std::abs(velocity_) / 4) {
+        handover_count_ += elapsed;
+      } else {
+        handover_count_ = 0;
+      }
+      if (handover_count_ >= kHandoverPeriods) {
+        EnterS(kRun);
+        commutator_->WriteAmplitude(semi_amplitude_);
+      } else if (state_elapsed >= kRampPeriods + kHoldPeriods) {
+        // The rotor hasn't followed; start over.
+        EnterS(kAlign);
+      }
+      break;
+    default:
+      break;
+  }
+  if (state_ == kAlign || state_ == kRamp) {
+    commutator_->WriteAmplitude(ComputeStartupAmplitude());
+  }
+  const State state = state_;
+  const uint32_t open_loop_angle = angle_;
+  chSysUnlock();
+
+  if (state == kAlign || state == kRamp) {
+    *angle = open_loop_angle >> 16;
+    return true;
+  }
+  if (state == kCoast || !rotor_valid) {
+    return false;
+  }
+  *angle = rotor_angle;
+  return true;
+}
+
+bool StartupSequencer::ComputeVelocity(Velocity32 *velocity) {
+  chSysLock();
+  const State state = state_;
+  const Velocity32 open_loop_velocity = velocity_;
+  chSysUnlock();
+
+  if (state == kAlign || state == kRamp) {
+    *velocity = open_loop_velocity;
+    return true;
+  }
+  if (state == kCoast) {
+    return false;
+  }
+  return rotor_->ComputeVelocity(velocity);
+}
+
+bool StartupSequencer::IsStarting() {
+  chSysLock();
+  const State state = state_;
+  chSysUnlock();
+  return state == kAlign || state == kRamp || state == kCoast;
+}
+
+// Only wakes the commutator while the sequence is timed; otherwise the closed-
+// loop rotor signals it.
+void StartupSequencer::SignalPeriod(void *startup_sequencer) {
+  StartupSequencer * const sequencer = static_cast<StartupSequencer *>(
+      startup_sequencer);
+  chSysLockFromIsr();
+  sequencer->periods_++;
+  if (sequencer->state_ == kAlign ||
+      sequencer->state_ == kRamp ||
+      sequencer->state_ == kCoast) {
+    sequencer->commutator_->SignalChange();
+  }
+  chSysUnlockFromIsr();
+}
+
+// The field starts out aligned with the rotor at the start of the ramp, so
+// the torque builds up as the rotor falls behind.
+void StartupSequencer::EnterS(State state) {
+  state_ = state;
+  state_periods_ = periods_;
+  last_periods_ = periods_;
+  handover_count_ = 0;
+  if (state == kAlign) {
+    direction_ = semi_amplitude_ > 0 ? 1 : -1;
+    angle_ = static_cast<uint32_t>(kAlignAngle) << 16;
+    velocity_ = 0;
+  }
+}
+
+// In current mode, the amplitude is a fraction of the full scale current. In
+// voltage mode, it is the phase voltage (as a fraction of half the bus) for the
+// resistive drop at the startup current, plus the back EMF at the open-loop
+// speed. With the rotor lagging the field, the current is then somewhat
+// higher than set.
+Width16Diff StartupSequencer::ComputeStartupAmplitude() const {
+  const int32_t max_amplitude = commutator_->GetMaxAmplitude();
+  int32_t amplitude;
+  if (regulates_current_) {
+    amplitude = static_cast<int64_t>(STARTUP_CURRENT) * max_amplitude /
+                FOC_MAX_CURRENT;
+  } else {
+    const int32_t voltage = kResistiveVoltage + static_cast<int32_t>(
+        (std::abs(velocity_) * kBackEmfPerVelocity) >> 32);
+    amplitude = static_cast<int64_t>(voltage) * 2 * max_amplitude /
+                MOTOR_BUS_VOLTAGE;
+  }
+  return direction_ * std::min(amplitude, max_amplitude);
+}
@@ -0,0 +1,205 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "motor/trig.h"
+
+#include <algorithm>
+
+namespace {
+
+// Sums the Taylor series of sin(x) from the term x^n / n! onwards, until the
+// terms no longer change the sum. For compile-time use; accurate for |x| <= 2.
+constexpr double SineSeries(double x, double term, int n, double sum) {
+  return sum + term == sum ? sum :
+      SineSeries(x, -term * x * x / ((n + 1) * (n + 2)), n + 2, sum + term);
+}
+
+constexpr double Sine(double x) {
+  return SineSeries(x, x, 1, 0);
+}
+
+// Sums the Taylor series of atan(x) from the term x^n / n onwards, as above.
+// Converges quickly for |x| <= 1/2.
+constexpr double ArcTangentSeries(double x, double power, int n, double sum) {
+  return sum + power / n == sum ? sum :
+      ArcTangentSeries(x, -power * x * x, n + 2, sum + power / n);
+}
+
+constexpr double ArcTangent(double x) {
+  return ArcTangentSeries(x, x, 1, 0);
+}
+
+constexpr int32_t Round(double x) {
+  return static_cast<int32_t>(x < 0 ? x - 0.5 : x + 0.5);
+}
+
+// Compile-time list of table indices, as with std::index_sequence (C++14).
+template<int... Indices>
+struct IndexList {
+};
+
+template<int N, int... Indices>
+struct MakeIndexList: MakeIndexList<N - 1, N - 1, Indices...> {
+};
+
+template<int... Indices>
+struct MakeIndexList<0, Indices...> {
+  typedef IndexList<Indices...> Type;
+};
+
+// The quarter wave from 0 to 90 degrees is split into 2^kSineTableBits steps,
+// leaving the rest of the 14 bits within the quarter for interpolation.
+constexpr int kSineTableBits = 8;
+constexpr int kSineTableSteps = 1 << kSineTableBits;
+constexpr int kSineFractionBits = 14 - kSineTableBits;
+
+// The entry past 90 degrees repeats it, so that interpolating at 90 degrees
+// stays in bounds.
+constexpr int16_t SineTableEntry(int index) {
+  return Round(Sine(kPi / 2 * (index < kSineTableSteps ? index :
+                                                        kSineTableSteps) /
+                    kSineTableSteps) * kTrigOne);
+}
+
+template<typename List>
+struct SineTable;
+
+template<int... Indices>
+struct SineTable<IndexList<Indices...>> {
+  static constexpr int16_t kValues[] = { SineTableEntry(Indices)... };
+};
+
+template<int... Indices>
+constexpr int16_t SineTable<IndexList<Indices...>>::kValues[];
+
+typedef SineTable<MakeIndexList<kSineTableSteps + 2>::Type> QuarterSine;
+
+static_assert(QuarterSine::kValues[0] == 0, "Bad sine table.");
+static_assert(QuarterSine::kValues[kSineTableSteps / 2] == 23170,
+              "Bad sine table.");
+static_assert(QuarterSine::kValues[kSineTableSteps] == kTrigOne,
+              "Bad sine table.");
+
+// CORDIC rotation angles atan(2^-i), in Angle16 units. Iterations stop once
+// the angle rounds to zero.
+constexpr int kCordicIterations = 15;
+
+constexpr int16_t CordicAngleEntry(int i) {
+  return Round((i == 0 ? kPi / 4 : ArcTangent(1.0 / (1 << i))) / (2 * kPi) *
+               65536);
+}
+
+template<typename List>
+struct CordicAngleTable;
+
+template<int... Indices>
+struct CordicAngleTable<IndexList<Indices...>> {
+  static constexpr int16_t kValues[] = { CordicAngleEntry(Indices)... };
+};
+
+template<int... Indices>
+constexpr int16_t CordicAngleTable<IndexList<Indices...>>::kValues[];
+
+typedef CordicAngleTable<MakeIndexList<kCordicIterations>::Type> CordicAngles;
+
+static_assert(CordicAngles::kValues[0] == 8192, "Bad CORDIC table.");
+static_assert(CordicAngles::kValues[kCordicIterations - 1] == 1,
+              "Bad CORDIC table.");
+
+// Reciprocal of the CORDIC gain, prod(sqrt(1 + 2^-2i)), in Q15.
+constexpr int32_t kInverseCordicGain = 19898;
+
+}  // namespace
+
+// The top two bits of the angle select the quadrant, which mirrors and negates
+// the quarter wave. Of the remaining 14 bits, the upper ones index the table
+// and the lower ones interpolate between neighboring entries.
+int16_t Sine16(Angle16 angle) {
+  const unsigned quadrant = angle >> 14;
+  unsigned offset = angle & 0x3FFF;
+  if (quadrant & 1) {
+    offset = 0x4000 - offset;
+  }
+  const unsigned index = offset >> kSineFractionBits;
+  const int fraction = offset & ((1 << kSineFractionBits) - 1);
+  const int low = QuarterSine::kValues[index];
+  const int high = QuarterSine::kValues[index + 1];
+  const int value = low + (((high - low) * fraction) >> kSineFractionBits);
+  return (quadrant & 2) ? -value : value;
+}
+
+// Normalizes the vector so that its larger component has its top bit at bit
+// 28, which keeps the most precision while leaving room for the length of the
+// diagonal times the CORDIC gain (about 2.33).
+// Rotates it into the right half plane, then rotates it onto the x axis by
+// successively smaller angles, summing them.
+Angle16 CordicVector(int32_t x, int32_t y, int32_t *magnitude) {
+  const uint32_t abs_x = x < 0 ? -static_cast<uint32_t>(x) : x;
+  const uint32_t abs_y = y < 0 ? -static_cast<uint32_t>(y) : y;
+  const uint32_t larger = std::max(abs_x, abs_y);
+  if (larger == 0) {
+    if (magnitude != nullptr) {
+      *magnitude = 0;
+    }
+    return 0;
+  }
+  const int shift = __builtin_clz(larger) - 3;
+  if (shift >= 0) {
+    x <<= shift;
+    y <<= shift;
+  } else {
+    x >>= -shift;
+    y >>= -shift;
+  }
+
+  Angle16 angle = 0;
+  if (x < 0) {
+    x = -x;
+    y = -y;
+    angle = DegreesToAngle16(180);
+  }
+  // Rotates clockwise while y is positive, and counterclockwise otherwise.
+  // The direction is applied by conditional negation with the sign mask of y,
+  // to avoid branching.
+  for (int i = 0; i < kCordicIterations; i++) {
+    const int32_t sign = y >> 31;
+    const int32_t x_shifted = x >> i;
+    const int32_t y_shifted = y >> i;
+    x += (y_shifted ^ sign) - sign;
+    y -= (x_shifted ^ sign) - sign;
+    angle += (CordicAngles::kValues[i] ^ sign) - sign;
+  }
+
+  if (magnitude != nullptr) {
+    // Undo the normalization, rounding to nearest.
+    const int64_t scaled = static_cast<int64_t>(x) * kInverseCordicGain;
+    const int scaled_shift = 15 + shift;
+    *magnitude = static_cast<int32_t>(
+        (scaled + (static_cast<int64_t>(1) << (scaled_shift - 1))) >>
+        scaled_shift);
+  }
+  return angle;
+}
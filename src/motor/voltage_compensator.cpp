@@ -0,0 +1,159 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+#include "motor/voltage_compensator.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "config.h"
+#include "base/integer.h"
+#include "base/utility.h"
+
+namespace {
+
+static_assert(BUS_VOLTAGE_MIN > 0 && BUS_VOLTAGE_MIN <= BUS_VOLTAGE_NOMINAL,
+              "Bus voltage minimum out of range.");
+
+// Nominal and minimum bus voltages, in Q16 volts.
+constexpr int64_t kNominalVoltage =
+    static_cast<int64_t>(BUS_VOLTAGE_NOMINAL) * 65536 / 1000;
+constexpr int32_t kMinVoltage =
+    static_cast<int64_t>(BUS_VOLTAGE_MIN) * 65536 / 1000;
+
+// Scale that passes commands through, in Q16.
+constexpr uint32_t kUnityScale = 1 << 16;
+
+// Each update moves the filtered bus voltage by 1/4 of its error, for a time
+// constant of about four intervals.
+constexpr int kFilterShift = 2;
+
+}  // namespace
+
+VoltageCompensator::VoltageCompensator(
+    BusVoltageSensorInterface *bus_voltage_sensor,
+    void *wa_update,
+    size_t wa_size)
+    : bus_voltage_sensor_(bus_voltage_sensor),
+      wa_update_(wa_update),
+      wa_size_(wa_size),
+      commutator_(nullptr),
+      command_(0),
+      bus_voltage_(0),
+      scale_(kUnityScale) {
+}
+
+// The thread is only created here, as it measures the bus right away.
+void VoltageCompensator::Start() {
+  chThdCreateStatic(wa_update_,
+                    wa_size_,
+                    NORMALPRIO,
+                    ThreadUpdateWrapper,
+                    this);
+}
+
+NORETURN void VoltageCompensator::CommutationLoop() {
+  commutator_->CommutationLoop();
+  UNREACHABLE();
+}
+
+void VoltageCompensator::SignalChange() {
+  commutator_->SignalChange();
+}
+
+// May be called from an ISR, so the scale is only read, and the caller
+// signals the change.
+void VoltageCompensator::WriteAmplitude(Width16Diff semi_amplitude) {
+  command_ = semi_amplitude;
+  commutator_->WriteAmplitude(Compensate(semi_amplitude));
+}
+
+Width16Diff VoltageCompensator::GetMaxAmplitude() {
+  return commutator_->GetMaxAmplitude();
+}
+
+void VoltageCompensator::SetEnable(bool enable) {
+  commutator_->SetEnable(enable);
+}
+
+// A bus below the minimum is taken to be at the minimum, which bounds the
+// scale, e.g. if the divider reads low. The first measurement sets the filter
+// outright. The command is rewritten under the lock so that a command written
+// meanwhile isn't overwritten with the previous one.
+void VoltageCompensator::Update() {
+  Voltage16 measured;
+  if (!bus_voltage_sensor_->ComputeBusVoltage(&measured)) {
+    return;
+  }
+  const int32_t voltage = std::max(static_cast<int32_t>(measured) << 8,
+                                   kMinVoltage);
+  if (bus_voltage_ == 0) {
+    bus_voltage_ = voltage;
+  } else {
+    bus_voltage_ += (voltage - bus_voltage_) >> kFilterShift;
+  }
+  const uint32_t scale = static_cast<uint32_t>((kNominalVoltage << 16) /
+                                               bus_voltage_);
+
+  chSysLock();
+  scale_ = scale;
+  commutator_->WriteAmplitude(Compensate(command_));
+  commutator_->SignalChange();
+  chSysUnlock();
+}
+
+bool VoltageCompensator::ComputeBusVoltage(Voltage16 *voltage) {
+  const int32_t bus_voltage = bus_voltage_;
+  if (bus_voltage == 0) {
+    return false;
+  }
+  *voltage = static_cast<Voltage16>(std::min<int32_t>(
+      bus_voltage >> 8, std::numeric_limits<Voltage16>::max()));
+  return true;
+}
+
+Width16Diff VoltageCompensator::Compensate(Width16Diff command) {
+  const int64_t max_amplitude = commutator_->GetMaxAmplitude();
+  return static_cast<Width16Diff>(Clamp<int64_t>(
+      (static_cast<int64_t>(command) * scale_) >> 16,
+      -max_amplitude,
+      max_amplitude));
+}
+
+NORETURN void VoltageCompensator::ThreadUpdate() {
+  while (true) {
+    Update();
+    chThdSleepMilliseconds(BUS_VOLTAGE_INTERVAL);
+  }
+}
+
+// Non-member function to pass to thread creation.
+NORETURN msg_t VoltageCompensator::ThreadUpdateWrapper(
+    void *voltage_compensator) {
+  chRegSetThreadName("compensator");
+  static_cast<VoltageCompensator *>(voltage_compensator)->ThreadUpdate();
+  chThdExit(0);
+}
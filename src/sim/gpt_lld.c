@@ -0,0 +1,197 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Implements the simulator GPT low level driver.
+ *
+ * @note The counter is not advanced; expiry is timed from the simulation time
+ *       that the timer was started, and the callback is invoked from
+ *       @c ChkIntSources like any other simulated interrupt.
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#if HAL_USE_GPT || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   GPTD3 driver identifier, used for the speed governor updates.
+ */
+GPTDriver GPTD3;
+
+/**
+ * @brief   GPTD6 driver identifier, used for sensorless commutation.
+ */
+GPTDriver GPTD6;
+
+/**
+ * @brief   GPTD7 driver identifier, used for advanced six-step commutation.
+ */
+GPTDriver GPTD7;
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+static stm32_tim_t sim_tim3;
+static stm32_tim_t sim_tim6;
+static stm32_tim_t sim_tim7;
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Gets the time between counter update events.
+ */
+static uint64_t gpt_lld_update_interval_ns(GPTDriver *gptp) {
+  return ((uint64_t)gptp->tim->ARR + 1) * 1000000000ULL / gptp->clock;
+}
+
+/**
+ * @brief   Serves a driver's counter update event if it is due.
+ */
+static bool gpt_lld_serve_driver(GPTDriver *gptp, uint64_t now_ns) {
+  if (gptp->next_update_ns == 0 || gptp->next_update_ns > now_ns) {
+    return false;
+  }
+
+  CH_IRQ_PROLOGUE();
+  sim_statistics.gpt_updates++;
+  if (gptp->state == GPT_ONESHOT) {
+    gptp->state = GPT_READY;
+    gpt_lld_stop_timer(gptp);
+  } else {
+    gptp->next_update_ns += gpt_lld_update_interval_ns(gptp);
+  }
+  gptp->config->callback(gptp);
+  CH_IRQ_EPILOGUE();
+  return true;
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Low level GPT driver initialization.
+ *
+ * @notapi
+ */
+void gpt_lld_init(void) {
+  gptObjectInit(&GPTD3);
+  GPTD3.tim = &sim_tim3;
+  gptObjectInit(&GPTD6);
+  GPTD6.tim = &sim_tim6;
+  gptObjectInit(&GPTD7);
+  GPTD7.tim = &sim_tim7;
+}
+
+/**
+ * @brief   Configures the virtual timer.
+ *
+ * @notapi
+ */
+void gpt_lld_start(GPTDriver *gptp) {
+  gptp->clock = gptp->config->frequency;
+  gptp->tim->CR1 = 0;
+  gptp->tim->CR2 = 0;
+  gptp->tim->ARR = 0xFFFF;
+  gptp->tim->DIER = gptp->config->dier;
+  gptp->next_update_ns = 0;
+}
+
+/**
+ * @brief   Deactivates the virtual timer.
+ *
+ * @notapi
+ */
+void gpt_lld_stop(GPTDriver *gptp) {
+  gpt_lld_stop_timer(gptp);
+}
+
+/**
+ * @brief   Starts the counter for an interval, as the STM32 driver does after
+ *          forcing an update to clear the prescaler.
+ *
+ * @notapi
+ */
+void gpt_lld_start_timer(GPTDriver *gptp, gptcnt_t interval) {
+  gptp->tim->ARR = (uint32_t)(interval - 1);
+  gptp->tim->CNT = 0;
+  gptp->tim->SR = 0;
+  if (gptp->config->callback != NULL) {
+    gptp->tim->DIER |= STM32_TIM_DIER_UIE;
+  }
+  gptp->tim->CR1 = STM32_TIM_CR1_URS | STM32_TIM_CR1_CEN;
+  gptp->start_ns = sim_lld_get_nanoseconds();
+  gptp->next_update_ns = gptp->start_ns + gpt_lld_update_interval_ns(gptp);
+}
+
+/**
+ * @brief   Stops the counter.
+ *
+ * @notapi
+ */
+void gpt_lld_stop_timer(GPTDriver *gptp) {
+  gptp->tim->CR1 = 0;
+  gptp->tim->SR = 0;
+  gptp->tim->DIER &= ~STM32_TIM_DIER_UIE;
+  gptp->next_update_ns = 0;
+}
+
+/**
+ * @brief   Waits in a busy loop for an interval to pass.
+ *
+ * @notapi
+ */
+void gpt_lld_polled_delay(GPTDriver *gptp, gptcnt_t interval) {
+  const uint64_t end_ns = sim_lld_get_nanoseconds() +
+                          (uint64_t)interval * 1000000000ULL / gptp->clock;
+  while (sim_lld_get_nanoseconds() < end_ns) {
+  }
+}
+
+/**
+ * @brief   Serves the counter update events that are due. One-shot timers are
+ *          stopped before the callback, so that it can start another.
+ *
+ * @return  Whether any callback was invoked.
+ *
+ * @notapi
+ */
+bool gpt_lld_serve_sim(uint64_t now_ns) {
+  bool served = gpt_lld_serve_driver(&GPTD3, now_ns);
+  served |= gpt_lld_serve_driver(&GPTD6, now_ns);
+  served |= gpt_lld_serve_driver(&GPTD7, now_ns);
+  return served;
+}
+
+#endif /* HAL_USE_GPT */
@@ -0,0 +1,224 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Implements the simulator HAL low level driver: the simulated time
+ *       base, the input stimulus, and dispatch of simulated interrupts.
+ */
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ch.h"
+#include "hal.h"
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Input signals of the virtual peripherals. Defaults to a stopped
+ *          rotor and a centered servo command at 50 Hz.
+ */
+SimStimulus sim_stimulus = { 0.0, 1500, 20000 };
+
+/**
+ * @brief   Counts of simulated peripheral events.
+ */
+SimStatistics sim_statistics;
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/* Time of the next system tick. */
+static uint64_t next_tick_ns;
+
+/* Set by the SIGINT handler to request the exit report. */
+static volatile sig_atomic_t exit_requested;
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+static void hal_lld_handle_sigint(int signal_number) {
+  (void)signal_number;
+  exit_requested = 1;
+}
+
+/**
+ * @brief   Reads a numeric environment variable, if set.
+ */
+static void hal_lld_read_env(const char *name, double *value) {
+  const char * const text = getenv(name);
+  if (text != NULL) {
+    *value = strtod(text, NULL);
+  }
+}
+
+/**
+ * @brief   Serves the system tick if it is due.
+ */
+static bool hal_lld_serve_tick(uint64_t now_ns) {
+  if (now_ns < next_tick_ns) {
+    return false;
+  }
+
+  next_tick_ns += 1000000000ULL / CH_FREQUENCY;
+  CH_IRQ_PROLOGUE();
+  chSysLockFromIsr();
+  chSysTimerHandlerI();
+  chSysUnlockFromIsr();
+  CH_IRQ_EPILOGUE();
+  return true;
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Low level HAL driver initialization. Reads the stimulus from the
+ *          environment and starts the time base.
+ *
+ * @notapi
+ */
+void hal_lld_init(void) {
+  double hall_frequency = sim_stimulus.hall_frequency;
+  double servo_width = sim_stimulus.servo_width_us;
+  double servo_period = sim_stimulus.servo_period_us;
+  hal_lld_read_env("CORN_SIM_HALL_HZ", &hall_frequency);
+  hal_lld_read_env("CORN_SIM_SERVO_US", &servo_width);
+  hal_lld_read_env("CORN_SIM_SERVO_PERIOD_US", &servo_period);
+  sim_stimulus.hall_frequency = hall_frequency;
+  sim_stimulus.servo_width_us = (uint32_t)servo_width;
+  sim_stimulus.servo_period_us = (uint32_t)servo_period;
+
+  signal(SIGINT, hal_lld_handle_sigint);
+  next_tick_ns = sim_lld_get_nanoseconds();
+}
+
+/**
+ * @brief   Serves all simulated interrupts that are due, then reschedules if
+ *          any made a higher priority thread ready. Called from the idle
+ *          thread through @c IDLE_LOOP_HOOK.
+ */
+void ChkIntSources(void) {
+  if (exit_requested) {
+    sim_lld_report();
+    exit(EXIT_SUCCESS);
+  }
+
+  const uint64_t now_ns = sim_lld_get_nanoseconds();
+  bool served = hal_lld_serve_tick(now_ns);
+#if HAL_USE_GPT
+  served |= gpt_lld_serve_sim(now_ns);
+#endif
+#if HAL_USE_ICU
+  served |= icu_lld_serve_sim(now_ns);
+#endif
+#if HAL_USE_PWM
+  served |= pwm_lld_serve_sim(now_ns);
+#endif
+#if HAL_USE_SPI
+  served |= spi_lld_serve_sim(now_ns);
+#endif
+#if HAL_USE_SERIAL
+  served |= sd_lld_serve_sim(now_ns);
+#endif
+
+  if (served) {
+    sim_statistics.interrupts++;
+    dbg_check_lock();
+    if (chSchIsPreemptionRequired()) {
+      chSchDoReschedule();
+    }
+    dbg_check_unlock();
+  }
+}
+
+/**
+ * @brief   Gets the monotonic time of the host in nanoseconds.
+ */
+uint64_t sim_lld_get_nanoseconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief   Converts a duration to the number of counts of a timer clocked at
+ *          @p frequency.
+ */
+uint32_t sim_lld_get_counts(uint64_t nanoseconds, uint32_t frequency) {
+  return (uint32_t)(nanoseconds * frequency / 1000000000ULL);
+}
+
+/**
+ * @brief   Prints the peripheral event counts and the CPU time used by each
+ *          thread to standard error.
+ */
+void sim_lld_report(void) {
+  fprintf(stderr,
+          "\nSimulated events:\n"
+          "  hall edges      %" PRIu32 "\n"
+          "  servo pulses    %" PRIu32 "\n"
+          "  ICU overflows   %" PRIu32 "\n"
+          "  GPT updates     %" PRIu32 "\n"
+          "  PWM COM events  %" PRIu32 "\n"
+          "  SPI frames      %" PRIu32 "\n"
+          "  serial bytes    %" PRIu32 "\n"
+          "  interrupts      %" PRIu32 "\n",
+          sim_statistics.hall_edges,
+          sim_statistics.servo_pulses,
+          sim_statistics.icu_overflows,
+          sim_statistics.gpt_updates,
+          sim_statistics.pwm_com_events,
+          sim_statistics.spi_transfers,
+          sim_statistics.serial_bytes_out,
+          sim_statistics.interrupts);
+#if CH_USE_REGISTRY && CH_DBG_THREADS_PROFILING
+  fprintf(stderr, "Thread ticks:\n");
+  Thread *tp = chRegFirstThread();
+  while (tp != NULL) {
+    fprintf(stderr, "  %-15s %" PRIu32 "\n",
+            tp->p_name != NULL ? tp->p_name : "(unnamed)",
+            (uint32_t)tp->p_time);
+    tp = chRegNextThread(tp);
+  }
+#endif
+}
+
+/**
+ * @brief   Exits the simulator, as there is nothing to restart it.
+ */
+void NVIC_SystemReset(void) {
+  sim_lld_report();
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,319 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Implements the simulator ICU low level driver.
+ *
+ * @note ICUD2 sees hall sensor edges at the rate set by
+ *       @c sim_stimulus.hall_frequency, and its input pins in GPIOA follow the
+ *       hall state sequence. ICUD4 sees servo pulses of
+ *       @c sim_stimulus.servo_width_us every @c sim_stimulus.servo_period_us.
+ *       Capture values are taken from the real time of each simulated edge,
+ *       rather than the time the simulated interrupt was served, so latency of
+ *       the simulator does not show up as jitter in the measurements.
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#include "config.h"
+#include "base/latency_trace.h"
+
+#if HAL_USE_ICU || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   ICUD2 driver identifier, used for the hall sensors.
+ */
+ICUDriver ICUD2;
+
+/**
+ * @brief   ICUD4 driver identifier, used for the servo input.
+ */
+ICUDriver ICUD4;
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+static stm32_tim_t sim_tim2;
+static stm32_tim_t sim_tim4;
+
+/* Hall states in counterclockwise order, starting from 0 degrees. Matches the
+ * kHall*Deg values in RotorHall. */
+static const uint32_t hall_sequence[] = { 3, 2, 6, 4, 5, 1 };
+#define HALL_SEQUENCE_LENGTH (sizeof(hall_sequence) / sizeof(hall_sequence[0]))
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Gets the timer counts between the last counter reset and a time.
+ */
+static uint64_t icu_lld_counts_since_reset(ICUDriver *icup, uint64_t t_ns) {
+  if (t_ns < icup->reset_ns) {
+    return 0;
+  }
+  return sim_lld_get_counts(t_ns - icup->reset_ns, icup->config->frequency);
+}
+
+/**
+ * @brief   Resets the counter as the timer slave controller would.
+ */
+static void icu_lld_reset_counter(ICUDriver *icup, uint64_t t_ns) {
+  icup->reset_ns = t_ns;
+  icup->last_counts = 0;
+  icup->tim->CNT = 0;
+}
+
+/**
+ * @brief   Invokes the overflow callback for each time the counter has wrapped
+ *          since the last check, and updates the visible counter value.
+ */
+static bool icu_lld_serve_overflow(ICUDriver *icup, uint64_t t_ns) {
+  const uint64_t modulus = (uint64_t)icup->tim->ARR + 1;
+  const uint64_t counts = icu_lld_counts_since_reset(icup, t_ns);
+  bool served = false;
+  while (icup->last_counts / modulus < counts / modulus) {
+    icup->last_counts += modulus;
+    sim_statistics.icu_overflows++;
+    if (icup->config->overflow_cb != NULL) {
+      icup->config->overflow_cb(icup);
+    }
+    served = true;
+  }
+  icup->last_counts = counts;
+  icup->tim->CNT = (uint32_t)(counts % modulus);
+  return served;
+}
+
+/**
+ * @brief   Gets the time between hall edges, or zero if the rotor is still.
+ */
+static uint64_t icu_lld_hall_interval_ns(void) {
+  const double frequency = sim_stimulus.hall_frequency;
+  if (frequency == 0.0) {
+    return 0;
+  }
+  const double interval =
+      1e9 / (HALL_SEQUENCE_LENGTH * (frequency > 0 ? frequency : -frequency));
+  return (uint64_t)interval;
+}
+
+/**
+ * @brief   Moves the hall inputs to the next state in the rotation direction,
+ *          then captures the time since the last edge. The XOR of the three
+ *          hall inputs toggles on every edge, so rising and falling captures
+ *          alternate, and the counter is reset on each as with
+ *          @c ICU_RESET_ON_CH1_EDGE.
+ */
+static void icu_lld_hall_edge(ICUDriver *icup, uint64_t edge_ns) {
+  if (sim_stimulus.hall_frequency > 0) {
+    icup->edge_index = (icup->edge_index + 1) % HALL_SEQUENCE_LENGTH;
+  } else {
+    icup->edge_index = (icup->edge_index + HALL_SEQUENCE_LENGTH - 1) %
+                       HALL_SEQUENCE_LENGTH;
+  }
+  const uint32_t hall_mask = PAL_PORT_BIT(GPIOA_HALL_A) |
+                             PAL_PORT_BIT(GPIOA_HALL_B) |
+                             PAL_PORT_BIT(GPIOA_HALL_C);
+  sim_gpioa.IDR = (sim_gpioa.IDR & ~hall_mask) |
+                  (hall_sequence[icup->edge_index] << GPIOA_HALL_A);
+
+  const uint32_t count = (uint32_t)icu_lld_counts_since_reset(icup, edge_ns);
+  icu_lld_reset_counter(icup, edge_ns);
+  sim_statistics.hall_edges++;
+
+#if LATENCY_TRACE_ENABLE
+  /* The cycle counter reads the same clock as edge times, so the age of the
+   * edge includes the simulator's delay in serving it. */
+  const uint32_t entry_time = CycleCounterRead();
+  LatencyTraceStartI(entry_time, entry_time - (uint32_t)edge_ns);
+#endif
+
+  const bool rising = (icup->edge_index % 2) != 0;
+  if (rising) {
+    *icup->pccrp = count - 1;
+    if (icup->config->period_cb != NULL) {
+      icup->config->period_cb(icup);
+    }
+  } else {
+    *icup->wccrp = count - 1;
+    if (icup->config->width_cb != NULL) {
+      icup->config->width_cb(icup);
+    }
+  }
+}
+
+/**
+ * @brief   Generates the next servo pulse edge. The counter is reset on each
+ *          rising edge as with @c ICU_RESET_ON_ACTIVE, so the period is
+ *          captured on rising edges and the width on falling edges.
+ */
+static void icu_lld_servo_edge(ICUDriver *icup, uint64_t edge_ns) {
+  const uint32_t count = (uint32_t)icu_lld_counts_since_reset(icup, edge_ns);
+  const bool rising = (icup->edge_index % 2) == 0;
+  icup->edge_index++;
+
+  if (rising) {
+    sim_gpiob.IDR |= PAL_PORT_BIT(GPIOB_PWM_IN);
+    *icup->pccrp = count - 1;
+    icu_lld_reset_counter(icup, edge_ns);
+    if (icup->config->period_cb != NULL) {
+      icup->config->period_cb(icup);
+    }
+    icup->next_edge_ns = edge_ns + sim_stimulus.servo_width_us * 1000ULL;
+  } else {
+    sim_gpiob.IDR &= ~PAL_PORT_BIT(GPIOB_PWM_IN);
+    *icup->wccrp = count - 1;
+    sim_statistics.servo_pulses++;
+    if (icup->config->width_cb != NULL) {
+      icup->config->width_cb(icup);
+    }
+    icup->next_edge_ns = edge_ns + (sim_stimulus.servo_period_us -
+                                    sim_stimulus.servo_width_us) * 1000ULL;
+  }
+}
+
+/**
+ * @brief   Serves edges and overflows of one ICU that are due.
+ */
+static bool icu_lld_serve_driver(ICUDriver *icup, uint64_t now_ns) {
+  if (icup->state != ICU_WAITING && icup->state != ICU_ACTIVE &&
+      icup->state != ICU_IDLE) {
+    return false;
+  }
+
+  bool served = false;
+  CH_IRQ_PROLOGUE();
+  while (icup->next_edge_ns != 0 && icup->next_edge_ns <= now_ns) {
+    const uint64_t edge_ns = icup->next_edge_ns;
+    served |= icu_lld_serve_overflow(icup, edge_ns);
+    if (icup == &ICUD2) {
+      icu_lld_hall_edge(icup, edge_ns);
+      const uint64_t interval = icu_lld_hall_interval_ns();
+      icup->next_edge_ns = interval != 0 ? edge_ns + interval : 0;
+    } else {
+      icu_lld_servo_edge(icup, edge_ns);
+    }
+    served = true;
+  }
+  served |= icu_lld_serve_overflow(icup, now_ns);
+  CH_IRQ_EPILOGUE();
+  return served;
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Low level ICU driver initialization.
+ *
+ * @notapi
+ */
+void icu_lld_init(void) {
+  icuObjectInit(&ICUD2);
+  ICUD2.tim = &sim_tim2;
+  icuObjectInit(&ICUD4);
+  ICUD4.tim = &sim_tim4;
+}
+
+/**
+ * @brief   Configures the virtual timer. TIM2 has a 32-bit counter and TIM4
+ *          has a 16-bit counter, as on the STM32F30x.
+ *
+ * @notapi
+ */
+void icu_lld_start(ICUDriver *icup) {
+  icup->clock = icup->config->frequency;
+  icup->tim->ARR = (icup == &ICUD2) ? 0xFFFFFFFF : 0xFFFF;
+  icup->tim->DIER = icup->config->dier;
+  if (icup->config->channel == ICU_CHANNEL_1) {
+    icup->wccrp = &icup->tim->CCR[1];
+    icup->pccrp = &icup->tim->CCR[0];
+  } else {
+    icup->wccrp = &icup->tim->CCR[0];
+    icup->pccrp = &icup->tim->CCR[1];
+  }
+}
+
+/**
+ * @brief   Deactivates the virtual timer.
+ *
+ * @notapi
+ */
+void icu_lld_stop(ICUDriver *icup) {
+  icup->next_edge_ns = 0;
+}
+
+/**
+ * @brief   Starts the counter and schedules the first simulated edge.
+ *
+ * @notapi
+ */
+void icu_lld_enable(ICUDriver *icup) {
+  const uint64_t now_ns = sim_lld_get_nanoseconds();
+  icu_lld_reset_counter(icup, now_ns);
+  icup->edge_index = 0;
+  if (icup == &ICUD2) {
+    const uint64_t interval = icu_lld_hall_interval_ns();
+    icup->next_edge_ns = interval != 0 ? now_ns + interval : 0;
+  } else if (sim_stimulus.servo_width_us != 0 &&
+             sim_stimulus.servo_width_us < sim_stimulus.servo_period_us) {
+    icup->next_edge_ns = now_ns + sim_stimulus.servo_period_us * 1000ULL;
+  } else {
+    icup->next_edge_ns = 0;
+  }
+}
+
+/**
+ * @brief   Stops generating edges.
+ *
+ * @notapi
+ */
+void icu_lld_disable(ICUDriver *icup) {
+  icup->next_edge_ns = 0;
+}
+
+/**
+ * @brief   Serves all simulated ICU interrupts that are due.
+ *
+ * @return  Whether any callbacks were invoked.
+ *
+ * @notapi
+ */
+bool icu_lld_serve_sim(uint64_t now_ns) {
+  bool served = icu_lld_serve_driver(&ICUD2, now_ns);
+  served |= icu_lld_serve_driver(&ICUD4, now_ns);
+  return served;
+}
+
+#endif /* HAL_USE_ICU */
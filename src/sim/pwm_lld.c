@@ -0,0 +1,192 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Implements the simulator PWM low level driver.
+ *
+ * @note Output levels are not simulated. Instead, the output modes and widths
+ *       in effect can be read from @c PWMD1, which latches the preloaded CCER
+ *       and CCMRx registers when a COM event is generated through the EGR
+ *       register, as TIM1 does with @c STM32_TIM_CR2_CCPC set.
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#if HAL_USE_PWM || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   PWMD1 driver identifier, used for the inverter.
+ */
+PWMDriver PWMD1;
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+static stm32_tim_t sim_tim1;
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Gets the time between counter update events. In center-aligned
+ *          mode the counter updates at both ends of its count, and the
+ *          repetition counter skips RCR of every RCR + 1 updates.
+ */
+static uint64_t pwm_lld_update_interval_ns(PWMDriver *pwmp) {
+  const uint64_t counts_per_update =
+      (uint64_t)(pwmp->tim->ARR + 1) * (pwmp->tim->RCR + 1);
+  return counts_per_update * 1000000000ULL / pwmp->clock;
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Low level PWM driver initialization.
+ *
+ * @notapi
+ */
+void pwm_lld_init(void) {
+  pwmObjectInit(&PWMD1);
+  PWMD1.tim = &sim_tim1;
+}
+
+/**
+ * @brief   Configures the virtual timer with the same register settings as
+ *          the target driver.
+ *
+ * @notapi
+ */
+void pwm_lld_start(PWMDriver *pwmp) {
+  pwmp->clock = pwmp->config->frequency;
+  pwmp->tim->CR1 = pwmp->config->cr1;
+  pwmp->tim->CR2 = pwmp->config->cr2;
+  pwmp->tim->ARR = pwmp->period - 1;
+  pwmp->tim->CCR[0] = 0;
+  pwmp->tim->CCR[1] = 0;
+  pwmp->tim->CCR[2] = 0;
+  pwmp->tim->CCR[3] = 0;
+  pwmp->tim->CCMR1 = STM32_TIM_CCMR1_OC1M(6) | STM32_TIM_CCMR1_OC1PE |
+                     STM32_TIM_CCMR1_OC2M(6) | STM32_TIM_CCMR1_OC2PE;
+  pwmp->tim->CCMR2 = STM32_TIM_CCMR2_OC3M(6) | STM32_TIM_CCMR2_OC3PE |
+                     STM32_TIM_CCMR2_OC4M(6) | STM32_TIM_CCMR2_OC4PE;
+  pwmp->tim->CCER = 0;
+  pwmp->tim->BDTR = pwmp->config->bdtr | STM32_TIM_BDTR_MOE;
+  pwmp->tim->DIER = pwmp->config->dier;
+  if (pwmp->config->callback != NULL) {
+    pwmp->tim->DIER |= STM32_TIM_DIER_UIE;
+  }
+  pwmp->tim->SR = 0;
+  pwmp->tim->EGR = 0;
+  pwmp->tim->CR1 |= STM32_TIM_CR1_CEN;
+  pwmp->active_ccer = pwmp->tim->CCER;
+  pwmp->active_ccmr1 = pwmp->tim->CCMR1;
+  pwmp->active_ccmr2 = pwmp->tim->CCMR2;
+  pwmp->next_update_ns =
+      sim_lld_get_nanoseconds() + pwm_lld_update_interval_ns(pwmp);
+}
+
+/**
+ * @brief   Deactivates the virtual timer, leaving all outputs disabled.
+ *
+ * @notapi
+ */
+void pwm_lld_stop(PWMDriver *pwmp) {
+  pwmp->tim->CR1 = 0;
+  pwmp->tim->CCER = 0;
+  pwmp->tim->BDTR = 0;
+  pwmp->active_ccer = 0;
+  pwmp->next_update_ns = 0;
+}
+
+/**
+ * @brief   Enables a PWM channel.
+ *
+ * @notapi
+ */
+void pwm_lld_enable_channel(PWMDriver *pwmp,
+                            pwmchannel_t channel,
+                            pwmcnt_t width) {
+  pwmp->tim->CCR[channel] = width;
+}
+
+/**
+ * @brief   Disables a PWM channel.
+ *
+ * @notapi
+ */
+void pwm_lld_disable_channel(PWMDriver *pwmp, pwmchannel_t channel) {
+  pwmp->tim->CCR[channel] = 0;
+}
+
+/**
+ * @brief   Serves COM events written since the last call, and counter update
+ *          events that are due.
+ *
+ * @return  Whether any simulated interrupts were served.
+ *
+ * @notapi
+ */
+bool pwm_lld_serve_sim(uint64_t now_ns) {
+  PWMDriver * const pwmp = &PWMD1;
+  if (pwmp->state != PWM_READY) {
+    return false;
+  }
+
+  bool served = false;
+  CH_IRQ_PROLOGUE();
+  if ((pwmp->tim->EGR & STM32_TIM_EGR_COMG) != 0) {
+    pwmp->tim->EGR &= ~STM32_TIM_EGR_COMG;
+    pwmp->active_ccer = pwmp->tim->CCER;
+    pwmp->active_ccmr1 = pwmp->tim->CCMR1;
+    pwmp->active_ccmr2 = pwmp->tim->CCMR2;
+    pwmp->tim->SR |= STM32_TIM_SR_COMIF;
+    sim_statistics.pwm_com_events++;
+    served = true;
+  }
+  while (pwmp->next_update_ns != 0 && pwmp->next_update_ns <= now_ns) {
+    pwmp->next_update_ns += pwm_lld_update_interval_ns(pwmp);
+    pwmp->tim->SR |= STM32_TIM_SR_UIF;
+    if ((pwmp->tim->DIER & STM32_TIM_DIER_UIE) != 0 &&
+        pwmp->config->callback != NULL) {
+      pwmp->tim->SR &= ~STM32_TIM_SR_UIF;
+      pwmp->config->callback(pwmp);
+      served = true;
+    }
+  }
+  CH_IRQ_EPILOGUE();
+  return served;
+}
+
+#endif /* HAL_USE_PWM */
@@ -0,0 +1,139 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Implements the simulator serial low level driver, connecting SD3 to
+ *       the standard input and output of the simulator process.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#if HAL_USE_SERIAL || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   SD3 driver identifier, used for the debug console.
+ */
+SerialDriver SD3;
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Drains the output queue to the host as soon as data is written, as
+ *          writes to the terminal are fast enough not to need buffering.
+ */
+static void onotify(GenericQueue *qp) {
+  SerialDriver * const sdp = (SerialDriver *)chQGetLink(qp);
+  msg_t b;
+  while ((b = chOQGetI(&sdp->oqueue)) >= Q_OK) {
+    const uint8_t c = (uint8_t)b;
+    if (write(sdp->outfd, &c, 1) == 1) {
+      sim_statistics.serial_bytes_out++;
+    }
+  }
+  chnAddFlagsI(sdp, CHN_OUTPUT_EMPTY | CHN_TRANSMISSION_END);
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Low level serial driver initialization.
+ *
+ * @notapi
+ */
+void sd_lld_init(void) {
+  sdObjectInit(&SD3, NULL, onotify);
+  SD3.infd = -1;
+  SD3.outfd = -1;
+}
+
+/**
+ * @brief   Connects the driver to the host's standard input and output. The
+ *          baud rate in @p config is ignored.
+ *
+ * @notapi
+ */
+void sd_lld_start(SerialDriver *sdp, const SerialConfig *config) {
+  (void)config;
+  sdp->infd = STDIN_FILENO;
+  sdp->outfd = STDOUT_FILENO;
+  fcntl(sdp->infd, F_SETFL, fcntl(sdp->infd, F_GETFL) | O_NONBLOCK);
+}
+
+/**
+ * @brief   Disconnects the driver from the host.
+ *
+ * @notapi
+ */
+void sd_lld_stop(SerialDriver *sdp) {
+  sdp->infd = -1;
+  sdp->outfd = -1;
+}
+
+/**
+ * @brief   Moves characters typed on the host into the input queue, as the
+ *          receive interrupt would.
+ *
+ * @return  Whether any characters were received.
+ *
+ * @notapi
+ */
+bool sd_lld_serve_sim(uint64_t now_ns) {
+  SerialDriver * const sdp = &SD3;
+  (void)now_ns;
+  if (sdp->state != SD_READY || sdp->infd < 0) {
+    return false;
+  }
+
+  uint8_t buffer[SERIAL_BUFFERS_SIZE];
+  const ssize_t n = read(sdp->infd, buffer, sizeof(buffer));
+  if (n <= 0) {
+    return false;
+  }
+
+  CH_IRQ_PROLOGUE();
+  chSysLockFromIsr();
+  ssize_t i;
+  for (i = 0; i < n; i++) {
+    sdIncomingDataI(sdp, buffer[i]);
+  }
+  chSysUnlockFromIsr();
+  CH_IRQ_EPILOGUE();
+  return true;
+}
+
+#endif /* HAL_USE_SERIAL */
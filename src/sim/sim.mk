@@ -0,0 +1,123 @@
+# Rules for building the whole Corn3 firmware as a Linux process, using the
+# ChibiOS/RT SIMIA32 port and the virtual peripherals in /include/sim and
+# /src/sim in place of the STM32 platform and board.
+#
+# Invoked through "make sim" from the top level Makefile. Needs ChibiOS and a
+# host gcc that can build 32-bit x86 code (e.g. gcc-multilib), but not the ARM
+# toolchain. Run the result with build/sim/corn3_sim; see README.md.
+
+PROJECT = corn3
+CHIBIOS = ChibiOS
+
+# Host toolchain. The SIMIA32 port switches contexts with 32-bit x86 code.
+SIMPREFIX ?=
+SIMCC   = $(SIMPREFIX)gcc
+SIMCPPC = $(SIMPREFIX)g++
+
+SIMBUILDDIR = build/sim
+SIMOBJDIR   = $(SIMBUILDDIR)/obj
+SIMTARGET   = $(SIMBUILDDIR)/$(PROJECT)_sim
+
+# Same language options and warnings as the target. Stack protection and PIE
+# are disabled because the port builds thread stacks and frames by hand.
+SIMOPT    = -m32 -O2 -ggdb3 -fno-stack-protector -fno-pie -no-pie
+SIMCOPT   = -std=gnu99 -Wall -Wextra -Wstrict-prototypes
+SIMCPPOPT = -std=c++11 -fno-rtti -fno-exceptions -fno-threadsafe-statics \
+            -Wall -Wextra
+SIMDEFS   = -DCORN_SIM=1 -DLOGGING_USE_CHPRINTF=1 -DUSE_NEW_DELETE=0 \
+            -include include/sim/simconf.h
+
+# ChibiOS kernel and portable HAL rules.
+include $(CHIBIOS)/os/hal/hal.mk
+include $(CHIBIOS)/os/kernel/kernel.mk
+
+SIMPORTSRC = $(CHIBIOS)/os/ports/GCC/SIMIA32/chcore.c
+SIMPORTINC = $(CHIBIOS)/os/ports/GCC/SIMIA32
+
+# Simulated platform and board, replacing src/lld, src/board, and the USB
+# device driver.
+SIMPLATFORMSRC = src/sim/hal_lld.c \
+                 src/sim/pal_lld.c \
+                 src/sim/board.c \
+                 src/sim/gpt_lld.c \
+                 src/sim/icu_lld.c \
+                 src/sim/pwm_lld.c \
+                 src/sim/spi_lld.c \
+                 src/sim/serial_lld.c \
+
+# Version information, generated as for the target.
+BUILDDIR = $(SIMBUILDDIR)
+include src/version/version_vars.mk
+
+SIMCSRC = $(SIMPORTSRC) \
+          $(KERNSRC) \
+          $(HALSRC) \
+          $(SIMPLATFORMSRC) \
+          $(VERSIONSRC) \
+          $(CHIBIOS)/os/various/chprintf.c \
+          src/base/capture_record.c \
+          src/base/histogram.c \
+          src/base/isr_profile.c \
+          src/base/latency_trace.c \
+          src/base/log.c \
+          src/base/utility.c \
+
+SIMCPPSRC = src/main.cpp \
+            src/corn.cpp \
+            src/sim/usb_device_sim.cpp \
+            src/driver/DRV8303.cpp \
+            src/driver/servo_input.cpp \
+            src/motor/commutator_foc.cpp \
+            src/motor/commutator_six_step.cpp \
+            src/motor/inverter_pwm.cpp \
+            src/motor/modulator_space_vector.cpp \
+            src/motor/motor_identifier.cpp \
+            src/motor/rotor_bemf.cpp \
+            src/motor/rotor_flux.cpp \
+            src/motor/rotor_hall.cpp \
+            src/motor/rotor_pll.cpp \
+            src/motor/speed_governor.cpp \
+            src/motor/startup_sequencer.cpp \
+            src/motor/trig.cpp \
+            src/motor/voltage_compensator.cpp \
+            src/bench/benchmark.cpp \
+
+# The simulator headers come first so they replace include/board and
+# include/driver/usb_device.h.
+SIMINC = -Iinclude/sim -Iinclude \
+         $(addprefix -I, $(SIMPORTINC) $(KERNINC) $(HALINC)) \
+         -I$(CHIBIOS)/os/various
+
+SIMOBJS = $(addprefix $(SIMOBJDIR)/, \
+            $(notdir $(SIMCSRC:.c=.o)) $(notdir $(SIMCPPSRC:.cpp=.o)))
+
+vpath %.c $(sort $(dir $(SIMCSRC)))
+vpath %.cpp $(sort $(dir $(SIMCPPSRC)))
+
+.PHONY: sim sim-clean
+
+sim: $(SIMTARGET)
+
+$(SIMTARGET): $(SIMOBJS) $(VERSIONLIBS)
+	@echo Linking $@
+	@$(SIMCPPC) $(SIMOPT) $(SIMDEFS) $(SIMINC) $^ -o $@
+
+$(SIMOBJDIR)/%.o: %.c | $(SIMOBJDIR)
+	@echo Compiling $(<F) for simulator
+	@$(SIMCC) -c $(SIMOPT) $(SIMCOPT) $(SIMDEFS) $(SIMINC) -MMD -MP $< -o $@
+
+$(SIMOBJDIR)/%.o: %.cpp | $(SIMOBJDIR)
+	@echo Compiling $(<F) for simulator
+	@$(SIMCPPC) -c $(SIMOPT) $(SIMCPPOPT) $(SIMDEFS) $(SIMINC) -MMD -MP $< -o $@
+
+$(SIMOBJDIR) $(SIMBUILDDIR):
+	@mkdir -p $@
+
+$(SIMBUILDDIR)/version.c.newest: | $(SIMBUILDDIR)
+
+sim-clean:
+	rm -rf $(SIMBUILDDIR)
+
+include src/version/version_rules.mk
+
+-include $(SIMOBJS:.o=.d)
@@ -0,0 +1,241 @@
+/*
+ * Corn3 - Copyright (C) 2014 Xo Wang
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the sale,
+ * use or other dealings in this Software without prior written authorization.
+ */
+
+/**
+ * @file Implements the simulator SPI low level driver, with a register model
+ *       of a fault-free DRV8303 on SPID1.
+ *
+ * @note As on the DRV8303, each command frame is answered in the following
+ *       frame: reads with the register address and contents, and writes with
+ *       Status register 1. Frames clocked out by receive operations are
+ *       treated as no-ops. Transfers complete in the next call to
+ *       @c ChkIntSources, so the calling thread blocks as it would on the
+ *       target.
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#if HAL_USE_SPI || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+#define DRV_READ_WRITE_BIT      15
+#define DRV_ADDRESS_OFFSET      11
+#define DRV_ADDRESS_MASK        0xFU
+#define DRV_DATA_MASK           ((1U << DRV_ADDRESS_OFFSET) - 1)
+#define DRV_NUM_REGISTERS       4
+#define DRV_REGISTER_STATUS2    1
+#define DRV_REGISTER_CONTROL1   2
+#define DRV_CONTROL1_GATE_RESET (1U << 2)
+#define DRV_DEVICE_ID           1
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   SPID1 driver identifier, connected to the DRV8303 model.
+ */
+SPIDriver SPID1;
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/* DRV8303 registers. Status registers read as no faults. */
+static uint16_t drv_registers[DRV_NUM_REGISTERS] = { 0, DRV_DEVICE_ID, 0, 0 };
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Processes one command frame received by the DRV8303 model, and
+ *          prepares the response for the next frame.
+ */
+static void spi_lld_drv_command(SPIDriver *spip, uint16_t frame) {
+  const uint32_t address = (frame >> DRV_ADDRESS_OFFSET) & DRV_ADDRESS_MASK;
+  if (address >= DRV_NUM_REGISTERS) {
+    spip->response = (uint16_t)(1U << DRV_READ_WRITE_BIT);  /* Frame error. */
+    return;
+  }
+
+  if ((frame & (1U << DRV_READ_WRITE_BIT)) != 0) {
+    spip->response = (uint16_t)((address << DRV_ADDRESS_OFFSET) |
+                                drv_registers[address]);
+  } else {
+    if (address >= DRV_REGISTER_CONTROL1) {
+      drv_registers[address] = frame & DRV_DATA_MASK;
+    }
+    /* The gate driver reset completes well within one frame. */
+    drv_registers[DRV_REGISTER_CONTROL1] &= ~DRV_CONTROL1_GATE_RESET;
+    spip->response = drv_registers[0];
+  }
+}
+
+/**
+ * @brief   Shifts frames through the model and stores received frames.
+ */
+static void spi_lld_transfer(SPIDriver *spip, size_t n,
+                             const uint16_t *txbuf, uint16_t *rxbuf) {
+  size_t i;
+  for (i = 0; i < n; i++) {
+    if (rxbuf != NULL) {
+      rxbuf[i] = spip->response;
+    }
+    if (txbuf != NULL) {
+      spi_lld_drv_command(spip, txbuf[i]);
+    }
+    sim_statistics.spi_transfers++;
+  }
+  spip->pending = n;
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Low level SPI driver initialization.
+ *
+ * @notapi
+ */
+void spi_lld_init(void) {
+  spiObjectInit(&SPID1);
+}
+
+/**
+ * @brief   Configures the virtual SPI peripheral. Only 16-bit frames are
+ *          supported, as used by the DRV8303.
+ *
+ * @notapi
+ */
+void spi_lld_start(SPIDriver *spip) {
+  spip->pending = 0;
+  spip->response = 0;
+}
+
+/**
+ * @brief   Deactivates the virtual SPI peripheral.
+ *
+ * @notapi
+ */
+void spi_lld_stop(SPIDriver *spip) {
+  spip->pending = 0;
+}
+
+/**
+ * @brief   Asserts the slave select signal.
+ *
+ * @notapi
+ */
+void spi_lld_select(SPIDriver *spip) {
+  palClearPad(spip->config->ssport, spip->config->sspad);
+}
+
+/**
+ * @brief   Deasserts the slave select signal.
+ *
+ * @notapi
+ */
+void spi_lld_unselect(SPIDriver *spip) {
+  palSetPad(spip->config->ssport, spip->config->sspad);
+}
+
+/**
+ * @brief   Clocks out @p n no-op frames.
+ *
+ * @notapi
+ */
+void spi_lld_ignore(SPIDriver *spip, size_t n) {
+  spi_lld_transfer(spip, n, NULL, NULL);
+}
+
+/**
+ * @brief   Exchanges @p n frames.
+ *
+ * @notapi
+ */
+void spi_lld_exchange(SPIDriver *spip, size_t n,
+                      const void *txbuf, void *rxbuf) {
+  spi_lld_transfer(spip, n, (const uint16_t *)txbuf, (uint16_t *)rxbuf);
+}
+
+/**
+ * @brief   Sends @p n frames, discarding received frames.
+ *
+ * @notapi
+ */
+void spi_lld_send(SPIDriver *spip, size_t n, const void *txbuf) {
+  spi_lld_transfer(spip, n, (const uint16_t *)txbuf, NULL);
+}
+
+/**
+ * @brief   Receives @p n frames while clocking out no-op frames.
+ *
+ * @notapi
+ */
+void spi_lld_receive(SPIDriver *spip, size_t n, void *rxbuf) {
+  spi_lld_transfer(spip, n, NULL, (uint16_t *)rxbuf);
+}
+
+/**
+ * @brief   Exchanges one frame without waiting for completion.
+ *
+ * @notapi
+ */
+uint16_t spi_lld_polled_exchange(SPIDriver *spip, uint16_t frame) {
+  uint16_t received;
+  spi_lld_transfer(spip, 1, &frame, &received);
+  spip->pending = 0;
+  return received;
+}
+
+/**
+ * @brief   Completes the transfer in progress, as the DMA interrupt would.
+ *
+ * @return  Whether a transfer was completed.
+ *
+ * @notapi
+ */
+bool spi_lld_serve_sim(uint64_t now_ns) {
+  SPIDriver * const spip = &SPID1;
+  (void)now_ns;
+  if (spip->state != SPI_ACTIVE || spip->pending == 0) {
+    return false;
+  }
+
+  CH_IRQ_PROLOGUE();
+  spip->pending = 0;
+  _spi_isr_code(spip);
+  CH_IRQ_EPILOGUE();
+  return true;
+}
+
+#endif /* HAL_USE_SPI */